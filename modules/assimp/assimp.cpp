@@ -6,15 +6,21 @@
 //
 //
 
+#include <atomic>
+#include <condition_variable>
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 
 #include <crocore/filesystem.hpp>
+#include <crocore/ThreadPool.hpp>
 
 #include "gl/Mesh.hpp"
+#include "gl/optimize.hpp"
+#include "gl/simplify.hpp"
 #include "gl/Scene.hpp"
 #include "assimp.hpp"
+#include "model_cache.hpp"
 
 using namespace std;
 using namespace glm;
@@ -25,11 +31,26 @@ namespace assimp {
 typedef map<std::string, pair<int, mat4>> BoneMap;
 typedef map<uint32_t, list<pair<uint32_t, float>>> WeightMap;
 
-/////////////////////////////////////////////////////////////////
+//! destination-arrays, sized for all submeshes of a model
+struct geometry_dst_t
+{
+    vec3 *vertices, *normals, *tangents;
+    vec2 *tex_coords;
+    vec4 *colors;
+    gl::index_t *indices;
+};
+
+//! images decoded during an import, shared by concurrent material-tasks
+struct image_cache_t
+{
+    std::mutex mutex;
+    std::map<std::string, crocore::ImagePtr> images;
+};
 
-void merge_geometries(gl::GeometryPtr src, gl::GeometryPtr dst);
+/////////////////////////////////////////////////////////////////
 
-gl::GeometryPtr createGeometry(const aiMesh *aMesh, const aiScene *theScene);
+void insert_geometry(const aiMesh *aMesh, const glm::mat4 &the_transform, const gl::Mesh::Entry &the_entry,
+                     const geometry_dst_t &the_dst);
 
 gl::MaterialPtr createMaterial(const aiMaterial *mtl);
 
@@ -49,7 +70,7 @@ void create_bone_animation(const aiNode *theNode, const aiAnimation *theAnimatio
 
 //void get_node_transform(const aiNode *the_node, mat4 &the_transform);
 
-bool get_mesh_transform(const aiScene *the_scene, const aiMesh *the_ai_mesh, glm::mat4 &the_out_transform);
+std::vector<glm::mat4> get_mesh_transforms(const aiScene *the_scene);
 
 void process_node(const aiScene *the_scene, const aiNode *the_in_node,
                   const gl::Object3DPtr &the_parent_node);
@@ -92,76 +113,81 @@ inline gl::Color aicolor_convert(const aiColor3D &the_color)
 
 /////////////////////////////////////////////////////////////////
 
-gl::GeometryPtr createGeometry(const aiMesh *aMesh, const aiScene *theScene)
+void insert_geometry(const aiMesh *aMesh, const glm::mat4 &the_transform, const gl::Mesh::Entry &the_entry,
+                     const geometry_dst_t &the_dst)
 {
-    gl::GeometryPtr geom = gl::Geometry::create();
+    const uint32_t num_vertices = aMesh->mNumVertices;
+    glm::mat3 normal_matrix = glm::inverseTranspose(glm::mat3(the_transform));
 
-    glm::mat4 model_matrix;
-    if(!get_mesh_transform(theScene, aMesh, model_matrix)){ LOG_WARNING << "could not find mesh transform"; }
-    glm::mat3 normal_matrix = glm::inverseTranspose(glm::mat3(model_matrix));
-
-    geom->vertices().insert(geom->vertices().end(), (vec3 *)aMesh->mVertices,
-                            (vec3 *)aMesh->mVertices + aMesh->mNumVertices);
+    vec3 *vertices = the_dst.vertices + the_entry.base_vertex;
+    vec3 *normals = the_dst.normals + the_entry.base_vertex;
+    vec3 *tangents = the_dst.tangents + the_entry.base_vertex;
+    vec2 *tex_coords = the_dst.tex_coords + the_entry.base_vertex;
+    gl::index_t *indices = the_dst.indices + the_entry.base_index;
 
     // transform loaded verts
-    for(auto &v : geom->vertices()){ v = (model_matrix * vec4(v, 1.f)).xyz; }
+    for(uint32_t i = 0; i < num_vertices; ++i)
+    {
+        vertices[i] = (the_transform * vec4(aivector_to_glm_vec3(aMesh->mVertices[i]), 1.f)).xyz;
+    }
 
     if(aMesh->HasTextureCoords(0))
     {
-        geom->tex_coords().reserve(aMesh->mNumVertices);
-        for(uint32_t i = 0; i < aMesh->mNumVertices; i++)
+        for(uint32_t i = 0; i < num_vertices; i++)
         {
-            geom->append_tex_coord(aMesh->mTextureCoords[0][i].x, aMesh->mTextureCoords[0][i].y);
+            tex_coords[i] = vec2(aMesh->mTextureCoords[0][i].x, aMesh->mTextureCoords[0][i].y);
         }
-    }else
-    {
-        geom->tex_coords().resize(aMesh->mNumVertices, vec2(0));
     }
 
-    std::vector<gl::index_t> &indices = geom->indices();
-    indices.reserve(aMesh->mNumFaces * 3);
     for(uint32_t i = 0; i < aMesh->mNumFaces; ++i)
     {
         const aiFace &f = aMesh->mFaces[i];
         if(f.mNumIndices != 3) throw std::runtime_error("Non triangle mesh loaded");
-        indices.insert(indices.end(), f.mIndices, f.mIndices + 3);
+        std::copy(f.mIndices, f.mIndices + 3, indices + 3 * i);
     }
-    geom->faces().resize(aMesh->mNumFaces);
-    ::memcpy(&geom->faces()[0], &indices[0], indices.size() * sizeof(gl::index_t));
-
-    if(aMesh->HasNormals())
-    {
-        geom->normals().insert(geom->normals().end(), (vec3 *)aMesh->mNormals,
-                               (vec3 *)aMesh->mNormals + aMesh->mNumVertices);
 
-        // transform loaded normals
-        for(auto &n : geom->normals()){ n = normal_matrix * n; }
-    }else
+    if(aMesh->HasVertexColors(0))
     {
-        geom->compute_vertex_normals();
+        vec4 *colors = the_dst.colors + the_entry.base_vertex;
+        for(uint32_t i = 0; i < num_vertices; ++i){ colors[i] = aicolor_convert(aMesh->mColors[0][i]); }
     }
 
-    if(aMesh->HasVertexColors(0))
+    // transform loaded normals and tangents
+    if(aMesh->HasNormals())
     {
-        geom->colors().insert(geom->colors().end(), (vec4 *)aMesh->mColors,
-                              (vec4 *)aMesh->mColors + aMesh->mNumVertices);
+        for(uint32_t i = 0; i < num_vertices; ++i)
+        {
+            normals[i] = normal_matrix * aivector_to_glm_vec3(aMesh->mNormals[i]);
+        }
     }
-//        else{ geom->colors().resize(aMesh->mNumVertices, gl::COLOR_WHITE); }
 
     if(aMesh->HasTangentsAndBitangents())
     {
-        geom->tangents().insert(geom->tangents().end(), (vec3 *)aMesh->mTangents,
-                                (vec3 *)aMesh->mTangents + aMesh->mNumVertices);
+        for(uint32_t i = 0; i < num_vertices; ++i)
+        {
+            tangents[i] = normal_matrix * aivector_to_glm_vec3(aMesh->mTangents[i]);
+        }
+    }
 
-        // transform loaded tangents
-        for(auto &t : geom->tangents()){ t = normal_matrix * t; }
-    }else
+    // compute missing normals or tangents on a temporary geometry
+    if(!aMesh->HasNormals() || !aMesh->HasTangentsAndBitangents())
     {
-        // compute tangents
-        geom->compute_tangents();
+        auto geom = gl::Geometry::create();
+        geom->vertices().assign(vertices, vertices + num_vertices);
+        geom->tex_coords().assign(tex_coords, tex_coords + num_vertices);
+        geom->faces().resize(aMesh->mNumFaces);
+        ::memcpy(reinterpret_cast<gl::index_t*>(geom->faces().data()), indices,
+                 3 * aMesh->mNumFaces * sizeof(gl::index_t));
+
+        if(aMesh->HasNormals()){ geom->normals().assign(normals, normals + num_vertices); }
+        else{ geom->compute_vertex_normals(); }
+
+        if(!aMesh->HasTangentsAndBitangents()){ geom->compute_tangents(); }
+
+        const auto &geom_normals = geom->normals(), &geom_tangents = geom->tangents();
+        if(geom_normals.size() == num_vertices){ std::copy(geom_normals.begin(), geom_normals.end(), normals); }
+        if(geom_tangents.size() == num_vertices){ std::copy(geom_tangents.begin(), geom_tangents.end(), tangents); }
     }
-    geom->compute_aabb();
-    return geom;
 }
 
 /////////////////////////////////////////////////////////////////
@@ -287,7 +313,7 @@ gl::CameraPtr create_camera(const aiCamera *the_cam)
 /////////////////////////////////////////////////////////////////
 
 gl::MaterialPtr create_material(const aiScene *the_scene, const aiMaterial *mtl,
-                                std::map<std::string, crocore::ImagePtr> *the_img_map = nullptr)
+                                image_cache_t *the_img_cache = nullptr)
 {
     gl::MaterialPtr theMaterial = gl::Material::create();
     theMaterial->set_blending(true);
@@ -351,14 +377,18 @@ gl::MaterialPtr create_material(const aiScene *the_scene, const aiMaterial *mtl,
         theMaterial->set_two_sided(two_sided);
     }
 
-    auto create_tex_image = [the_scene, the_img_map](const std::string the_path) -> crocore::ImagePtr
+    // images that are modified afterwards are decoded without the cache
+    auto create_tex_image = [the_scene, the_img_cache](const std::string the_path,
+                                                       bool use_cache = true) -> crocore::ImagePtr
     {
         crocore::ImagePtr img;
+        image_cache_t *cache = use_cache ? the_img_cache : nullptr;
 
-        if(the_img_map)
+        if(cache)
         {
-            auto it = the_img_map->find(the_path);
-            if(it != the_img_map->end())
+            std::unique_lock<std::mutex> lock(cache->mutex);
+            auto it = cache->images.find(the_path);
+            if(it != cache->images.end())
             {
                 img = it->second;
                 LOG_TRACE << "using cached image: " << the_path;
@@ -366,6 +396,7 @@ gl::MaterialPtr create_material(const aiScene *the_scene, const aiMaterial *mtl,
         }
         if(!img)
         {
+            // decode without holding the lock
             if(!the_path.empty() && the_path[0] == '*')
             {
                 size_t tex_index = crocore::string_to<size_t>(the_path.substr(1));
@@ -377,7 +408,12 @@ gl::MaterialPtr create_material(const aiScene *the_scene, const aiMaterial *mtl,
                     img = crocore::create_image_from_data((uint8_t *)ai_tex->pcData, ai_tex->mWidth);
                 }
             }else{ img = crocore::create_image_from_file(the_path); }
-            if(the_img_map){ (*the_img_map)[the_path] = img; }
+
+            if(cache)
+            {
+                std::unique_lock<std::mutex> lock(cache->mutex);
+                img = cache->images.insert(std::make_pair(the_path, img)).first->second;
+            }
         }
         return img;
     };
@@ -439,7 +475,7 @@ gl::MaterialPtr create_material(const aiScene *the_scene, const aiMaterial *mtl,
     if(AI_SUCCESS == mtl->GetTexture(aiTextureType(aiTextureType_UNKNOWN), 0, &path_buf))
     {
         LOG_TRACE << "unknown texture usage (assuming AO/ROUGHNESS/METAL ): '" << path_buf.data << "'";
-        auto ao_rough_metal_img = create_tex_image(path_buf.data);
+        auto ao_rough_metal_img = create_tex_image(path_buf.data, false);
         constexpr size_t ao_offset = 0;
         uint8_t *dst = (uint8_t *)ao_rough_metal_img->data(), *dst_end = dst + ao_rough_metal_img->num_bytes();
 
@@ -470,22 +506,125 @@ gl::MaterialPtr create_material(const aiScene *the_scene, const aiMaterial *mtl,
 
 /////////////////////////////////////////////////////////////////
 
-void merge_geometries(gl::GeometryPtr src, gl::GeometryPtr dst)
+/////////////////////////////////////////////////////////////////
+
+/*!
+ * submeshes and materials of a scene, converted concurrently.
+ * the job owns its data, tasks starting late must not touch anything before claiming an item
+ */
+struct import_job_t
+{
+    const aiScene *scene = nullptr;
+    std::vector<gl::Mesh::Entry> entries;
+    std::vector<uint32_t> material_indices;
+    std::vector<gl::MaterialPtr> materials;
+    std::vector<glm::mat4> mesh_transforms;
+    geometry_dst_t dst;
+    image_cache_t image_cache;
+    uint32_t num_materials = 0;
+    uint32_t num_items = 0;
+
+    std::atomic<uint32_t> next_item{0}, num_done{0};
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::exception_ptr exception;
+};
+
+//! claim and process items until none are left
+void process_import_job(const std::shared_ptr<import_job_t> &the_job)
+{
+    const uint32_t num_items = the_job->num_items;
+    const uint32_t num_materials = the_job->num_materials;
+    uint32_t i;
+
+    while((i = the_job->next_item++) < num_items)
+    {
+        try
+        {
+            if(i < num_materials)
+            {
+                uint32_t mat_index = the_job->material_indices[i];
+                the_job->materials[mat_index] = create_material(the_job->scene,
+                                                                the_job->scene->mMaterials[mat_index],
+                                                                &the_job->image_cache);
+            }
+            else
+            {
+                uint32_t mesh_index = i - num_materials;
+                insert_geometry(the_job->scene->mMeshes[mesh_index], the_job->mesh_transforms[mesh_index],
+                                the_job->entries[mesh_index], the_job->dst);
+            }
+        }
+        catch(...)
+        {
+            std::unique_lock<std::mutex> lock(the_job->mutex);
+            if(!the_job->exception){ the_job->exception = std::current_exception(); }
+        }
+
+        if(++the_job->num_done == num_items)
+        {
+            std::unique_lock<std::mutex> lock(the_job->mutex);
+            the_job->condition.notify_all();
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+
+//! largest coordinate stored as half-float, rounding-errors stay below 1/64 units
+const float g_max_half_position = 64.f;
+
+/*!
+ * return the_layout, with float-positions instead of half-floats
+ * if the_geom exceeds the range where half-floats are precise enough
+ */
+gl::VertexLayout safe_vertex_layout(const gl::GeometryPtr &the_geom, const gl::VertexLayout &the_layout)
 {
-    dst->append_vertices(src->vertices());
-    dst->append_normals(src->normals());
-    dst->append_colors(src->colors());
-    dst->tangents().insert(dst->tangents().end(), src->tangents().begin(), src->tangents().end());
-    dst->append_tex_coords(src->tex_coords());
-    dst->append_indices(src->indices());
-    dst->bone_vertex_data().insert(dst->bone_vertex_data().end(), src->bone_vertex_data().begin(),
-                                   src->bone_vertex_data().end());
-    dst->faces().insert(dst->faces().end(), src->faces().begin(), src->faces().end());
+    gl::VertexLayout ret = the_layout;
+
+    if(ret.position == gl::VertexLayout::HALF)
+    {
+        const auto &aabb = the_geom->aabb();
+        vec3 extents = glm::max(glm::abs(aabb.min), glm::abs(aabb.max));
+        float max_coord = std::max(extents.x, std::max(extents.y, extents.z));
+
+        if(!(max_coord <= g_max_half_position))
+        {
+            LOG_DEBUG << "model exceeds half-float range (" << max_coord << "), using float-positions";
+            ret.position = gl::VertexLayout::FLOAT;
+        }
+    }
+    return ret;
+}
+
+void finalize_mesh(const gl::MeshPtr &the_mesh, const std::string &the_path, const gl::VertexLayout &the_layout)
+{
+    // cached arrays are stored as floats, the encoding only affects GL buffers
+    the_mesh->geometry()->set_vertex_layout(safe_vertex_layout(the_mesh->geometry(), the_layout));
+
+    gl::ShaderType sh_type;
+
+    try
+    {
+        if(the_mesh->geometry()->has_bones()){ sh_type = gl::ShaderType::PHONG_SKIN; }
+        else{ sh_type = gl::ShaderType::PHONG; }
+
+    }catch(std::exception &e) { LOG_WARNING << e.what(); }
+
+    for(auto &mat : the_mesh->materials()){ mat->enqueue_shader(sh_type); }
+
+    // extract model name from filename
+    the_mesh->set_name(crocore::fs::get_filename_part(the_path));
+
+    LOG_DEBUG << "loaded model: " << the_mesh->geometry()->vertices().size() << " vertices - " <<
+              the_mesh->geometry()->faces().size() << " faces - " << the_mesh->num_bones() << " bones";
+    LOG_DEBUG << "bounds: " << to_string(the_mesh->aabb().min) << " - " << to_string(the_mesh->aabb().max);
 }
 
 /////////////////////////////////////////////////////////////////
 
-gl::MeshPtr load_model(const std::string &theModelPath)
+gl::MeshPtr load_model(const std::string &theModelPath, bool use_cache, crocore::ThreadPool *the_pool,
+                       const gl::VertexLayout &the_layout, bool the_create_lods)
 {
     Assimp::Importer importer;
     std::string found_path;
@@ -497,57 +636,108 @@ gl::MeshPtr load_model(const std::string &theModelPath)
     }
 //    load_scene(theModelPath);
 
+    // super useful postprocessing steps
+    const uint32_t import_flags = aiProcess_Triangulate
+                                  //                                  | aiProcess_GenSmoothNormals
+                                  | aiProcess_JoinIdenticalVertices
+                                  | aiProcess_CalcTangentSpace
+                                  | aiProcess_LimitBoneWeights;
+
+    // warm start -> skip assimp entirely
+    cache_key_t cache_key;
+    if(use_cache){ cache_key = create_cache_key(found_path, import_flags, the_create_lods); }
+    gl::MeshPtr mesh = load_cached_model(cache_key);
+
+    if(mesh)
+    {
+        finalize_mesh(mesh, found_path, the_layout);
+        return mesh;
+    }
+
     LOG_DEBUG << "loading model '" << theModelPath << "' ...";
     const aiScene *theScene = importer.ReadFile(found_path, 0);
+    theScene = importer.ApplyPostProcessing(import_flags);
 
-    // super useful postprocessing steps
-    theScene = importer.ApplyPostProcessing(aiProcess_Triangulate
-                                            //                                            | aiProcess_GenSmoothNormals
-                                            | aiProcess_JoinIdenticalVertices
-                                            | aiProcess_CalcTangentSpace
-                                            | aiProcess_LimitBoneWeights);
     if(theScene)
     {
-        std::vector<gl::GeometryPtr> geometries;
         std::vector<gl::MaterialPtr> materials;
         materials.resize(theScene->mNumMaterials, gl::Material::create());
 
         uint32_t current_base_index = 0, current_base_vertex = 0;
-        gl::GeometryPtr combined_geom = gl::Geometry::create();
         BoneMap bonemap;
         WeightMap weightmap;
         std::vector<gl::Mesh::Entry> entries;
-        std::map<std::string, crocore::ImagePtr> mat_image_cache;
+        std::vector<uint32_t> material_indices;
 
+        // entry-offsets and bones up front, bone-indices depend on submesh-order
         for(uint32_t i = 0; i < theScene->mNumMeshes; i++)
         {
             aiMesh *aMesh = theScene->mMeshes[i];
-            gl::GeometryPtr g = createGeometry(aMesh, theScene);
             loadBones(aMesh, current_base_vertex, bonemap, weightmap);
             gl::Mesh::Entry m;
-            m.num_vertices = g->vertices().size();
-            m.num_indices = g->indices().size();
+            m.num_vertices = aMesh->mNumVertices;
+            m.num_indices = 3 * aMesh->mNumFaces;
             m.base_index = current_base_index;
             m.base_vertex = current_base_vertex;
             m.material_index = aMesh->mMaterialIndex;
             entries.push_back(m);
-            current_base_vertex += g->vertices().size();
-            current_base_index += g->indices().size();
+            current_base_vertex += m.num_vertices;
+            current_base_index += m.num_indices;
+            material_indices.push_back(aMesh->mMaterialIndex);
+        }
+        std::sort(material_indices.begin(), material_indices.end());
+        material_indices.erase(std::unique(material_indices.begin(), material_indices.end()),
+                               material_indices.end());
 
-            geometries.push_back(g);
-            merge_geometries(g, combined_geom);
-            materials[aMesh->mMaterialIndex] = create_material(theScene, theScene->mMaterials[aMesh->mMaterialIndex],
-                                                               &mat_image_cache);
+        // exact-sized destination arrays, colors default to white
+        gl::GeometryPtr combined_geom = gl::Geometry::create();
+        combined_geom->vertices().resize(current_base_vertex, vec3(0));
+        combined_geom->normals().resize(current_base_vertex, vec3(0));
+        combined_geom->tangents().resize(current_base_vertex, vec3(0));
+        combined_geom->tex_coords().resize(current_base_vertex, vec2(0));
+        combined_geom->colors().resize(current_base_vertex, gl::COLOR_WHITE);
+        combined_geom->indices().resize(current_base_index);
+
+        // materials (image-decoding) first, then submeshes
+        const uint32_t num_items = material_indices.size() + entries.size();
+
+        auto job = std::make_shared<import_job_t>();
+        job->scene = theScene;
+        job->entries = entries;
+        job->num_materials = material_indices.size();
+        job->material_indices = std::move(material_indices);
+        job->materials = std::move(materials);
+        job->num_items = num_items;
+        job->mesh_transforms = get_mesh_transforms(theScene);
+        job->dst = {combined_geom->vertices().data(), combined_geom->normals().data(),
+                    combined_geom->tangents().data(), combined_geom->tex_coords().data(),
+                    combined_geom->colors().data(), combined_geom->indices().data()};
+
+        if(the_pool && num_items > 1)
+        {
+            uint32_t num_tasks = std::min<uint32_t>(the_pool->num_threads(), num_items - 1);
+            for(uint32_t i = 0; i < num_tasks; ++i){ the_pool->post([job](){ process_import_job(job); }); }
         }
-        combined_geom->compute_aabb();
+        process_import_job(job);
+
+        {
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->condition.wait(lock, [&job, num_items](){ return job->num_done == num_items; });
+        }
+        if(job->exception){ std::rethrow_exception(job->exception); }
+        materials = std::move(job->materials);
 
-        // insert colors, if not present
-        combined_geom->colors().resize(combined_geom->vertices().size(), gl::COLOR_WHITE);
+        combined_geom->faces().resize(current_base_index / 3);
+        if(current_base_index)
+        {
+            ::memcpy(reinterpret_cast<gl::index_t*>(combined_geom->faces().data()),
+                     combined_geom->indices().data(), current_base_index * sizeof(gl::index_t));
+        }
+        combined_geom->compute_aabb();
 
         insertBoneVertexData(combined_geom, weightmap);
 
-        gl::GeometryPtr geom = combined_geom;
-        gl::MeshPtr mesh = gl::Mesh::create(combined_geom, materials.empty() ? gl::Material::create() : materials[0]);
+        mesh = gl::Mesh::create(combined_geom, materials.empty() ? gl::Material::create() : materials[0]);
         mesh->entries() = entries;
         if(!materials.empty()){ mesh->materials() = materials; }
         mesh->set_root_bone(create_bone_hierarchy(theScene->mRootNode, mat4(1), bonemap));
@@ -561,28 +751,21 @@ gl::MeshPtr load_model(const std::string &theModelPath)
             create_bone_animation(theScene->mRootNode, assimpAnimation, mesh->root_bone(), anim);
             mesh->add_animation(anim);
         }
-        gl::ShaderType sh_type;
-
-        try
-        {
-            if(geom->has_bones()){ sh_type = gl::ShaderType::PHONG_SKIN; }
-            else{ sh_type = gl::ShaderType::PHONG; }
+        importer.FreeScene();
 
-        }catch(std::exception &e) { LOG_WARNING << e.what(); }
+        // vertex-cache, overdraw and fetch-locality, paid once per import (results are cached)
+        auto stats = gl::optimize_mesh(mesh);
+        LOG_DEBUG << "ACMR: " << stats.acmr_before << " -> " << stats.acmr_after;
 
-        for(uint32_t i = 0; i < materials.size(); i++)
+        // levels-of-detail share the optimized vertices, also paid once per import
+        if(the_create_lods)
         {
-            materials[i]->enqueue_shader(sh_type);
+            gl::create_lods(mesh);
+            LOG_DEBUG << "levels-of-detail: " << mesh->num_lods();
         }
 
-        // extract model name from filename
-        mesh->set_name(crocore::fs::get_filename_part(found_path));
-
-        LOG_DEBUG << "loaded model: " << geom->vertices().size() << " vertices - " <<
-                  geom->faces().size() << " faces - " << mesh->num_bones() << " bones";
-        LOG_DEBUG << "bounds: " << to_string(mesh->aabb().min) << " - " << to_string(mesh->aabb().max);
-
-        importer.FreeScene();
+        save_cached_model(cache_key, mesh);
+        finalize_mesh(mesh, found_path, the_layout);
         return mesh;
     }else
     {
@@ -640,7 +823,7 @@ gl::ScenePtr load_scene(const std::string &the_path)
 
 /////////////////////////////////////////////////////////////////
 
-bool get_mesh_transform(const aiScene *the_scene, const aiMesh *the_ai_mesh, glm::mat4 &the_out_transform)
+std::vector<glm::mat4> get_mesh_transforms(const aiScene *the_scene)
 {
     struct node_t
     {
@@ -648,6 +831,10 @@ bool get_mesh_transform(const aiScene *the_scene, const aiMesh *the_ai_mesh, glm
         glm::mat4 global_transform;
     };
 
+    // one traversal for all meshes
+    std::vector<glm::mat4> ret(the_scene->mNumMeshes, glm::mat4(1));
+    std::vector<bool> found(the_scene->mNumMeshes, false);
+
     std::deque<node_t> node_queue;
     node_queue.push_back({the_scene->mRootNode, glm::mat4(1)});
 
@@ -658,15 +845,15 @@ bool get_mesh_transform(const aiScene *the_scene, const aiMesh *the_ai_mesh, glm
         glm::mat4 node_transform = node_queue.front().global_transform;
         node_queue.pop_front();
 
+        // first occurrence in breadth-first order wins
         for(uint32_t i = 0; i < p->mNumMeshes; ++i)
         {
-            const aiMesh *m = the_scene->mMeshes[p->mMeshes[i]];
+            uint32_t mesh_index = p->mMeshes[i];
 
-            // we found the mesh and are done
-            if(m == the_ai_mesh)
+            if(mesh_index < ret.size() && !found[mesh_index])
             {
-                the_out_transform = node_transform;
-                return true;
+                ret[mesh_index] = node_transform;
+                found[mesh_index] = true;
             }
         }
 
@@ -678,7 +865,8 @@ bool get_mesh_transform(const aiScene *the_scene, const aiMesh *the_ai_mesh, glm
             node_queue.push_back({p->mChildren[c], node_transform * child_transform});
         }
     }
-    return false;
+    LOG_WARNING_IF(std::count(found.begin(), found.end(), false)) << "could not find mesh transform";
+    return ret;
 }
 
 /////////////////////////////////////////////////////////////////
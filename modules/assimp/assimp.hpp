@@ -9,11 +9,24 @@
 #pragma once
 
 #include "gl/gl.hpp"
+#include "gl/Geometry.hpp"
+
+namespace crocore{ class ThreadPool; }
 
 namespace kinski { namespace assimp{
 
-//! load a single 3D model from file
-gl::MeshPtr load_model(const std::string &thePath);
+/*!
+ * load a single 3D model from file, using the binary model-cache if use_cache is set (see model_cache.hpp).
+ * submeshes and materials are converted concurrently on the_pool, if provided.
+ * the_layout determines the encoding of GL vertex-buffers, defaults to gl::VertexLayout::packed().
+ * half-float positions are only used for models within +-64 units, larger models keep float-positions.
+ * pass gl::VertexLayout() to opt out, e.g. for models requiring full float-precision for positions.
+ * with the_create_lods, levels-of-detail are generated once per import (see gl::create_lods())
+ * and stored in the model-cache along with the model
+ */
+gl::MeshPtr load_model(const std::string &thePath, bool use_cache = true, crocore::ThreadPool *the_pool = nullptr,
+                       const gl::VertexLayout &the_layout = gl::VertexLayout::packed(),
+                       bool the_create_lods = false);
     
 //! load a scene from file
 gl::ScenePtr load_scene(const std::string &thePath);
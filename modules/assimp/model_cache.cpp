@@ -0,0 +1,493 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <crocore/filesystem.hpp>
+#include "gl/Mesh.hpp"
+#include "model_cache.hpp"
+
+namespace kinski { namespace assimp {
+
+namespace
+{
+    //! bump, whenever the layout of cache-files or the import-processing changes
+    const uint32_t g_cache_version = 3;
+
+    const char g_cache_magic[8] = {'K', 'I', 'N', 'S', 'K', 'M', 'D', 'L'};
+
+    //! arrays start at multiples of this, so they can be accessed in place from a mapped file
+    const size_t g_alignment = 16;
+
+    //! sizes of all raw-copied types, a mismatch invalidates cache-files written by a different build
+    const uint32_t g_layout_sizes[] = {sizeof(gl::vec2), sizeof(gl::vec3), sizeof(gl::vec4), sizeof(gl::index_t),
+                                       sizeof(gl::Face3), sizeof(gl::BoneVertexData), sizeof(gl::Mesh::Entry),
+                                       sizeof(gl::Key<gl::vec3>), sizeof(gl::Key<gl::quat>), sizeof(gl::mat4)};
+
+    std::string g_cache_directory = crocore::fs::join_paths(getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp",
+                                                            "kinski_model_cache");
+
+    struct header_t
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t import_flags;
+        uint32_t lods;
+        int64_t mtime;
+        uint64_t file_size;
+        uint32_t layout_sizes[sizeof(g_layout_sizes) / sizeof(uint32_t)];
+    };
+
+    class cache_writer
+    {
+    public:
+
+        template<typename T> void write(const T &the_value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be cached");
+            auto ptr = reinterpret_cast<const uint8_t*>(&the_value);
+            m_data.insert(m_data.end(), ptr, ptr + sizeof(T));
+        }
+
+        template<typename T> void write_array(const std::vector<T> &the_array)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be cached");
+            write<uint64_t>(the_array.size());
+            m_data.resize((m_data.size() + g_alignment - 1) / g_alignment * g_alignment, 0);
+            auto ptr = reinterpret_cast<const uint8_t*>(the_array.data());
+            m_data.insert(m_data.end(), ptr, ptr + the_array.size() * sizeof(T));
+        }
+
+        void write_string(const std::string &the_str)
+        {
+            write<uint32_t>(the_str.size());
+            m_data.insert(m_data.end(), the_str.begin(), the_str.end());
+        }
+
+        const std::vector<uint8_t>& data() const { return m_data; }
+
+    private:
+        std::vector<uint8_t> m_data;
+    };
+
+    class cache_reader
+    {
+    public:
+
+        cache_reader(const uint8_t *the_data, size_t the_num_bytes) :
+                m_begin(the_data), m_ptr(the_data), m_end(the_data + the_num_bytes){}
+
+        template<typename T> T read()
+        {
+            T ret;
+            memcpy(&ret, claim(sizeof(T)), sizeof(T));
+            return ret;
+        }
+
+        //! returns a pointer into the mapped data, valid as long as the mapping
+        template<typename T> const T* read_array(size_t &the_out_count)
+        {
+            the_out_count = read<uint64_t>();
+            size_t offset = m_ptr - m_begin;
+            claim((offset + g_alignment - 1) / g_alignment * g_alignment - offset);
+            if(the_out_count > size_t(m_end - m_ptr) / sizeof(T)){ throw std::runtime_error("truncated cache-file"); }
+            return reinterpret_cast<const T*>(claim(the_out_count * sizeof(T)));
+        }
+
+        template<typename T> void read_array(std::vector<T> &the_out_array)
+        {
+            size_t count;
+            const T *ptr = read_array<T>(count);
+            the_out_array.assign(ptr, ptr + count);
+        }
+
+        std::string read_string()
+        {
+            uint32_t num_bytes = read<uint32_t>();
+            auto ptr = reinterpret_cast<const char*>(claim(num_bytes));
+            return std::string(ptr, ptr + num_bytes);
+        }
+
+    private:
+
+        const uint8_t* claim(size_t the_num_bytes)
+        {
+            if(the_num_bytes > size_t(m_end - m_ptr)){ throw std::runtime_error("truncated cache-file"); }
+            const uint8_t *ret = m_ptr;
+            m_ptr += the_num_bytes;
+            return ret;
+        }
+
+        const uint8_t *m_begin, *m_ptr, *m_end;
+    };
+
+    //! read-only mapping of an entire file
+    class mapped_file
+    {
+    public:
+
+        explicit mapped_file(const std::string &the_path)
+        {
+            int fd = open(the_path.c_str(), O_RDONLY);
+            if(fd < 0){ return; }
+            struct stat st = {};
+
+            if(fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if(ptr != MAP_FAILED)
+                {
+                    m_data = static_cast<const uint8_t*>(ptr);
+                    m_num_bytes = st.st_size;
+                }
+            }
+            close(fd);
+        }
+
+        ~mapped_file(){ if(m_data){ munmap(const_cast<uint8_t*>(m_data), m_num_bytes); }}
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        const uint8_t* data() const { return m_data; }
+        size_t num_bytes() const { return m_num_bytes; }
+
+    private:
+        const uint8_t *m_data = nullptr;
+        size_t m_num_bytes = 0;
+    };
+
+    std::string cache_file_path(const cache_key_t &the_key)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%016llx.kmc", (unsigned long long)std::hash<std::string>()(the_key.path));
+        return crocore::fs::join_paths(g_cache_directory, buf);
+    }
+
+    //! images that can't be reproduced from their path (embedded or combined) are stored with the material
+    bool needs_pixel_data(const std::string &the_path, uint32_t the_key, const crocore::ImagePtr &the_img)
+    {
+        return the_img && !the_img->is_float() &&
+               ((!the_path.empty() && the_path[0] == '*') ||
+                the_key == (uint32_t)gl::Texture::Usage::AO_ROUGHNESS_METAL);
+    }
+
+    void write_bones(cache_writer &the_writer, const gl::BonePtr &the_bone, int32_t the_parent_index,
+                     std::map<gl::BonePtr, int32_t> &the_bone_indices)
+    {
+        int32_t flat_index = the_bone_indices.size();
+        the_bone_indices[the_bone] = flat_index;
+        the_writer.write_string(the_bone->name);
+        the_writer.write(the_parent_index);
+        the_writer.write(the_bone->index);
+        the_writer.write(the_bone->transform);
+        the_writer.write(the_bone->worldtransform);
+        the_writer.write(the_bone->offset);
+        for(const auto &child : the_bone->children){ write_bones(the_writer, child, flat_index, the_bone_indices); }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+cache_key_t create_cache_key(const std::string &the_path, uint32_t the_import_flags, bool the_lods)
+{
+    cache_key_t ret;
+    struct stat st = {};
+
+    if(stat(the_path.c_str(), &st) == 0)
+    {
+        ret.path = the_path;
+        ret.mtime = st.st_mtime;
+        ret.file_size = st.st_size;
+        ret.import_flags = the_import_flags;
+        ret.lods = the_lods;
+    }
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void set_cache_directory(const std::string &the_directory)
+{
+    g_cache_directory = the_directory;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const std::string& cache_directory()
+{
+    return g_cache_directory;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+gl::MeshPtr load_cached_model(const cache_key_t &the_key)
+{
+    if(!the_key || g_cache_directory.empty()){ return nullptr; }
+
+    std::string cache_path = cache_file_path(the_key);
+    mapped_file file(cache_path);
+    if(!file.data()){ return nullptr; }
+
+    try
+    {
+        cache_reader reader(file.data(), file.num_bytes());
+
+        // validate header and key
+        auto header = reader.read<header_t>();
+
+        if(memcmp(header.magic, g_cache_magic, sizeof(g_cache_magic)) || header.version != g_cache_version ||
+           memcmp(header.layout_sizes, g_layout_sizes, sizeof(g_layout_sizes)) ||
+           header.import_flags != the_key.import_flags || header.lods != the_key.lods ||
+           header.mtime != the_key.mtime ||
+           header.file_size != the_key.file_size || reader.read_string() != the_key.path)
+        {
+            LOG_DEBUG << "outdated cache-file: " << cache_path;
+            return nullptr;
+        }
+
+        // geometry
+        auto geom = gl::Geometry::create();
+        reader.read_array(geom->vertices());
+        reader.read_array(geom->normals());
+        reader.read_array(geom->tangents());
+        reader.read_array(geom->tex_coords());
+        reader.read_array(geom->colors());
+        reader.read_array(geom->indices());
+        reader.read_array(geom->faces());
+
+        std::vector<gl::BoneVertexData> bone_vertex_data;
+        reader.read_array(bone_vertex_data);
+        if(!bone_vertex_data.empty()){ geom->bone_vertex_data() = std::move(bone_vertex_data); }
+        geom->compute_aabb();
+
+        // materials
+        std::vector<gl::MaterialPtr> materials(reader.read<uint32_t>());
+
+        for(auto &mat : materials)
+        {
+            mat = gl::Material::create();
+            mat->set_diffuse(reader.read<gl::Color>());
+            mat->set_emission(reader.read<gl::Color>());
+            mat->set_roughness(reader.read<float>());
+            mat->set_metalness(reader.read<float>());
+            mat->set_blending(reader.read<uint8_t>());
+            mat->set_two_sided(reader.read<uint8_t>());
+            mat->set_wireframe(reader.read<uint8_t>());
+
+            uint32_t num_textures = reader.read<uint32_t>();
+
+            for(uint32_t i = 0; i < num_textures; ++i)
+            {
+                std::string path = reader.read_string();
+                uint32_t key = reader.read<uint32_t>();
+                crocore::ImagePtr img;
+
+                if(reader.read<uint8_t>())
+                {
+                    auto dims = reader.read<glm::uvec3>();
+                    size_t num_bytes;
+                    const uint8_t *pixels = reader.read_array<uint8_t>(num_bytes);
+                    auto pixel_img = crocore::Image_<uint8_t>::create(dims.x, dims.y, dims.z);
+                    if(pixel_img && pixel_img->num_bytes() == num_bytes)
+                    {
+                        memcpy(pixel_img->data(), pixels, num_bytes);
+                    }
+                    img = pixel_img;
+                }
+                mat->enqueue_texture(path, img, key);
+            }
+        }
+
+        auto mesh = gl::Mesh::create(geom, materials.empty() ? gl::Material::create() : materials[0]);
+        if(!materials.empty()){ mesh->materials() = materials; }
+        reader.read_array(mesh->entries());
+
+        // levels-of-detail, their indices are part of the geometry
+        mesh->lods().resize(reader.read<uint32_t>());
+
+        for(auto &lod : mesh->lods())
+        {
+            lod.screen_size = reader.read<float>();
+            lod.error = reader.read<float>();
+            reader.read_array(lod.entries);
+        }
+
+        // bone-hierarchy, flattened in depth-first order
+        std::vector<gl::BonePtr> bones(reader.read<uint32_t>());
+
+        for(auto &bone : bones)
+        {
+            bone = std::make_shared<gl::Bone>();
+            bone->name = reader.read_string();
+            int32_t parent_index = reader.read<int32_t>();
+            bone->index = reader.read<uint32_t>();
+            bone->transform = reader.read<gl::mat4>();
+            bone->worldtransform = reader.read<gl::mat4>();
+            bone->offset = reader.read<gl::mat4>();
+
+            if(parent_index >= 0 && parent_index < int32_t(&bone - bones.data()))
+            {
+                bone->parent = bones[parent_index];
+                bones[parent_index]->children.push_back(bone);
+            }
+        }
+        if(!bones.empty()){ mesh->set_root_bone(bones.front()); }
+
+        // animations
+        uint32_t num_animations = reader.read<uint32_t>();
+
+        for(uint32_t i = 0; i < num_animations; ++i)
+        {
+            gl::MeshAnimation anim;
+            anim.duration = reader.read<float>();
+            anim.ticks_per_sec = reader.read<float>();
+            uint32_t num_channels = reader.read<uint32_t>();
+
+            for(uint32_t j = 0; j < num_channels; ++j)
+            {
+                uint32_t bone_index = reader.read<uint32_t>();
+                if(bone_index >= bones.size()){ throw std::runtime_error("invalid bone-index"); }
+
+                gl::AnimationKeys &keys = anim.bone_keys[bones[bone_index]];
+                reader.read_array(keys.positionkeys);
+                reader.read_array(keys.rotationkeys);
+                reader.read_array(keys.scalekeys);
+            }
+            mesh->add_animation(anim);
+        }
+        LOG_DEBUG << "loaded model from cache: " << cache_path;
+        return mesh;
+    }
+    catch(std::exception &e){ LOG_WARNING << "corrupt cache-file '" << cache_path << "': " << e.what(); }
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool save_cached_model(const cache_key_t &the_key, const gl::MeshConstPtr &the_mesh)
+{
+    if(!the_key || !the_mesh || g_cache_directory.empty()){ return false; }
+
+    cache_writer writer;
+    header_t header = {};
+    memcpy(header.magic, g_cache_magic, sizeof(g_cache_magic));
+    header.version = g_cache_version;
+    header.import_flags = the_key.import_flags;
+    header.lods = the_key.lods;
+    header.mtime = the_key.mtime;
+    header.file_size = the_key.file_size;
+    memcpy(header.layout_sizes, g_layout_sizes, sizeof(g_layout_sizes));
+    writer.write(header);
+    writer.write_string(the_key.path);
+
+    // geometry
+    const auto &geom = the_mesh->geometry();
+    writer.write_array(geom->vertices());
+    writer.write_array(geom->normals());
+    writer.write_array(geom->tangents());
+    writer.write_array(geom->tex_coords());
+    writer.write_array(geom->colors());
+    writer.write_array(geom->indices());
+    writer.write_array(geom->faces());
+    writer.write_array(geom->bone_vertex_data());
+
+    // materials, textures are referenced by path
+    writer.write<uint32_t>(the_mesh->materials().size());
+
+    for(const auto &mat : the_mesh->materials())
+    {
+        writer.write(mat->diffuse());
+        writer.write(mat->emission());
+        writer.write(mat->roughness());
+        writer.write(mat->metalness());
+        writer.write<uint8_t>(mat->blending());
+        writer.write<uint8_t>(mat->two_sided());
+        writer.write<uint8_t>(mat->wireframe());
+        writer.write<uint32_t>(mat->queued_textures().size());
+
+        for(const auto &pair : mat->queued_textures())
+        {
+            const auto &img = pair.second.image;
+            bool store_pixels = needs_pixel_data(pair.first, pair.second.key, img);
+            writer.write_string(pair.first);
+            writer.write(pair.second.key);
+            writer.write<uint8_t>(store_pixels);
+
+            if(store_pixels)
+            {
+                writer.write(glm::uvec3(img->width(), img->height(), img->num_components()));
+                writer.write_array(std::vector<uint8_t>(img->data(), img->data() + img->num_bytes()));
+            }
+        }
+    }
+    writer.write_array(the_mesh->entries());
+
+    // levels-of-detail
+    writer.write<uint32_t>(the_mesh->lods().size());
+
+    for(const auto &lod : the_mesh->lods())
+    {
+        writer.write(lod.screen_size);
+        writer.write(lod.error);
+        writer.write_array(lod.entries);
+    }
+
+    // bone-hierarchy
+    std::map<gl::BonePtr, int32_t> bone_indices;
+    cache_writer bone_writer;
+    if(the_mesh->root_bone()){ write_bones(bone_writer, the_mesh->root_bone(), -1, bone_indices); }
+    writer.write<uint32_t>(bone_indices.size());
+
+    // bone-records contain no arrays, so they can be appended without breaking alignment
+    for(uint8_t b : bone_writer.data()){ writer.write(b); }
+
+    // animations
+    writer.write<uint32_t>(the_mesh->animations().size());
+
+    for(const auto &anim : the_mesh->animations())
+    {
+        writer.write(anim.duration);
+        writer.write(anim.ticks_per_sec);
+
+        uint32_t num_channels = 0;
+        for(const auto &pair : anim.bone_keys){ num_channels += bone_indices.count(pair.first); }
+        writer.write(num_channels);
+
+        for(const auto &pair : anim.bone_keys)
+        {
+            auto it = bone_indices.find(pair.first);
+            if(it == bone_indices.end()){ continue; }
+            writer.write<uint32_t>(it->second);
+            writer.write_array(pair.second.positionkeys);
+            writer.write_array(pair.second.rotationkeys);
+            writer.write_array(pair.second.scalekeys);
+        }
+    }
+
+    // write to a temporary file first, readers never see partial files
+    if(!crocore::fs::is_directory(g_cache_directory)){ mkdir(g_cache_directory.c_str(), 0755); }
+    std::string cache_path = cache_file_path(the_key), tmp_path = cache_path + ".tmp";
+
+    if(!crocore::fs::write_binary_file(tmp_path, writer.data()) || rename(tmp_path.c_str(), cache_path.c_str()))
+    {
+        LOG_WARNING << "could not write cache-file: " << cache_path;
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    LOG_DEBUG << "wrote cache-file: " << cache_path << " (" << writer.data().size() / 1024 << " kB)";
+    return true;
+}
+
+}}//namespaces
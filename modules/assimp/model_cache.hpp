@@ -0,0 +1,52 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+//  model_cache.hpp
+//
+//  Versioned binary on-disk cache for imported models
+
+#pragma once
+
+#include "gl/gl.hpp"
+
+namespace kinski { namespace assimp {
+
+//! identifies an import by its source-file, modification-time, post-processing flags and generated LODs
+struct cache_key_t
+{
+    std::string path;
+    int64_t mtime = 0;
+    uint64_t file_size = 0;
+    uint32_t import_flags = 0;
+    bool lods = false;
+
+    explicit operator bool() const { return !path.empty(); }
+};
+
+//! create a key for the file at the_path, returns an empty key if the file can't be accessed
+cache_key_t create_cache_key(const std::string &the_path, uint32_t the_import_flags, bool the_lods = false);
+
+/*!
+ * directory used to store cache-files, defaults to "kinski_model_cache" inside the temp-directory.
+ * an empty directory disables caching
+ */
+void set_cache_directory(const std::string &the_directory);
+
+const std::string& cache_directory();
+
+/*!
+ * load a mesh from the cache-file for the_key. the file is memory-mapped and its arrays are copied
+ * without further parsing. returns an empty pointer if there is no valid cache-entry for the_key
+ */
+gl::MeshPtr load_cached_model(const cache_key_t &the_key);
+
+//! store geometry, entries, levels-of-detail, materials, bones and animations of the_mesh in a cache-file for the_key
+bool save_cached_model(const cache_key_t &the_key, const gl::MeshConstPtr &the_mesh);
+
+}}//namespaces
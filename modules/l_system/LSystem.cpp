@@ -6,6 +6,10 @@
 //
 //
 
+#include <condition_variable>
+#include <cstring>
+#include <random>
+#include <crocore/ThreadPool.hpp>
 #include "LSystem.h"
 #include "gl/Mesh.hpp"
 
@@ -45,412 +49,563 @@ LSystem::LSystem() :
     m_state_stack = {{glm::mat4(1), false, m_diameter}};
 }
 
-const glm::vec3 &LSystem::head() const
+glm::mat4 &LSystem::turtle_transform()
 {
-    return *reinterpret_cast<glm::vec3 *>(&m_state_stack.back().transform[0]);
+    return m_state_stack.back().transform;
 }
 
-const glm::vec3 &LSystem::left() const
+const glm::mat4 &LSystem::turtle_transform() const
 {
-    return *reinterpret_cast<glm::vec3 *>(&m_state_stack.back().transform[1]);
+    return m_state_stack.back().transform;
 }
 
-const glm::vec3 &LSystem::up() const
+namespace
 {
-    return *reinterpret_cast<glm::vec3 *>(&m_state_stack.back().transform[2]);
-}
 
-const glm::vec3 &LSystem::position() const
-{
-    return *reinterpret_cast<glm::vec3 *>(&m_state_stack.back().transform[3]);
-}
+//! symbols which do not grow a line-segment
+const char *g_command_symbols = "[]()+-|&^\\/!";
 
-glm::mat4 &LSystem::turtle_transform()
+//! upper limit for memory reserved in advance, more segments will still be appended
+const uint64_t g_max_reserved_segments = 1 << 22;
+
+bool is_segment_symbol(unsigned char c)
 {
-    return m_state_stack.back().transform;
+    return !std::isspace(c) && !std::isdigit(c) && c != '.' && !strchr(g_command_symbols, c);
 }
 
-const glm::mat4 &LSystem::turtle_transform() const
+//! a line-segment, grown at a branch-depth
+struct segment_t
 {
-    return m_state_stack.back().transform;
-}
+    vec3 start, end, normal;
+    float diameter;
+    uint32_t depth;
+};
 
-void LSystem::iterate(int num_iterations)
+}// namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+class LSystem::SymbolStream
 {
-    m_buffer = m_axiom;
-    m_iteration_depth = num_iterations;
+public:
 
-    for(int i = 0; i < num_iterations; i++)
+    explicit SymbolStream(const LSystem *the_lsystem):
+            m_rule_index(&the_lsystem->m_rule_index),
+            m_rule_bodies(&the_lsystem->m_rule_bodies)
     {
-        stringstream ss;
-
-        for(char ch : m_buffer)
-        {
-            auto iter = m_rules.find(ch);
+        const auto &axiom = the_lsystem->m_compiled_axiom;
+        m_stack.reserve(the_lsystem->m_iteration_depth + 1);
+        m_stack.push_back({axiom.data(), axiom.data() + axiom.size(), the_lsystem->m_iteration_depth});
+        m_next = fetch();
+    }
 
-            // if we found a corresponding rule, apply it. else append the original token
-            if(iter != m_rules.end()){ ss << iter->second; }
-            else{ ss << ch; }
-        }
-        m_buffer = ss.str();
+    //! consume the next symbol, 0 at the end of the derivation
+    char next()
+    {
+        char ret = m_next;
+        if(ret){ m_next = fetch(); }
+        return ret;
     }
-    m_buffer = crocore::remove_whitespace(m_buffer);
-    LOG_TRACE << m_buffer;
 
-    // reset stack
-    m_state_stack = {{glm::mat4(1), false, m_diameter}};
-}
+    //! consume an optional parameter-block "(...)" following the last symbol, NaN if there is none
+    float parameter()
+    {
+        if(m_next != '('){ return std::nanf("0"); }
+        next();
 
-/*!
- 
- + Turn left by angle δ, using rotation matrix RU(δ).
- − Turn right by angle δ, using rotation matrix RU(−δ).
- & Pitch down by angle δ, using rotation matrix RL(δ).
- ∧ Pitch up by angle δ, using rotation matrix RL(−δ).
- \ Roll left by angle δ, using rotation matrix RH(δ).
- / Roll right by angle δ, using rotation matrix RH(−δ).
- | Turn around, using rotation matrix RU (180◦ ).
- 
-*/
-gl::MeshPtr LSystem::create_mesh() const
-{
-    m_cancel_requested = false;
+        char buf[32];
+        size_t len = 0;
 
-    // use subgeometries for different branch depths
-    bool use_mesh_entries = true;
-
-    // our output geometry
-    gl::MeshPtr ret = gl::Mesh::create(gl::Geometry::create(), gl::Material::create());
-    auto &points = ret->geometry()->vertices();
-    auto &normals = ret->geometry()->normals();
-    auto &colors = ret->geometry()->colors();
-    auto &indices = ret->geometry()->indices();
-    auto &point_sizes = ret->geometry()->point_sizes();
-
-    uint32_t max_branch_depth = 0;
-
-    // vertex info for the different branch depths
-    std::vector<std::vector<glm::vec3>> verts_vec;
-    std::vector<std::vector<glm::vec3>> normals_vec;
-    std::vector<std::vector<glm::vec4>> colors_vec;
-    std::vector<std::vector<uint32_t>> indices_vec;
-
-    // will hold the current branch diameter
-    std::vector<std::vector<float>> point_sizes_vec;
-
-    // helper to have seperate indices for each branch depth
-    std::vector<uint32_t> index_increments;
-
-    // tmp values
-    int i = 0;
-    vec3 current_pos, new_pos, current_normal;
-    vec3 branch_angle;
-    float increment, diameter_shrink_factor;
-
-    // create geometry out of our buffer string
-    for(auto iter = m_buffer.begin(), end = m_buffer.end(); iter != end; ++iter)
-    {
-        if(m_cancel_requested)
+        for(char c = next(); c && c != ')'; c = next())
         {
-            LOG_DEBUG << "cancel requested ...";
-            return gl::MeshPtr();
+            if(len < sizeof(buf) - 1){ buf[len++] = c; }
         }
+        buf[len] = '\0';
+        return std::strtof(buf, nullptr);
+    }
 
-        char ch = *iter, next_ch = (iter + 1) != m_buffer.end() ? *(iter + 1) : 0;
+private:
 
-        gl::Color current_color(gl::COLOR_WHITE);
+    struct frame_t
+    {
+        const char *pos, *end;
 
-        // upcoming char starts a parameter block
-        bool has_parameter = next_ch == '(';
+        //! number of rule-applications left for the symbols in this frame
+        uint32_t num_rewrites;
+    };
 
-        // color / material / stack state here
-        switch(ch)
+    char fetch()
+    {
+        while(!m_stack.empty())
         {
-            // push state
-            case '[':
-                m_state_stack.push_back(m_state_stack.back());
-                break;
+            auto &frame = m_stack.back();
+            if(frame.pos == frame.end){ m_stack.pop_back(); continue; }
 
-                // pop state
-            case ']':
-                m_state_stack.pop_back();
-                break;
+            unsigned char c = *frame.pos++;
+            int32_t rule = frame.num_rewrites ? (*m_rule_index)[c] : -1;
 
-            default:
-                break;
+            // descend into the rule's body, else emit the symbol
+            if(rule >= 0)
+            {
+                const auto &body = (*m_rule_bodies)[rule];
+                uint32_t num_rewrites = frame.num_rewrites - 1;
+                m_stack.push_back({body.data(), body.data() + body.size(), num_rewrites});
+            }
+            else if(!std::isspace(c)){ return c; }
         }
+        return 0;
+    }
 
-        // this optional parameter will only be used if not NaN
-        float optional_param = std::nanf("0");
+    const std::array<int32_t, 256> *m_rule_index;
+    const std::vector<std::string> *m_rule_bodies;
 
-        if(has_parameter)
-        {
-            // jump forward to first position in parameter block
-            iter += 2;
+    //! one frame per expansion-level, never more than num_iterations + 1
+    std::vector<frame_t> m_stack;
 
-            string accum;
+    char m_next = 0;
+};
 
-            // increment the iterator until a ')' char is encountered, build up accum string
-            while(iter != m_buffer.end())
-            {
-                // parameter string ended
-                if(*iter == ')'){ break; }
+///////////////////////////////////////////////////////////////////////////////
 
-                accum.insert(accum.end(), *iter);
-                ++iter;
-            }
-            optional_param = crocore::string_to<float>(accum);
-        }
+class LSystem::Turtle
+{
+public:
+
+    //! a top-level branch, deferred for concurrent interpretation
+    struct branch_t
+    {
+        //! positioned after the opening '['
+        SymbolStream stream;
 
-        // this branch should not continue growing -> move on with iteration
-        if(m_state_stack.back().abort_branch)
-            continue;
+        turtle_state state;
 
-        // save current position here
-        current_pos = new_pos = position();
+        //! stack-size outside of the branch
+        size_t depth;
+    };
 
-        // derive normal from up-vector
-        current_normal = up();
+    explicit Turtle(const LSystem *the_lsystem):
+            m_lsystem(the_lsystem),
+            m_rng(std::random_device()()){}
 
-        // the possible base values to apply, either predefined or from supplied parameter
-        branch_angle = m_branch_angle;
-        increment = m_increment;
-        diameter_shrink_factor = m_diameter_shrink_factor;
+    /*!
+     * interpret symbols until the stream ends or the stack shrinks to the_end_depth.
+     * if the_branches is provided, top-level branches are skipped and stored there instead.
+     * returns false if cancelled
+     */
+    bool run(SymbolStream &the_stream, size_t the_end_depth, std::vector<branch_t> *the_branches = nullptr)
+    {
+        const size_t top_level = stack.size();
 
-        // a custom parameter was provided
-        if(!std::isnan(optional_param))
+        while(stack.size() > the_end_depth)
         {
-            branch_angle = vec3(optional_param);
-            increment = optional_param;
-            diameter_shrink_factor = optional_param;
-        }
+            if(m_lsystem->m_cancel_requested){ return false; }
 
-        // our current branch angles
-        vec3 current_branch_angles = glm::radians(branch_angle + glm::linearRand(-m_branch_randomness,
-                                                                                 m_branch_randomness));
+            char ch = the_stream.next();
+            if(!ch){ break; }
 
-        // our current increment
-        float current_increment = increment + crocore::random(-m_increment_randomness,
-                                                              m_increment_randomness);
+            // this optional parameter will only be used if not NaN
+            float optional_param = the_stream.parameter();
 
-        switch(ch)
-        {
-            // already handled above
-            case '[':
-            case ']':
-            case '(':
-            case ')':
-                break;
+            // push state
+            if(ch == '[')
+            {
+                if(the_branches && stack.size() == top_level)
+                {
+                    if(!stack.back().abort_branch)
+                    {
+                        the_branches->push_back({the_stream, stack.back(), top_level});
+                    }
+                    skip_branch(the_stream);
+                }
+                else{ stack.push_back(stack.back()); }
+                continue;
+            }
+
+            // pop state
+            if(ch == ']')
+            {
+                if(stack.size() > 1){ stack.pop_back(); }
+                continue;
+            }
+            auto &state = stack.back();
 
+            // this branch should not continue growing -> move on with iteration
+            if(state.abort_branch){ continue; }
+
+            // the possible base values to apply, either predefined or from supplied parameter
+            vec3 branch_angle = m_lsystem->m_branch_angle;
+            float increment = m_lsystem->m_increment;
+            float diameter_shrink_factor = m_lsystem->m_diameter_shrink_factor;
+
+            // a custom parameter was provided
+            if(!std::isnan(optional_param))
+            {
+                branch_angle = vec3(optional_param);
+                increment = optional_param;
+                diameter_shrink_factor = optional_param;
+            }
+            const vec3 head(state.transform[0]), left(state.transform[1]), up(state.transform[2]);
+            vec3 angles;
+
+            switch(ch)
+            {
+                case '+': case '-': case '&': case '^': case '\\': case '/':
+                    angles = glm::radians(branch_angle + random(-m_lsystem->m_branch_randomness,
+                                                                m_lsystem->m_branch_randomness));
+                    break;
+
+                default:
+                    break;
+            }
+
+            switch(ch)
+            {
                 // rotate around 'up vector' ccw
-            case '+':
-                m_state_stack.back().transform = glm::rotate(m_state_stack.back().transform,
-                                                             current_branch_angles[2],
-                                                             up());
-                break;
+                case '+':
+                    state.transform = glm::rotate(state.transform, angles[2], up);
+                    break;
 
                 // rotate around 'up vector' cw
-            case '-':
-                m_state_stack.back().transform = glm::rotate(m_state_stack.back().transform,
-                                                             -current_branch_angles[2],
-                                                             up());
-                break;
+                case '-':
+                    state.transform = glm::rotate(state.transform, -angles[2], up);
+                    break;
 
                 // rotate around 'up vector' 180 deg
-            case '|':
-                m_state_stack.back().transform = glm::rotate(m_state_stack.back().transform,
-                                                             180.f,
-                                                             up());
-                break;
+                case '|':
+                    state.transform = glm::rotate(state.transform, 180.f, up);
+                    break;
 
                 // rotate around 'left vector' ccw
-            case '&':
-                m_state_stack.back().transform = glm::rotate(m_state_stack.back().transform,
-                                                             current_branch_angles[1],
-                                                             left());
-                break;
+                case '&':
+                    state.transform = glm::rotate(state.transform, angles[1], left);
+                    break;
 
                 // rotate around 'left vector' cw
-            case '^':
-                m_state_stack.back().transform = glm::rotate(m_state_stack.back().transform,
-                                                             -current_branch_angles[1],
-                                                             left());
-                break;
+                case '^':
+                    state.transform = glm::rotate(state.transform, -angles[1], left);
+                    break;
 
                 // rotate around 'head vector' ccw
-            case '\\':
-                m_state_stack.back().transform = glm::rotate(m_state_stack.back().transform,
-                                                             current_branch_angles[0],
-                                                             head());
-                break;
+                case '\\':
+                    state.transform = glm::rotate(state.transform, angles[0], head);
+                    break;
 
                 // rotate around 'head vector' cw
-            case '/':
-                m_state_stack.back().transform = glm::rotate(m_state_stack.back().transform,
-                                                             -current_branch_angles[0],
-                                                             head());
-                break;
+                case '/':
+                    state.transform = glm::rotate(state.transform, -angles[0], head);
+                    break;
 
                 // shrink diameter
-            case '!':
-                m_state_stack.back().diameter *= diameter_shrink_factor;
-                break;
+                case '!':
+                    state.diameter *= diameter_shrink_factor;
+                    break;
+
+                // stray parameter-delimiters
+                case '(':
+                case ')':
+                    break;
+
+                // all other symbols will insert a line segment in 'head direction'
+                default:
+                    grow(state, increment, static_cast<uint32_t>(stack.size() - 1));
+                    break;
+            }
+        }
+        return true;
+    }
 
-                // all other symbols will insert a line sequment in 'head direction'
-            default:
+    //! turtle state: transform -> (Head, Left, Up, Pos)
+    std::vector<turtle_state> stack;
 
-                // current branch depth
-                size_t current_branch_depth = m_state_stack.size();
+    std::vector<segment_t> segments;
 
-                // create seperate vectors for each branch_depth to store vertex infos
-                if(current_branch_depth > max_branch_depth)
-                {
-                    max_branch_depth = current_branch_depth;
-                    verts_vec.resize(max_branch_depth);
-                    normals_vec.resize(max_branch_depth);
-                    colors_vec.resize(max_branch_depth);
-                    indices_vec.resize(max_branch_depth);
-                    point_sizes_vec.resize(max_branch_depth);
-                    index_increments.resize(max_branch_depth, 0);
-                }
+private:
+
+    //! try to grow a segment in 'head direction', abort the branch if no valid position is found
+    void grow(turtle_state &the_state, float the_increment, uint32_t the_depth)
+    {
+        const auto &ls = *m_lsystem;
+        const vec3 current_pos(the_state.transform[3]), current_normal(the_state.transform[2]);
+        vec3 new_pos, grow_dir(the_state.transform[0]);
 
-                // try to grow in head direction
-                vec3 grow_dir = head();
+        float current_increment = the_increment + random(-ls.m_increment_randomness, ls.m_increment_randomness);
 
-                // number of tries to grow in this direction
-                uint32_t num_grow_tries = 0;
+        // number of tries to grow in this direction
+        uint32_t num_grow_tries = 0;
+        bool valid;
 
-                //geometry check here
-                while(true)
-                {
-                    new_pos = current_pos + grow_dir * current_increment;
-                    num_grow_tries++;
+        //geometry check here
+        while(true)
+        {
+            new_pos = current_pos + grow_dir * current_increment;
+            num_grow_tries++;
+            valid = ls.is_position_valid(new_pos);
+
+            // exit condition
+            if(valid || num_grow_tries >= ls.m_max_random_tries){ break; }
+
+            // our current increment
+            current_increment = the_increment + random(-ls.m_increment_randomness, ls.m_increment_randomness);
 
-                    // exit condition
-                    if(is_position_valid(new_pos) || num_grow_tries >= m_max_random_tries)
-                        break;
+            // random direction
+            grow_dir = random_direction();
+        }
 
-                    // get new random vals
-                    // our current branch angles
-                    current_branch_angles = branch_angle + glm::linearRand(-m_branch_randomness,
-                                                                           m_branch_randomness);
+        // no way to grow from this point
+        if(!valid)
+        {
+            the_state.abort_branch = true;
+            LOG_DEBUG << "aborting branch";
+            return;
+        }
+        segments.push_back({current_pos, new_pos, current_normal, the_state.diameter, the_depth});
 
+        // re-insert position
+        the_state.transform[3] = vec4(new_pos, 1.f);
+    }
 
-                    // our current increment
-                    current_increment = increment + crocore::random(-m_increment_randomness,
-                                                                    m_increment_randomness);
+    //! consume symbols up to and including the closing ']' of the current branch
+    static void skip_branch(SymbolStream &the_stream)
+    {
+        for(uint32_t depth = 1; depth;)
+        {
+            char ch = the_stream.next();
+            if(!ch){ break; }
+            the_stream.parameter();
 
-                    // random direction
-                    grow_dir = glm::sphericalRand(1.f);
+            if(ch == '['){ depth++; }
+            else if(ch == ']'){ depth--; }
+        }
+    }
 
-                    // rotate around 'up vector' 180 deg
-//                    m_state_stack.back().transform = glm::rotate(m_state_stack.back().transform,
-//                                                                 current_branch_angles[2],
-//                                                                 up());
-                }
+    float random(float the_min, float the_max)
+    {
+        return the_min + (the_max - the_min) * m_unit_distribution(m_rng);
+    }
 
+    vec3 random(const vec3 &the_min, const vec3 &the_max)
+    {
+        return vec3(random(the_min.x, the_max.x), random(the_min.y, the_max.y), random(the_min.z, the_max.z));
+    }
 
-                // no way to grow from this point
-                if(num_grow_tries >= m_max_random_tries)
-                {
-                    // TODO: come up with something useful here
+    vec3 random_direction()
+    {
+        vec3 ret(m_normal_distribution(m_rng), m_normal_distribution(m_rng), m_normal_distribution(m_rng));
+        float len = glm::length(ret);
+        return len > 0.f ? ret / len : vec3(0, 0, 1);
+    }
 
-                    m_state_stack.back().abort_branch = true;
-                    LOG_DEBUG << "aborting branch";
-                    continue;
+    const LSystem *m_lsystem;
 
-                }
+    //! per turtle, shared generators are not thread-safe
+    std::mt19937 m_rng;
+    std::uniform_real_distribution<float> m_unit_distribution{0.f, 1.f};
+    std::normal_distribution<float> m_normal_distribution;
+};
 
-                if(!use_mesh_entries)
-                {
-                    points.push_back(current_pos);
-                    points.push_back(new_pos);
-                    normals.push_back(current_normal);
-                    normals.push_back(current_normal);
-                    colors.push_back(current_color);
-                    colors.push_back(current_color);
-                    point_sizes.push_back(m_state_stack.back().diameter);
-                    point_sizes.push_back(m_state_stack.back().diameter);
-                    indices.push_back(i++);
-                    indices.push_back(i++);
-                }
-                    // seperate entries implementation
-                else
+///////////////////////////////////////////////////////////////////////////////
+
+void LSystem::iterate(int num_iterations)
+{
+    m_iteration_depth = std::max(num_iterations, 0);
+    m_compiled_axiom = m_axiom;
+    m_rule_bodies.clear();
+    m_rule_index.fill(-1);
+
+    for(const auto &rule : m_rules)
+    {
+        m_rule_index[static_cast<unsigned char>(rule.first)] = m_rule_bodies.size();
+        m_rule_bodies.push_back(rule.second);
+    }
+
+    // number of segment-symbols each symbol expands to, level by level
+    std::array<uint64_t, 256> num_segments, next_num_segments;
+    for(uint32_t c = 0; c < 256; ++c){ num_segments[c] = is_segment_symbol(c); }
+
+    for(uint32_t i = 0; i < m_iteration_depth; ++i)
+    {
+        next_num_segments = num_segments;
+
+        for(const auto &rule : m_rules)
+        {
+            uint64_t sum = 0;
+            for(unsigned char c : rule.second){ sum = std::min(sum + num_segments[c], uint64_t(1) << 48); }
+            next_num_segments[static_cast<unsigned char>(rule.first)] = sum;
+        }
+        num_segments = next_num_segments;
+    }
+    m_max_num_segments = 0;
+
+    for(unsigned char c : m_compiled_axiom)
+    {
+        m_max_num_segments = std::min(m_max_num_segments + num_segments[c], uint64_t(1) << 48);
+    }
+    LOG_DEBUG << "max. number of segments: " << m_max_num_segments;
+
+    // reset stack
+    m_state_stack = {{glm::mat4(1), false, m_diameter}};
+}
+
+/*!
+ 
+ + Turn left by angle δ, using rotation matrix RU(δ).
+ − Turn right by angle δ, using rotation matrix RU(−δ).
+ & Pitch down by angle δ, using rotation matrix RL(δ).
+ ∧ Pitch up by angle δ, using rotation matrix RL(−δ).
+ \ Roll left by angle δ, using rotation matrix RH(δ).
+ / Roll right by angle δ, using rotation matrix RH(−δ).
+ | Turn around, using rotation matrix RU (180◦ ).
+ 
+*/
+gl::MeshPtr LSystem::create_mesh(crocore::ThreadPool *the_pool) const
+{
+    m_cancel_requested = false;
+
+    SymbolStream stream(this);
+    Turtle trunk(this);
+    trunk.stack = m_state_stack;
+
+    // with a pool, the trunk only records its top-level branches
+    std::vector<Turtle::branch_t> branches;
+    if(!the_pool){ trunk.segments.reserve(std::min(m_max_num_segments, g_max_reserved_segments)); }
+
+    if(!trunk.run(stream, 0, the_pool ? &branches : nullptr))
+    {
+        LOG_DEBUG << "cancel requested ...";
+        return gl::MeshPtr();
+    }
+
+    // segments per top-level branch, in order of appearance
+    std::vector<std::vector<segment_t>> branch_segments;
+
+    if(!branches.empty())
+    {
+        //! the job owns its data, tasks starting late must not touch anything before claiming a branch
+        struct branch_job_t
+        {
+            const LSystem *lsystem = nullptr;
+            std::vector<Turtle::branch_t> branches;
+            std::vector<std::vector<segment_t>> segments;
+            uint32_t num_branches = 0;
+            std::atomic<uint32_t> next_branch{0}, num_done{0};
+            std::mutex mutex;
+            std::condition_variable condition;
+        };
+
+        //! claim and interpret branches until none are left
+        auto process = [](const std::shared_ptr<branch_job_t> &the_job)
+        {
+            const uint32_t num_branches = the_job->num_branches;
+            Turtle turtle(the_job->lsystem);
+            uint32_t i;
+
+            while((i = the_job->next_branch++) < num_branches)
+            {
+                auto &branch = the_job->branches[i];
+                turtle.stack.assign(branch.depth + 1, branch.state);
+                turtle.segments.clear();
+                turtle.run(branch.stream, branch.depth);
+                the_job->segments[i] = std::move(turtle.segments);
+
+                if(++the_job->num_done == num_branches)
                 {
-                    int idx = current_branch_depth - 1;
-                    verts_vec[idx].push_back(current_pos);
-                    verts_vec[idx].push_back(new_pos);
-                    normals_vec[idx].push_back(current_normal);
-                    normals_vec[idx].push_back(current_normal);
-                    colors_vec[idx].push_back(current_color);
-                    colors_vec[idx].push_back(current_color);
-                    point_sizes_vec[idx].push_back(m_state_stack.back().diameter);
-                    point_sizes_vec[idx].push_back(m_state_stack.back().diameter);
-                    indices_vec[idx].push_back(index_increments[idx]++);
-                    indices_vec[idx].push_back(index_increments[idx]++);
+                    std::unique_lock<std::mutex> lock(the_job->mutex);
+                    the_job->condition.notify_all();
                 }
-                break;
+            }
+        };
+
+        const uint32_t num_branches = branches.size();
+        auto job = std::make_shared<branch_job_t>();
+        job->lsystem = this;
+        job->branches = std::move(branches);
+        job->segments.resize(num_branches);
+        job->num_branches = num_branches;
+
+        if(num_branches > 1)
+        {
+            uint32_t num_tasks = std::min<uint32_t>(the_pool->num_threads(), num_branches - 1);
+            for(uint32_t i = 0; i < num_tasks; ++i){ the_pool->post([job, process](){ process(job); }); }
         }
-        // re-insert position
-        m_state_stack.back().transform[3] = vec4(new_pos, 1.f);
+        process(job);
+
+        {
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->condition.wait(lock, [&job, num_branches](){ return job->num_done == num_branches; });
+        }
+        branch_segments = std::move(job->segments);
     }
 
-    // merge together all sub entries
-    if(use_mesh_entries)
+    if(m_cancel_requested)
     {
-        uint32_t current_index = 0, current_vertex = 0, material_index = 0;
-        std::vector<gl::Mesh::Entry> entries;
-        std::vector<gl::MaterialPtr> materials;
+        LOG_DEBUG << "cancel requested ...";
+        return gl::MeshPtr();
+    }
+    m_state_stack = trunk.stack;
 
-        gl::GeometryPtr merged_geom = gl::Geometry::create();
+    // number of segments per branch-depth
+    std::vector<uint32_t> num_segments;
 
-        for(uint32_t i = 0; i < max_branch_depth; i++)
+    auto count = [&num_segments](const std::vector<segment_t> &the_segments)
+    {
+        for(const auto &s : the_segments)
         {
-            // merge vertices
-            merged_geom->vertices().insert(merged_geom->vertices().end(),
-                                           verts_vec[i].begin(),
-                                           verts_vec[i].end());
-
-            // merge normals
-            merged_geom->normals().insert(merged_geom->normals().end(),
-                                          normals_vec[i].begin(),
-                                          normals_vec[i].end());
-
-            // merge colors
-            merged_geom->colors().insert(merged_geom->colors().end(),
-                                         colors_vec[i].begin(),
-                                         colors_vec[i].end());
-
-            // merge indices
-            merged_geom->indices().insert(merged_geom->indices().end(),
-                                          indices_vec[i].begin(),
-                                          indices_vec[i].end());
-
-            // merge point sizes (aka diameters)
-            merged_geom->point_sizes().insert(merged_geom->point_sizes().end(),
-                                              point_sizes_vec[i].begin(),
-                                              point_sizes_vec[i].end());
-
-            gl::Mesh::Entry m;
-            m.num_vertices = verts_vec[i].size();
-            m.num_indices = indices_vec[i].size();
-            m.base_index = current_index;
-            m.base_vertex = current_vertex;
-            m.material_index = material_index;
-            entries.push_back(m);
-            current_vertex += verts_vec[i].size();
-            current_index += indices_vec[i].size();
-            material_index++;
-            materials.push_back(gl::Material::create());
+            if(s.depth >= num_segments.size()){ num_segments.resize(s.depth + 1, 0); }
+            num_segments[s.depth]++;
         }
-        ret->geometry() = merged_geom;
-        ret->entries() = entries;
-        ret->materials() = materials;
-    }else
+    };
+    count(trunk.segments);
+    for(const auto &segments : branch_segments){ count(segments); }
+
+    // use subgeometries for different branch depths
+    std::vector<gl::Mesh::Entry> entries(num_segments.size());
+    std::vector<gl::MaterialPtr> materials(num_segments.size());
+    std::vector<uint32_t> num_written(num_segments.size(), 0);
+    uint32_t num_vertices = 0;
+
+    for(uint32_t i = 0; i < num_segments.size(); i++)
     {
-        ret->entries().front().num_vertices = ret->geometry()->vertices().size();
-        ret->entries().front().num_indices = ret->geometry()->indices().size();
+        auto &e = entries[i];
+        e.num_vertices = e.num_indices = 2 * num_segments[i];
+        e.base_vertex = e.base_index = num_vertices;
+        e.material_index = i;
+        materials[i] = gl::Material::create();
+        num_vertices += e.num_vertices;
     }
+
+    // our output geometry, written in place
+    auto geom = gl::Geometry::create();
+    auto &points = geom->vertices();
+    auto &normals = geom->normals();
+    auto &colors = geom->colors();
+    auto &indices = geom->indices();
+    auto &point_sizes = geom->point_sizes();
+    points.resize(num_vertices);
+    normals.resize(num_vertices);
+    colors.assign(num_vertices, gl::COLOR_WHITE);
+    indices.resize(num_vertices);
+    point_sizes.resize(num_vertices);
+
+    auto write = [&](const std::vector<segment_t> &the_segments)
+    {
+        for(const auto &s : the_segments)
+        {
+            uint32_t local_index = 2 * num_written[s.depth]++;
+            uint32_t v = entries[s.depth].base_vertex + local_index;
+            points[v] = s.start;
+            points[v + 1] = s.end;
+            normals[v] = normals[v + 1] = s.normal;
+            point_sizes[v] = point_sizes[v + 1] = s.diameter;
+            indices[v] = local_index;
+            indices[v + 1] = local_index + 1;
+        }
+    };
+    write(trunk.segments);
+    for(const auto &segments : branch_segments){ write(segments); }
+
+    gl::MeshPtr ret = gl::Mesh::create(geom, gl::Material::create());
+    ret->entries() = entries;
+    ret->materials() = materials;
     ret->geometry()->set_primitive_type(GL_LINES);
     ret->geometry()->compute_aabb();
     return ret;
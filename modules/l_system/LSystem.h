@@ -9,6 +9,7 @@
 #pragma once
 
 #include "gl/gl.hpp"
+#include <array>
 #include <unordered_map>
 #include <atomic>
 
@@ -23,11 +24,16 @@ namespace kinski
         
         LSystem();
         
-        //! repeatedly apply rules and generate a string
+        /*! set the number of rule-applications and compile axiom and rules.
+         *  the derivation is not materialised, symbols are expanded lazily by create_mesh()
+         */
         void iterate(int num_iterations);
         
-        //! generate a gl::Mesh object from current string
-        gl::MeshPtr create_mesh() const;
+        /*! generate a gl::Mesh object by walking the derivation depth-first.
+         *  if the_pool is provided, top-level branches are interpreted concurrently,
+         *  an assigned PositionCheckFunctor then needs to be thread-safe
+         */
+        gl::MeshPtr create_mesh(crocore::ThreadPool *the_pool = nullptr) const;
 
         //! cancel currently running calculations
         void cancel();
@@ -85,9 +91,19 @@ namespace kinski
             float diameter;
         };
         
-        std::string m_axiom, m_buffer;
+        std::string m_axiom;
         std::unordered_map<char, std::string> m_rules;
         
+        //! axiom and rules, as compiled by iterate()
+        std::string m_compiled_axiom;
+        std::vector<std::string> m_rule_bodies;
+        
+        //! index into m_rule_bodies for each symbol, -1 if there is no rule
+        std::array<int32_t, 256> m_rule_index;
+        
+        //! upper bound for the number of line-segments, used to reserve memory
+        uint64_t m_max_num_segments = 0;
+        
         //! euler angles, in degrees, to apply when rotating (Head, Left, Up)
         glm::vec3 m_branch_angle;
         
@@ -122,11 +138,11 @@ namespace kinski
          */
         PositionCheckFunctor m_position_check;
         
-        // convenience getters for current turtle orientation
-        const glm::vec3& head() const;
-        const glm::vec3& left() const;
-        const glm::vec3& up() const;
-        const glm::vec3& position() const;
+        //! lazy, depth-first expansion of the compiled axiom
+        class SymbolStream;
+        
+        //! interprets symbols from a SymbolStream and records line-segments
+        class Turtle;
         
         /*! perform a validity check for a new position
          *  if no functor is defined the check will always succeed
@@ -0,0 +1,133 @@
+//  See http://www.boost.org/libs/test for the library home page.
+
+// Boost.Test
+
+// each test module could contain no more then one 'main' file with init function defined
+// alternatively you could define init function yourself
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <crocore/ThreadPool.hpp>
+#include "gl/Mesh.hpp"
+#include "LSystem.h"
+
+using namespace kinski;
+//____________________________________________________________________________//
+
+namespace
+{
+    // reference, materialising the full production string
+    std::string expand_linear(const LSystem &the_lsystem, int the_num_iterations)
+    {
+        std::string ret = the_lsystem.axiom();
+
+        for(int i = 0; i < the_num_iterations; ++i)
+        {
+            std::string next;
+
+            for(char c : ret)
+            {
+                auto it = the_lsystem.rules().find(c);
+                next += it != the_lsystem.rules().end() ? it->second : std::string(1, c);
+            }
+            ret = std::move(next);
+        }
+        return ret;
+    }
+
+    // deterministic, with nested branches and parameter-blocks
+    void setup(LSystem &the_lsystem)
+    {
+        the_lsystem.set_axiom("F[&(30)G]-F");
+        the_lsystem.add_rule("F = F[+F(0.5)[-G]]F[-(25)!(0.7)F]&F");
+        the_lsystem.add_rule("G = G[^F]\\(15)G");
+        the_lsystem.set_branch_angles(glm::vec3(22.5f));
+        the_lsystem.set_branch_randomness(glm::vec3(0.f));
+        the_lsystem.set_increment_randomness(0.f);
+        the_lsystem.set_diameter_shrink_factor(0.9f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_LSystem_segments )
+{
+    LSystem ls;
+    ls.set_axiom("FF[+F]F");
+    ls.set_increment(2.f);
+    ls.iterate(0);
+
+    auto mesh = ls.create_mesh();
+    BOOST_REQUIRE(mesh);
+
+    // one entry per branch-depth, the trunk grows along the head-axis
+    BOOST_REQUIRE(mesh->entries().size() == 2);
+    BOOST_CHECK(mesh->entries()[0].num_vertices == 6);
+    BOOST_CHECK(mesh->entries()[1].num_vertices == 2);
+
+    const auto &verts = mesh->geometry()->vertices();
+    BOOST_CHECK(verts[0] == glm::vec3(0));
+    BOOST_CHECK(verts[5] == glm::vec3(6, 0, 0));
+
+    // branch starts where it was pushed
+    BOOST_CHECK(verts[6] == glm::vec3(4, 0, 0));
+}
+
+BOOST_AUTO_TEST_CASE( test_LSystem_serial_vs_pooled )
+{
+    LSystem ls;
+    setup(ls);
+    crocore::ThreadPool pool(4);
+
+    for(int num_iterations = 0; num_iterations < 5; ++num_iterations)
+    {
+        // every non-command symbol of the derivation grows one segment
+        auto production = expand_linear(ls, num_iterations);
+        uint32_t num_segments = std::count(production.begin(), production.end(), 'F') +
+                                std::count(production.begin(), production.end(), 'G');
+
+        // iterate() resets the turtle, create_mesh() continues where the last run ended
+        ls.iterate(num_iterations);
+        auto serial_mesh = ls.create_mesh();
+        ls.iterate(num_iterations);
+        auto pooled_mesh = ls.create_mesh(&pool);
+        BOOST_REQUIRE(serial_mesh && pooled_mesh);
+
+        const auto &serial_verts = serial_mesh->geometry()->vertices();
+        const auto &pooled_verts = pooled_mesh->geometry()->vertices();
+        BOOST_CHECK(serial_verts.size() == 2 * num_segments);
+        BOOST_REQUIRE(pooled_verts.size() == serial_verts.size());
+
+        BOOST_REQUIRE(serial_mesh->entries().size() == pooled_mesh->entries().size());
+
+        for(uint32_t i = 0; i < serial_mesh->entries().size(); ++i)
+        {
+            BOOST_CHECK(serial_mesh->entries()[i].base_vertex == pooled_mesh->entries()[i].base_vertex);
+            BOOST_CHECK(serial_mesh->entries()[i].num_vertices == pooled_mesh->entries()[i].num_vertices);
+        }
+        BOOST_CHECK(serial_verts == pooled_verts);
+        BOOST_CHECK(serial_mesh->geometry()->point_sizes() == pooled_mesh->geometry()->point_sizes());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_LSystem_cancel )
+{
+    LSystem ls;
+    setup(ls);
+    ls.iterate(5);
+    crocore::ThreadPool pool(4);
+
+    // cancel from within the interpretation, the position-check runs on pool-threads as well
+    std::atomic<uint32_t> num_checks{0};
+    ls.set_position_check([&ls, &num_checks](const glm::vec3 &)
+    {
+        if(++num_checks == 100){ ls.cancel(); }
+        return true;
+    });
+    BOOST_CHECK(!ls.create_mesh());
+
+    num_checks = 0;
+    BOOST_CHECK(!ls.create_mesh(&pool));
+
+    // a new run is not affected by an earlier cancel
+    ls.set_position_check(LSystem::PositionCheckFunctor());
+    BOOST_CHECK(ls.create_mesh(&pool));
+}
@@ -17,6 +17,14 @@ public:
     enum class RenderTarget{SCREEN, TEXTURE};
     enum class AudioTarget{AUTO, HDMI, AUDIO_JACK, BOTH};
 
+    /*!
+     * memory-layout of decoded frames.
+     * AUTO: frames are uploaded and converted by the decoder-backend (e.g. as GL-memory), where supported.
+     * RGBA, I420: frames in system-memory, streamed to textures via pixel-buffers.
+     * I420 frames are converted to RGB in a shader, which avoids a CPU color-conversion and reduces upload-size.
+     */
+    enum class FrameFormat{AUTO, RGBA, I420};
+
     typedef std::function<void(MediaControllerPtr the_movie)> callback_t;
 
     static MediaControllerPtr create();
@@ -55,6 +63,10 @@ public:
     RenderTarget render_target() const;
     AudioTarget audio_target() const;
 
+    //! the current FrameFormat. changing it will reload the current media
+    FrameFormat frame_format() const;
+    void set_frame_format(FrameFormat the_format);
+
     void set_on_load_callback(callback_t c);
     void set_media_ended_callback(callback_t c);
 
@@ -84,7 +96,8 @@ public:
     bool copy_frame_to_image(crocore::ImagePtr& the_image);
 
     /*!
-     * upload all frames to a gl::Texture object with target GL_TEXTURE_2D_ARRAY
+     * upload all frames to a gl::Texture object with target GL_TEXTURE_2D_ARRAY.
+     * frames are uploaded while decoding, the texture's depth equals the number of frames afterwards
      * @return true if all frames have been uploaded successfully,
      * false otherwise
      */
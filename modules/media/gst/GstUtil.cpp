@@ -11,8 +11,9 @@ std::weak_ptr<std::thread> GstUtil::s_thread;
 std::weak_ptr<GstGLDisplay> GstUtil::s_gst_gl_display;
 const int GstUtil::s_enable_async_state_change = true;
 
-GstUtil::GstUtil(bool use_gl):
+GstUtil::GstUtil(bool use_gl, const std::string &the_raw_format):
 m_use_gl(use_gl),
+m_raw_format(the_raw_format),
 m_num_video_channels(0),
 m_num_audio_channels(0),
 m_has_subtitle(false),
@@ -160,7 +161,7 @@ void GstUtil::use_pipeline(GstElement *the_pipeline, GstElement *the_appsink)
         gst_base_sink_set_max_lateness(GST_BASE_SINK(m_app_sink), 20 * GST_MSECOND);
 
         std::string caps_descr = "video/x-raw(memory:GLMemory), format=RGBA";
-        if(!m_use_gl){ caps_descr = "video/x-raw, format=RGBA"; }
+        if(!m_use_gl){ caps_descr = "video/x-raw, format=" + m_raw_format; }
         GstCaps* caps = gst_caps_from_string(caps_descr.c_str());
         gst_app_sink_set_caps(GST_APP_SINK(m_app_sink), caps);
         gst_caps_unref(caps);
@@ -51,7 +51,11 @@ namespace kinski{ namespace media{
 class GstUtil
 {
 public:
-    GstUtil(bool use_gl);
+    /*!
+     * @param use_gl deliver frames as GL-memory (gstreamer's own upload and color-conversion)
+     * @param the_raw_format video-format requested from the appsink, if use_gl is false (e.g. "RGBA", "I420")
+     */
+    GstUtil(bool use_gl, const std::string &the_raw_format = "RGBA");
     ~GstUtil();
 
     bool set_pipeline_state(GstState the_target_state);
@@ -96,6 +100,7 @@ private:
     static const int s_enable_async_state_change;
 
     bool m_use_gl;
+    std::string m_raw_format;
     std::atomic<uint32_t> m_num_video_channels;
     std::atomic<uint32_t> m_num_audio_channels;
     std::atomic<bool> m_has_subtitle;
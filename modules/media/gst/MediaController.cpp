@@ -1,8 +1,9 @@
-#include <deque>
-
 #include "GstUtil.h"
 #include "gl/Texture.hpp"
 #include "gl/Buffer.hpp"
+#include "gl/Fbo.hpp"
+#include "gl/Material.hpp"
+#include "gl/Shader.hpp"
 #include "MediaController.hpp"
 
 #include <gst/net/gstnet.h>
@@ -10,6 +11,122 @@
 namespace kinski{ namespace media
 {
 
+namespace
+{
+#if defined(KINSKI_GLES)
+const char *g_glsl_version = "#version 300 es\nprecision mediump float;\n";
+#else
+const char *g_glsl_version = "#version 410 core\n";
+#endif
+
+const char *g_yuv_vert = R"(
+struct matrix_struct_t
+{
+    mat4 model_view;
+    mat4 model_view_projection;
+    mat4 texture_matrix;
+    mat3 normal_matrix;
+};
+
+layout(std140) uniform MatrixBlock
+{
+    matrix_struct_t ubo;
+};
+
+layout(location = 0) in vec4 a_vertex;
+layout(location = 2) in vec4 a_texCoord;
+
+out vec2 v_texCoord;
+
+void main()
+{
+    v_texCoord = (ubo.texture_matrix * a_texCoord).xy;
+    gl_Position = ubo.model_view_projection * a_vertex;
+}
+)";
+
+const char *g_yuv_frag = R"(
+uniform sampler2D u_sampler_2D[3];
+uniform mat3 u_yuv_matrix;
+uniform vec3 u_yuv_offset;
+
+in vec2 v_texCoord;
+
+out vec4 fragData;
+
+void main()
+{
+    vec3 yuv = vec3(texture(u_sampler_2D[0], v_texCoord).r, texture(u_sampler_2D[1], v_texCoord).r,
+                    texture(u_sampler_2D[2], v_texCoord).r);
+    fragData = vec4(u_yuv_matrix * (yuv - u_yuv_offset), 1.0);
+}
+)";
+
+//! Y'CbCr -> RGB conversion for the colorimetry in the_info, applied as: rgb = matrix * (yuv - offset)
+void yuv_conversion(const GstVideoInfo &the_info, gl::mat3 &out_matrix, gl::vec3 &out_offset)
+{
+    gdouble kr, kb;
+    if(!gst_video_color_matrix_get_Kr_Kb(the_info.colorimetry.matrix, &kr, &kb)){ kr = 0.299; kb = 0.114; }
+    float kg = 1.f - kr - kb;
+
+    // limited range (16-235 / 16-240) unless stated otherwise
+    bool full_range = the_info.colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255;
+    float y_scale = full_range ? 1.f : 255.f / 219.f, c_scale = full_range ? 1.f : 255.f / 224.f;
+    out_offset = gl::vec3(full_range ? 0.f : 16.f / 255.f, 128.f / 255.f, 128.f / 255.f);
+    out_matrix = gl::mat3(gl::vec3(y_scale),
+                          c_scale * gl::vec3(0.f, -2.f * (1.f - kb) * kb / kg, 2.f * (1.f - kb)),
+                          c_scale * gl::vec3(2.f * (1.f - kr), -2.f * (1.f - kr) * kr / kg, 0.f));
+}
+
+#if !defined(KINSKI_GLES)
+//! reallocate the GL_TEXTURE_2D_ARRAY the_texture with the_depth layers, preserving existing layers
+bool resize_array_texture(gl::Texture &the_texture, uint32_t the_depth)
+{
+    static bool has_copy_image = gl::is_extension_supported("GL_ARB_copy_image");
+
+    gl::Texture::Format fmt;
+    fmt.target = GL_TEXTURE_2D_ARRAY;
+    fmt.internal_format = the_texture.internal_format();
+
+    if(!has_copy_image && fmt.internal_format != GL_RGBA)
+    {
+        LOG_WARNING << "resizing compressed array-textures requires GL_ARB_copy_image";
+        return false;
+    }
+    gl::Texture ret(the_texture.width(), the_texture.height(), the_depth, fmt);
+    ret.set_flipped(the_texture.flipped());
+    uint32_t num_layers = std::min(the_depth, the_texture.depth());
+
+    if(has_copy_image)
+    {
+        glCopyImageSubData(the_texture.id(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, ret.id(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+                           ret.width(), ret.height(), num_layers);
+    }
+    else
+    {
+        // copy layer by layer, attached to a temporary framebuffer
+        gl::SaveFramebufferBinding sfb;
+        GLuint fbo_id = 0;
+        glGenFramebuffers(1, &fbo_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_id);
+        ret.bind();
+
+        for(uint32_t i = 0; i < num_layers; ++i)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, the_texture.id(), 0, i);
+            glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, 0, 0, ret.width(), ret.height());
+        }
+        glDeleteFramebuffers(1, &fbo_id);
+    }
+    KINSKI_CHECK_GL_ERRORS();
+    the_texture = ret;
+    return true;
+}
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 struct MediaControllerImpl
 {
     std::string m_src_path;
@@ -38,8 +155,22 @@ struct MediaControllerImpl
 
     MediaController::RenderTarget m_render_target = MediaController::RenderTarget::TEXTURE;
     MediaController::AudioTarget m_audio_target = MediaController::AudioTarget::AUTO;
+    MediaController::FrameFormat m_frame_format = MediaController::FrameFormat::AUTO;
 
-    MediaControllerImpl():
+    // ring of pixel-unpack buffers, frames in system-memory are copied here directly from the mapped GstBuffer
+    gl::RingBuffer m_pixel_buffer;
+
+    // one texture per plane (RGBA or Y, U, V)
+    gl::Texture m_planes[3];
+
+    // YUV -> RGB conversion
+    gl::FboPtr m_yuv_fbo;
+    gl::MaterialPtr m_yuv_material;
+
+    using plane_upload_fn_t = std::function<void(uint32_t the_plane, uint32_t the_width, uint32_t the_height,
+                                                 GLenum the_format, const void *the_data)>;
+
+    MediaControllerImpl(MediaController::FrameFormat the_format = MediaController::FrameFormat::AUTO):
     m_rate(1.f),
     m_volume(1.f),
     m_seeking(false),
@@ -48,9 +179,11 @@ struct MediaControllerImpl
     m_seek_requested_nanos(0),
     m_stream(false),
     m_loop(false),
-    m_gst_util(true),
+    m_gst_util(the_format == MediaController::FrameFormat::AUTO,
+               the_format == MediaController::FrameFormat::I420 ? "I420" : "RGBA"),
     m_video_sink(nullptr),
-    m_net_time_provider(nullptr, &g_object_unref)
+    m_net_time_provider(nullptr, &g_object_unref),
+    m_frame_format(the_format)
     {
         init_callbacks();
     }
@@ -157,6 +290,191 @@ struct MediaControllerImpl
         }
         return position;
     }
+
+    /*!
+     * map the frame in the_buffer (system-memory), stage its planes in our pixel-buffers
+     * and issue the_upload_fn for each plane, while the pixel-buffer is bound as GL_PIXEL_UNPACK_BUFFER.
+     * the_data is an offset into the pixel-buffer then (or a pointer to mapped memory, if pixel-buffers are unavailable)
+     */
+    bool upload_planes(GstBuffer *the_buffer, const plane_upload_fn_t &the_upload_fn)
+    {
+        GstVideoInfo info = m_gst_util.video_info();
+        GstVideoFrame frame;
+
+        if(!gst_video_frame_map(&frame, &info, the_buffer, GST_MAP_READ))
+        {
+            LOG_WARNING << "could not map video-frame";
+            return false;
+        }
+        const uint32_t num_planes = std::min<uint32_t>(GST_VIDEO_FRAME_N_PLANES(&frame), 3);
+        GLenum data_format = GL_RGBA;
+#if !defined(KINSKI_GLES_2)
+        if(GST_VIDEO_INFO_IS_YUV(&info)){ data_format = GL_RED; }
+#endif
+        const void *plane_data[3] = {};
+        constexpr size_t alignment = 16;
+
+#if !defined(KINSKI_GLES_2)
+        size_t num_bytes = 0;
+
+        for(uint32_t p = 0; p < num_planes; ++p)
+        {
+            num_bytes += GST_VIDEO_FRAME_PLANE_STRIDE(&frame, p) * GST_VIDEO_FRAME_COMP_HEIGHT(&frame, p) + alignment;
+        }
+
+        if(!m_pixel_buffer || m_pixel_buffer.segment_size() < num_bytes)
+        {
+            m_pixel_buffer = gl::RingBuffer(GL_PIXEL_UNPACK_BUFFER, num_bytes, 3);
+        }
+        m_pixel_buffer.begin_segment();
+
+        for(uint32_t p = 0; p < num_planes; ++p)
+        {
+            size_t plane_size = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, p) * GST_VIDEO_FRAME_COMP_HEIGHT(&frame, p);
+            int64_t offset = m_pixel_buffer.push(GST_VIDEO_FRAME_PLANE_DATA(&frame, p), plane_size, alignment);
+            plane_data[p] = BUFFER_OFFSET(offset);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixel_buffer.id());
+#else
+        for(uint32_t p = 0; p < num_planes; ++p){ plane_data[p] = GST_VIDEO_FRAME_PLANE_DATA(&frame, p); }
+#endif
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        for(uint32_t p = 0; p < num_planes; ++p)
+        {
+#if !defined(KINSKI_GLES_2)
+            glPixelStorei(GL_UNPACK_ROW_LENGTH,
+                          GST_VIDEO_FRAME_PLANE_STRIDE(&frame, p) / GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, p));
+#endif
+            the_upload_fn(p, GST_VIDEO_FRAME_COMP_WIDTH(&frame, p), GST_VIDEO_FRAME_COMP_HEIGHT(&frame, p),
+                          data_format, plane_data[p]);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+#if !defined(KINSKI_GLES_2)
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_pixel_buffer.end_segment();
+#endif
+        gst_video_frame_unmap(&frame);
+        KINSKI_CHECK_GL_ERRORS();
+        return true;
+    }
+
+    /*!
+     * upload a frame in system-memory to m_planes.
+     * YUV-frames are converted to RGB into m_yuv_fbo.
+     * @return the texture holding the RGB(A)-frame, or an empty texture on failure
+     */
+    gl::Texture upload_frame(GstBuffer *the_buffer)
+    {
+        const GstVideoInfo &info = m_gst_util.video_info();
+        const bool is_yuv = GST_VIDEO_INFO_IS_YUV(&info);
+
+        // plane-textures need to be created before a pixel-buffer is bound
+        for(uint32_t p = 0; p < std::min<uint32_t>(GST_VIDEO_INFO_N_PLANES(&info), 3); ++p)
+        {
+            uint32_t w = GST_VIDEO_INFO_COMP_WIDTH(&info, p), h = GST_VIDEO_INFO_COMP_HEIGHT(&info, p);
+
+            if(m_planes[p].width() != w || m_planes[p].height() != h)
+            {
+                gl::Texture::Format fmt;
+                fmt.wrap_s = fmt.wrap_t = GL_CLAMP_TO_EDGE;
+                GLenum data_format = GL_RGBA;
+#if !defined(KINSKI_GLES_2)
+                if(is_yuv){ fmt.internal_format = GL_R8; data_format = GL_RED; }
+#endif
+                m_planes[p] = gl::Texture(nullptr, data_format, w, h, fmt);
+                m_planes[p].set_flipped(!is_yuv);
+            }
+        }
+
+        bool success = upload_planes(the_buffer, [this](uint32_t the_plane, uint32_t the_width, uint32_t the_height,
+                                                        GLenum the_format, const void *the_data)
+        {
+            m_planes[the_plane].bind();
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, the_width, the_height, the_format, GL_UNSIGNED_BYTE, the_data);
+        });
+
+        if(!success){ return gl::Texture(); }
+        return is_yuv ? convert_yuv(info) : m_planes[0];
+    }
+
+    //! render the Y, U, V planes into m_yuv_fbo, converting to RGB
+    gl::Texture convert_yuv(const GstVideoInfo &the_info)
+    {
+        if(!m_yuv_material)
+        {
+            std::string version = g_glsl_version;
+            m_yuv_material = gl::Material::create(gl::Shader::create(version + g_yuv_vert, version + g_yuv_frag));
+            m_yuv_material->set_depth_test(false);
+            m_yuv_material->set_depth_write(false);
+            m_yuv_material->set_blending(false);
+        }
+        gl::mat3 yuv_matrix;
+        gl::vec3 yuv_offset;
+        yuv_conversion(the_info, yuv_matrix, yuv_offset);
+        m_yuv_material->uniform("u_yuv_matrix", yuv_matrix);
+        m_yuv_material->uniform("u_yuv_offset", yuv_offset);
+        for(uint32_t p = 0; p < 3; ++p){ m_yuv_material->add_texture(m_planes[p], p); }
+
+        uint32_t w = GST_VIDEO_INFO_WIDTH(&the_info), h = GST_VIDEO_INFO_HEIGHT(&the_info);
+
+        if(!m_yuv_fbo || m_yuv_fbo->size() != gl::ivec2(w, h))
+        {
+            gl::Fbo::Format fmt;
+            fmt.depth_buffer = false;
+            m_yuv_fbo = gl::Fbo::create(w, h, fmt);
+        }
+        auto ret = gl::render_to_texture(m_yuv_fbo, [this]()
+        {
+            gl::draw_quad(gl::vec2(m_yuv_fbo->size()), m_yuv_material);
+        });
+        ret.set_flipped(true);
+        return ret;
+    }
+
+#if !defined(KINSKI_GLES)
+    //! upload the frame in the_buffer to layer the_layer of the GL_TEXTURE_2D_ARRAY the_texture
+    bool upload_layer(GstBuffer *the_buffer, const gl::Texture &the_texture, uint32_t the_layer)
+    {
+        static bool has_copy_image = gl::is_extension_supported("GL_ARB_copy_image");
+        GstMemory *mem = gst_buffer_peek_memory(the_buffer, 0);
+
+        // frame already resides on the GPU, copy without a roundtrip
+        if(mem && gst_is_gl_memory(mem) && has_copy_image && the_texture.internal_format() == GL_RGBA)
+        {
+            GstGLMemory *gl_mem = (GstGLMemory*)(mem);
+            GLenum target = GL_TEXTURE_2D;
+            if(gl_mem->tex_target == GST_GL_TEXTURE_TARGET_RECTANGLE){ target = GL_TEXTURE_RECTANGLE; }
+            glCopyImageSubData(gl_mem->tex_id, target, 0, 0, 0, 0, the_texture.id(), GL_TEXTURE_2D_ARRAY,
+                               0, 0, 0, the_layer, the_texture.width(), the_texture.height(), 1);
+            return true;
+        }
+
+        if(GST_VIDEO_INFO_IS_YUV(&m_gst_util.video_info()))
+        {
+            if(!upload_frame(the_buffer)){ return false; }
+
+            // copy the converted frame from our framebuffer
+            gl::SaveFramebufferBinding sfb;
+            m_yuv_fbo->bind();
+            the_texture.bind();
+            glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, the_layer, 0, 0, the_texture.width(),
+                                the_texture.height());
+            return true;
+        }
+
+        return upload_planes(the_buffer, [&the_texture, the_layer](uint32_t the_plane, uint32_t the_width,
+                                                                   uint32_t the_height, GLenum the_format,
+                                                                   const void *the_data)
+        {
+            the_texture.bind();
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, the_layer, the_width, the_height, 1, the_format,
+                            GL_UNSIGNED_BYTE, the_data);
+        });
+    }
+#endif
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -205,7 +523,8 @@ void MediaController::load(const std::string &filePath, bool autoplay, bool loop
     }
     callback_t on_load = m_impl ? m_impl->m_on_load_cb : callback_t();
     callback_t on_end = m_impl ? m_impl->m_on_end_cb : callback_t();
-    m_impl.reset(new MediaControllerImpl());
+    FrameFormat frame_format = m_impl ? m_impl->m_frame_format : FrameFormat::AUTO;
+    m_impl.reset(new MediaControllerImpl(frame_format));
     m_impl->m_src_path = found_path;
     m_impl->m_loop = loop;
     m_impl->m_media_controller = shared_from_this();
@@ -262,7 +581,7 @@ bool MediaController::is_loaded() const
 
 void MediaController::unload()
 {
-    m_impl.reset(new MediaControllerImpl);
+    m_impl.reset(new MediaControllerImpl(frame_format()));
 //    m_impl->m_gst_util.reset_pipeline();
 }
 
@@ -362,12 +681,13 @@ bool MediaController::copy_frame_to_image(crocore::ImagePtr& the_image)
         {
             auto img = crocore::Image_<uint8_t >::create(w, h, num_channels);
             img->type = crocore::Image::Type::RGBA;
+            the_image = img;
         }
 
         // map the buffer for reading
         gst_buffer_map(buf.get(), &m_impl->m_memory_map_info, GST_MAP_READ);
         uint8_t *buf_data = m_impl->m_memory_map_info.data;
-        size_t num_bytes = m_impl->m_memory_map_info.size;
+        size_t num_bytes = std::min<size_t>(m_impl->m_memory_map_info.size, w * h * num_channels);
         memcpy(the_image->data(), buf_data, num_bytes);
         gst_buffer_unmap(buf.get(), &m_impl->m_memory_map_info);
         return true;
@@ -399,6 +719,14 @@ bool MediaController::copy_frame_to_texture(gl::Texture &tex, bool as_texture2D)
             tex.set_flipped(true);
             return true;
         }
+
+        // frame in system-memory, streamed via pixel-buffers
+        auto frame_tex = m_impl->upload_frame(buf.get());
+        if(frame_tex)
+        {
+            tex = frame_tex;
+            return true;
+        }
     }
     return false;
 }
@@ -414,57 +742,52 @@ bool MediaController::copy_frames_offline(gl::Texture &tex, bool compress)
     // pause
     pause();
 
-    std::deque<std::shared_ptr<GstBuffer>> samples;
+    uint32_t num_frames = 0;
 
-    // keep calling wait_for_new_buffer()
+    // keep calling wait_for_new_buffer(), frames are uploaded as they arrive
     while(auto buf = m_impl->m_gst_util.wait_for_buffer())
     {
-        samples.push_back(buf);
+        if(!num_frames)
+        {
+            const GstVideoInfo &info = m_impl->m_gst_util.video_info();
+
+            if(compress && GST_VIDEO_INFO_IS_YUV(&info))
+            {
+                LOG_WARNING << "compression not supported for YUV-frames";
+                compress = false;
+            }
+
+            // aquire gpu-memory for the estimated number of frames, grown on demand
+            gl::Texture::Format fmt;
+            fmt.target = GL_TEXTURE_2D_ARRAY;
+            fmt.internal_format = compress ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA;
+            uint32_t num_frames_estimate = std::max<uint32_t>(std::ceil(duration() * fps()), 1);
+            tex = gl::Texture(GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info), num_frames_estimate, fmt);
+            tex.set_flipped();
+            KINSKI_CHECK_GL_ERRORS();
+        }
+
+        if(num_frames == tex.depth() && !resize_array_texture(tex, 2 * num_frames))
+        {
+            LOG_WARNING << "could not grow array-texture, stopping after " << num_frames << " frames";
+            break;
+        }
+
+        if(!m_impl->upload_layer(buf.get(), tex, num_frames)){ break; }
+        num_frames++;
 
         // step to next frame
         m_impl->send_step_event();
     }
 
-    uint32_t num_frames = samples.size();
-    uint32_t width, height, i = 0;
-
-    if(num_frames)
-    {
-        width = (uint32_t)m_impl->m_gst_util.video_info().width;
-        height = (uint32_t)m_impl->m_gst_util.video_info().height;
-
-        // aquire gpu-memory for our frames
-        gl::Texture::Format fmt;
-        fmt.target = GL_TEXTURE_2D_ARRAY;
-        fmt.internal_format = compress ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA;
-        tex = gl::Texture(width, height, num_frames, fmt);
-        tex.set_flipped();
-        KINSKI_CHECK_GL_ERRORS();
-    }
-    else
+    if(!num_frames)
     {
         LOG_ERROR << "no samples";
         return false;
     }
 
-    while(!samples.empty())
-    {
-        auto s = samples.front();
-        samples.pop_front();
-
-        // map the buffer for reading
-        gst_buffer_map(s.get(), &m_impl->m_memory_map_info, GST_MAP_READ);
-        uint8_t *buf_data = m_impl->m_memory_map_info.data;
-
-        // upload to texture
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, buf_data);
-
-        // unmap
-        gst_buffer_unmap(s.get(), &m_impl->m_memory_map_info);
-
-        // advance index
-        i++;
-    }
+    // trim excess layers
+    if(num_frames < tex.depth()){ resize_array_texture(tex, num_frames); }
     return true;
 #endif
     return false;
@@ -609,5 +932,33 @@ MediaController::AudioTarget MediaController::audio_target() const
     return AudioTarget::AUTO;
 }
 
+/////////////////////////////////////////////////////////////////
+
+MediaController::FrameFormat MediaController::frame_format() const
+{
+    return m_impl ? m_impl->m_frame_format : FrameFormat::AUTO;
+}
+
+/////////////////////////////////////////////////////////////////
+
+void MediaController::set_frame_format(FrameFormat the_format)
+{
+#if defined(KINSKI_GLES_2)
+    if(the_format == FrameFormat::I420)
+    {
+        LOG_WARNING << "YUV-frames not supported, using RGBA";
+        the_format = FrameFormat::RGBA;
+    }
+#endif
+    if(!m_impl || m_impl->m_frame_format == the_format){ return; }
+    m_impl->m_frame_format = the_format;
+
+    // the appsink is configured on load
+    if(is_loaded())
+    {
+        load(m_impl->m_src_path, is_playing(), m_impl->m_loop, m_impl->m_render_target, m_impl->m_audio_target);
+    }
+}
+
 /////////////////////////////////////////////////////////////////
 }}// namespaces
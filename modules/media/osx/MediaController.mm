@@ -645,6 +645,17 @@ namespace kinski{ namespace media{
         return AudioTarget::AUTO;
     }
     
+/////////////////////////////////////////////////////////////////
+    
+    MediaController::FrameFormat MediaController::frame_format() const
+    {
+        return FrameFormat::AUTO;
+    }
+    
+/////////////////////////////////////////////////////////////////
+    
+    void MediaController::set_frame_format(FrameFormat the_format){}
+    
 }}// namespaces
 
 @implementation LoopHelper
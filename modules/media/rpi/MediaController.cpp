@@ -790,5 +790,16 @@ namespace kinski{ namespace media
         return m_impl ? m_impl->m_audio_target : AudioTarget::AUTO;
     }
 
+/////////////////////////////////////////////////////////////////
+
+    MediaController::FrameFormat MediaController::frame_format() const
+    {
+        return FrameFormat::AUTO;
+    }
+
+/////////////////////////////////////////////////////////////////
+
+    void MediaController::set_frame_format(FrameFormat the_format){}
+
 /////////////////////////////////////////////////////////////////
 }}// namespaces
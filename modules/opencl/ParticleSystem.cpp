@@ -91,6 +91,10 @@ namespace kinski{ namespace gl{
 
         if(m_mesh)
         {
+            // kernels operate on separate float-buffers and 32bit indices
+            gl::VertexLayout layout;
+            layout.compact_indices = false;
+            m_mesh->geometry()->set_vertex_layout(layout);
             m_mesh->geometry()->create_gl_buffers(GL_STATIC_DRAW);
             gl::GeometryConstPtr geom = m_mesh->geometry();
             
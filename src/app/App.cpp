@@ -7,6 +7,7 @@
 //  http://www.boost.org/LICENSE_1_0.txt
 // __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
 
+#include "gl/Profiler.hpp"
 #include "App.hpp"
 
 #include <thread>
@@ -58,37 +59,58 @@ int App::run()
     // Main loop
     while(m_running)
     {
+        gl::profiler().begin_frame();
+
         // update application time
         time_stamp = get_application_time();
 
-        // poll io_service if no seperate worker-threads exist
-        if(!m_main_queue.num_threads()) m_main_queue.poll();
+        {
+            gl::ScopedProfile sp("poll", false);
 
-        // poll input events
-        poll_events();
+            // poll io_service if no seperate worker-threads exist
+            if(!m_main_queue.num_threads()) m_main_queue.poll();
+
+            // poll input events
+            poll_events();
+        }
 
         // time elapsed since last frame
         double time_delta = time_stamp - m_lastTimeStamp;
 
         // call update callback
-        update(time_delta);
+        {
+            gl::ScopedProfile sp("update");
+            update(time_delta);
+        }
 
         m_lastTimeStamp = time_stamp;
 
         if(needs_redraw())
         {
             // call draw callback
-            draw_internal();
+            {
+                gl::ScopedProfile sp("draw");
+                draw_internal();
+            }
 
             // Swap front and back rendering buffers
-            swap_buffers();
+            {
+                gl::ScopedProfile sp("swap", false);
+                swap_buffers();
+            }
+
+            // finish counting GL state-changes for this frame
+            if(gl::context()){ gl::context()->end_frame(); }
         }
 
         // perform fps-timing
         timing(time_stamp);
 
         // post draw hook
-        post_draw();
+        {
+            gl::ScopedProfile sp("post_draw", false);
+            post_draw();
+        }
 
         // Check if ESC key was pressed or window was closed or whatever
         m_running = is_running();
@@ -98,9 +120,11 @@ int App::run()
 
         if(current_fps > m_max_fps)
         {
+            gl::ScopedProfile sp("sleep", false);
             double sleep_secs = std::max(0.0, (1.0 / m_max_fps - time_delta));
             this_thread::sleep_for(duration_t(sleep_secs));
         }
+        gl::profiler().end_frame();
     }
 
     // manage teardown, save stuff etc.
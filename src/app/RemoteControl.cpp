@@ -12,6 +12,7 @@
 //  Created by Croc Dialer on 06/10/14.
 
 #include "gl/Fbo.hpp"
+#include "gl/Profiler.hpp"
 #include "app/ViewerApp.hpp"
 
 #include "gl/SerializerGL.hpp"
@@ -23,6 +24,7 @@ using namespace kinski;
 RemoteControl::RemoteControl(io_service_t &io, const std::list<ComponentPtr> &the_list)
 {
     set_components(the_list);
+    m_io_service = &io;
     m_tcp_server = net::tcp_server(io, net::tcp_server::tcp_connection_callback());
     m_udp_server = net::udp_server(io);
 }
@@ -121,6 +123,46 @@ void RemoteControl::start_listen(uint16_t tcp_port, uint16_t udp_port)
         con->write(serializer::serialize(components(), PropertyIO_GL(), true));
     });
 
+    add_command("profiler_stats", [](net::tcp_connection_ptr con, const std::vector<std::string> &the_args)
+    {
+        // mean timings over the last n frames
+        uint32_t num_frames = the_args.empty() ? 60 : string_to<uint32_t>(the_args.front());
+        con->write(gl::profiler().stats_json(num_frames) + "\n");
+    });
+
+    add_command("profiler_trace", [](net::tcp_connection_ptr con, const std::vector<std::string> &)
+    {
+        // complete profiler-history in chrome's trace-event format
+        con->write(gl::profiler().chrome_trace());
+    });
+
+    add_command("profiler_stream", [this](net::tcp_connection_ptr con, const std::vector<std::string> &the_args)
+    {
+        // stream stats every interval seconds, an interval of 0 unsubscribes
+        double interval = the_args.empty() ? 1.0 : string_to<double>(the_args.front());
+        m_profiler_connections.erase(std::remove(m_profiler_connections.begin(), m_profiler_connections.end(), con),
+                                     m_profiler_connections.end());
+
+        if(!con || interval <= 0.0 || !m_io_service){ return; }
+        m_profiler_connections.push_back(con);
+
+        m_profiler_timer = Timer(*m_io_service, [this, interval]()
+        {
+            std::vector<net::tcp_connection_ptr> open_connections;
+
+            for(auto &c : m_profiler_connections){ if(c->is_open()){ open_connections.push_back(c); }}
+            m_profiler_connections = open_connections;
+
+            if(m_profiler_connections.empty()){ m_profiler_timer.cancel(); return; }
+
+            // mean timings over the interval, assuming 60 fps
+            auto stats = gl::profiler().stats_json(std::max<uint32_t>(1, interval * 60)) + "\n";
+            for(auto &c : m_profiler_connections){ c->write(stats); }
+        });
+        m_profiler_timer.set_periodic();
+        m_profiler_timer.expires_from_now(interval);
+    });
+
     m_udp_server.start_listen(udp_port);
     m_udp_server.set_receive_function([this](const std::vector<uint8_t> &the_data,
                                              const std::string &the_ip,
@@ -15,6 +15,7 @@
 
 #include <crocore/Component.hpp>
 #include <crocore/networking.hpp>
+#include <crocore/Timer.hpp>
 
 namespace kinski
 {
@@ -66,5 +67,12 @@ namespace kinski
         
         //!
         std::vector<crocore::net::tcp_connection_ptr> m_tcp_connections;
+        
+        //! io_service used for our servers and timers
+        crocore::io_service_t *m_io_service = nullptr;
+        
+        //! periodically streams profiler-stats to subscribed connections
+        crocore::Timer m_profiler_timer;
+        std::vector<crocore::net::tcp_connection_ptr> m_profiler_connections;
     };
 }
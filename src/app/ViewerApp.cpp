@@ -90,7 +90,8 @@ ViewerApp::ViewerApp(int argc, char *argv[]) : BaseApp(argc, argv),
 
 ViewerApp::~ViewerApp()
 {
-
+    // our background_queue() is about to go away, stop handing out texture-decode tasks to it
+    gl::set_texture_decode_pool(nullptr);
 }
 
 void ViewerApp::setup()
@@ -138,11 +139,17 @@ void ViewerApp::setup()
         lights().push_back(light);
     }
     // viewer provides a directional light
-    lights().front()->position() = glm::vec3(1);
+    lights().front()->set_position(glm::vec3(1));
     lights().front()->set_type(gl::Light::DIRECTIONAL);
 
     for(auto l : lights()){ scene()->add_object(l); }
 
+    // distribute culling across our worker-threads
+    scene()->renderer()->set_thread_pool(&background_queue());
+
+    // decode queued material-textures in the background
+    gl::set_texture_decode_pool(&background_queue());
+
     // enable observer mechanism
     observe_properties();
 
@@ -205,10 +212,10 @@ void ViewerApp::update(float timeDelta)
 
         glm::mat4 tmp = glm::mat4(m_rotation->value());
         tmp[3] = glm::vec4(look_at + m_rotation->value()[2] * m_distance->value(), 1.0f);
-        m_camera->transform() = tmp;
+        m_camera->set_transform(tmp);
         m_dirty_cam = false;
     }
-    m_scene->update(timeDelta);
+    m_scene->update(timeDelta, &background_queue());
 }
 
 void ViewerApp::mouse_press(const MouseEvent &e)
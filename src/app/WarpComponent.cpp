@@ -240,6 +240,27 @@ void WarpComponent::render_output(int the_index, const gl::Texture &the_tex,
                                   const float the_brightness)
 {
     m_quad_warp[the_index].render_output(the_tex, the_brightness);
+    render_overlay(the_index);
+}
+
+void WarpComponent::render_output(const gl::Texture &the_tex, const float the_brightness)
+{
+    std::vector<gl::Warp*> warps;
+
+    for(uint32_t i = 0; i < m_quad_warp.size(); ++i)
+    {
+        if(m_params[i].enabled){ warps.push_back(&m_quad_warp[i]); }
+    }
+    gl::render_warps(warps, the_tex, the_brightness);
+
+    for(uint32_t i = 0; i < m_quad_warp.size(); ++i)
+    {
+        if(m_params[i].enabled){ render_overlay(i); }
+    }
+}
+
+void WarpComponent::render_overlay(int the_index)
+{
     if(m_params[the_index].display_grid){ m_quad_warp[the_index].render_grid(); }
 
     if(m_show_cursor)
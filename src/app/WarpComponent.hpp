@@ -41,6 +41,9 @@ public:
 
     void render_output(int the_index, const gl::Texture &the_tex, const float the_brightness = 1.f);
 
+    //! render all enabled warps in a single compositing pass, followed by their overlays
+    void render_output(const gl::Texture &the_tex, const float the_brightness = 1.f);
+
     void set_from(gl::Warp &the_quadwarp, uint32_t the_index = 0);
 
     uint32_t index() const { return *m_index; }
@@ -76,6 +79,9 @@ public:
 private:
     WarpComponent();
 
+    //! grid, boundary, label and control points of warp the_index, as enabled
+    void render_overlay(int the_index);
+
     std::vector<gl::Warp> m_quad_warp{10};
 
     typedef struct
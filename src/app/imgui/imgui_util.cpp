@@ -692,6 +692,111 @@ void draw_scenegraph_ui(const gl::SceneConstPtr &the_scene, std::set<gl::Object3
     }
 }
 
+namespace
+{
+//! draws the scopes of the_frame as a flame-graph, one row per nesting level
+void draw_flame_graph(const char *the_label, const gl::Profiler::frame_t &the_frame, bool the_gpu)
+{
+    uint32_t max_depth = 0;
+    double span = the_gpu ? 0.0 : the_frame.duration;
+
+    for(const auto &s : the_frame.scopes)
+    {
+        if(the_gpu && s.gpu_duration < 0.0){ continue; }
+        max_depth = std::max(max_depth, s.depth);
+        if(the_gpu){ span = std::max(span, s.gpu_begin + s.gpu_duration); }
+    }
+    if(span <= 0.0){ return; }
+
+    ImGui::Text("%s: %.2f ms", the_label, 1000.0 * span);
+
+    const float row_height = ImGui::GetTextLineHeightWithSpacing();
+    const float width = ImGui::GetContentRegionAvailWidth();
+    const float scale = width / span;
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+
+    for(const auto &s : the_frame.scopes)
+    {
+        double begin = the_gpu ? s.gpu_begin : s.cpu_begin;
+        double duration = the_gpu ? s.gpu_duration : s.cpu_duration;
+        if(duration < 0.0){ continue; }
+
+        const char *name = s.name ? s.name : "";
+        ImVec2 a(origin.x + begin * scale, origin.y + s.depth * row_height);
+        ImVec2 b(a.x + std::max<float>(duration * scale, 1.f), a.y + row_height - 1.f);
+
+        // stable color per scope-name
+        float hue = (std::hash<std::string>()(name) % 256) / 255.f;
+        draw_list->AddRectFilled(a, b, ImColor::HSV(hue, .5f, .6f));
+        draw_list->PushClipRect(a, b, true);
+        draw_list->AddText(ImVec2(a.x + 2.f, a.y), ImGui::GetColorU32(ImGuiCol_Text), name);
+        draw_list->PopClipRect();
+
+        if(ImGui::IsMouseHoveringRect(a, b)){ ImGui::SetTooltip("%s: %.3f ms", name, 1000.0 * duration); }
+    }
+    ImGui::Dummy(ImVec2(width, (max_depth + 1) * row_height));
+}
+}
+
+void draw_profiler_ui(gl::Profiler &the_profiler)
+{
+    ImGui::Begin("profiler");
+
+    bool enabled = the_profiler.enabled(), gpu_timing = the_profiler.gpu_timing();
+    if(ImGui::Checkbox("enabled", &enabled)){ the_profiler.set_enabled(enabled); }
+    ImGui::SameLine();
+    if(ImGui::Checkbox("gpu-timing", &gpu_timing)){ the_profiler.set_gpu_timing(gpu_timing); }
+    ImGui::SameLine();
+    if(ImGui::Button("save trace")){ the_profiler.save_chrome_trace("profiler_trace.json"); }
+
+    const auto &history = the_profiler.history();
+
+    if(!history.empty())
+    {
+        const auto &frame = history[history.size() - 1];
+
+        // frame-times in ms, oldest first
+        std::vector<float> frame_times(history.size());
+        for(uint32_t i = 0; i < history.size(); ++i){ frame_times[i] = 1000.f * history[i].duration; }
+
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "%.2f ms", frame_times.back());
+        ImGui::PlotHistogram("##frame_times", frame_times.data(), frame_times.size(), 0, overlay, 0.f, FLT_MAX,
+                             ImVec2(ImGui::GetContentRegionAvailWidth(), 60.f));
+
+        const auto &stats = frame.state_stats;
+        ImGui::Text("draw-calls: %u - state-changes: %u (%u redundant) - uploads: %.1f kB", stats.num_draw_calls,
+                    stats.num_changes, stats.num_redundant, stats.num_upload_bytes / 1024.f);
+
+        draw_flame_graph("cpu", frame, false);
+        draw_flame_graph("gpu", frame, true);
+
+        // timings per scope for the latest frame
+        ImGui::Separator();
+        ImGui::Columns(3, "profiler_scopes");
+        ImGui::Text("scope");
+        ImGui::NextColumn();
+        ImGui::Text("cpu (ms)");
+        ImGui::NextColumn();
+        ImGui::Text("gpu (ms)");
+        ImGui::NextColumn();
+
+        for(const auto &s : frame.scopes)
+        {
+            ImGui::Text("%*s%s", 2 * s.depth, "", s.name ? s.name : "");
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", 1000.0 * s.cpu_duration);
+            ImGui::NextColumn();
+            if(s.gpu_duration >= 0.0){ ImGui::Text("%.3f", 1000.0 * s.gpu_duration); }
+            else{ ImGui::Text("-"); }
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+    }
+    ImGui::End();
+}
+
 void process_joystick_input(const std::vector<JoystickState> &the_joystick_states)
 {
     ImGuiIO &io = ImGui::GetIO();
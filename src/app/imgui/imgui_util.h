@@ -7,6 +7,7 @@
 
 #include <crocore/Component.hpp>
 #include "gl/gl.hpp"
+#include "gl/Profiler.hpp"
 #include "app/App.hpp"
 #include "app/LightComponent.hpp"
 #include "app/WarpComponent.hpp"
@@ -40,6 +41,9 @@ void draw_mesh_ui(const gl::MeshPtr &the_mesh);
 
 void draw_scenegraph_ui(const gl::SceneConstPtr &the_scene, std::set<gl::Object3DPtr>* the_selection = nullptr);
 
+//! frame-times, GL state-stats and a flame-graph of the latest frame
+void draw_profiler_ui(gl::Profiler &the_profiler = gl::profiler());
+
 void process_joystick_input(const std::vector<JoystickState> &the_joystick_states);
 
 }}// namespaces
@@ -0,0 +1,214 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+#include "Geometry.hpp"
+#include "BVH.hpp"
+
+namespace kinski { namespace gl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+void BVH::build(const std::vector<gl::AABB> &the_bounds, uint32_t the_max_leaf_size)
+{
+    clear();
+    if(the_bounds.empty()){ return; }
+
+    m_indices.resize(the_bounds.size());
+    std::iota(m_indices.begin(), m_indices.end(), 0);
+
+    std::vector<vec3> centroids(the_bounds.size());
+    for(uint32_t i = 0; i < the_bounds.size(); ++i){ centroids[i] = the_bounds[i].center(); }
+
+    // a binary tree with at least one primitive per leaf
+    m_nodes.reserve(2 * the_bounds.size());
+    m_nodes.push_back(node_t());
+    subdivide(0, 0, the_bounds.size(), the_bounds, centroids, std::max<uint32_t>(the_max_leaf_size, 1));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void BVH::subdivide(uint32_t the_node_index, uint32_t the_first, uint32_t the_count,
+                    const std::vector<gl::AABB> &the_bounds, const std::vector<vec3> &the_centroids,
+                    uint32_t the_max_leaf_size)
+{
+    gl::AABB bounds = the_bounds[m_indices[the_first]];
+    gl::AABB centroid_bounds(the_centroids[m_indices[the_first]], the_centroids[m_indices[the_first]]);
+
+    for(uint32_t i = the_first + 1; i < the_first + the_count; ++i)
+    {
+        const vec3 &c = the_centroids[m_indices[i]];
+        bounds += the_bounds[m_indices[i]];
+        centroid_bounds += gl::AABB(c, c);
+    }
+    m_nodes[the_node_index].bounds = bounds;
+
+    // split along the largest extent of the centroid-bounds
+    vec3 extents = centroid_bounds.size();
+    uint32_t axis = 0;
+    if(extents.y > extents[axis]){ axis = 1; }
+    if(extents.z > extents[axis]){ axis = 2; }
+
+    // leaf
+    if(the_count <= the_max_leaf_size || extents[axis] <= 0.f)
+    {
+        m_nodes[the_node_index].offset = the_first;
+        m_nodes[the_node_index].count = the_count;
+        return;
+    }
+
+    // object-median split
+    uint32_t mid = the_first + the_count / 2;
+    std::nth_element(m_indices.begin() + the_first, m_indices.begin() + mid,
+                     m_indices.begin() + the_first + the_count,
+                     [&the_centroids, axis](uint32_t lhs, uint32_t rhs)
+                     {
+                         return the_centroids[lhs][axis] < the_centroids[rhs][axis];
+                     });
+
+    // children are stored next to each other, behind their parent
+    uint32_t left_index = m_nodes.size();
+    m_nodes.push_back(node_t());
+    m_nodes.push_back(node_t());
+    m_nodes[the_node_index].offset = left_index;
+    m_nodes[the_node_index].count = 0;
+
+    subdivide(left_index, the_first, mid - the_first, the_bounds, the_centroids, the_max_leaf_size);
+    subdivide(left_index + 1, mid, the_first + the_count - mid, the_bounds, the_centroids,
+              the_max_leaf_size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void BVH::refit(const std::vector<gl::AABB> &the_bounds)
+{
+    if(the_bounds.size() != m_indices.size())
+    {
+        LOG_WARNING << "BVH::refit: primitive count mismatch, rebuilding";
+        build(the_bounds);
+        return;
+    }
+
+    // children have higher indices than their parents -> reverse sweep is bottom-up
+    for(auto it = m_nodes.rbegin(); it != m_nodes.rend(); ++it)
+    {
+        node_t &node = *it;
+
+        if(node.is_leaf())
+        {
+            node.bounds = the_bounds[m_indices[node.offset]];
+            for(uint32_t i = 1; i < node.count; ++i){ node.bounds += the_bounds[m_indices[node.offset + i]]; }
+        }
+        else{ node.bounds = m_nodes[node.offset].bounds + m_nodes[node.offset + 1].bounds; }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void BVH::clear()
+{
+    m_nodes.clear();
+    m_indices.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TriangleBVHPtr TriangleBVH::create(const gl::Geometry &the_geom, const std::vector<range_t> &the_ranges)
+{
+    auto ret = TriangleBVHPtr(new TriangleBVH());
+    ret->m_ranges = the_ranges;
+
+    // empty ranges -> cover the entire geometry
+    std::vector<range_t> ranges = the_ranges;
+
+    if(ranges.empty())
+    {
+        range_t r;
+        r.num_indices = the_geom.indices().size();
+        r.num_vertices = the_geom.vertices().size();
+        ranges.push_back(r);
+    }
+
+    const auto &vertices = the_geom.vertices();
+    const auto &indices = the_geom.indices();
+    std::vector<gl::AABB> triangle_bounds;
+
+    auto add_triangle = [&](uint32_t the_range_index, uint32_t a, uint32_t b, uint32_t c)
+    {
+        if(a >= vertices.size() || b >= vertices.size() || c >= vertices.size()){ return; }
+        gl::Triangle t(vertices[a], vertices[b], vertices[c]);
+        gl::AABB bb(glm::min(glm::min(t.v0, t.v1), t.v2), glm::max(glm::max(t.v0, t.v1), t.v2));
+        ret->m_triangles.push_back(t);
+        ret->m_range_indices.push_back(the_range_index);
+        triangle_bounds.push_back(bb);
+    };
+
+    for(uint32_t r = 0; r < ranges.size(); ++r)
+    {
+        const range_t &range = ranges[r];
+
+        if(the_geom.has_indices())
+        {
+            uint32_t end = std::min<uint32_t>(range.base_index + range.num_indices, indices.size());
+
+            for(uint32_t i = range.base_index; i + 2 < end; i += 3)
+            {
+                add_triangle(r, indices[i] + range.base_vertex, indices[i + 1] + range.base_vertex,
+                             indices[i + 2] + range.base_vertex);
+            }
+        }
+        else
+        {
+            uint32_t end = range.base_vertex + range.num_vertices;
+            for(uint32_t i = range.base_vertex; i + 2 < end; i += 3){ add_triangle(r, i, i + 1, i + 2); }
+        }
+    }
+    ret->m_bvh.build(triangle_bounds);
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+ray_triangle_intersection TriangleBVH::intersect(const gl::Ray &the_ray,
+                                                 const range_filter_t &the_range_filter,
+                                                 uint32_t *the_out_range_index) const
+{
+    ray_triangle_intersection ret(REJECT);
+    float max_distance = std::numeric_limits<float>::max();
+
+    m_bvh.traverse(the_ray, max_distance, [&](uint32_t i)
+    {
+        if(the_range_filter && !the_range_filter(m_range_indices[i])){ return; }
+        ray_triangle_intersection hit = m_triangles[i].intersect(the_ray);
+
+        if(hit && hit.distance >= 0.f && hit.distance < max_distance)
+        {
+            max_distance = hit.distance;
+            ret = hit;
+            if(the_out_range_index){ *the_out_range_index = m_range_indices[i]; }
+        }
+    });
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t TriangleBVH::num_intersections(const gl::Ray &the_ray) const
+{
+    uint32_t ret = 0;
+    float max_distance = std::numeric_limits<float>::max();
+
+    m_bvh.traverse(the_ray, max_distance, [&](uint32_t i)
+    {
+        ray_triangle_intersection hit = m_triangles[i].intersect(the_ray);
+        if(hit && hit.distance >= 0.f){ ret++; }
+    });
+    return ret;
+}
+
+}}//namespace
@@ -0,0 +1,215 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+//  BVH.hpp
+//
+//  Bounding volume hierarchies for ray-queries against scenes and triangle meshes
+
+#pragma once
+
+#include "gl/gl.hpp"
+#include "geometry_types.hpp"
+
+namespace kinski { namespace gl {
+
+/*!
+ * Bounding volume hierarchy over a set of axis-aligned boxes (primitives).
+ * Nodes are stored depth-first in a flat array and children always follow their parent,
+ * so a reverse sweep over all nodes is sufficient to refit the hierarchy bottom-up.
+ */
+class BVH
+{
+public:
+
+    struct node_t
+    {
+        //! bounds of all primitives below this node
+        gl::AABB bounds;
+
+        //! index of the first child (inner nodes) or first primitive-index (leaves)
+        uint32_t offset = 0;
+
+        //! number of primitives for leaves, 0 for inner nodes
+        uint32_t count = 0;
+
+        inline bool is_leaf() const { return count; }
+    };
+
+    /*!
+     * build the hierarchy from scratch, splitting at the object-median along the largest axis
+     */
+    void build(const std::vector<gl::AABB> &the_bounds, uint32_t the_max_leaf_size = 4);
+
+    /*!
+     * update all node bounds without changing the topology.
+     * the_bounds need to describe the same primitives, in the same order, as passed to build()
+     */
+    void refit(const std::vector<gl::AABB> &the_bounds);
+
+    void clear();
+
+    inline bool empty() const { return m_nodes.empty(); }
+
+    inline size_t num_primitives() const { return m_indices.size(); }
+
+    inline const std::vector<node_t>& nodes() const { return m_nodes; }
+
+    /*!
+     * visit all primitives in leaves intersected by the_ray, roughly ordered front to back.
+     * subtrees further away than the_max_distance are skipped,
+     * the_fn(uint32_t prim_index) may shrink the_max_distance to tighten the search.
+     */
+    template<typename Fn>
+    void traverse(const gl::Ray &the_ray, float &the_max_distance, Fn the_fn) const
+    {
+        if(m_nodes.empty()){ return; }
+
+        const vec3 inv_dir = 1.f / the_ray.direction;
+        float t_near;
+
+        if(!intersect(m_nodes[0].bounds, the_ray.origin, inv_dir, t_near) || t_near > the_max_distance)
+        {
+            return;
+        }
+
+        struct stack_item_t{ uint32_t node; float distance; };
+        stack_item_t stack[64];
+        uint32_t stack_size = 0;
+        stack[stack_size++] = {0, t_near};
+
+        while(stack_size)
+        {
+            const auto item = stack[--stack_size];
+            if(item.distance > the_max_distance){ continue; }
+
+            const node_t &node = m_nodes[item.node];
+
+            if(node.is_leaf())
+            {
+                for(uint32_t i = 0; i < node.count; ++i){ the_fn(m_indices[node.offset + i]); }
+                continue;
+            }
+            float t_left, t_right;
+            bool hit_left = intersect(m_nodes[node.offset].bounds, the_ray.origin, inv_dir, t_left);
+            bool hit_right = intersect(m_nodes[node.offset + 1].bounds, the_ray.origin, inv_dir, t_right);
+
+            // push the farther child first, so the nearer one gets processed next
+            if(hit_left && hit_right)
+            {
+                if(t_left < t_right)
+                {
+                    stack[stack_size++] = {node.offset + 1, t_right};
+                    stack[stack_size++] = {node.offset, t_left};
+                }
+                else
+                {
+                    stack[stack_size++] = {node.offset, t_left};
+                    stack[stack_size++] = {node.offset + 1, t_right};
+                }
+            }
+            else if(hit_left){ stack[stack_size++] = {node.offset, t_left}; }
+            else if(hit_right){ stack[stack_size++] = {node.offset + 1, t_right}; }
+        }
+    }
+
+    /*!
+     * slab-test for a ray, given by origin and inverse direction.
+     * returns true on hit and sets the_distance to the (non-negative) entry distance
+     */
+    static inline bool intersect(const gl::AABB &the_box, const vec3 &the_origin, const vec3 &the_inv_dir,
+                                 float &the_distance)
+    {
+        vec3 t0 = (the_box.min - the_origin) * the_inv_dir;
+        vec3 t1 = (the_box.max - the_origin) * the_inv_dir;
+        vec3 t_min = glm::min(t0, t1), t_max = glm::max(t0, t1);
+        float t_enter = std::max(std::max(t_min.x, t_min.y), t_min.z);
+        float t_exit = std::min(std::min(t_max.x, t_max.y), t_max.z);
+        the_distance = std::max(t_enter, 0.f);
+        return t_exit >= the_distance;
+    }
+
+private:
+
+    void subdivide(uint32_t the_node_index, uint32_t the_first, uint32_t the_count,
+                   const std::vector<gl::AABB> &the_bounds, const std::vector<vec3> &the_centroids,
+                   uint32_t the_max_leaf_size);
+
+    std::vector<node_t> m_nodes;
+    std::vector<uint32_t> m_indices;
+};
+
+DEFINE_CLASS_PTR(TriangleBVH);
+
+/*!
+ * BVH over the triangles of a gl::Geometry, used for fast ray-queries in object-space
+ */
+class TriangleBVH
+{
+public:
+
+    //! describes a range of triangles within a gl::Geometry, analogous to gl::Mesh::Entry
+    struct range_t
+    {
+        uint32_t base_index = 0;
+        uint32_t num_indices = 0;
+        uint32_t base_vertex = 0;
+        uint32_t num_vertices = 0;
+
+        inline bool operator==(const range_t &the_other) const
+        {
+            return base_index == the_other.base_index && num_indices == the_other.num_indices &&
+                   base_vertex == the_other.base_vertex && num_vertices == the_other.num_vertices;
+        }
+
+        inline bool operator<(const range_t &the_other) const
+        {
+            if(base_index != the_other.base_index){ return base_index < the_other.base_index; }
+            if(num_indices != the_other.num_indices){ return num_indices < the_other.num_indices; }
+            if(base_vertex != the_other.base_vertex){ return base_vertex < the_other.base_vertex; }
+            return num_vertices < the_other.num_vertices;
+        }
+    };
+
+    using range_filter_t = std::function<bool(uint32_t)>;
+
+    /*!
+     * create a TriangleBVH for the provided ranges of the_geom.
+     * an empty list of ranges covers all triangles contained in the_geom
+     */
+    static TriangleBVHPtr create(const gl::Geometry &the_geom,
+                                 const std::vector<range_t> &the_ranges = {});
+
+    /*!
+     * return the closest intersection with the_ray (in object-space).
+     * the_range_filter can be used to skip triangles, based on their range-index.
+     */
+    ray_triangle_intersection intersect(const gl::Ray &the_ray,
+                                        const range_filter_t &the_range_filter = {},
+                                        uint32_t *the_out_range_index = nullptr) const;
+
+    /*!
+     * return the total number of triangles intersected by the_ray
+     */
+    uint32_t num_intersections(const gl::Ray &the_ray) const;
+
+    inline const std::vector<range_t>& ranges() const { return m_ranges; }
+
+    inline size_t num_triangles() const { return m_triangles.size(); }
+
+private:
+
+    TriangleBVH() = default;
+
+    std::vector<range_t> m_ranges;
+    std::vector<gl::Triangle> m_triangles;
+    std::vector<uint32_t> m_range_indices;
+    BVH m_bvh;
+};
+
+}}//namespace
@@ -144,21 +144,233 @@ void Buffer::set_stride(size_t theStride)
     
 void Buffer::set_data(const void *the_data, size_t num_bytes)
 {
-    if(!m_impl)
+    if(!m_impl){ init(); }
+
+    // glBufferData orphans the old storage, no need to wait for pending draws
+    glBindBuffer(m_impl->target, m_impl->buffer_id);
+    m_impl->num_bytes = num_bytes;
+    glBufferData(m_impl->target, num_bytes, the_data, m_impl->usage);
+    glBindBuffer(m_impl->target, 0);
+    if(the_data && gl::context()){ gl::context()->add_upload_bytes(num_bytes); }
+}
+
+void Buffer::set_sub_data(const void *the_data, size_t the_num_bytes, size_t the_offset)
+{
+    if(!m_impl || the_offset + the_num_bytes > m_impl->num_bytes)
     {
-        init();
-        glBindBuffer(m_impl->target, m_impl->buffer_id);
+        throw std::runtime_error("gl::Buffer::set_sub_data: range exceeds buffer");
+    }
+    glBindBuffer(m_impl->target, m_impl->buffer_id);
+    glBufferSubData(m_impl->target, the_offset, the_num_bytes, the_data);
+    glBindBuffer(m_impl->target, 0);
+    if(gl::context()){ gl::context()->add_upload_bytes(the_num_bytes); }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct RingBufferImpl
+{
+    uint32_t buffer_id = 0;
+    GLenum target = 0;
+    size_t segment_size = 0;
+    uint32_t num_segments = 0;
+    uint32_t current_segment = 0;
+    size_t offset = 0;
+
+    //! persistently mapped memory, if supported
+    uint8_t *mapped_ptr = nullptr;
+
+    //! range written via RingBuffer::map(), without persistent mapping
+    size_t map_offset = 0, map_num_bytes = 0;
+    std::vector<uint8_t> staging;
+
+    //! advance the current offset by the_num_bytes, returns the aligned offset or -1
+    int64_t reserve(size_t the_num_bytes, size_t the_alignment)
+    {
+        the_alignment = std::max<size_t>(the_alignment, 1);
+        size_t segment_start = current_segment * segment_size;
+        size_t aligned_offset = (segment_start + offset + the_alignment - 1) / the_alignment * the_alignment;
+
+        if(aligned_offset + the_num_bytes > segment_start + segment_size){ return -1; }
+        offset = aligned_offset + the_num_bytes - segment_start;
+        if(gl::context()){ gl::context()->add_upload_bytes(the_num_bytes); }
+        return aligned_offset;
+    }
+
+#if !defined(KINSKI_GLES_2)
+    std::vector<GLsync> fences;
+#endif
+
+    ~RingBufferImpl()
+    {
+#if !defined(KINSKI_GLES_2)
+        for(auto &f : fences){ if(f){ glDeleteSync(f); } }
+#endif
+        if(buffer_id)
+        {
+#if !defined(KINSKI_GLES) && !defined(KINSKI_COCOA)
+            if(mapped_ptr)
+            {
+                glBindBuffer(target, buffer_id);
+                glUnmapBuffer(target);
+                glBindBuffer(target, 0);
+            }
+#endif
+            glDeleteBuffers(1, &buffer_id);
+        }
     }
+};
+
+RingBuffer::RingBuffer(GLenum the_target, size_t the_segment_size, uint32_t the_num_segments):
+m_impl(std::make_shared<RingBufferImpl>())
+{
+    m_impl->target = the_target;
+    m_impl->segment_size = the_segment_size;
+    m_impl->num_segments = std::max<uint32_t>(the_num_segments, 1);
+    size_t num_bytes = m_impl->segment_size * m_impl->num_segments;
+
+    // start with an exhausted segment, begin_segment() needs to be called first
+    m_impl->current_segment = m_impl->num_segments - 1;
+    m_impl->offset = the_segment_size;
+
+    glGenBuffers(1, &m_impl->buffer_id);
+    glBindBuffer(the_target, m_impl->buffer_id);
+
+#if !defined(KINSKI_GLES_2)
+    m_impl->fences.resize(m_impl->num_segments, nullptr);
+#endif
+
+#if !defined(KINSKI_GLES) && !defined(KINSKI_COCOA)
+    static bool has_buffer_storage = gl::is_extension_supported("GL_ARB_buffer_storage");
+
+    if(has_buffer_storage)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(the_target, num_bytes, nullptr, flags);
+        m_impl->mapped_ptr = (uint8_t*)glMapBufferRange(the_target, 0, num_bytes, flags);
+        if(!m_impl->mapped_ptr){ LOG_WARNING << "RingBuffer: persistent mapping failed"; }
+    }
+#endif
+    if(!m_impl->mapped_ptr){ glBufferData(the_target, num_bytes, nullptr, GL_STREAM_DRAW); }
+    glBindBuffer(the_target, 0);
+}
+
+void RingBuffer::begin_segment()
+{
+    if(!m_impl){ return; }
+    m_impl->current_segment = (m_impl->current_segment + 1) % m_impl->num_segments;
+    m_impl->offset = 0;
+
+#if !defined(KINSKI_GLES_2)
+    GLsync &fence = m_impl->fences[m_impl->current_segment];
+
+    if(fence)
+    {
+        // wait (up to 1s) until the GPU is done with this segment
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if(result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED)
+        {
+            LOG_WARNING << "RingBuffer: waiting for segment " << m_impl->current_segment << " failed";
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+#endif
+}
+
+void RingBuffer::end_segment()
+{
+#if !defined(KINSKI_GLES_2)
+    if(!m_impl){ return; }
+    GLsync &fence = m_impl->fences[m_impl->current_segment];
+    if(fence){ glDeleteSync(fence); }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+}
+
+int64_t RingBuffer::push(const void *the_data, size_t the_num_bytes, size_t the_alignment)
+{
+    if(!m_impl){ return -1; }
+    int64_t offset = m_impl->reserve(the_num_bytes, the_alignment);
+    if(offset < 0){ return -1; }
+
+    if(m_impl->mapped_ptr){ memcpy(m_impl->mapped_ptr + offset, the_data, the_num_bytes); }
     else
     {
-        //orphan buffer
         glBindBuffer(m_impl->target, m_impl->buffer_id);
-        glBufferData(m_impl->target, num_bytes, nullptr, m_impl->usage);
+        glBufferSubData(m_impl->target, offset, the_num_bytes, the_data);
+        glBindBuffer(m_impl->target, 0);
     }
-    
-    m_impl->num_bytes = num_bytes;
-    glBufferData(m_impl->target, num_bytes, the_data, m_impl->usage);
+    return offset;
+}
+
+uint8_t* RingBuffer::map(size_t the_num_bytes, size_t the_alignment, size_t &the_offset)
+{
+    if(!m_impl){ return nullptr; }
+    int64_t offset = m_impl->reserve(the_num_bytes, the_alignment);
+    if(offset < 0){ return nullptr; }
+    the_offset = offset;
+
+    if(m_impl->mapped_ptr){ return m_impl->mapped_ptr + offset; }
+    m_impl->map_offset = offset;
+    m_impl->map_num_bytes = the_num_bytes;
+
+#if !defined(KINSKI_GLES_2)
+    // the segment is guarded by its fence, no need to synchronize
+    glBindBuffer(m_impl->target, m_impl->buffer_id);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    uint8_t *ptr = (uint8_t*)glMapBufferRange(m_impl->target, offset, the_num_bytes, flags);
     glBindBuffer(m_impl->target, 0);
+    if(!ptr){ m_impl->map_num_bytes = 0; }
+    return ptr;
+#else
+    m_impl->staging.resize(the_num_bytes);
+    return m_impl->staging.data();
+#endif
+}
+
+void RingBuffer::unmap()
+{
+    if(!m_impl || m_impl->mapped_ptr || !m_impl->map_num_bytes){ return; }
+    glBindBuffer(m_impl->target, m_impl->buffer_id);
+
+#if !defined(KINSKI_GLES_2)
+    glUnmapBuffer(m_impl->target);
+#else
+    glBufferSubData(m_impl->target, m_impl->map_offset, m_impl->map_num_bytes, m_impl->staging.data());
+#endif
+    glBindBuffer(m_impl->target, 0);
+    m_impl->map_num_bytes = 0;
+}
+
+uint32_t RingBuffer::id() const
+{
+    return m_impl ? m_impl->buffer_id : 0;
+}
+
+GLenum RingBuffer::target() const
+{
+    return m_impl ? m_impl->target : GL_NONE;
+}
+
+size_t RingBuffer::segment_size() const
+{
+    return m_impl ? m_impl->segment_size : 0;
+}
+
+uint32_t RingBuffer::num_segments() const
+{
+    return m_impl ? m_impl->num_segments : 0;
+}
+
+size_t RingBuffer::num_bytes_free() const
+{
+    return m_impl ? m_impl->segment_size - m_impl->offset : 0;
+}
+
+bool RingBuffer::persistent() const
+{
+    return m_impl && m_impl->mapped_ptr;
 }
     
 }}//namespace
@@ -51,6 +51,12 @@ class Buffer
     void set_usage(GLenum theUsage);
     void set_stride(size_t theStride);
     void set_data(const void *theData, size_t num_bytes);
+
+    /*!
+     * update the_num_bytes, starting at the_offset, without reallocating the buffer.
+     * throws if the range exceeds the current size
+     */
+    void set_sub_data(const void *the_data, size_t the_num_bytes, size_t the_offset);
     
     template <typename T>
     inline void set_data(const std::vector<T> &the_vec)
@@ -65,6 +71,65 @@ private:
     
     void init(GLenum target = GL_ARRAY_BUFFER, GLenum usage = GL_STATIC_DRAW);
 };
+
+/*!
+ * A buffer divided into a number of segments which are used in turn (e.g. one per frame).
+ * Where supported (GL 4.4 / GL_ARB_buffer_storage) the buffer is persistently mapped and written directly,
+ * otherwise data is uploaded via glBufferSubData.
+ * Fences guard each segment, so the CPU never overwrites data still in use by the GPU.
+ */
+class RingBuffer
+{
+public:
+
+    RingBuffer(){};
+    RingBuffer(GLenum the_target, size_t the_segment_size, uint32_t the_num_segments = 3);
+
+    //! Emulates shared_ptr-like behavior
+    explicit operator bool() const { return m_impl.get(); }
+    void reset() { m_impl.reset(); }
+
+    /*!
+     * advance to the next segment, waiting for the GPU to release it, if necessary
+     */
+    void begin_segment();
+
+    /*!
+     * place a fence for the current segment. call this after issuing all commands reading from it
+     */
+    void end_segment();
+
+    /*!
+     * copy the_data into the current segment.
+     * the data is placed at an offset aligned to the_alignment, which is returned.
+     * returns -1 if the remaining space in the current segment is insufficient
+     */
+    int64_t push(const void *the_data, size_t the_num_bytes, size_t the_alignment = 1);
+
+    /*!
+     * reserve the_num_bytes in the current segment, at an offset aligned to the_alignment,
+     * which is stored in the_offset. returns a pointer for writing the data directly,
+     * valid until unmap() is called, or nullptr if the remaining space is insufficient
+     */
+    uint8_t* map(size_t the_num_bytes, size_t the_alignment, size_t &the_offset);
+
+    //! finish writing to the range returned by map()
+    void unmap();
+
+    uint32_t id() const;
+    GLenum target() const;
+    size_t segment_size() const;
+    uint32_t num_segments() const;
+
+    //! remaining space in the current segment
+    size_t num_bytes_free() const;
+
+    //! true if the buffer uses persistent mapping
+    bool persistent() const;
+
+private:
+    std::shared_ptr<struct RingBufferImpl> m_impl;
+};
     
 }}
 
@@ -8,6 +8,7 @@
 #include "Light.hpp"
 #include "Scene.hpp"
 #include "ShaderLibrary.h"
+#include "Profiler.hpp"
 #include "DeferredRenderer.hpp"
 
 namespace kinski{ namespace gl{
@@ -65,6 +66,15 @@ void DeferredRenderer::init()
     *m_mat_lighting_enviroment = *m_mat_lighting;
     m_mat_lighting_enviroment->set_shader(gl::Shader::create(unlit_vert, deferred_lighting_enviroment_frag));
     
+#if !defined(KINSKI_GLES)
+    // clustered lighting, single full-screen pass without stencil
+    m_mat_lighting_clustered = gl::Material::create();
+    *m_mat_lighting_clustered = *m_mat_lighting;
+    m_mat_lighting_clustered->set_stencil_test(false);
+    frag_src = glsl_version + "\n" + brdf_glsl + "\n" + deferred_lighting_clustered_frag;
+    m_mat_lighting_clustered->set_shader(gl::Shader::create(unlit_vert, frag_src));
+#endif
+
     m_mat_stencil = gl::Material::create(shader);
     m_mat_stencil->set_depth_test(true);
     m_mat_stencil->set_depth_write(false);
@@ -106,16 +116,6 @@ void DeferredRenderer::init()
     
     m_shader_shadow_omni = gl::Shader::create(empty_vert, linear_depth_frag, cube_layers_geom);
     m_shader_shadow_omni_skin = gl::Shader::create(empty_skin_vert, linear_depth_frag, cube_layers_geom);
-    
-    const uint32_t sz = 1024, cube_sz = 512;
-    
-    // create shadow fbo (spot + directional lights)
-    gl::Fbo::Format fbo_fmt;
-    fbo_fmt.num_color_buffers = 0;
-    m_fbo_shadow = gl::Fbo::create(sz, sz, fbo_fmt);
-    
-    // create shadow fbo (point lights)
-    m_fbo_shadow_cube = create_cube_framebuffer(cube_sz, false);
     KINSKI_CHECK_GL_ERRORS();
 #endif
 }
@@ -134,17 +134,34 @@ uint32_t DeferredRenderer::render_scene(const gl::SceneConstPtr &the_scene, cons
     if(m_g_buffer_resolution.x > 0 && m_g_buffer_resolution.y > 0){ resolution = m_g_buffer_resolution; }
 
     // culling
-    auto render_bin = cull(the_scene, the_cam, the_tags);
+    {
+        gl::ScopedProfile sp("cull", false);
+        m_cull_snapshot = create_cull_snapshot(the_scene, m_cull_snapshot);
+        m_render_bin = cull(m_cull_snapshot, the_cam, the_tags, m_render_bin, m_thread_pool);
+    }
 
     {
         gl::SaveFramebufferBinding sfb;
 
+        // update outdated shadow-maps
+        {
+            gl::ScopedProfile sp("shadow");
+            shadow_pass(m_render_bin);
+        }
+
         // create G-buffer, if necessary, and fill it
-        geometry_pass(resolution, render_bin);
+        {
+            gl::ScopedProfile sp("g-buffer");
+            geometry_pass(resolution, m_render_bin);
+        }
 
         // lighting pass
-        light_pass(resolution, render_bin);
+        {
+            gl::ScopedProfile sp("light");
+            light_pass(resolution, m_render_bin);
+        }
     }
+    gl::ScopedProfile sp_resolve("resolve");
 
     // skybox drawing
     if(the_scene->skybox())
@@ -165,7 +182,7 @@ uint32_t DeferredRenderer::render_scene(const gl::SceneConstPtr &the_scene, cons
     gl::draw_quad(gl::window_dimension(), m_mat_resolve);
     
     // return number of rendered objects
-    return render_bin->items.size();
+    return m_render_bin->num_items();
 #endif
     return 0;
 }
@@ -191,11 +208,13 @@ void DeferredRenderer::geometry_pass(const gl::ivec2 &the_size, const RenderBinP
         KINSKI_CHECK_GL_ERRORS();
     }
 
-    std::list<RenderBin::item> opaque_items, blended_items;
-    sort_render_bin(the_renderbin, opaque_items, blended_items);
-    
-    // tmp hack to draw all geometry
-    opaque_items.insert(opaque_items.end(), blended_items.begin(), blended_items.end());
+    {
+        gl::ScopedProfile sp("sort", false);
+        sort_render_bin(the_renderbin);
+    }
+
+    // shader-overrides are assigned per mesh, only batch when there are none
+    batch_render_bin(the_renderbin, [this](const gl::MeshPtr&){ return m_override_shader_map.empty(); });
     
     // bind G-Buffer
     gl::SaveViewPort sv;
@@ -225,18 +244,43 @@ void DeferredRenderer::geometry_pass(const gl::ivec2 &the_size, const RenderBinP
         return m_shader_map[key];
     };
     
-    for (const RenderBin::item &item : opaque_items)
+    gl::ScopedMatrixPush mv(gl::MODEL_VIEW_MATRIX), proj(gl::PROJECTION_MATRIX);
+    gl::set_projection(the_renderbin->camera);
+
+    // tmp hack to draw all geometry (opaque and blended)
+    for(const auto &batch : the_renderbin->batches)
     {
-        gl::ScopedMatrixPush mv(gl::MODEL_VIEW_MATRIX), proj(gl::PROJECTION_MATRIX);
-        gl::set_projection(the_renderbin->camera);
-        gl::load_matrix(gl::MODEL_VIEW_MATRIX, item.transform);
-        gl::draw_mesh(item.mesh, select_shader(item.mesh));
+        draw_batch(the_renderbin, batch, select_shader(the_renderbin->meshes[*batch.begin()]));
     }
 #endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
+void DeferredRenderer::draw_batch(const RenderBinPtr &the_renderbin, const RenderBin::range_t &the_batch,
+                                  const gl::ShaderPtr &the_shader)
+{
+    const gl::MeshPtr &mesh = the_renderbin->meshes[*the_batch.begin()];
+    const uint32_t lod = the_renderbin->lods[*the_batch.begin()];
+
+    if(the_batch.size() > 1)
+    {
+        m_instance_transforms.clear();
+        for(uint32_t i : the_batch){ m_instance_transforms.push_back(the_renderbin->transforms[i]); }
+
+        // transforms are already in eye-coords
+        gl::load_identity(gl::MODEL_VIEW_MATRIX);
+        gl::draw_mesh_instanced(mesh, m_instance_transforms, the_shader, lod);
+    }
+    else
+    {
+        gl::load_matrix(gl::MODEL_VIEW_MATRIX, the_renderbin->transforms[*the_batch.begin()]);
+        gl::draw_mesh(mesh, the_shader, lod);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 void DeferredRenderer::light_pass(const gl::ivec2 &the_size, const RenderBinPtr &the_renderbin)
 {
 #if !defined(KINSKI_GLES_2)
@@ -260,6 +304,7 @@ void DeferredRenderer::light_pass(const gl::ivec2 &the_size, const RenderBinPtr
             m_mat_lighting_shadow->add_texture(m_fbo_geometry->texture(i), i);
             m_mat_lighting_shadow_omni->add_texture(m_fbo_geometry->texture(i), i);
             m_mat_lighting_enviroment->add_texture(m_fbo_geometry->texture(i), i);
+            if(m_mat_lighting_clustered){ m_mat_lighting_clustered->add_texture(m_fbo_geometry->texture(i), i); }
         }
     }
     gl::SaveViewPort sv;
@@ -288,50 +333,86 @@ void DeferredRenderer::light_pass(const gl::ivec2 &the_size, const RenderBinPtr
     glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
     m_fbo_lighting->enable_draw_buffers(true);
     render_light_volumes(the_renderbin, false);
+
+    if(m_use_clustered_lighting){ render_clustered_lights(the_renderbin); }
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void DeferredRenderer::shadow_pass(const RenderBinPtr &the_renderbin)
+{
+#if !defined(KINSKI_GLES_2)
+    std::vector<gl::LightPtr> shadow_lights;
+
+    for(const auto &l : the_renderbin->lights)
+    {
+        if(l.light->cast_shadow()){ shadow_lights.push_back(l.light); }
+    }
+
+    auto create_fbo = [](const gl::LightPtr &l)
+    {
+        const uint32_t sz = 1024, cube_sz = 512;
+
+        // point lights use cube-maps
+        if(l->type() == gl::Light::POINT){ return create_cube_framebuffer(cube_sz, false); }
+
+        gl::Fbo::Format fbo_fmt;
+        fbo_fmt.num_color_buffers = 0;
+        return gl::Fbo::create(sz, sz, fbo_fmt);
+    };
+    auto shadow_maps = update_shadow_maps(shadow_lights, std::numeric_limits<float>::max(), create_fbo,
+                                          [this](shadow_map_t &m){ render_shadow_map(m); });
+
+    // align with the lights in the_renderbin
+    m_light_shadow_maps.clear();
+    auto it = shadow_maps.begin();
+
+    for(const auto &l : the_renderbin->lights)
+    {
+        m_light_shadow_maps.push_back(l.light->cast_shadow() ? *it++ : nullptr);
+    }
 #endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-gl::Texture DeferredRenderer::create_shadow_map(const RenderBinPtr &the_renderbin,
-                                                const gl::LightPtr &l)
+void DeferredRenderer::render_shadow_map(shadow_map_t &the_map)
 {
 #if !defined(KINSKI_GLES_2)
-    auto shadow_cam = gl::create_shadow_camera(l, l->radius());
-    auto bin = cull(the_renderbin->scene, shadow_cam);
-    std::list<RenderBin::item> opaque_items, blended_items;
-    sort_render_bin(bin, opaque_items, blended_items);
+    auto l = the_map.light.lock();
+    const auto &bin = the_map.casters;
+    sort_render_bin(bin);
+    batch_render_bin(bin);
     
     if(l->type() == gl::Light::SPOT || l->type() == gl::Light::DIRECTIONAL)
     {
         // offscreen render shadow map here
-        gl::render_to_texture(m_fbo_shadow, [&]()
+        gl::render_to_texture(the_map.fbo, [&]()
         {
             gl::reset_state();
             glClear(GL_DEPTH_BUFFER_BIT);
             gl::ScopedMatrixPush mv(gl::MODEL_VIEW_MATRIX), proj(gl::PROJECTION_MATRIX);
             gl::set_projection(bin->camera);
           
-            for(const RenderBin::item &item : opaque_items)
+            for(uint32_t b = 0; b < bin->num_opaque_batches; ++b)
             {
+                const auto &batch = bin->batches[b];
+                const gl::MeshPtr &mesh = bin->meshes[*batch.begin()];
+
                 // filter out non-shadow casters
-                if(!(item.mesh->material()->shadow_properties() & gl::Material::SHADOW_CAST)){ continue; }
-              
-                gl::load_matrix(gl::MODEL_VIEW_MATRIX, item.transform);
-                gl::ShaderPtr shader = item.mesh->geometry()->has_bones() ? m_shader_shadow_skin : m_shader_shadow;
-                gl::draw_mesh(item.mesh, shader);
+                if(!(mesh->material()->shadow_properties() & gl::Material::SHADOW_CAST)){ continue; }
+
+                gl::ShaderPtr shader = mesh->geometry()->has_bones() ? m_shader_shadow_skin : m_shader_shadow;
+                draw_batch(bin, batch, shader);
             }
         });
-        mat4 shadow_matrix = shadow_cam->projection_matrix() * shadow_cam->view_matrix() *
-        the_renderbin->camera->global_transform();
-        m_mat_lighting_shadow->uniform("u_shadow_matrix", shadow_matrix);
-        return m_fbo_shadow->depth_texture();
     }
     else if(l->type() == gl::Light::POINT)
     {
         KINSKI_CHECK_GL_ERRORS();
         
-        auto cube_cam = std::dynamic_pointer_cast<CubeCamera>(shadow_cam);
+        auto cube_cam = std::dynamic_pointer_cast<CubeCamera>(the_map.camera);
         
         std::vector<glm::mat4> cam_matrices = cube_cam->view_matrices();
         
@@ -346,32 +427,28 @@ gl::Texture DeferredRenderer::create_shadow_map(const RenderBinPtr &the_renderbi
         KINSKI_CHECK_GL_ERRORS();
         
         // offscreen render shadow map here
-        gl::render_to_texture(m_fbo_shadow_cube, [&]()
+        gl::render_to_texture(the_map.fbo, [&]()
         {
             gl::reset_state();
             glClear(GL_DEPTH_BUFFER_BIT);
             gl::ScopedMatrixPush mv(gl::MODEL_VIEW_MATRIX), proj(gl::PROJECTION_MATRIX);
             gl::load_identity(gl::PROJECTION_MATRIX);
           
-            for(const RenderBin::item &item : opaque_items)
+            for(uint32_t i : bin->opaque_items())
             {
+                const gl::MeshPtr &mesh = bin->meshes[i];
+
                 // filter out non-shadow casters
-                if(!(item.mesh->material()->shadow_properties() & gl::Material::SHADOW_CAST)){ continue; }
+                if(!(mesh->material()->shadow_properties() & gl::Material::SHADOW_CAST)){ continue; }
               
-                gl::load_matrix(gl::MODEL_VIEW_MATRIX, item.mesh->global_transform());
-                gl::ShaderPtr shader = item.mesh->geometry()->has_bones() ?
+                gl::load_matrix(gl::MODEL_VIEW_MATRIX, mesh->global_transform());
+                gl::ShaderPtr shader = mesh->geometry()->has_bones() ?
                     m_shader_shadow_omni_skin : m_shader_shadow_omni;
-                gl::draw_mesh(item.mesh, shader);
+                gl::draw_mesh(mesh, shader, bin->lods[i]);
             }
         });
-        m_mat_lighting_shadow_omni->uniform("u_clip_planes", vec2(cube_cam->near(), cube_cam->far()));
-        m_mat_lighting_shadow_omni->uniform("u_camera_transform",
-                                            the_renderbin->camera->global_transform());
-        m_mat_lighting_shadow_omni->uniform("u_poisson_radius", .005f);
-        return m_fbo_shadow_cube->depth_texture();
     }
 #endif
-    return gl::Texture();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -385,20 +462,39 @@ void DeferredRenderer::render_light_volumes(const RenderBinPtr &the_renderbin, b
     gl::MaterialPtr mat = stencil_pass ? m_mat_stencil : m_mat_lighting;
     int light_index = 0;
 
-    for(auto l : the_renderbin->lights)
+    for(const auto &l : the_renderbin->lights)
     {
+        auto *shadow_map = light_index < (int)m_light_shadow_maps.size() ? m_light_shadow_maps[light_index] : nullptr;
+        bool has_shadow = shadow_map && shadow_map->fbo;
+
+        // lights without shadows are handled by the cluster-grid
+        if(m_use_clustered_lighting && m_mat_lighting_clustered && !has_shadow)
+        {
+            light_index++;
+            continue;
+        }
+
         if(!stencil_pass)
         {
-            if(l.light->cast_shadow())
+            if(has_shadow)
             {
-                auto shadow_map = create_shadow_map(the_renderbin, l.light);
-                
-                if(shadow_map)
+                const auto &shadow_cam = shadow_map->render_camera;
+
+                if(l.light->type() == gl::Light::POINT)
                 {
-                    mat = (l.light->type() == gl::Light::POINT) ?
-                        m_mat_lighting_shadow_omni : m_mat_lighting_shadow;
-                    mat->add_texture(shadow_map, Texture::Usage::SHADOW);
+                    mat = m_mat_lighting_shadow_omni;
+                    mat->uniform("u_clip_planes", vec2(shadow_cam->near(), shadow_cam->far()));
+                    mat->uniform("u_camera_transform", the_renderbin->camera->global_transform());
+                    mat->uniform("u_poisson_radius", .005f);
                 }
+                else
+                {
+                    mat = m_mat_lighting_shadow;
+                    mat4 shadow_matrix = shadow_cam->projection_matrix() * shadow_cam->view_matrix() *
+                                         the_renderbin->camera->global_transform();
+                    mat->uniform("u_shadow_matrix", shadow_matrix);
+                }
+                mat->add_texture(shadow_map->fbo->depth_texture(), Texture::Usage::SHADOW);
             }
             else{ mat = m_mat_lighting; }
         }
@@ -473,6 +569,90 @@ void DeferredRenderer::render_light_volumes(const RenderBinPtr &the_renderbin, b
 #endif
 }
     
+///////////////////////////////////////////////////////////////////////////////
+
+void DeferredRenderer::render_clustered_lights(const RenderBinPtr &the_renderbin)
+{
+#if !defined(KINSKI_GLES)
+    if(!m_mat_lighting_clustered){ return; }
+    const auto &cam = the_renderbin->camera;
+
+    // bounding-spheres in eye-coords and parameters (Lightsource layout) for lights without shadows
+    m_light_spheres.clear();
+    m_light_data.clear();
+    uint32_t light_index = 0;
+
+    for(const auto &l : the_renderbin->lights)
+    {
+        auto *shadow_map = light_index < m_light_shadow_maps.size() ? m_light_shadow_maps[light_index] : nullptr;
+        light_index++;
+        if(shadow_map && shadow_map->fbo){ continue; }
+
+        // directional- and area-lights affect all clusters
+        bool is_local = l.light->type() == Light::POINT || l.light->type() == Light::SPOT;
+        m_light_spheres.push_back(vec4(l.transform[3].xyz(), is_local ? l.light->radius() : -1.f));
+
+        m_light_data.push_back(vec4(l.transform[3].xyz(), l.light->type()));
+        m_light_data.push_back(l.light->diffuse());
+        m_light_data.push_back(l.light->ambient());
+        m_light_data.push_back(vec4(glm::normalize(-vec3(l.transform[2].xyz())), l.light->intensity()));
+        m_light_data.push_back(vec4(l.light->radius(), cosf(glm::radians(l.light->spot_cutoff())),
+                                    l.light->spot_exponent(), l.light->attenuation().quadratic));
+    }
+    if(m_light_spheres.empty()){ return; }
+
+    {
+        gl::ScopedProfile sp("light-grid", false);
+        m_light_grid.update(cam->projection_matrix(), cam->near(), cam->far(), m_light_spheres, m_thread_pool);
+    }
+
+    // upload grid and lights
+    const auto &light_indices = m_light_grid.light_indices();
+    bool create_textures = !m_cluster_buffer;
+
+    if(create_textures)
+    {
+        m_cluster_buffer = gl::Buffer(GL_TEXTURE_BUFFER, GL_STREAM_DRAW);
+        m_light_index_buffer = gl::Buffer(GL_TEXTURE_BUFFER, GL_STREAM_DRAW);
+        m_light_data_buffer = gl::Buffer(GL_TEXTURE_BUFFER, GL_STREAM_DRAW);
+    }
+    m_cluster_buffer.set_data(m_light_grid.clusters());
+    m_light_data_buffer.set_data(m_light_data);
+
+    // avoid empty buffers
+    if(light_indices.empty()){ m_light_index_buffer.set_data(std::vector<uint32_t>(1, 0)); }
+    else{ m_light_index_buffer.set_data(light_indices); }
+
+    if(create_textures)
+    {
+        // buffer-names stay the same when orphaned, so the textures are only attached once
+        GLuint tex_ids[3];
+        glGenTextures(3, tex_ids);
+        const gl::Buffer *buffers[3] = {&m_cluster_buffer, &m_light_index_buffer, &m_light_data_buffer};
+        gl::Texture *textures[3] = {&m_cluster_texture, &m_light_index_texture, &m_light_data_texture};
+        const GLenum formats[3] = {GL_RG32UI, GL_R32UI, GL_RGBA32UI};
+
+        for(uint32_t i = 0; i < 3; ++i)
+        {
+            *textures[i] = gl::Texture(GL_TEXTURE_BUFFER, tex_ids[i], 0, 0, false);
+            gl::context()->bind_texture(GL_TEXTURE_BUFFER, tex_ids[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]->id());
+        }
+        m_mat_lighting_clustered->add_texture(m_cluster_texture, G_BUFFER_SIZE);
+        m_mat_lighting_clustered->add_texture(m_light_index_texture, G_BUFFER_SIZE + 1);
+        m_mat_lighting_clustered->add_texture(m_light_data_texture, G_BUFFER_SIZE + 2);
+    }
+    m_mat_lighting_clustered->uniform("u_grid_dims", vec3(m_light_grid.dimensions()));
+    m_mat_lighting_clustered->uniform("u_clip_planes", vec2(cam->near(), cam->far()));
+
+    gl::ScopedMatrixPush mv(gl::MODEL_VIEW_MATRIX), proj(gl::PROJECTION_MATRIX);
+    gl::set_projection(cam);
+    gl::load_identity(gl::MODEL_VIEW_MATRIX);
+    m_frustum_mesh->materials()[0] = m_mat_lighting_clustered;
+    gl::draw_mesh(m_frustum_mesh);
+#endif
+}
+
 ///////////////////////////////////////////////////////////////////////////////
     
 gl::Texture DeferredRenderer::create_env_diff(const gl::Texture &the_env_tex)
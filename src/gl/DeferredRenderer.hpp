@@ -5,6 +5,7 @@
 
 #include <unordered_map>
 #include "SceneRenderer.hpp"
+#include "LightGrid.hpp"
 
 namespace kinski{ namespace gl {
 
@@ -34,6 +35,11 @@ public:
     bool use_fxaa() const{ return m_use_fxaa; };
     void set_use_fxaa(bool b);
 
+    bool use_clustered_lighting() const{ return m_use_clustered_lighting; };
+
+    //! shade all lights without shadows in a single full-screen pass, using a cluster-grid
+    void set_use_clustered_lighting(bool b){ m_use_clustered_lighting = b; };
+
     void set_enviroment_light_strength(float v){ m_enviroment_light_strength = v; };
     float enviroment_light_strength() const{ return m_enviroment_light_strength; };
 
@@ -50,9 +56,19 @@ private:
     void init();
     void geometry_pass(const gl::ivec2 &the_size, const RenderBinPtr &the_renderbin);
     void light_pass(const gl::ivec2 &the_size, const RenderBinPtr &the_renderbin);
+
+    //! draw a batch of items from the_renderbin, using a single instanced draw-call if possible
+    void draw_batch(const RenderBinPtr &the_renderbin, const RenderBin::range_t &the_batch,
+                    const gl::ShaderPtr &the_shader);
     void stencil_pass(const RenderBinPtr &the_renderbin);
     void render_light_volumes(const RenderBinPtr &the_renderbin, bool stencil_pass);
-    gl::Texture create_shadow_map(const RenderBinPtr &the_renderbin, const gl::LightPtr &l);
+
+    //! assign lights without shadows to clusters and shade them in a single full-screen pass
+    void render_clustered_lights(const RenderBinPtr &the_renderbin);
+
+    //! update cached shadow-maps for all shadow-casting lights in the_renderbin
+    void shadow_pass(const RenderBinPtr &the_renderbin);
+    void render_shadow_map(shadow_map_t &the_map);
     gl::Texture create_env_diff(const gl::Texture &the_env_tex);
     gl::Texture create_env_spec(const gl::Texture &the_env_tex);
     gl::Texture create_brdf_lut();
@@ -65,14 +81,27 @@ private:
     std::unordered_map<gl::Mesh*, gl::ShaderPtr> m_override_shader_map;
 
     gl::ShaderPtr m_shader_shadow, m_shader_shadow_skin, m_shader_shadow_omni, m_shader_shadow_omni_skin;
-    gl::FboPtr m_fbo_geometry, m_fbo_lighting, m_fbo_shadow, m_fbo_shadow_cube;
+    gl::FboPtr m_fbo_geometry, m_fbo_lighting;
+
+    //! shadow-maps for the lights in m_render_bin, nullptr for lights without shadows
+    std::vector<shadow_map_t*> m_light_shadow_maps;
 
     gl::MaterialPtr m_mat_lighting, m_mat_lighting_shadow, m_mat_lighting_shadow_omni,
-    m_mat_lighting_enviroment, m_mat_stencil, m_mat_resolve;
+    m_mat_lighting_enviroment, m_mat_lighting_clustered, m_mat_stencil, m_mat_resolve;
     gl::MeshPtr m_mesh_sphere, m_mesh_cone, m_frustum_mesh;
     
     bool m_use_fxaa = true;
 
+    bool m_use_clustered_lighting = false;
+    gl::LightGrid m_light_grid;
+
+    //! bounding-spheres and packed parameters of the lights handled by m_light_grid
+    std::vector<vec4> m_light_spheres, m_light_data;
+
+    //! cluster-grid, light-indices and light-parameters, accessed as texture-buffers
+    gl::Buffer m_cluster_buffer, m_light_index_buffer, m_light_data_buffer;
+    gl::Texture m_cluster_texture, m_light_index_texture, m_light_data_texture;
+
     float m_enviroment_light_strength = 1.0;
     gl::MeshPtr m_skybox;
     gl::Texture m_env_conv_diff, m_env_conv_spec, m_brdf_lut;
@@ -586,7 +586,7 @@ void Fbo::bind_texture(int the_texture_unit, int the_attachment)
 
 void Fbo::unbind_texture()
 {
-    glBindTexture(target(), 0);
+    gl::context()->bind_texture(target(), 0);
 }
 
 void Fbo::bind_depth_texture(int the_texture_unit)
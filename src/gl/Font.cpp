@@ -11,131 +11,535 @@
 //
 //  Created by Fabian on 3/9/13.
 
+#include <list>
+#include <unordered_map>
 #include <crocore/filesystem.hpp>
 #include "Texture.hpp"
 #include "Mesh.hpp"
 #include "Font.hpp"
 
-#define STB_RECT_PACK_IMPLEMENTATION
-
-#include "stb_rect_pack.h"
-
 //#define STBTT_RASTERIZER_VERSION 1
 #define STB_TRUETYPE_IMPLEMENTATION
 
 #include "stb_truetype.h"
 
+#include <locale>
 #include <codecvt>
 // -> fallback to boost/locale
 //#include <boost/locale/encoding_utf.hpp>
 
-std::wstring utf8_to_wstring(const std::string &str)
+std::u32string utf8_to_utf32(const std::string &str)
 {
-    // the UTF-8 / UTF-16 standard conversion facet
-    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> utf16conv;
-    return utf16conv.from_bytes(str);
-//    return boost::locale::conv::utf_to_utf<wchar_t>(str.c_str(), str.c_str() + str.size());
+    // the UTF-8 / UTF-32 standard conversion facet
+    std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> utf32conv;
+    return utf32conv.from_bytes(str);
+//    return boost::locale::conv::utf_to_utf<char32_t>(str.c_str(), str.c_str() + str.size());
 }
 
-//std::string wstring_to_utf8(const std::wstring& str)
-//{
-//    return utf_to_utf<char>(str.c_str(), str.c_str() + str.size());
-//}
+std::string utf32_to_utf8(const std::u32string &str)
+{
+    std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> utf32conv;
+    return utf32conv.to_bytes(str);
+}
 
 #define BITMAP_WIDTH(font_sz) font_sz > 50 ? 2048 : 1024
 
 namespace kinski {
 namespace gl {
 
-struct string_mesh_container
+namespace
 {
-    std::string text;
-    MeshPtr mesh;
-    uint64_t counter;
+    //! maximum number of atlas-pages, before rows of glyphs are evicted
+    constexpr uint32_t g_max_pages = 4;
 
-    string_mesh_container() : counter(0) {};
+    //! how many string meshes are buffered at max
+    constexpr size_t g_max_mesh_buffer_size = 500;
 
-    string_mesh_container(const std::string &t, const MeshPtr &m) : text(t), mesh(m), counter(0) {}
+    //! workaround for weirdness in stb_truetype (blank 1st characters on line)
+    constexpr float g_start_x = 0.5f;
+
+    std::unique_ptr<uint8_t[]> create_luminance_alpha(const uint8_t *the_data, size_t the_num_pixels)
+    {
+        auto ret = std::unique_ptr<uint8_t[]>(new uint8_t[2 * the_num_pixels]);
+        uint8_t *out_ptr = ret.get(), *data_end = ret.get() + 2 * the_num_pixels;
 
-    bool operator<(const string_mesh_container &other) const { return counter < other.counter; }
+        for(; out_ptr < data_end; out_ptr += 2, ++the_data)
+        {
+            out_ptr[0] = 255;
+            out_ptr[1] = *the_data;
+        }
+        return ret;
+    }
+
+    //! replace the rows [the_y, the_y + the_img->height()) of the_tex with the content of the_img
+    void upload_rows(gl::Texture &the_tex, const crocore::ImagePtr &the_img, uint32_t the_y)
+    {
+        size_t num_pixels = the_img->width() * the_img->height();
+        bool use_float = the_img->num_bytes() / (num_pixels * the_img->num_components()) > 1;
+        const void *data = the_img->data();
+        GLenum format = 0, internal_format = 0;
+        get_texture_format(the_img->num_components(), false, use_float ? GL_FLOAT : GL_UNSIGNED_BYTE, &format,
+                           &internal_format);
+
+#if defined(KINSKI_ARM)
+        std::unique_ptr<uint8_t[]> luminance_alpha_data;
+
+        if(the_tex.internal_format() == GL_LUMINANCE_ALPHA)
+        {
+            luminance_alpha_data = create_luminance_alpha(the_img->data(), num_pixels);
+            data = luminance_alpha_data.get();
+            format = GL_LUMINANCE_ALPHA;
+        }
+#endif
+        the_tex.bind();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, the_y, the_img->width(), the_img->height(), format,
+                        use_float ? GL_FLOAT : GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        KINSKI_CHECK_GL_ERRORS();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct glyph_t
+{
+    //! quad-extents relative to the pen-position
+    float x0 = 0.f, y0 = 0.f, x1 = 0.f, y1 = 0.f;
+    float advance = 0.f;
+
+    //! pixel-rect within the atlas-page
+    uint32_t x = 0, y = 0, width = 0, height = 0;
+    uint32_t page = 0, row = 0;
+};
+
+struct glyph_quad_t
+{
+    stbtt_aligned_quad quad;
+    uint32_t page;
+};
+
+struct atlas_row_t
+{
+    uint32_t y = 0;
+
+    //! horizontal position for the next glyph
+    uint32_t cursor = 0;
+    uint64_t last_used = 0;
+    std::vector<char32_t> codepoints;
+};
+
+struct atlas_page_t
+{
+    crocore::Image_<uint8_t>::Ptr bitmap;
+    Texture texture, sdf_texture;
+    std::vector<atlas_row_t> rows;
+
+    //! pixel-rows modified since the last upload
+    uint32_t dirty_begin = std::numeric_limits<uint32_t>::max(), dirty_end = 0;
+
+    //! shared material used by TextBatch
+    gl::MaterialPtr batch_material;
+};
+
+//! a range of codepoints forming a line of text and its horizontal extents
+struct line_t
+{
+    size_t begin = 0, end = 0;
+    float width = 0.f;
+};
+
+struct string_mesh_container
+{
+    std::string text;
+    MeshPtr mesh;
+    uint64_t generation = 0;
 };
 
 struct FontImpl
 {
     std::string path;
-    std::unique_ptr<stbtt_packedchar[]> char_data;
+    std::vector<uint8_t> font_data;
+    stbtt_fontinfo font_info = {};
+    float scale = 1.f;
     uint32_t font_height;
     uint32_t line_height;
-
-    crocore::Image_<uint8_t>::Ptr bitmap;
-    Texture texture, sdf_texture;
     bool use_sdf;
 
-    // how many string meshes are buffered at max
-    size_t max_mesh_buffer_size;
-    std::unordered_map<std::string, string_mesh_container> string_mesh_map;
+    uint32_t page_width = 0;
+    uint32_t row_height = 0;
+    uint32_t padding = 0;
+    std::vector<atlas_page_t> pages;
+    std::unordered_map<char32_t, glyph_t> glyphs;
 
-    FontImpl() :
-            max_mesh_buffer_size(500)
+    //! advanced per operation, rows touched during the current operation are not evicted
+    uint64_t tick = 0;
+
+    //! advanced when glyphs are evicted or the font is reloaded, outdates existing quads
+    uint64_t generation = 0;
+
+    // least recently used string-meshes at the back
+    std::list<string_mesh_container> string_mesh_list;
+    std::unordered_map<std::string, std::list<string_mesh_container>::iterator> string_mesh_map;
+
+    FontImpl()
     {
         font_height = 64;
         line_height = 70;
         use_sdf = false;
     }
 
-    std::tuple<crocore::Image_<uint8_t>::Ptr, std::unique_ptr<stbtt_packedchar[]>>
-    create_bitmap(const std::vector<uint8_t> &the_font, float the_font_size,
-                  uint32_t the_bitmap_width, uint32_t the_padding)
+    void init(std::vector<uint8_t> the_font, uint32_t the_font_size, bool the_use_sdf)
+    {
+        font_data = std::move(the_font);
+
+        if(!stbtt_InitFont(&font_info, font_data.data(), stbtt_GetFontOffsetForIndex(font_data.data(), 0)))
+        {
+            throw std::runtime_error("could not parse font: " + path);
+        }
+        scale = stbtt_ScaleForPixelHeight(&font_info, the_font_size);
+        font_height = the_font_size;
+        line_height = the_font_size;
+        use_sdf = the_use_sdf;
+        padding = use_sdf ? 6 : 2;
+        page_width = BITMAP_WIDTH(the_font_size);
+
+        int x0, y0, x1, y1;
+        stbtt_GetFontBoundingBox(&font_info, &x0, &y0, &x1, &y1);
+        row_height = std::min<uint32_t>(std::ceil((y1 - y0) * scale) + 1 + padding, page_width);
+
+        pages.clear();
+        glyphs.clear();
+        string_mesh_list.clear();
+        string_mesh_map.clear();
+        generation++;
+
+        // rasterise printable ASCII up front, everything else on demand
+        tick++;
+        for(char32_t c = 32; c < 127; ++c){ glyph(c); }
+    }
+
+    //! find space for a glyph of the_width pixels, adds rows and pages or evicts the least recently used row
+    void allocate(uint32_t the_width, uint32_t *the_page, uint32_t *the_row)
     {
-        std::unique_ptr<stbtt_packedchar[]> c_data(new stbtt_packedchar[1024]);
-        auto img = crocore::Image_<uint8_t>::create(the_bitmap_width, the_bitmap_width, 1);
-
-        // rect packing
-        stbtt_pack_context spc;
-        stbtt_PackBegin(&spc, (uint8_t*)img->data(), img->width(), img->height(), 0, the_padding, nullptr);
-
-        int num_chars = 768;
-        stbtt_PackFontRange(&spc, const_cast<uint8_t *>(the_font.data()), 0, the_font_size, 32,
-                            num_chars, c_data.get());
-        stbtt_PackEnd(&spc);
-        return std::make_tuple(img, std::move(c_data));
+        // first fit within existing rows
+        for(uint32_t p = 0; p < pages.size(); ++p)
+        {
+            for(uint32_t r = 0; r < pages[p].rows.size(); ++r)
+            {
+                if(pages[p].rows[r].cursor + the_width <= page_width)
+                {
+                    *the_page = p;
+                    *the_row = r;
+                    return;
+                }
+            }
+        }
+
+        // new row on the last page
+        if(!pages.empty() && (pages.back().rows.size() + 1) * row_height <= page_width)
+        {
+            auto &page = pages.back();
+            atlas_row_t row;
+            row.y = page.rows.size() * row_height;
+            page.rows.push_back(row);
+            *the_page = pages.size() - 1;
+            *the_row = page.rows.size() - 1;
+            return;
+        }
+
+        // new page
+        if(pages.size() < g_max_pages)
+        {
+            atlas_page_t page;
+            page.bitmap = crocore::Image_<uint8_t>::create(page_width, page_width, 1);
+            memset(page.bitmap->data(), 0, page.bitmap->num_bytes());
+            page.rows.push_back(atlas_row_t());
+            pages.push_back(std::move(page));
+            *the_page = pages.size() - 1;
+            *the_row = 0;
+            return;
+        }
+
+        // evict the least recently used row, preferably one not in use by the current operation
+        *the_page = *the_row = 0;
+        uint64_t min_used = std::numeric_limits<uint64_t>::max();
+
+        for(uint32_t p = 0; p < pages.size(); ++p)
+        {
+            for(uint32_t r = 0; r < pages[p].rows.size(); ++r)
+            {
+                if(pages[p].rows[r].last_used < min_used)
+                {
+                    min_used = pages[p].rows[r].last_used;
+                    *the_page = p;
+                    *the_row = r;
+                }
+            }
+        }
+        LOG_WARNING_IF(min_used == tick) << "glyph-atlas exhausted, evicting glyphs in use";
+
+        auto &page = pages[*the_page];
+        auto &row = page.rows[*the_row];
+        for(auto c : row.codepoints){ glyphs.erase(c); }
+        row.codepoints.clear();
+        row.cursor = 0;
+
+        uint8_t *row_ptr = page.bitmap->data() + row.y * page_width;
+        memset(row_ptr, 0, row_height * page_width);
+        set_dirty(page, row.y, row.y + row_height);
+        generation++;
     }
 
-    std::list<stbtt_aligned_quad> create_quads(const std::string &the_text,
-                                               uint32_t *the_max_x, uint32_t *the_max_y)
+    void set_dirty(atlas_page_t &the_page, uint32_t the_begin, uint32_t the_end)
     {
-        // workaround for weirdness in stb_truetype (blank 1st characters on line)
-        constexpr float start_x = 0.5f;
-        float x = start_x;
-        float y = 0.f;
-        stbtt_aligned_quad q;
-        std::list<stbtt_aligned_quad> quads;
+        the_page.dirty_begin = std::min(the_page.dirty_begin, the_begin);
+        the_page.dirty_end = std::max(the_page.dirty_end, std::min(the_end, page_width));
+    }
 
-        // converts the codepoints to 16bit
-        auto wstr = utf8_to_wstring(the_text);
+    //! lookup a glyph, rasterise it into the atlas if necessary
+    const glyph_t& glyph(char32_t the_codepoint)
+    {
+        auto it = glyphs.find(the_codepoint);
 
-        for(auto it = wstr.begin(); it != wstr.end(); ++it)
+        if(it != glyphs.end())
+        {
+            pages[it->second.page].rows[it->second.row].last_used = tick;
+            return it->second;
+        }
+        int glyph_index = stbtt_FindGlyphIndex(&font_info, the_codepoint);
+        int advance, left_bearing, ix0, iy0, ix1, iy1;
+        stbtt_GetGlyphHMetrics(&font_info, glyph_index, &advance, &left_bearing);
+        stbtt_GetGlyphBitmapBox(&font_info, glyph_index, scale, scale, &ix0, &iy0, &ix1, &iy1);
+
+        glyph_t g;
+        g.width = std::min<uint32_t>(ix1 - ix0, page_width - padding);
+        g.height = std::min<uint32_t>(iy1 - iy0, row_height - padding);
+        g.x0 = ix0;
+        g.y0 = iy0;
+        g.x1 = ix0 + g.width;
+        g.y1 = iy0 + g.height;
+        g.advance = scale * advance;
+
+        allocate(g.width + padding, &g.page, &g.row);
+        auto &page = pages[g.page];
+        auto &row = page.rows[g.row];
+        g.x = row.cursor;
+        g.y = row.y;
+        row.cursor += g.width + padding;
+        row.last_used = tick;
+        row.codepoints.push_back(the_codepoint);
+
+        if(g.width && g.height)
         {
-            const auto &codepoint = *it;
+            stbtt_MakeGlyphBitmap(&font_info, page.bitmap->data() + g.y * page_width + g.x, g.width, g.height,
+                                  page_width, scale, scale, glyph_index);
+            set_dirty(page, row.y, row.y + row_height);
+        }
+        return glyphs[the_codepoint] = g;
+    }
+
+    //! create the quad for the_glyph at the pen-position (x, y) and advance x
+    glyph_quad_t create_quad(const glyph_t &the_glyph, float *x, float y) const
+    {
+        const float inv_width = 1.f / page_width;
+        glyph_quad_t ret;
+        ret.page = the_glyph.page;
+        ret.quad.x0 = *x + the_glyph.x0;
+        ret.quad.y0 = y + the_glyph.y0;
+        ret.quad.x1 = *x + the_glyph.x1;
+        ret.quad.y1 = y + the_glyph.y1;
+        ret.quad.s0 = the_glyph.x * inv_width;
+        ret.quad.t0 = the_glyph.y * inv_width;
+        ret.quad.s1 = (the_glyph.x + the_glyph.width) * inv_width;
+        ret.quad.t1 = (the_glyph.y + the_glyph.height) * inv_width;
+        *x += the_glyph.advance;
+        return ret;
+    }
+
+    //! append quads for the codepoints [the_begin, the_end) of the_text, starting at the_offset
+    void append_quads(const std::u32string &the_text, size_t the_begin, size_t the_end, const vec2 &the_offset,
+                      std::vector<glyph_quad_t> &the_quads)
+    {
+        float x = the_offset.x + g_start_x;
+        float y = the_offset.y;
 
+        for(size_t i = the_begin; i < the_end; ++i)
+        {
             //new line
-            if(codepoint == '\n')
+            if(the_text[i] == '\n')
             {
-                x = start_x;
+                x = the_offset.x + g_start_x;
                 y += line_height;
                 continue;
             }
-            stbtt_GetPackedQuad(char_data.get(), bitmap->width(), bitmap->height(),
-                                codepoint - 32, &x, &y, &q, 0);
+            the_quads.push_back(create_quad(glyph(the_text[i]), &x, y));
+        }
+    }
+
+    std::vector<glyph_quad_t> create_quads(const std::string &the_text, uint32_t *the_max_x, uint32_t *the_max_y)
+    {
+        tick++;
+        auto text = utf8_to_utf32(the_text);
+        std::vector<glyph_quad_t> quads;
+        quads.reserve(text.size());
+        append_quads(text, 0, text.size(), vec2(0), quads);
 
-            if(the_max_y && *the_max_y < q.y1 + font_height){ *the_max_y = q.y1 + font_height; }
-            if(the_max_x && *the_max_x < q.x1){ *the_max_x = q.x1; }
-            quads.push_back(q);
+        for(const auto &q : quads)
+        {
+            if(the_max_y && *the_max_y < q.quad.y1 + font_height){ *the_max_y = q.quad.y1 + font_height; }
+            if(the_max_x && *the_max_x < q.quad.x1){ *the_max_x = q.quad.x1; }
         }
         return quads;
     }
+
+    /*!
+     * split the_text into lines at newlines and, if the_linewidth is non-zero,
+     * at the last space before a line would exceed the_linewidth.
+     * extents are accumulated in one pass, a broken word is shifted to the start of the next line
+     */
+    std::vector<line_t> wrap_lines(const std::u32string &the_text, uint32_t the_linewidth)
+    {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        std::vector<line_t> ret;
+
+        line_t line;
+        float x = g_start_x, line_min = inf, line_max = -inf;
+
+        // last space within the current line, extents of the line before it and the word after it
+        size_t space = std::string::npos;
+        float space_min = inf, space_max = -inf, word_x = 0.f, word_min = inf, word_max = -inf;
+
+        auto push_line = [&ret](const line_t &l, float the_min, float the_max)
+        {
+            ret.push_back(l);
+            ret.back().width = the_max > the_min ? the_max - the_min : 0.f;
+        };
+
+        for(size_t i = 0; i < the_text.size(); ++i)
+        {
+            char32_t c = the_text[i];
+
+            if(c == '\n')
+            {
+                line.end = i;
+                push_line(line, line_min, line_max);
+                line.begin = i + 1;
+                x = g_start_x;
+                line_min = word_min = space_min = inf;
+                line_max = word_max = space_max = -inf;
+                space = std::string::npos;
+                continue;
+            }
+            const auto &g = glyph(c);
+            float x0 = x + g.x0, x1 = x + g.x1;
+
+            if(the_linewidth && c != ' ' && space != std::string::npos && space > line.begin &&
+               std::max(line_max, x1) - std::min(line_min, x0) > the_linewidth)
+            {
+                // break at the last space and move the current word to the next line
+                line.end = space;
+                push_line(line, space_min, space_max);
+                line.begin = space + 1;
+
+                float shift = word_x - g_start_x;
+                x -= shift;
+                x0 -= shift;
+                x1 -= shift;
+                line_min = word_min - shift;
+                line_max = word_max - shift;
+                space = std::string::npos;
+            }
+
+            if(c == ' ')
+            {
+                space = i;
+                space_min = line_min;
+                space_max = line_max;
+                word_x = x + g.advance;
+                word_min = inf;
+                word_max = -inf;
+            }
+            else
+            {
+                word_min = std::min(word_min, x0);
+                word_max = std::max(word_max, x1);
+            }
+            line_min = std::min(line_min, x0);
+            line_max = std::max(line_max, x1);
+            x += g.advance;
+        }
+        line.end = the_text.size();
+        push_line(line, line_min, line_max);
+        return ret;
+    }
+
+    //! upload modified rows of all atlas-pages, creates textures for new pages
+    void update_textures()
+    {
+        for(auto &page : pages)
+        {
+            if(!page.texture)
+            {
+#if defined(KINSKI_ARM)
+                GLint tex_format = GL_LUMINANCE_ALPHA;
+                auto luminance_alpha_data = create_luminance_alpha(page.bitmap->data(), page_width * page_width);
+
+                // create a new texture object for our glyphs
+                gl::Texture::Format fmt;
+                fmt.internal_format = tex_format;
+                page.texture = gl::Texture(luminance_alpha_data.get(), tex_format, page_width, page_width, fmt);
+                page.texture.set_flipped();
+                page.texture.set_mipmapping(true);
+#else
+                page.texture = create_texture_from_image(page.bitmap, true);
+                page.texture.set_swizzle(GL_ONE, GL_ONE, GL_ONE, GL_RED);
+#endif
+                // signed distance field
+                if(use_sdf)
+                {
+                    auto dist_img = compute_distance_field(page.bitmap, 5);
+                    dist_img = dist_img->blur();
+                    page.sdf_texture = create_texture_from_image(dist_img, true);
+                }
+            }
+            else if(page.dirty_begin < page.dirty_end)
+            {
+                auto strip = crocore::Image_<uint8_t>::create(page_width, page.dirty_end - page.dirty_begin, 1);
+                memcpy(strip->data(), page.bitmap->data() + page.dirty_begin * page_width, strip->num_bytes());
+                upload_rows(page.texture, strip, page.dirty_begin);
+
+                // rows are separated by padding, so the distance field can be computed per strip
+                if(use_sdf)
+                {
+                    auto dist_img = compute_distance_field(strip, 5);
+                    dist_img = dist_img->blur();
+                    upload_rows(page.sdf_texture, dist_img, page.dirty_begin);
+                }
+            }
+            page.dirty_begin = std::numeric_limits<uint32_t>::max();
+            page.dirty_end = 0;
+        }
+    }
+
+    gl::MaterialPtr create_material(const atlas_page_t &the_page, const vec4 &the_color) const
+    {
+        gl::MaterialPtr mat = gl::Material::create();
+        mat->set_diffuse(the_color);
+        mat->set_blending(true);
+
+        if(use_sdf)
+        {
+            mat->set_shader(gl::create_shader(ShaderType::SDF_FONT));
+            mat->add_texture(the_page.sdf_texture, Texture::Usage::COLOR);
+            mat->uniform("u_buffer", 0.725f);
+            mat->uniform("u_gamma", 0.05f);
+        }else{ mat->add_texture(the_page.texture, Texture::Usage::COLOR); }
+        return mat;
+    }
 };
 
+///////////////////////////////////////////////////////////////////////////////
 
 Font::Font() : m_impl(new FontImpl())
 {
@@ -149,12 +553,19 @@ const std::string Font::path() const
 
 Texture Font::glyph_texture() const
 {
-    return m_impl->texture;
+    m_impl->update_textures();
+    return m_impl->pages.empty() ? Texture() : m_impl->pages.front().texture;
 }
 
 Texture Font::sdf_texture() const
 {
-    return m_impl->sdf_texture;
+    m_impl->update_textures();
+    return m_impl->pages.empty() ? Texture() : m_impl->pages.front().sdf_texture;
+}
+
+uint32_t Font::num_pages() const
+{
+    return m_impl->pages.size();
 }
 
 uint32_t Font::font_size() const
@@ -181,53 +592,8 @@ void Font::load(const std::string &thePath, size_t theSize, bool use_sdf)
     try
     {
         auto p = crocore::fs::search_file(thePath);
-        std::vector<uint8_t> font_file = crocore::fs::read_binary_file(p);
         m_impl->path = p;
-        m_impl->string_mesh_map.clear();
-        m_impl->font_height = theSize;
-        m_impl->line_height = theSize;
-        m_impl->use_sdf = use_sdf;
-
-        auto tuple = m_impl->create_bitmap(font_file, theSize, BITMAP_WIDTH(theSize),
-                                           use_sdf ? 6 : 2);
-
-        m_impl->bitmap = std::get<0>(tuple);
-        m_impl->char_data = std::move(std::get<1>(tuple));
-
-        // signed distance field
-        if(use_sdf)
-        {
-            auto dist_img = compute_distance_field(m_impl->bitmap, 5);
-            dist_img = dist_img->blur();
-            m_impl->sdf_texture = create_texture_from_image(dist_img, true);
-        }
-
-#if defined(KINSKI_ARM)
-        GLint tex_format = GL_LUMINANCE_ALPHA;
-
-        // create data
-        size_t num_bytes = m_impl->bitmap->width() * m_impl->bitmap->height() * 2;
-        auto luminance_alpha_data = std::unique_ptr<uint8_t>(new uint8_t[num_bytes]);
-        uint8_t *src_ptr = static_cast<uint8_t*>(m_impl->bitmap->data());
-        uint8_t *out_ptr = luminance_alpha_data.get(), *data_end = luminance_alpha_data.get() + num_bytes;
-
-        for (; out_ptr < data_end; out_ptr += 2, ++src_ptr)
-        {
-            out_ptr[0] = 255;
-            out_ptr[1] = *src_ptr;
-        }
-
-        // create a new texture object for our glyphs
-        gl::Texture::Format fmt;
-        fmt.internal_format = tex_format;
-        m_impl->texture = gl::Texture(luminance_alpha_data.get(), tex_format, m_impl->bitmap->width(),
-                                     m_impl->bitmap->height(), fmt);
-        m_impl->texture.set_flipped();
-        m_impl->texture.set_mipmapping(true);
-#else
-        m_impl->texture = create_texture_from_image(m_impl->bitmap, true);
-        m_impl->texture.set_swizzle(GL_ONE, GL_ONE, GL_ONE, GL_RED);
-#endif
+        m_impl->init(crocore::fs::read_binary_file(p), theSize, use_sdf);
     }catch(const std::exception &e)
     {
         LOG_ERROR << e.what();
@@ -240,10 +606,10 @@ gl::AABB Font::create_aabb(const std::string &theText) const
     uint32_t max_x = 0, max_y = 0;
     auto quads = m_impl->create_quads(theText, &max_x, &max_y);
 
-    for(const auto &quad : quads)
+    for(const auto &q : quads)
     {
-        ret += gl::AABB(gl::vec3(quad.x0, quad.y0, 0),
-                        gl::vec3(quad.x1, quad.y1, 0));
+        ret += gl::AABB(gl::vec3(q.quad.x0, q.quad.y0, 0),
+                        gl::vec3(q.quad.x1, q.quad.y1, 0));
     }
     return ret;
 }
@@ -251,30 +617,24 @@ gl::AABB Font::create_aabb(const std::string &theText) const
 crocore::ImagePtr Font::create_image(const std::string &theText, const vec4 &theColor) const
 {
     uint32_t max_x = 0, max_y = 0;
-    typedef std::list<std::pair<crocore::Area_<uint32_t>, crocore::Area_<uint32_t>>> Area_Pairs;
-    Area_Pairs area_pairs;
     auto quads = m_impl->create_quads(theText, &max_x, &max_y);
-
-    for(auto &q : quads)
-    {
-        crocore::Area_<uint32_t> src = {static_cast<uint32_t>(q.s0 * m_impl->bitmap->width()),
-                                        static_cast<uint32_t>(q.t0 * m_impl->bitmap->height()),
-                                        static_cast<uint32_t>((q.s1 - q.s0) * m_impl->bitmap->width()),
-                                        static_cast<uint32_t>((q.t1 - q.t0) * m_impl->bitmap->height())};
-        crocore::Area_<uint32_t> dst = {static_cast<uint32_t>(q.x0),
-                                        static_cast<uint32_t>(m_impl->font_height + q.y0),
-                                        static_cast<uint32_t>(q.x1 - q.x0),
-                                        static_cast<uint32_t>(q.y1 - q.y0)};
-
-        area_pairs.push_back(std::make_pair(src, dst));
-    }
     auto dst_img = crocore::Image_<uint8_t>::create(max_x, max_y, 1);
+    const float w = m_impl->page_width;
 
-    for(const auto &a : area_pairs)
+    for(auto &q : quads)
     {
-        m_impl->bitmap->roi = a.first;
-        dst_img->roi = a.second;
-        crocore::copy_image<uint8_t>(m_impl->bitmap, dst_img);
+        crocore::Area_<uint32_t> src = {static_cast<uint32_t>(std::lround(q.quad.s0 * w)),
+                                        static_cast<uint32_t>(std::lround(q.quad.t0 * w)),
+                                        static_cast<uint32_t>(std::lround((q.quad.s1 - q.quad.s0) * w)),
+                                        static_cast<uint32_t>(std::lround((q.quad.t1 - q.quad.t0) * w))};
+        crocore::Area_<uint32_t> dst = {static_cast<uint32_t>(q.quad.x0),
+                                        static_cast<uint32_t>(m_impl->font_height + q.quad.y0),
+                                        static_cast<uint32_t>(q.quad.x1 - q.quad.x0),
+                                        static_cast<uint32_t>(q.quad.y1 - q.quad.y0)};
+        auto &bitmap = m_impl->pages[q.page].bitmap;
+        bitmap->roi = src;
+        dst_img->roi = dst;
+        crocore::copy_image<uint8_t>(bitmap, dst_img);
     }
     return dst_img;
 }
@@ -287,16 +647,7 @@ Texture Font::create_texture(const std::string &theText, const glm::vec4 &theCol
     GLint tex_format = GL_LUMINANCE_ALPHA;
 
     // create data
-    size_t num_bytes = img->width() * img->height() * 2;
-    auto luminance_alpha_data = std::unique_ptr<uint8_t[]>(new uint8_t[num_bytes]);
-    uint8_t *src_ptr = static_cast<uint8_t*>(img->data());
-    uint8_t *out_ptr = luminance_alpha_data.get(), *data_end = luminance_alpha_data.get() + num_bytes;
-
-    for (; out_ptr < data_end; out_ptr += 2, ++src_ptr)
-    {
-        out_ptr[0] = 255;
-        out_ptr[1] = *src_ptr;
-    }
+    auto luminance_alpha_data = create_luminance_alpha(img->data(), img->width() * img->height());
 
     // create a new texture object
     gl::Texture::Format fmt;
@@ -312,48 +663,55 @@ Texture Font::create_texture(const std::string &theText, const glm::vec4 &theCol
 
 gl::MeshPtr Font::create_mesh(const std::string &theText, const glm::vec4 &theColor) const
 {
-    // look for an existing mesh
+    // look for an existing mesh, outdated by evicted glyphs
     auto mesh_iter = m_impl->string_mesh_map.find(theText);
 
     if(mesh_iter != m_impl->string_mesh_map.end())
     {
-        mesh_iter->second.counter++;
-        mesh_iter->second.mesh->set_transform(mat4(1));
-        return mesh_iter->second.mesh;
+        auto list_it = mesh_iter->second;
+
+        if(list_it->generation == m_impl->generation)
+        {
+            m_impl->string_mesh_list.splice(m_impl->string_mesh_list.begin(), m_impl->string_mesh_list, list_it);
+            list_it->mesh->set_transform(mat4(1));
+            return list_it->mesh;
+        }
+        m_impl->string_mesh_list.erase(list_it);
+        m_impl->string_mesh_map.erase(mesh_iter);
     }
+    uint32_t max_y = 0;
+    auto quads = m_impl->create_quads(theText, nullptr, &max_y);
+    m_impl->update_textures();
+
+    // group quads by atlas-page
+    std::stable_sort(quads.begin(), quads.end(), [](const glyph_quad_t &lhs, const glyph_quad_t &rhs)
+    {
+        return lhs.page < rhs.page;
+    });
 
     // create a new mesh object
     GeometryPtr geom = Geometry::create();
     geom->set_primitive_type(GL_TRIANGLES);
-    gl::MaterialPtr mat = gl::Material::create();
-    mat->set_diffuse(theColor);
-    mat->set_blending(true);
-
-    if(m_impl->use_sdf)
-    {
-        mat->set_shader(gl::create_shader(ShaderType::SDF_FONT));
-        mat->add_texture(m_impl->sdf_texture, Texture::Usage::COLOR);
-        mat->uniform("u_buffer", 0.725f);
-        mat->uniform("u_gamma", 0.05f);
-    }else{ mat->add_texture(m_impl->texture, Texture::Usage::COLOR); }
-
-    MeshPtr ret = gl::Mesh::create(geom, mat);
+    MeshPtr ret = gl::Mesh::create(geom);
     ret->entries().clear();
+    ret->materials().clear();
 
     std::vector<glm::vec3> &vertices = geom->vertices();
     std::vector<glm::vec2> &tex_coords = geom->tex_coords();
     std::vector<glm::vec4> &colors = geom->colors();
 
-    uint32_t max_y = 0;
-    auto quads = m_impl->create_quads(theText, nullptr, &max_y);
-
     // reserve memory
     vertices.reserve(quads.size() * 4);
     tex_coords.reserve(quads.size() * 4);
-    colors.reserve(quads.size() * 4);
+    colors.assign(quads.size() * 4, vec4(1));
+    geom->faces().reserve(quads.size() * 2);
+    geom->indices().reserve(quads.size() * 6);
 
-    for(const auto &quad : quads)
+    std::map<uint32_t, uint32_t> page_materials;
+
+    for(const auto &q : quads)
     {
+        const auto &quad = q.quad;
         float h = quad.y1 - quad.y0;
 
         stbtt_aligned_quad adjusted = {};
@@ -366,8 +724,21 @@ gl::MeshPtr Font::create_mesh(const std::string &theText, const glm::vec4 &theCo
         adjusted.s1 = quad.s1;
         adjusted.t1 = 1 - quad.t1;
 
+        // one entry and material per atlas-page
+        if(!page_materials.count(q.page))
+        {
+            page_materials[q.page] = ret->materials().size();
+            ret->materials().push_back(m_impl->create_material(m_impl->pages[q.page], theColor));
+
+            gl::Mesh::Entry e;
+            e.base_index = geom->indices().size();
+            e.material_index = page_materials[q.page];
+            ret->entries().push_back(e);
+        }
+
         // CREATE QUAD
         // create vertices
+        index_t i = vertices.size();
         vertices.emplace_back(adjusted.x0, adjusted.y1, 0);
         vertices.emplace_back(adjusted.x1, adjusted.y1, 0);
         vertices.emplace_back(adjusted.x1, adjusted.y0, 0);
@@ -379,37 +750,24 @@ gl::MeshPtr Font::create_mesh(const std::string &theText, const glm::vec4 &theCo
         tex_coords.emplace_back(adjusted.s1, adjusted.t0);
         tex_coords.emplace_back(adjusted.s0, adjusted.t0);
 
-        // create colors
-        for(int i = 0; i < 4; i++){ colors.emplace_back(1); }
-    }
-    for(uint32_t i = 0; i < vertices.size(); i += 4)
-    {
         geom->append_face(i, i + 1, i + 2);
         geom->append_face(i, i + 2, i + 3);
+        ret->entries().back().num_indices += 6;
+        ret->entries().back().num_vertices += 4;
     }
-    geom->compute_face_normals();
+    if(ret->materials().empty()){ ret->materials().push_back(gl::Material::create()); }
     geom->compute_aabb();
 
-    // free the less frequent used half of our buffered string-meshes
-    if(m_impl->string_mesh_map.size() >= m_impl->max_mesh_buffer_size)
+    // free the least recently used string-mesh
+    if(m_impl->string_mesh_list.size() >= g_max_mesh_buffer_size)
     {
-        LOG_TRACE << "font-mesh buffersize: " << m_impl->max_mesh_buffer_size << " -> clearing ...";
-        std::list<string_mesh_container> tmp_list;
-
-        for(auto &item : m_impl->string_mesh_map){ tmp_list.push_back(item.second); }
-        tmp_list.sort();
-
-        std::list<string_mesh_container>::reverse_iterator list_it = tmp_list.rbegin();
-        m_impl->string_mesh_map.clear();
-
-        for(uint32_t i = 0; i < tmp_list.size() / 2; i++, ++list_it)
-        {
-            list_it->counter--;
-            m_impl->string_mesh_map[list_it->text] = *list_it;
-        }
+        m_impl->string_mesh_map.erase(m_impl->string_mesh_list.back().text);
+        m_impl->string_mesh_list.pop_back();
     }
+
     // insert the newly created mesh
-    m_impl->string_mesh_map[theText] = string_mesh_container(theText, ret);
+    m_impl->string_mesh_list.push_front({theText, ret, m_impl->generation});
+    m_impl->string_mesh_map[theText] = m_impl->string_mesh_list.begin();
     return ret;
 }
 
@@ -420,68 +778,44 @@ gl::Object3DPtr Font::create_text_object(std::list<std::string> the_lines,
 {
     if(!the_lineheight){ the_lineheight = line_height(); }
     gl::Object3DPtr root = gl::Object3D::create();
-    auto parent = root;
-
     vec2 line_offset;
-    bool reformat = false;
 
-    for(auto it = the_lines.begin(); it != the_lines.end(); ++it)
+    for(const auto &l : the_lines)
     {
-        if(!reformat){ parent = root; }
-        std::string &l = *it;
+        // split line in a single pass, if necessary
+        m_impl->tick++;
+        auto text = utf8_to_utf32(l);
+        auto wrapped = m_impl->wrap_lines(text, the_linewidth);
 
-        // center line_mesh
-        auto line_aabb = create_aabb(l);
+        // wrapped lines are grouped, so root's children correspond to the_lines
+        auto parent = root;
+        if(wrapped.size() > 1){ parent = gl::Object3D::create(); root->add_child(parent); }
 
-        reformat = false;
-        auto insert_it = it;
-        insert_it++;
-
-        //split line, if necessary
-        while(the_linewidth && (line_aabb.width() > the_linewidth))
+        for(const auto &w : wrapped)
         {
-            size_t indx = l.find_last_of(' ');
-            if(indx == std::string::npos){ break; }
-
-            std::string last_word = l.substr(indx + 1);
-            l = l.substr(0, indx);
-
-            if(!reformat)
-            {
-                parent = gl::Object3D::create();
-                root->add_child(parent);
-                reformat = true;
-                insert_it = the_lines.insert(insert_it, last_word);
-            }else if(insert_it != the_lines.end())
+            switch(the_align)
             {
-                *insert_it = last_word + " " + *insert_it;
-            }else{ the_lines.push_back(last_word); }
+                case Align::LEFT:
+                    line_offset.x = 0.f;
+                    break;
+                case Align::CENTER:
+                    line_offset.x = (the_linewidth - w.width) / 2.f;
+                    break;
+                case Align::RIGHT:
+                    line_offset.x = (the_linewidth - w.width);
+                    break;
+            }
+            auto line_mesh = create_mesh(utf32_to_utf8(text.substr(w.begin, w.end - w.begin)))->copy();
+            const gl::Geometry &geom = *line_mesh->geometry();
+            line_mesh->set_position(vec3(line_offset.x, line_offset.y - geom.aabb().height(), 0.f));
+            for(auto &mat : line_mesh->materials()){ mat->set_blending(); }
 
-            // new aabb
-            line_aabb = create_aabb(l);
-        }
+            // advance offset
+            line_offset.y -= line_height();
 
-        switch(the_align)
-        {
-            case Align::LEFT:
-                line_offset.x = 0.f;
-                break;
-            case Align::CENTER:
-                line_offset.x = (the_linewidth - line_aabb.width()) / 2.f;
-                break;
-            case Align::RIGHT:
-                line_offset.x = (the_linewidth - line_aabb.width());
-                break;
+            // add line
+            parent->add_child(line_mesh);
         }
-        auto line_mesh = create_mesh(l)->copy();
-        line_mesh->set_position(vec3(line_offset.x, line_offset.y - line_aabb.height(), 0.f));
-        line_mesh->material()->set_blending();
-
-        // advance offset
-        line_offset.y -= line_height();
-
-        // add line
-        parent->add_child(line_mesh);
     }
     return root;
 }
@@ -496,5 +830,221 @@ gl::Object3DPtr Font::create_text_object(const std::string &the_text,
     return create_text_object(std::list<std::string>(lines.begin(), lines.end()),
                               the_align, the_linewidth, the_lineheight);
 }
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct TextBatchImpl
+{
+    struct item_t
+    {
+        std::string text;
+        vec2 top_left;
+        Color color;
+        Font::Align align;
+        uint32_t linewidth;
+    };
+
+    Font font;
+    std::vector<item_t> items;
+
+    //! streamed geometry, one entry per atlas-page
+    gl::MeshPtr mesh;
+    std::vector<glyph_quad_t> quads;
+    std::vector<Color> quad_colors;
+
+    //! the font-generation our mesh was created with, items changed if false
+    uint64_t generation = 0;
+    bool dirty = true;
+
+    //! layout all items and write their quads into our geometry
+    void update_geometry()
+    {
+        FontImpl &font_impl = *font.m_impl;
+        quads.clear();
+        quad_colors.clear();
+
+        // all items share one tick, so their glyphs are not evicted while this batch is assembled
+        font_impl.tick++;
+
+        for(const auto &item : items)
+        {
+            auto text = utf8_to_utf32(item.text);
+            size_t first_quad = quads.size();
+            vec2 offset = item.top_left;
+
+            for(const auto &l : font_impl.wrap_lines(text, item.linewidth))
+            {
+                switch(item.align)
+                {
+                    case Font::Align::LEFT:
+                        offset.x = item.top_left.x;
+                        break;
+                    case Font::Align::CENTER:
+                        offset.x = item.top_left.x + (item.linewidth - l.width) / 2.f;
+                        break;
+                    case Font::Align::RIGHT:
+                        offset.x = item.top_left.x + item.linewidth - l.width;
+                        break;
+                }
+                font_impl.append_quads(text, l.begin, l.end, offset, quads);
+                offset.y += font_impl.line_height;
+            }
+
+            // align the top of the glyph-extents with the_top_left
+            float min_y = std::numeric_limits<float>::max();
+            for(size_t i = first_quad; i < quads.size(); ++i){ min_y = std::min(min_y, quads[i].quad.y0); }
+            float shift = item.top_left.y - min_y;
+
+            for(size_t i = first_quad; i < quads.size(); ++i)
+            {
+                quads[i].quad.y0 += shift;
+                quads[i].quad.y1 += shift;
+            }
+            quad_colors.resize(quads.size(), item.color);
+        }
+        font_impl.update_textures();
+
+        // group quads by atlas-page
+        std::vector<uint32_t> order(quads.size());
+        for(uint32_t i = 0; i < order.size(); ++i){ order[i] = i; }
+        std::stable_sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs)
+        {
+            return quads[lhs].page < quads[rhs].page;
+        });
+
+        auto &geom = mesh->geometry();
+        auto &vertices = geom->vertices();
+        auto &tex_coords = geom->tex_coords();
+        auto &colors = geom->colors();
+        vertices.resize(4 * quads.size());
+        tex_coords.resize(4 * quads.size());
+        colors.resize(4 * quads.size());
+
+        // the index-pattern only depends on the number of quads, so it only grows
+        const gl::Geometry &const_geom = *geom;
+        if(const_geom.indices().size() < 6 * quads.size())
+        {
+            auto &indices = geom->indices();
+
+            // counter-clockwise, after flipping the y-axis
+            for(index_t i = indices.size() / 6 * 4; i < 4 * quads.size(); i += 4)
+            {
+                indices.insert(indices.end(), {i, i + 3, i + 2, i, i + 2, i + 1});
+            }
+        }
+        mesh->entries().clear();
+        mesh->materials().clear();
+
+        for(uint32_t j = 0; j < order.size(); ++j)
+        {
+            const auto &q = quads[order[j]];
+            const auto &c = quad_colors[order[j]];
+            auto &page = font_impl.pages[q.page];
+
+            // one entry per atlas-page, using the page's shared material
+            if(mesh->entries().empty() || mesh->materials().back() != page.batch_material)
+            {
+                if(!page.batch_material)
+                {
+                    page.batch_material = font_impl.create_material(page, gl::COLOR_WHITE);
+                    page.batch_material->set_depth_test(false);
+                }
+                gl::Mesh::Entry e;
+                e.base_index = 6 * j;
+                e.material_index = mesh->materials().size();
+                mesh->entries().push_back(e);
+                mesh->materials().push_back(page.batch_material);
+            }
+            mesh->entries().back().num_indices += 6;
+            mesh->entries().back().num_vertices += 4;
+
+            // texture is flipped
+            uint32_t i = 4 * j;
+            vertices[i] = vec3(q.quad.x0, q.quad.y0, 0.f);
+            vertices[i + 1] = vec3(q.quad.x1, q.quad.y0, 0.f);
+            vertices[i + 2] = vec3(q.quad.x1, q.quad.y1, 0.f);
+            vertices[i + 3] = vec3(q.quad.x0, q.quad.y1, 0.f);
+            tex_coords[i] = vec2(q.quad.s0, 1.f - q.quad.t0);
+            tex_coords[i + 1] = vec2(q.quad.s1, 1.f - q.quad.t0);
+            tex_coords[i + 2] = vec2(q.quad.s1, 1.f - q.quad.t1);
+            tex_coords[i + 3] = vec2(q.quad.s0, 1.f - q.quad.t1);
+            for(uint32_t k = 0; k < 4; ++k){ colors[i + k] = c; }
+        }
+        if(mesh->materials().empty()){ mesh->materials().push_back(gl::Material::create()); }
+        generation = font_impl.generation;
+        dirty = false;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+TextBatchPtr TextBatch::create(const Font &the_font)
+{
+    return TextBatchPtr(new TextBatch(the_font));
+}
+
+TextBatch::TextBatch(const Font &the_font):
+m_impl(new TextBatchImpl())
+{
+    m_impl->font = the_font;
+}
+
+const Font& TextBatch::font() const
+{
+    return m_impl->font;
+}
+
+void TextBatch::set_font(const Font &the_font)
+{
+    if(m_impl->font.m_impl != the_font.m_impl)
+    {
+        m_impl->font = the_font;
+        m_impl->dirty = true;
+    }
+}
+
+void TextBatch::add(const std::string &the_text, const vec2 &the_top_left, const Color &the_color,
+                    Font::Align the_align, uint32_t the_linewidth)
+{
+    m_impl->items.push_back({the_text, the_top_left, the_color, the_align, the_linewidth});
+    m_impl->dirty = true;
+}
+
+void TextBatch::draw()
+{
+    if(m_impl->items.empty() || m_impl->font.m_impl->font_data.empty()){ return; }
+
+    if(!m_impl->mesh)
+    {
+        auto geom = gl::Geometry::create();
+        geom->set_primitive_type(GL_TRIANGLES);
+        m_impl->mesh = gl::Mesh::create(geom);
+    }
+    if(m_impl->dirty || m_impl->generation != m_impl->font.m_impl->generation){ m_impl->update_geometry(); }
+    else{ m_impl->font.m_impl->update_textures(); }
+
+    // our vertex-data is replaced entirely, whenever the batch changes
+    auto &geom = m_impl->mesh->geometry();
+    if(geom->has_dirty_buffers()){ geom->create_gl_buffers(GL_STREAM_DRAW); }
+
+    // window-coordinates, origin top-left
+    gl::ScopedMatrixPush model(MODEL_VIEW_MATRIX), projection(PROJECTION_MATRIX);
+    const auto &win_size = gl::window_dimension();
+    gl::load_matrix(gl::PROJECTION_MATRIX, glm::ortho(0.f, win_size.x, win_size.y, 0.f, 0.f, 1.f));
+    gl::load_identity(gl::MODEL_VIEW_MATRIX);
+    gl::draw_mesh(m_impl->mesh);
+}
+
+void TextBatch::clear()
+{
+    m_impl->items.clear();
+    m_impl->dirty = true;
+}
+
+bool TextBatch::empty() const
+{
+    return m_impl->items.empty();
+}
+
 }
 }// namespace
@@ -17,7 +17,13 @@
 #include "gl/gl.hpp"
 
 namespace kinski { namespace gl {
-    
+
+DEFINE_CLASS_PTR(TextBatch);
+
+/*!
+ * Font rasterises glyphs on demand into atlas-pages of fixed size.
+ * once the maximum number of pages is reached, the least recently used rows of glyphs are evicted
+ */
 class Font
 {
 public:
@@ -28,9 +34,14 @@ public:
 
     void load(const std::string &the_path, size_t the_size, bool use_sdf = false);
     const std::string path() const;
+
+    //! the first atlas-page, pending glyphs are uploaded before
     Texture glyph_texture() const;
     Texture sdf_texture() const;
 
+    //! number of atlas-pages currently in use
+    uint32_t num_pages() const;
+
     gl::AABB create_aabb(const std::string &theText) const;
 
     crocore::ImagePtr create_image(const std::string &theText, const vec4 &theColor = vec4(1)) const;
@@ -66,6 +77,8 @@ public:
     void set_use_sdf(bool b);
 
 private:
+    friend class TextBatch;
+    friend struct TextBatchImpl;
     std::shared_ptr<struct FontImpl> m_impl;
 
 public:
@@ -73,4 +86,34 @@ public:
     void reset() { m_impl.reset(); }
 };
 
+/*!
+ * TextBatch collects the glyph-quads of many strings and draws them in screen-space
+ * using one streamed vertex-buffer and one draw-call per atlas-page.
+ * typical usage is to clear(), add() all labels of a frame and draw() them once
+ */
+class TextBatch
+{
+public:
+
+    static TextBatchPtr create(const Font &the_font = Font());
+
+    const Font& font() const;
+    void set_font(const Font &the_font);
+
+    //! add the_text with its top-left corner at the_top_left (window-coordinates, origin top-left)
+    void add(const std::string &the_text, const vec2 &the_top_left, const Color &the_color = Color(1),
+             Font::Align the_align = Font::Align::LEFT, uint32_t the_linewidth = 0);
+
+    //! draw all strings added since the last clear()
+    void draw();
+
+    void clear();
+
+    bool empty() const;
+
+private:
+    TextBatch(const Font &the_font);
+    std::shared_ptr<struct TextBatchImpl> m_impl;
+};
+
 }}// namespace
@@ -7,11 +7,11 @@
 //  http://www.boost.org/LICENSE_1_0.txt
 // __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
 
-#include <unordered_map>
-
 #include <crocore/Timer.hpp>
 
 #include "Geometry.hpp"
+#include "Mesh.hpp"
+#include "glm/gtc/packing.hpp"
 
 using namespace std;
 
@@ -19,58 +19,188 @@ namespace kinski{ namespace gl{
 
 namespace
 {
-    inline uint64_t pack(uint64_t a, uint64_t b){ return (a << 32) | b; }
-    inline uint64_t swizzle(uint64_t a){ return ((a & 0xFFFFFFFF) << 32) | (a >> 32); }
+    template<typename T>
+    inline void hash_combine(size_t &the_seed, const T &the_value)
+    {
+        the_seed ^= std::hash<T>()(the_value) + 0x9e3779b9 + (the_seed << 6) + (the_seed >> 2);
+    }
+
+    Geometry::buffer_attrib_t attrib_format(const gl::Buffer &the_buffer, VertexLayout::Format the_format,
+                                            uint32_t the_num_components, uint32_t the_offset, uint32_t the_stride)
+    {
+        Geometry::buffer_attrib_t ret;
+        ret.buffer = the_buffer;
+        ret.size = the_num_components;
+        ret.offset = the_offset;
+        ret.stride = the_stride;
+
+        switch(the_format)
+        {
+#if !defined(KINSKI_GLES_2)
+            case VertexLayout::HALF:
+                ret.type = GL_HALF_FLOAT;
+                break;
+            case VertexLayout::SNORM_10_10_10_2:
+                ret.type = GL_INT_2_10_10_10_REV;
+                ret.size = 4;
+                ret.normalize = true;
+                break;
+#endif
+            case VertexLayout::UNORM_8:
+                ret.type = GL_UNSIGNED_BYTE;
+                ret.size = 4;
+                ret.normalize = true;
+                break;
+            default:
+                ret.type = GL_FLOAT;
+                break;
+        }
+        return ret;
+    }
+}
+
+uint32_t vertex_attrib_size(VertexLayout::Format the_format, uint32_t the_num_components)
+{
+    switch(the_format)
+    {
+        case VertexLayout::HALF: return (2 * the_num_components + 3) & ~3U;
+        case VertexLayout::SNORM_10_10_10_2:
+        case VertexLayout::UNORM_8: return 4;
+        default: return 4 * the_num_components;
+    }
+}
+
+void encode_vertex_attrib(VertexLayout::Format the_format, const float *the_src, uint32_t the_num_components,
+                          uint8_t *the_dst)
+{
+    switch(the_format)
+    {
+        case VertexLayout::HALF:
+        {
+            uint16_t *dst = (uint16_t*)the_dst;
+            for(uint32_t i = 0; i < the_num_components; ++i){ dst[i] = glm::packHalf1x16(the_src[i]); }
+            break;
+        }
+        case VertexLayout::SNORM_10_10_10_2:
+        {
+            vec4 v(0);
+            for(uint32_t i = 0; i < std::min<uint32_t>(the_num_components, 3); ++i){ v[i] = the_src[i]; }
+            uint32_t packed = glm::packSnorm3x10_1x2(v);
+            memcpy(the_dst, &packed, 4);
+            break;
+        }
+        case VertexLayout::UNORM_8:
+        {
+            vec4 v(0, 0, 0, 1);
+            for(uint32_t i = 0; i < std::min<uint32_t>(the_num_components, 4); ++i){ v[i] = the_src[i]; }
+            uint32_t packed = glm::packUnorm4x8(glm::clamp(v, vec4(0), vec4(1)));
+            memcpy(the_dst, &packed, 4);
+            break;
+        }
+        default:
+            memcpy(the_dst, the_src, 4 * the_num_components);
+            break;
+    }
+}
+
+void decode_vertex_attrib(VertexLayout::Format the_format, const uint8_t *the_src, uint32_t the_num_components,
+                          float *the_dst)
+{
+    switch(the_format)
+    {
+        case VertexLayout::HALF:
+        {
+            const uint16_t *src = (const uint16_t*)the_src;
+            for(uint32_t i = 0; i < the_num_components; ++i){ the_dst[i] = glm::unpackHalf1x16(src[i]); }
+            break;
+        }
+        case VertexLayout::SNORM_10_10_10_2:
+        {
+            uint32_t packed;
+            memcpy(&packed, the_src, 4);
+            vec4 v = glm::unpackSnorm3x10_1x2(packed);
+            for(uint32_t i = 0; i < std::min<uint32_t>(the_num_components, 4); ++i){ the_dst[i] = v[i]; }
+            break;
+        }
+        case VertexLayout::UNORM_8:
+        {
+            uint32_t packed;
+            memcpy(&packed, the_src, 4);
+            vec4 v = glm::unpackUnorm4x8(packed);
+            for(uint32_t i = 0; i < std::min<uint32_t>(the_num_components, 4); ++i){ the_dst[i] = v[i]; }
+            break;
+        }
+        default:
+            memcpy(the_dst, the_src, 4 * the_num_components);
+            break;
+    }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+
 std::vector<HalfEdge> compute_half_edges(gl::GeometryPtr the_geom)
 {
     crocore::Stopwatch timer;
     timer.start();
     
-    std::vector<HalfEdge> ret(3 * the_geom->faces().size());
-    std::unordered_map<uint64_t, HalfEdge*> edge_table;
+    const auto &faces = static_cast<const gl::Geometry&>(*the_geom).faces();
+    std::vector<HalfEdge> ret(3 * faces.size());
     
     HalfEdge *edge = ret.data();
+    index_t max_index = 0;
     
-    for(const Face3& face : the_geom->faces())
+    for(const Face3& face : faces)
     {
         // create the half-edge that goes from C to A:
-        edge_table[pack(face.c, face.a)] = edge;
         edge->index = face.a;
         edge->next = edge + 1;
         ++edge;
         
         // create the half-edge that goes from A to B:
-        edge_table[pack(face.a, face.b)] = edge;
         edge->index = face.b;
         edge->next = edge + 1;
         ++edge;
         
         // create the half-edge that goes from B to C:
-        edge_table[pack(face.b, face.c)] = edge;
         edge->index = face.c;
         edge->next = edge - 2;
         ++edge;
+        
+        max_index = std::max(max_index, std::max(face.a, std::max(face.b, face.c)));
     }
     
-    // populate the twin pointers by iterating over the edge_table
+    // outgoing half-edges per vertex (CSR), the source of a half-edge is the end of its predecessor
+    auto source = [&ret](uint32_t i) -> index_t { return ret[i - i % 3 + (i + 2) % 3].index; };
+    std::vector<uint32_t> offsets(faces.empty() ? 1 : max_index + 2, 0), outgoing(ret.size());
+    
+    for(uint32_t i = 0; i < ret.size(); ++i){ offsets[source(i) + 1]++; }
+    for(uint32_t v = 1; v < offsets.size(); ++v){ offsets[v] += offsets[v - 1]; }
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for(uint32_t i = 0; i < ret.size(); ++i){ outgoing[cursor[source(i)]++] = i; }
+    }
+    
+    // populate the twin pointers by searching the outgoing edges of each half-edge's end
     int boundaryCount = 0;
     
-    for(auto &e : edge_table)
+    for(uint32_t i = 0; i < ret.size(); ++i)
     {
-        HalfEdge *current_edge = e.second;
-        
-        // try to find twin edge in map
-        auto it = edge_table.find(swizzle(e.first));
+        HalfEdge *current_edge = &ret[i];
+        if(current_edge->twin){ continue; }
+        index_t from = source(i), to = current_edge->index;
         
-        if(it != edge_table.end())
+        for(uint32_t j = offsets[to]; j < offsets[to + 1]; ++j)
         {
-            HalfEdge *twin_edge = it->second;
-            twin_edge->twin = current_edge;
-            current_edge->twin = twin_edge;
+            HalfEdge *twin_edge = &ret[outgoing[j]];
+            
+            if(twin_edge->index == from && !twin_edge->twin)
+            {
+                twin_edge->twin = current_edge;
+                current_edge->twin = twin_edge;
+                break;
+            }
         }
-        else{ ++boundaryCount; }
+        if(!current_edge->twin){ ++boundaryCount; }
     }
     
     if(boundaryCount > 0)
@@ -83,7 +213,8 @@ std::vector<HalfEdge> compute_half_edges(gl::GeometryPtr the_geom)
     
 Geometry::Geometry():
 m_primitive_type(GL_TRIANGLES),
-m_dirty_bits(0)
+m_dirty_bits(0),
+m_buffer_index_type(index_type())
 {
 
 }
@@ -95,7 +226,28 @@ Geometry::~Geometry()
 
 void Geometry::compute_aabb()
 {
-    m_bounding_box = gl::compute_aabb(m_vertices);
+    AABB bounds = gl::compute_aabb(m_vertices);
+    if(bounds == m_bounding_box){ return; }
+    m_bounding_box = bounds;
+
+    // meshes compare against our bounds only when queried, their ancestors need to be notified
+    for(auto it = m_bounds_observers.begin(); it != m_bounds_observers.end();)
+    {
+        if(auto m = it->lock())
+        {
+            m->invalidate_aabb();
+            ++it;
+        }
+        else{ it = m_bounds_observers.erase(it); }
+    }
+}
+
+void Geometry::add_bounds_observer(const std::weak_ptr<const Mesh> &the_mesh)
+{
+    auto m = the_mesh.lock();
+
+    for(const auto &o : m_bounds_observers){ if(o.lock() == m){ return; } }
+    if(m){ m_bounds_observers.push_back(the_mesh); }
 }
 
 void Geometry::compute_face_normals()
@@ -204,15 +356,28 @@ void Geometry::compute_tangents()
     }
 }
 
+TriangleBVHConstPtr Geometry::triangle_bvh(const std::vector<TriangleBVH::range_t> &the_ranges) const
+{
+    auto &bvh = m_triangle_bvhs[the_ranges];
+    if(!bvh){ bvh = TriangleBVH::create(*this, the_ranges); }
+    return bvh;
+}
+
 bool Geometry::has_dirty_buffers() const
 {
-    return m_dirty_bits;
+    return m_dirty_bits || !m_dirty_ranges.empty();
 }
 
 void Geometry::create_gl_buffers(GLenum usage)
 {
+    VertexLayout layout = m_vertex_layout;
+
 #if defined(KINSKI_GLES_2)
     usage = GL_STATIC_DRAW;
+
+    // no half-floats or packed formats
+    layout = VertexLayout();
+    layout.interleaved = m_vertex_layout.interleaved;
 //#else
 //    usage = usage != GL_DONT_CARE ? usage : GL_STATIC_DRAW;
 #endif
@@ -221,106 +386,157 @@ void Geometry::create_gl_buffers(GLenum usage)
     {
         return the_usage != GL_DONT_CARE ? the_usage : the_buf ? the_buf.usage() : GL_STATIC_DRAW;
     };
-    
-    if(has_vertices())
+
+    // per-vertex attributes, bone-data and indices are handled separately
+    struct attrib_source_t
     {
-        auto buf_usage = usage_fn(m_vertex_buffer, usage);
-        
-        if(has_flag(VERTEX_BIT) || m_vertex_buffer.usage() != buf_usage)
-        {
-            if(!m_vertex_buffer){ m_vertex_buffer = gl::Buffer(GL_ARRAY_BUFFER, buf_usage); }
-            else{ m_vertex_buffer.set_usage(buf_usage); }
-            
-            m_vertex_buffer.set_data(nullptr, m_vertices.size() * sizeof(glm::vec4));
-            m_vertex_buffer.set_stride(sizeof(glm::vec4));
-            
-            // pad vec3 -> vec4 (OpenCL compat issue)
-            glm::vec4 *buf_ptr = (glm::vec4*) m_vertex_buffer.map();
-            for (const auto &v3 : m_vertices){ (*buf_ptr++) = glm::vec4(v3, 1.f); }
-            m_vertex_buffer.unmap();
-            KINSKI_CHECK_GL_ERRORS();
-            remove_flag(VERTEX_BIT);
-        }
-    }
+        uint32_t bit;
+        VertexLayout::Format format;
+        uint32_t num_components;
+        const float *data;
+        gl::Buffer *buffer;
+    };
 
-    // insert normals
-    if(has_normals())
+    std::vector<attrib_source_t> sources;
+    auto add_source = [&sources](bool the_present, uint32_t the_bit, VertexLayout::Format the_format,
+                                 uint32_t the_num_components, const float *the_data, gl::Buffer *the_buffer)
     {
-        auto buf_usage = usage_fn(m_normal_buffer, usage);
-        
-        if(has_flag(NORMAL_BIT) || m_normal_buffer.usage() != buf_usage)
+        if(the_present){ sources.push_back({the_bit, the_format, the_num_components, the_data, the_buffer}); }
+    };
+    add_source(has_vertices(), VERTEX_BIT, layout.position, 3, (const float*)m_vertices.data(), &m_vertex_buffer);
+    add_source(has_normals(), NORMAL_BIT, layout.normal, 3, (const float*)m_normals.data(), &m_normal_buffer);
+    add_source(has_tex_coords(), TEXCOORD_BIT, layout.tex_coord, 2, (const float*)m_tex_coords.data(),
+               &m_tex_coord_buffer);
+    add_source(has_tangents(), TANGENT_BIT, layout.tangent, 3, (const float*)m_tangents.data(), &m_tangent_buffer);
+    add_source(has_point_sizes(), POINTSIZE_BIT, VertexLayout::FLOAT, 1, m_point_sizes.data(), &m_point_size_buffer);
+    add_source(has_colors(), COLOR_BIT, layout.color, 4, (const float*)m_colors.data(), &m_color_buffer);
+
+    const size_t num_vertices = m_vertices.size();
+
+    // upload a range of elements, the entire range is uploaded via glBufferData (orphaning the old storage)
+    auto upload = [num_vertices](gl::Buffer &the_buffer, const uint8_t *the_data, size_t the_first, size_t the_end,
+                                 size_t the_stride)
+    {
+        if(the_first == 0 && the_end == num_vertices)
         {
-            if(!m_normal_buffer){ m_normal_buffer = gl::Buffer(GL_ARRAY_BUFFER, buf_usage); }
-            else{ m_vertex_buffer.set_usage(buf_usage); }
-            
-            m_normal_buffer.set_data(m_normals);
-            KINSKI_CHECK_GL_ERRORS();
-            remove_flag(NORMAL_BIT);
+            the_buffer.set_data(the_data, num_vertices * the_stride);
         }
-    }
+        else if(the_first < the_end)
+        {
+            the_buffer.set_sub_data(the_data, (the_end - the_first) * the_stride, the_first * the_stride);
+        }
+    };
 
-    // insert texcoords
-    if(has_tex_coords())
+    if(layout.interleaved && !sources.empty())
     {
-        auto buf_usage = usage_fn(m_tex_coord_buffer, usage);
-        
-        if(has_flag(TEXCOORD_BIT) || m_tex_coord_buffer.usage() != buf_usage)
+        auto buf_usage = usage_fn(m_vertex_buffer, usage);
+
+        // attribute-offsets within a vertex
+        uint32_t stride = 0;
+        std::vector<uint32_t> offsets;
+
+        for(const auto &src : sources)
         {
-            if(!m_tex_coord_buffer){ m_tex_coord_buffer = gl::Buffer(GL_ARRAY_BUFFER, buf_usage); }
-            else{ m_tex_coord_buffer.set_usage(buf_usage); }
-            
-            m_tex_coord_buffer.set_data(m_tex_coords);
-            KINSKI_CHECK_GL_ERRORS();
-            remove_flag(TEXCOORD_BIT);
+            offsets.push_back(stride);
+            stride += vertex_attrib_size(src.format, src.num_components);
         }
-    }
+        bool full = m_vertex_buffer.usage() != buf_usage || m_vertex_buffer.num_bytes() != num_vertices * stride;
+        size_t first, end;
+        std::tie(first, end) = pending_range(VERTEX_BIT);
+        bool dirty = full || first < end;
 
-    // insert tangents
-    if(has_tangents())
-    {
-        auto buf_usage = usage_fn(m_tangent_buffer, usage);
-        
-        if(has_flag(TANGENT_BIT) || m_tangent_buffer.usage() != buf_usage)
+        // streamed buffers are orphaned, instead of synchronizing on partial updates
+        if(full || (dirty && buf_usage == GL_STREAM_DRAW)){ first = 0; end = num_vertices; }
+
+        if(dirty && first < end)
         {
-            if(!m_tangent_buffer){ m_tangent_buffer = gl::Buffer(GL_ARRAY_BUFFER, buf_usage); }
-            else{ m_tangent_buffer.set_usage(buf_usage); }
-            
-            m_tangent_buffer.set_data(m_tangents);
+            if(!m_vertex_buffer){ m_vertex_buffer = gl::Buffer(GL_ARRAY_BUFFER, buf_usage); }
+            else{ m_vertex_buffer.set_usage(buf_usage); }
+
+            std::vector<uint8_t> data((end - first) * stride);
+
+            for(uint32_t i = 0; i < sources.size(); ++i)
+            {
+                const auto &src = sources[i];
+                uint8_t *dst = data.data() + offsets[i];
+
+                for(size_t v = first; v < end; ++v, dst += stride)
+                {
+                    encode_vertex_attrib(src.format, src.data + v * src.num_components, src.num_components, dst);
+                }
+                m_buffer_attribs[src.bit] = attrib_format(m_vertex_buffer, src.format, src.num_components,
+                                                          offsets[i], stride);
+
+                // separate buffers are not used anymore
+                if(src.buffer != &m_vertex_buffer){ src.buffer->reset(); }
+            }
+            upload(m_vertex_buffer, data.data(), first, end, stride);
+            m_vertex_buffer.set_stride(stride);
             KINSKI_CHECK_GL_ERRORS();
-            remove_flag(TANGENT_BIT);
         }
+        for(const auto &src : sources){ remove_flag(src.bit); }
     }
-
-    // insert point sizes
-    if(has_point_sizes())
+    else
     {
-        auto buf_usage = usage_fn(m_point_size_buffer, usage);
-        
-        if(has_flag(POINTSIZE_BIT) || m_point_size_buffer.usage() != buf_usage)
+        for(const auto &src : sources)
         {
-            if(!m_point_size_buffer){ m_point_size_buffer = gl::Buffer(GL_ARRAY_BUFFER, buf_usage); }
-            else{ m_point_size_buffer.set_usage(buf_usage); }
-            
-            m_point_size_buffer.set_data(m_point_sizes);
-            KINSKI_CHECK_GL_ERRORS();
-            remove_flag(POINTSIZE_BIT);
+            auto &buffer = *src.buffer;
+            auto buf_usage = usage_fn(buffer, usage);
+
+            // pad vec3 -> vec4 (OpenCL compat issue)
+            bool pad = src.bit == VERTEX_BIT && src.format == VertexLayout::FLOAT;
+            uint32_t stride = pad ? sizeof(glm::vec4) : vertex_attrib_size(src.format, src.num_components);
+            uint32_t num_components = pad ? 4 : src.num_components;
+
+            bool full = buffer.usage() != buf_usage || buffer.num_bytes() != num_vertices * stride;
+            size_t first, end;
+            std::tie(first, end) = pending_range(src.bit);
+            bool dirty = full || first < end;
+            if(full || (dirty && buf_usage == GL_STREAM_DRAW)){ first = 0; end = num_vertices; }
+
+            if(dirty && first < end)
+            {
+                if(!buffer){ buffer = gl::Buffer(GL_ARRAY_BUFFER, buf_usage); }
+                else{ buffer.set_usage(buf_usage); }
+
+                if(src.format == VertexLayout::FLOAT && !pad)
+                {
+                    upload(buffer, (const uint8_t*)(src.data + first * src.num_components), first, end, stride);
+                }
+                else
+                {
+                    std::vector<uint8_t> data((end - first) * stride);
+                    uint8_t *dst = data.data();
+
+                    for(size_t v = first; v < end; ++v, dst += stride)
+                    {
+                        if(pad)
+                        {
+                            glm::vec4 p(m_vertices[v], 1.f);
+                            memcpy(dst, &p, sizeof(p));
+                        }
+                        else{ encode_vertex_attrib(src.format, src.data + v * src.num_components, src.num_components, dst); }
+                    }
+                    upload(buffer, data.data(), first, end, stride);
+                }
+                buffer.set_stride(stride);
+                m_buffer_attribs[src.bit] = attrib_format(buffer, src.format, num_components, 0, stride);
+                KINSKI_CHECK_GL_ERRORS();
+            }
+            remove_flag(src.bit);
         }
     }
+    m_dirty_ranges.clear();
 
-    // insert colors
-    if(has_colors())
+    // drop formats for attributes that are gone
+    for(auto it = m_buffer_attribs.begin(); it != m_buffer_attribs.end();)
     {
-        auto buf_usage = usage_fn(m_color_buffer, usage);
-        
-        if(has_flag(COLOR_BIT) || m_color_buffer.usage() != buf_usage)
+        bool present = std::any_of(sources.begin(), sources.end(), [&it](const attrib_source_t &src)
         {
-            if(!m_color_buffer){ m_color_buffer = gl::Buffer(GL_ARRAY_BUFFER, buf_usage); }
-            else{ m_color_buffer.set_usage(buf_usage); }
-            
-            m_color_buffer.set_data(m_colors);
-            KINSKI_CHECK_GL_ERRORS();
-            remove_flag(COLOR_BIT);
-        }
+            return src.bit == it->first;
+        });
+        if(!present){ it = m_buffer_attribs.erase(it); }
+        else{ ++it; }
     }
 
     // insert bone indices and weights
@@ -362,9 +578,22 @@ void Geometry::create_gl_buffers(GLenum usage)
         {
             if(!m_index_buffer){ m_index_buffer = gl::Buffer(GL_ELEMENT_ARRAY_BUFFER, buf_usage); }
             else{ m_index_buffer.set_usage(buf_usage); }
-            
+
+            // 16bit indices, if possible
+            bool compact = layout.compact_indices && sizeof(index_t) > sizeof(uint16_t) &&
+                           *std::max_element(m_indices.begin(), m_indices.end()) < 0xFFFF;
+
             // index buffer
-            m_index_buffer.set_data(m_indices);
+            if(compact)
+            {
+                m_index_buffer.set_data(std::vector<uint16_t>(m_indices.begin(), m_indices.end()));
+                m_buffer_index_type = GL_UNSIGNED_SHORT;
+            }
+            else
+            {
+                m_index_buffer.set_data(m_indices);
+                m_buffer_index_type = index_type();
+            }
             KINSKI_CHECK_GL_ERRORS();
             remove_flag(INDEX_BIT);
         }
@@ -372,9 +601,87 @@ void Geometry::create_gl_buffers(GLenum usage)
     
     // not necessary, but who knows
     m_dirty_bits = 0;
+
+    // vertex-arrays referencing other buffers or formats need to be recreated
+    size_t signature = std::hash<uint32_t>()(m_bone_buffer ? m_bone_buffer.id() : 0);
+    hash_combine<uint32_t>(signature, m_index_buffer ? m_index_buffer.id() : 0);
+
+    for(const auto &pair : m_buffer_attribs)
+    {
+        const auto &a = pair.second;
+        for(uint32_t v : {pair.first, a.buffer.id(), a.type, a.size, a.offset, a.stride, (uint32_t)a.normalize})
+        {
+            hash_combine(signature, v);
+        }
+    }
+    if(signature != m_buffer_signature)
+    {
+        m_buffer_signature = signature;
+        m_buffer_version++;
+    }
+}
+
+void Geometry::set_dirty_range(uint32_t the_bits, size_t the_first, size_t the_count)
+{
+    if(!the_count){ return; }
+    if(the_bits & VERTEX_BIT){ m_triangle_bvhs.clear(); }
+    m_modification_count++;
+
+    for(uint32_t bit = VERTEX_BIT; bit <= COLOR_BIT; bit <<= 1)
+    {
+        if(!(the_bits & bit)){ continue; }
+        auto it = m_dirty_ranges.find(bit);
+
+        if(it == m_dirty_ranges.end()){ m_dirty_ranges[bit] = {the_first, the_first + the_count}; }
+        else
+        {
+            it->second.first = std::min(it->second.first, the_first);
+            it->second.second = std::max(it->second.second, the_first + the_count);
+        }
+    }
+}
+
+std::pair<size_t, size_t> Geometry::pending_range(uint32_t the_bit) const
+{
+    const size_t num_vertices = m_vertices.size();
+
+    // attributes present in the vertex-buffers
+    uint32_t present_bits = (has_vertices() ? VERTEX_BIT : 0) | (has_normals() ? NORMAL_BIT : 0) |
+                            (has_tex_coords() ? TEXCOORD_BIT : 0) | (has_tangents() ? TANGENT_BIT : 0) |
+                            (has_point_sizes() ? POINTSIZE_BIT : 0) | (has_colors() ? COLOR_BIT : 0);
+
+    if(!(present_bits & the_bit)){ return {0, 0}; }
+    uint32_t bits = m_vertex_layout.interleaved ? present_bits : the_bit;
+    if(m_dirty_bits & bits){ return {0, num_vertices}; }
+
+    size_t first = num_vertices, end = 0;
+
+    for(const auto &pair : m_dirty_ranges)
+    {
+        if(!(pair.first & bits)){ continue; }
+        first = std::min(first, pair.second.first);
+        end = std::max(end, std::min(pair.second.second, num_vertices));
+    }
+    if(first >= end){ return {0, 0}; }
+    return {first, end};
 }
 
-GLenum Geometry::index_type()
+void Geometry::set_vertex_layout(const VertexLayout &the_layout)
+{
+    if(the_layout == m_vertex_layout){ return; }
+    m_vertex_layout = the_layout;
+
+    // re-encode all buffers, keeps the BVH
+    m_dirty_bits |= VERTEX_BIT | NORMAL_BIT | TANGENT_BIT | POINTSIZE_BIT | TEXCOORD_BIT | COLOR_BIT | INDEX_BIT;
+}
+
+const Geometry::buffer_attrib_t* Geometry::buffer_attrib(uint32_t the_bit) const
+{
+    auto it = m_buffer_attribs.find(the_bit);
+    return it != m_buffer_attribs.end() ? &it->second : nullptr;
+}
+
+GLenum Geometry::index_type() const
 {
 #if defined(KINSKI_GLES)
     GLenum ret = GL_UNSIGNED_SHORT;
@@ -384,6 +691,11 @@ GLenum Geometry::index_type()
     return ret;
 }
 
+size_t Geometry::buffer_index_size() const
+{
+    return m_buffer_index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
 /********************************* PRIMITIVES ****************************************/
 
 GeometryPtr Geometry::create_plane(float width, float height,
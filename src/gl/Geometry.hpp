@@ -12,6 +12,7 @@
 #include "gl/gl.hpp"
 #include "geometry_types.hpp"
 #include "Buffer.hpp"
+#include "BVH.hpp"
 
 namespace kinski{ namespace gl{
 
@@ -29,6 +30,10 @@ struct Face3
     };
 };
 
+// faces are copied from and to flat index-arrays
+static_assert(sizeof(Face3) == 3 * sizeof(index_t) && std::is_standard_layout<Face3>::value,
+              "Face3 needs to be layout-compatible with index_t[3]");
+
 // each vertex can reference up to 4 bones
 struct BoneVertexData
 {
@@ -40,6 +45,72 @@ struct BoneVertexData
     weights(vec4(0)){};
 };
 
+/*!
+ * describes how vertex-attributes are encoded in GL buffers.
+ * the default layout uses separate float-buffers (positions padded to vec4)
+ */
+struct VertexLayout
+{
+    enum Format : uint8_t
+    {
+        FLOAT = 0,
+
+        //! 16bit floats, e.g. for positions and texcoords
+        HALF = 1,
+
+        //! signed normalized 10:10:10:2, e.g. for normals and tangents
+        SNORM_10_10_10_2 = 2,
+
+        //! unsigned normalized 8bit, e.g. for colors (values are clamped to [0, 1])
+        UNORM_8 = 3
+    };
+
+    Format position = FLOAT;
+    Format normal = FLOAT;
+    Format tangent = FLOAT;
+    Format tex_coord = FLOAT;
+    Format color = FLOAT;
+
+    //! store all attributes, except bone-data, in a single buffer
+    bool interleaved = false;
+
+    //! use 16bit indices, if all indices fit
+    bool compact_indices = true;
+
+    //! interleaved layout with packed encodings, about half the size of the default layout
+    static VertexLayout packed()
+    {
+        VertexLayout ret;
+        ret.position = ret.tex_coord = HALF;
+        ret.normal = ret.tangent = SNORM_10_10_10_2;
+        ret.color = UNORM_8;
+        ret.interleaved = true;
+        return ret;
+    }
+
+    bool operator==(const VertexLayout &other) const
+    {
+        return position == other.position && normal == other.normal && tangent == other.tangent &&
+               tex_coord == other.tex_coord && color == other.color && interleaved == other.interleaved &&
+               compact_indices == other.compact_indices;
+    }
+    bool operator!=(const VertexLayout &other) const { return !(*this == other); }
+};
+
+//! size in bytes for the_num_components, encoded as the_format (4-byte aligned)
+uint32_t vertex_attrib_size(VertexLayout::Format the_format, uint32_t the_num_components);
+
+//! encode the_num_components floats from the_src as the_format, writing vertex_attrib_size() bytes to the_dst
+void encode_vertex_attrib(VertexLayout::Format the_format, const float *the_src, uint32_t the_num_components,
+                          uint8_t *the_dst);
+
+/*!
+ * decode an attribute written by encode_vertex_attrib(), following GL's conversion rules
+ * for normalized formats. used for read-back and testing, drawing leaves decoding to the GPU
+ */
+void decode_vertex_attrib(VertexLayout::Format the_format, const uint8_t *the_src, uint32_t the_num_components,
+                          float *the_dst);
+
 struct HalfEdge
 {
     //! Vertex index at the end of this half-edge
@@ -150,8 +221,12 @@ public:
     void compute_vertex_normals();
     void compute_tangents();
     
-    GLenum index_type();
+    GLenum index_type() const;
     inline size_t index_size() const { return sizeof(index_t); };
+
+    //! type of the indices in index_buffer(), might be more compact than index_type()
+    inline GLenum buffer_index_type() const { return m_buffer_index_type; };
+    size_t buffer_index_size() const;
     inline GLenum primitive_type() const {return m_primitive_type;};
     void set_primitive_type(GLenum type){ m_primitive_type = type; };
     
@@ -194,11 +269,76 @@ public:
     const std::vector<BoneVertexData>& bone_vertex_data() const { return m_bone_vertex_data; };
     
     inline const AABB& aabb() const { return m_bounding_box; };
+
+    //! the_mesh (and its ancestors) get their cached bounds invalidated, whenever compute_aabb() changes ours
+    void add_bounds_observer(const std::weak_ptr<const Mesh> &the_mesh);
     
-    inline void set_flag(uint32_t b){ m_dirty_bits |= b; }
+    inline void set_flag(uint32_t b)
+    {
+        m_dirty_bits |= b;
+        m_modification_count++;
+        if(b & (VERTEX_BIT | INDEX_BIT)){ m_triangle_bvhs.clear(); }
+    }
     inline void remove_flag(uint32_t b){ m_dirty_bits &= ~b; }
     inline bool has_flag(uint32_t b){ return m_dirty_bits & b; }
+
+    /*!
+     * flag the_count elements of the attributes in the_bits, starting at the_first, as modified.
+     * unless entire buffers are flagged, only these ranges are uploaded by create_gl_buffers()
+     */
+    void set_dirty_range(uint32_t the_bits, size_t the_first, size_t the_count);
+
+    /*!
+     * element-range [first, end) of attribute the_bit, pending for upload by create_gl_buffers().
+     * the entire range is returned for flagged attributes, an empty range for unmodified ones.
+     * with an interleaved layout all attributes share the combined range of the vertex-buffer
+     */
+    std::pair<size_t, size_t> pending_range(uint32_t the_bit) const;
+
+    //! access attribute-data to modify the_count elements, starting at the_first (see set_dirty_range())
+    inline std::vector<vec3>& vertices(size_t the_first, size_t the_count)
+    { set_dirty_range(VERTEX_BIT, the_first, the_count); return m_vertices; }
+
+    inline std::vector<vec3>& normals(size_t the_first, size_t the_count)
+    { set_dirty_range(NORMAL_BIT, the_first, the_count); return m_normals; }
+
+    inline std::vector<vec3>& tangents(size_t the_first, size_t the_count)
+    { set_dirty_range(TANGENT_BIT, the_first, the_count); return m_tangents; }
+
+    inline std::vector<float>& point_sizes(size_t the_first, size_t the_count)
+    { set_dirty_range(POINTSIZE_BIT, the_first, the_count); return m_point_sizes; }
+
+    inline std::vector<vec2>& tex_coords(size_t the_first, size_t the_count)
+    { set_dirty_range(TEXCOORD_BIT, the_first, the_count); return m_tex_coords; }
+
+    inline std::vector<vec4>& colors(size_t the_first, size_t the_count)
+    { set_dirty_range(COLOR_BIT, the_first, the_count); return m_colors; }
     
+    //! format of an attribute within its GL buffer, as created by create_gl_buffers()
+    struct buffer_attrib_t
+    {
+        gl::Buffer buffer;
+        GLenum type = GL_FLOAT;
+        uint32_t size = 0;
+        uint32_t offset = 0;
+        uint32_t stride = 0;
+        bool normalize = false;
+    };
+
+    inline const VertexLayout& vertex_layout() const { return m_vertex_layout; };
+
+    //! change the encoding of vertex-attributes, buffers are recreated on next use
+    void set_vertex_layout(const VertexLayout &the_layout);
+
+    //! returns the buffer-format for one of VERTEX_BIT, NORMAL_BIT, ..., or nullptr if not present
+    const buffer_attrib_t* buffer_attrib(uint32_t the_bit) const;
+
+    //! incremented whenever buffer-objects or attribute-formats change, invalidating vertex-arrays
+    inline uint32_t buffer_version() const { return m_buffer_version; };
+
+    //! incremented whenever attribute-data or indices are flagged as modified (see set_flag(), set_dirty_range())
+    inline uint32_t modification_count() const { return m_modification_count; };
+
     // GL buffers
     const gl::Buffer& vertex_buffer() const { return m_vertex_buffer; };
     const gl::Buffer& normal_buffer() const { return m_normal_buffer; };
@@ -209,6 +349,13 @@ public:
     const gl::Buffer& bone_buffer() const { return m_bone_buffer; };
     const gl::Buffer& index_buffer() const { return m_index_buffer; };
     
+    /*!
+     * returns a BVH over the triangles described by the_ranges (all triangles, if empty).
+     * the BVH is built on demand and cached per range-set until vertices or indices are modified,
+     * so meshes sharing this geometry with different entries do not evict each other.
+     */
+    TriangleBVHConstPtr triangle_bvh(const std::vector<TriangleBVH::range_t> &the_ranges = {}) const;
+    
     bool has_dirty_buffers() const;
     void create_gl_buffers(GLenum usage = GL_DONT_CARE);
     
@@ -246,6 +393,9 @@ private:
     std::vector<BoneVertexData> m_bone_vertex_data;
     
     AABB m_bounding_box;
+
+    //! meshes using this geometry, see add_bounds_observer()
+    std::vector<std::weak_ptr<const Mesh>> m_bounds_observers;
     gl::Buffer m_vertex_buffer;
     gl::Buffer m_normal_buffer;
     gl::Buffer m_tex_coord_buffer;
@@ -257,6 +407,19 @@ private:
     
     // bitmask for dirty buffers
     uint32_t m_dirty_bits;
+
+    // modified element-ranges [first, end) for partial uploads, per BufferBit
+    std::map<uint32_t, std::pair<size_t, size_t>> m_dirty_ranges;
+
+    VertexLayout m_vertex_layout;
+    std::map<uint32_t, buffer_attrib_t> m_buffer_attribs;
+    GLenum m_buffer_index_type;
+    uint32_t m_buffer_version = 0;
+    size_t m_buffer_signature = 0;
+    uint32_t m_modification_count = 0;
+    
+    // lazily created BVHs for ray-queries, keyed by their triangle-ranges
+    mutable std::map<std::vector<TriangleBVH::range_t>, TriangleBVHPtr> m_triangle_bvhs;
 };
 
 }//gl
@@ -0,0 +1,239 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+#include <atomic>
+#include <condition_variable>
+#include <crocore/ThreadPool.hpp>
+#include "LightGrid.hpp"
+
+namespace kinski { namespace gl {
+
+namespace
+{
+    struct grid_job_t
+    {
+        const LightGrid *grid = nullptr;
+        const std::vector<vec4> *lights = nullptr;
+        std::vector<std::vector<uint32_t>> *slice_indices = nullptr;
+        std::vector<LightGrid::cluster_t> *clusters = nullptr;
+        std::vector<float> slice_depths;
+        uint32_t num_slices = 0;
+
+        std::atomic<uint32_t> next_slice{0}, num_done{0};
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+
+    inline bool intersect(const gl::AABB &the_box, const vec4 &the_sphere)
+    {
+        vec3 p = glm::clamp(vec3(the_sphere), the_box.min, the_box.max);
+        return glm::length2(p - vec3(the_sphere)) <= the_sphere.w * the_sphere.w;
+    }
+
+    void process_slice(grid_job_t &the_job, uint32_t the_slice)
+    {
+        const auto &grid = *the_job.grid;
+        const auto &lights = *the_job.lights;
+        const uvec3 &dims = grid.dimensions();
+        float d0 = the_job.slice_depths[the_slice], d1 = the_job.slice_depths[the_slice + 1];
+
+        // lights overlapping this depth-slice
+        std::vector<uint32_t> candidates;
+
+        for(uint32_t i = 0; i < lights.size(); ++i)
+        {
+            const vec4 &l = lights[i];
+            if(l.w < 0.f || (-l.z + l.w >= d0 && -l.z - l.w <= d1)){ candidates.push_back(i); }
+        }
+
+        auto &indices = (*the_job.slice_indices)[the_slice];
+        indices.clear();
+
+        for(uint32_t y = 0; y < dims.y; ++y)
+        {
+            for(uint32_t x = 0; x < dims.x; ++x)
+            {
+                uint32_t index = grid.cluster_index(uvec3(x, y, the_slice));
+                const gl::AABB &bounds = grid.cluster_bounds()[index];
+
+                // offsets are relative to the slice, until merged
+                auto &cluster = (*the_job.clusters)[index];
+                cluster.offset = indices.size();
+
+                for(uint32_t i : candidates)
+                {
+                    if(lights[i].w < 0.f || intersect(bounds, lights[i])){ indices.push_back(i); }
+                }
+                cluster.count = indices.size() - cluster.offset;
+            }
+        }
+    }
+
+    //! claim and process depth-slices until none are left
+    void process_grid_job(const std::shared_ptr<grid_job_t> &the_job)
+    {
+        const uint32_t num_slices = the_job->num_slices;
+        uint32_t s;
+
+        while((s = the_job->next_slice++) < num_slices)
+        {
+            process_slice(*the_job, s);
+
+            if(++the_job->num_done == num_slices)
+            {
+                std::unique_lock<std::mutex> lock(the_job->mutex);
+                the_job->condition.notify_all();
+            }
+        }
+    }
+
+    inline float slice_depth(uint32_t the_slice, uint32_t the_num_slices, float the_near, float the_far)
+    {
+        return the_near * std::pow(the_far / the_near, the_slice / (float)the_num_slices);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+LightGrid::LightGrid(const uvec3 &the_dimensions)
+{
+    set_dimensions(the_dimensions);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void LightGrid::set_dimensions(const uvec3 &the_dimensions)
+{
+    m_dimensions = glm::max(the_dimensions, uvec3(1));
+    m_bounds.clear();
+    m_clusters.assign(num_clusters(), cluster_t());
+    m_slice_indices.resize(m_dimensions.z);
+    m_light_indices.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t LightGrid::slice(float the_depth) const
+{
+    if(the_depth <= m_near){ return 0; }
+    float s = std::log(the_depth / m_near) / std::log(m_far / m_near) * m_dimensions.z;
+    return std::min<uint32_t>(s, m_dimensions.z - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void LightGrid::update_bounds(const mat4 &the_projection, float the_near, float the_far)
+{
+    if(!m_bounds.empty() && the_projection == m_projection && the_near == m_near && the_far == m_far){ return; }
+    m_projection = the_projection;
+    m_near = the_near;
+    m_far = the_far;
+    m_bounds.resize(num_clusters());
+
+    const mat4 inv_projection = glm::inverse(the_projection);
+
+    auto unproject = [&inv_projection](float x, float y, float z)
+    {
+        vec4 p = inv_projection * vec4(x, y, z, 1.f);
+        return vec3(p) / p.w;
+    };
+
+    for(uint32_t y = 0; y < m_dimensions.y; ++y)
+    {
+        for(uint32_t x = 0; x < m_dimensions.x; ++x)
+        {
+            // corner-lines of this screen-tile, from near- to far-plane
+            vec3 near_points[4], far_points[4];
+
+            for(uint32_t c = 0; c < 4; ++c)
+            {
+                float ndc_x = -1.f + 2.f * (x + (c & 1)) / m_dimensions.x;
+                float ndc_y = -1.f + 2.f * (y + (c >> 1)) / m_dimensions.y;
+                near_points[c] = unproject(ndc_x, ndc_y, -1.f);
+                far_points[c] = unproject(ndc_x, ndc_y, 1.f);
+            }
+
+            for(uint32_t z = 0; z < m_dimensions.z; ++z)
+            {
+                float depths[2] = {slice_depth(z, m_dimensions.z, m_near, m_far),
+                                   slice_depth(z + 1, m_dimensions.z, m_near, m_far)};
+                gl::AABB bounds;
+                bool first = true;
+
+                for(uint32_t c = 0; c < 4; ++c)
+                {
+                    for(float d : depths)
+                    {
+                        // works for perspective and orthographic projections
+                        float t = (d + near_points[c].z) / (near_points[c].z - far_points[c].z);
+                        vec3 p = glm::mix(near_points[c], far_points[c], t);
+
+                        if(first){ bounds = gl::AABB(p, p); first = false; }
+                        else{ bounds += gl::AABB(p, p); }
+                    }
+                }
+                m_bounds[cluster_index(uvec3(x, y, z))] = bounds;
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void LightGrid::update(const mat4 &the_projection, float the_near, float the_far,
+                       const std::vector<vec4> &the_lights, crocore::ThreadPool *the_pool)
+{
+    update_bounds(the_projection, the_near, the_far);
+
+    auto job = std::make_shared<grid_job_t>();
+    job->grid = this;
+    job->lights = &the_lights;
+    job->slice_indices = &m_slice_indices;
+    job->clusters = &m_clusters;
+
+    for(uint32_t z = 0; z <= m_dimensions.z; ++z)
+    {
+        job->slice_depths.push_back(slice_depth(z, m_dimensions.z, m_near, m_far));
+    }
+
+    // distribute slices to worker-threads, if any. tasks starting late will find no slices left
+    const uint32_t num_slices = m_dimensions.z;
+    job->num_slices = num_slices;
+
+    if(the_pool && num_slices > 1 && !the_lights.empty())
+    {
+        uint32_t num_tasks = std::min<uint32_t>(the_pool->num_threads(), num_slices - 1);
+        for(uint32_t i = 0; i < num_tasks; ++i){ the_pool->post([job](){ process_grid_job(job); }); }
+    }
+    process_grid_job(job);
+
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->condition.wait(lock, [&job, num_slices](){ return job->num_done == num_slices; });
+    }
+
+    // merge in slice-order
+    size_t num_indices = 0;
+    for(const auto &indices : m_slice_indices){ num_indices += indices.size(); }
+    m_light_indices.resize(num_indices);
+
+    uint32_t offset = 0;
+    const uint32_t clusters_per_slice = m_dimensions.x * m_dimensions.y;
+
+    for(uint32_t z = 0; z < num_slices; ++z)
+    {
+        const auto &indices = m_slice_indices[z];
+        std::copy(indices.begin(), indices.end(), m_light_indices.begin() + offset);
+
+        for(uint32_t i = 0; i < clusters_per_slice; ++i){ m_clusters[z * clusters_per_slice + i].offset += offset; }
+        offset += indices.size();
+    }
+}
+
+}}//namespace
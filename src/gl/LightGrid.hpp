@@ -0,0 +1,89 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+//  LightGrid.hpp
+//
+//  View-space cluster-grid (froxels) for clustered light-culling
+
+#pragma once
+
+#include "gl/gl.hpp"
+#include "geometry_types.hpp"
+
+namespace crocore{ class ThreadPool; }
+
+namespace kinski { namespace gl {
+
+/*!
+ * Assigns light-volumes to the clusters of a view-frustum.
+ * Clusters are distributed uniformly in screen-space and exponentially along the depth-axis,
+ * so a cluster can be looked up from window-coords and view-space depth.
+ */
+class LightGrid
+{
+public:
+
+    //! range of light-indices affecting a cluster
+    struct cluster_t
+    {
+        uint32_t offset = 0;
+        uint32_t count = 0;
+    };
+
+    explicit LightGrid(const uvec3 &the_dimensions = uvec3(16, 9, 24));
+
+    void set_dimensions(const uvec3 &the_dimensions);
+
+    inline const uvec3& dimensions() const { return m_dimensions; }
+
+    inline uint32_t num_clusters() const { return m_dimensions.x * m_dimensions.y * m_dimensions.z; }
+
+    /*!
+     * assign lights to clusters.
+     * the_lights contain bounding-spheres in eye-coords (xyz: position, w: radius).
+     * a negative radius denotes lights affecting all clusters (e.g. directional lights).
+     * work is distributed across the_pool per depth-slice, if provided
+     */
+    void update(const mat4 &the_projection, float the_near, float the_far,
+                const std::vector<vec4> &the_lights, crocore::ThreadPool *the_pool = nullptr);
+
+    //! cluster-index for the_coord (x, y: screen-tile, z: depth-slice)
+    inline uint32_t cluster_index(const uvec3 &the_coord) const
+    {
+        return (the_coord.z * m_dimensions.y + the_coord.y) * m_dimensions.x + the_coord.x;
+    }
+
+    //! depth-slice for a (positive) view-space distance
+    uint32_t slice(float the_depth) const;
+
+    //! bounds of all clusters in eye-coords, indexed by cluster_index()
+    inline const std::vector<gl::AABB>& cluster_bounds() const { return m_bounds; }
+
+    inline const std::vector<cluster_t>& clusters() const { return m_clusters; }
+
+    inline const std::vector<uint32_t>& light_indices() const { return m_light_indices; }
+
+private:
+
+    //! recreate cluster-bounds, if the frustum changed
+    void update_bounds(const mat4 &the_projection, float the_near, float the_far);
+
+    uvec3 m_dimensions;
+    mat4 m_projection = mat4(0);
+    float m_near = 0.f, m_far = 0.f;
+
+    std::vector<gl::AABB> m_bounds;
+    std::vector<cluster_t> m_clusters;
+    std::vector<uint32_t> m_light_indices;
+
+    //! light-indices per depth-slice, merged in slice-order
+    std::vector<std::vector<uint32_t>> m_slice_indices;
+};
+
+}}//namespace
@@ -227,6 +227,19 @@ void Material::enqueue_shader(gl::ShaderType the_type)
     m_queued_shader = the_type;
 }
 
+void Material::uniform(const std::string &theName, const UniformValue &theVal)
+{
+    auto it = m_uniforms.find(theName);
+
+    if(it == m_uniforms.end()){ it = m_uniforms.insert(std::make_pair(theName, theVal)).first; }
+    else if(it->second == theVal){ return; }
+    else{ it->second = theVal; }
+
+    // map-nodes are stable, unless erased via non-const uniforms()
+    if(m_uniform_state.m_dirty.size() >= m_uniforms.size()){ m_uniform_state.set_all_dirty(); }
+    else if(!m_uniform_state.m_all_dirty){ m_uniform_state.m_dirty.push_back(&*it); }
+}
+
 void Material::update_uniforms(const ShaderPtr &the_shader)
 {
     auto shader_obj = the_shader ? the_shader : m_shader;
@@ -278,31 +291,49 @@ void Material::update_uniforms(const ShaderPtr &the_shader)
 #else
     if(m_dirty_uniform_buffer)
     {
-        m_uniforms["u_material.diffuse"] = m_diffuse;
-        m_uniforms["u_material.emmission"] = m_emission;
-        m_uniforms["u_metalness"] = m_metalness;
-        m_uniforms["u_roughness"] = m_roughness;
-        m_uniforms["u_material.point_vals"] = vec4(m_point_size,
-                                                   m_point_attenuation.constant,
-                                                   m_point_attenuation.linear,
-                                                   m_point_attenuation.quadratic);
+        uniform("u_material.diffuse", m_diffuse);
+        uniform("u_material.emmission", m_emission);
+        uniform("u_metalness", m_metalness);
+        uniform("u_roughness", m_roughness);
+        uniform("u_material.point_vals", vec4(m_point_size,
+                                              m_point_attenuation.constant,
+                                              m_point_attenuation.linear,
+                                              m_point_attenuation.quadratic));
     }
 #endif
+    m_dirty_uniform_buffer = false;
 
-    if(m_dirty_uniform_buffer)
+    auto &state = m_uniform_state;
+
+    // the shader still holds our values, only apply what changed since
+    bool same_state = state.m_shader == shader_obj.get() &&
+                      state.m_shader_version == shader_obj->uniform_version();
+
+    if(same_state && !state.m_all_dirty)
+    {
+        for(auto *pair : state.m_dirty)
+        {
+            boost::apply_visitor(InsertUniformVisitor(shader_obj, pair->first), pair->second);
+        }
+    }
+    else
     {
-        // set all other uniform values
-        for(auto&[name, uniform] : uniforms())
+        // set all uniform values, the shader skips values it already holds
+        for(auto&[name, uniform] : m_uniforms)
         {
 //            std::visit([this, &name](auto &&value)
 //                       {
 //                            m_shader->uniform(name, value);
 //                       }, uniform);
             boost::apply_visitor(InsertUniformVisitor(shader_obj, name), uniform);
-            KINSKI_CHECK_GL_ERRORS();
         }
     }
-    m_dirty_uniform_buffer = false;
+    KINSKI_CHECK_GL_ERRORS();
+
+    state.m_all_dirty = false;
+    state.m_dirty.clear();
+    state.m_shader = shader_obj.get();
+    state.m_shader_version = shader_obj->uniform_version();
 }
 
 }
@@ -37,7 +37,7 @@ namespace kinski { namespace gl {
 
         enum ShadowProperties{SHADOW_NONE = 0, SHADOW_CAST = 1, SHADOW_RECEIVE = 2};
 
-        enum class AssetLoadStatus{ NOT_LOADED = 0, NOT_FOUND = 1, IMAGE_LOADED = 2, DONE = 3 };
+        enum class AssetLoadStatus{ NOT_LOADED = 0, NOT_FOUND = 1, IMAGE_LOADED = 2, DONE = 3, LOADING = 4 };
 
         using texture_map_t = std::map<uint32_t, gl::Texture>;
 
@@ -52,7 +52,7 @@ namespace kinski { namespace gl {
         static MaterialPtr create(const gl::ShaderType &the_type = gl::ShaderType::UNLIT);
         static MaterialPtr create(const ShaderPtr &theShader);
 
-        bool dirty() const { return m_dirty_uniform_buffer; };
+        bool dirty() const { return m_dirty_uniform_buffer || m_uniform_state.num_dirty(); };
 
         void add_texture(const Texture &the_texture, Texture::Usage the_usage = Texture::Usage::COLOR);
         void add_texture(const Texture &the_texture, uint32_t the_key);
@@ -68,9 +68,16 @@ namespace kinski { namespace gl {
 
         glm::mat4 texture_matrix() const;
 
-        inline void uniform(const std::string &theName, const UniformValue &theVal)
-        { m_uniforms[theName] = theVal; m_dirty_uniform_buffer = true; };
+        /*!
+         * set a uniform value. assigning the current value is a no-op,
+         * otherwise the uniform will be uploaded during the next update_uniforms()
+         */
+        void uniform(const std::string &theName, const UniformValue &theVal);
 
+        /*!
+         * upload modified uniforms to the_shader (or the material's shader, if none is provided).
+         * switching shaders, or shaders modified elsewhere in between, cause all uniforms to be applied
+         */
         void update_uniforms(const ShaderPtr &the_shader = ShaderPtr());
 
         const ShaderPtr& shader();
@@ -97,7 +104,8 @@ namespace kinski { namespace gl {
 
         gl::ShaderType queued_shader() const { return m_queued_shader; };
 
-        UniformMap& uniforms() {return m_uniforms;};
+        //! non-const access, all uniforms will be applied during the next update_uniforms()
+        UniformMap& uniforms() { m_uniform_state.set_all_dirty(); return m_uniforms; };
         const UniformMap& uniforms() const {return m_uniforms;};
 
         bool two_sided() const { return !m_cull_value; };
@@ -157,9 +165,30 @@ namespace kinski { namespace gl {
 
         Material(const ShaderPtr &theShader);
 
+        /*!
+         * keeps track of modified uniforms and the shader-state they were last applied to.
+         * copies start out fully dirty, since the references can't be shared.
+         */
+        class uniform_state_t
+        {
+        public:
+            uniform_state_t() = default;
+            uniform_state_t(const uniform_state_t&){};
+            uniform_state_t& operator=(const uniform_state_t&){ set_all_dirty(); return *this; };
+
+            inline void set_all_dirty(){ m_all_dirty = true; m_dirty.clear(); }
+            inline size_t num_dirty() const { return m_all_dirty ? 1 : m_dirty.size(); }
+
+            bool m_all_dirty = true;
+            std::vector<UniformMap::value_type*> m_dirty;
+            const Shader *m_shader = nullptr;
+            uint64_t m_shader_version = 0;
+        };
+
         ShaderPtr m_shader;
 
         UniformMap m_uniforms;
+        uniform_state_t m_uniform_state;
         gl::Buffer m_uniform_buffer;
 
         bool m_dirty_uniform_buffer;
@@ -7,7 +7,11 @@
 //  http://www.boost.org/LICENSE_1_0.txt
 // __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
 
+#include <atomic>
+#include <condition_variable>
+#include <crocore/ThreadPool.hpp>
 #include "Mesh.hpp"
+#include "Skeleton.hpp"
 #include "Visitor.hpp"
 
 namespace kinski { namespace gl {
@@ -20,6 +24,11 @@ uint32_t num_bones_in_hierarchy(const BonePtr &the_root)
     return ret;
 }
 
+instance_record_t create_instance_record(const mat4 &the_transform)
+{
+    return {the_transform, glm::inverseTranspose(mat3(the_transform))};
+}
+
 BonePtr deep_copy_bones(BonePtr src)
 {
     if(!src){ return BonePtr(); }
@@ -59,7 +68,9 @@ m_pointSizeLocationName("a_pointSize"),
 m_texCoordLocationName("a_texCoord"),
 m_colorLocationName("a_color"),
 m_boneIDsLocationName("a_boneIds"),
-m_boneWeightsLocationName("a_boneWeights")
+m_boneWeightsLocationName("a_boneWeights"),
+m_instanceTransformLocationName("a_instance_transform"),
+m_instanceNormalMatrixLocationName("a_instance_normal_matrix")
 {
     m_materials.push_back(theMaterial);
     Entry entry;
@@ -78,59 +89,44 @@ Mesh::~Mesh()
 
 void Mesh::create_vertex_attribs(bool recreate)
 {
-    if(!m_vertex_attribs.empty() && !recreate) return;
+    if(m_geometry->has_dirty_buffers()){ m_geometry->create_gl_buffers(); }
 
-    m_vertex_attribs.clear();
-    m_geometry->create_gl_buffers();
+    if(!m_vertex_attribs.empty() && !recreate && m_vertex_attribs_version == m_geometry->buffer_version()) return;
 
-    VertexAttrib vertices;
-    vertices.name = m_vertexLocationName;
-    vertices.buffer = m_geometry->vertex_buffer();
-    m_vertex_attribs.insert(std::make_pair(Geometry::VERTEX_BIT, vertices));
-
-    if(m_geometry->has_tex_coords())
+    // keep custom attributes
+    for(auto it = m_vertex_attribs.begin(); it != m_vertex_attribs.end();)
     {
-        VertexAttrib tex_coords;
-        tex_coords.name = m_texCoordLocationName;
-        tex_coords.buffer = m_geometry->tex_coord_buffer();
-        tex_coords.size = 2;
-        m_vertex_attribs.insert(std::make_pair(Geometry::TEXCOORD_BIT, tex_coords));
-    }
-
-    if(m_geometry->has_colors())
-    {
-        VertexAttrib colors;
-        colors.name = m_colorLocationName;
-        colors.buffer = m_geometry->color_buffer();
-        colors.size = 4;
-        m_vertex_attribs.insert(std::make_pair(Geometry::COLOR_BIT, colors));
+        if(it->first != Geometry::CUSTOM_BIT){ it = m_vertex_attribs.erase(it); }
+        else{ ++it; }
     }
+    m_geometry->create_gl_buffers();
+    m_vertex_attribs_version = m_geometry->buffer_version();
 
-    if(m_geometry->has_normals())
+    // buffer, type and offsets as created by the geometry's VertexLayout
+    const std::pair<uint32_t, const std::string*> attribs[] =
     {
-        VertexAttrib normals;
-        normals.name = m_normalLocationName;
-        normals.buffer = m_geometry->normal_buffer();
-        normals.size = 3;
-        m_vertex_attribs.insert(std::make_pair(Geometry::NORMAL_BIT, normals));
-    }
-
-    if(m_geometry->has_tangents())
+        {Geometry::VERTEX_BIT, &m_vertexLocationName},
+        {Geometry::TEXCOORD_BIT, &m_texCoordLocationName},
+        {Geometry::COLOR_BIT, &m_colorLocationName},
+        {Geometry::NORMAL_BIT, &m_normalLocationName},
+        {Geometry::TANGENT_BIT, &m_tangentLocationName},
+        {Geometry::POINTSIZE_BIT, &m_pointSizeLocationName}
+    };
+
+    for(const auto &pair : attribs)
     {
-        VertexAttrib tangents;
-        tangents.name = m_tangentLocationName;
-        tangents.buffer = m_geometry->tangent_buffer();
-        tangents.size = 3;
-        m_vertex_attribs.insert(std::make_pair(Geometry::TANGENT_BIT, tangents));
-    }
-
-    if(m_geometry->has_point_sizes())
-    {
-        VertexAttrib point_sizes;
-        point_sizes.name = m_pointSizeLocationName;
-        point_sizes.buffer = m_geometry->point_size_buffer();
-        point_sizes.size = 1;
-        m_vertex_attribs.insert(std::make_pair(Geometry::POINTSIZE_BIT, point_sizes));
+        const auto *format = m_geometry->buffer_attrib(pair.first);
+        if(!format){ continue; }
+
+        VertexAttrib attrib;
+        attrib.name = *pair.second;
+        attrib.buffer = format->buffer;
+        attrib.size = format->size;
+        attrib.type = format->type;
+        attrib.offset = format->offset;
+        attrib.stride = format->stride;
+        attrib.normalize = format->normalize;
+        m_vertex_attribs.insert(std::make_pair(pair.first, attrib));
     }
 
     if(m_geometry->has_bones())
@@ -185,17 +181,24 @@ void Mesh::bind_vertex_pointers(const gl::ShaderPtr &the_shader)
             glEnableVertexAttribArray(location);
             KINSKI_CHECK_GL_ERRORS();
             
-            if(vertex_attrib.type == GL_FLOAT || vertex_attrib.type == GL_UNSIGNED_BYTE)
+            // interleaved attributes provide their own stride
+            size_t stride = vertex_attrib.stride ? vertex_attrib.stride : vertex_attrib.buffer.stride();
+
+#if !defined(KINSKI_GLES_2)
+            bool is_float = vertex_attrib.type == GL_FLOAT || vertex_attrib.type == GL_UNSIGNED_BYTE ||
+                            vertex_attrib.type == GL_HALF_FLOAT || vertex_attrib.type == GL_INT_2_10_10_10_REV;
+#else
+            bool is_float = vertex_attrib.type == GL_FLOAT || vertex_attrib.type == GL_UNSIGNED_BYTE;
+#endif
+            if(is_float)
             {
                 glVertexAttribPointer(location, vertex_attrib.size, vertex_attrib.type,
-                                      vertex_attrib.normalize, vertex_attrib.buffer.stride(),
-                                      BUFFER_OFFSET(vertex_attrib.offset));
+                                      vertex_attrib.normalize, stride, BUFFER_OFFSET(vertex_attrib.offset));
             }
 #if !defined(KINSKI_GLES_2)
             else if(vertex_attrib.type == GL_INT)
             {
-                glVertexAttribIPointer(location, vertex_attrib.size, vertex_attrib.type,
-                                       vertex_attrib.buffer.stride(),
+                glVertexAttribIPointer(location, vertex_attrib.size, vertex_attrib.type, stride,
                                        BUFFER_OFFSET(vertex_attrib.offset));
             }
 
@@ -206,11 +209,76 @@ void Mesh::bind_vertex_pointers(const gl::ShaderPtr &the_shader)
         }
     }
     
+    // default per-instance transform (identity)
+    bind_instance_transforms(the_shader);
+
     // bind index buffer
     if(m_index_buffer){ m_index_buffer.bind(); }
     else if(m_geometry->has_indices()){ m_geometry->index_buffer().bind(); }
 }
 
+GLenum Mesh::index_type() const
+{
+    return m_index_buffer ? m_geometry->index_type() : m_geometry->buffer_index_type();
+}
+
+size_t Mesh::index_size() const
+{
+    return m_index_buffer ? m_geometry->index_size() : m_geometry->buffer_index_size();
+}
+
+bool Mesh::supports_instancing(const gl::ShaderPtr &the_shader) const
+{
+#if !defined(KINSKI_GLES_2)
+    if(the_shader){ return the_shader->attrib_location(m_instanceTransformLocationName) >= 0; }
+
+    for(const auto &mat : m_materials)
+    {
+        if(!mat->shader() || mat->shader()->attrib_location(m_instanceTransformLocationName) < 0){ return false; }
+    }
+    return !m_materials.empty();
+#else
+    return false;
+#endif
+}
+
+void Mesh::bind_instance_transforms(const gl::ShaderPtr &the_shader, const gl::Buffer &the_buffer,
+                                    size_t the_offset)
+{
+#if !defined(KINSKI_GLES_2)
+    int32_t location = the_shader->attrib_location(m_instanceTransformLocationName);
+    if(location < 0){ return; }
+
+    static gl::Buffer identity_buffer;
+
+    if(!identity_buffer)
+    {
+        identity_buffer = gl::Buffer(std::vector<instance_record_t>(1, create_instance_record(mat4(1))),
+                                     GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+    }
+    const gl::Buffer &buffer = the_buffer ? the_buffer : identity_buffer;
+    buffer.bind(GL_ARRAY_BUFFER);
+
+    // matrices occupy consecutive locations, one per column
+    auto bind_matrix = [the_offset](int32_t the_location, uint32_t the_num_columns, size_t the_member_offset)
+    {
+        for(uint32_t i = 0; i < the_num_columns; ++i)
+        {
+            glEnableVertexAttribArray(the_location + i);
+            glVertexAttribPointer(the_location + i, the_num_columns, GL_FLOAT, GL_FALSE, sizeof(instance_record_t),
+                                  BUFFER_OFFSET(the_offset + the_member_offset + i * the_num_columns * sizeof(float)));
+            glVertexAttribDivisor(the_location + i, 1);
+        }
+    };
+    bind_matrix(location, 4, 0);
+
+    // optional, e.g. not used by depth-only shaders
+    int32_t normal_location = the_shader->attrib_location(m_instanceNormalMatrixLocationName);
+    if(normal_location >= 0){ bind_matrix(normal_location, 3, sizeof(mat4)); }
+    KINSKI_CHECK_GL_ERRORS();
+#endif
+}
+
 void Mesh::bind_vertex_pointers(int material_index)
 {
     ShaderPtr shader = m_materials[material_index]->shader();
@@ -220,7 +288,17 @@ void Mesh::bind_vertex_pointers(int material_index)
 void Mesh::update(float time_delta)
 {
     Object3D::update(time_delta);
+    update_animation(time_delta);
+}
 
+void Mesh::update_animation(float time_delta)
+{
+    evaluate_animation(time_delta);
+    update_bone_transforms();
+}
+
+void Mesh::evaluate_animation(float time_delta)
+{
     if(m_rootBone && m_animation_index < m_animations.size())
     {
         auto &anim = m_animations[m_animation_index];
@@ -228,118 +306,104 @@ void Mesh::update(float time_delta)
                                   anim.duration);
         anim.current_time += anim.current_time < 0.f ? anim.duration : 0.f;
 
-        m_boneMatrices.resize(num_bones());
-        build_bone_matrices(m_rootBone, m_boneMatrices);
+        if(!m_skeleton || m_skeleton->animations().size() != m_animations.size() ||
+           m_skeleton->bones().front() != m_rootBone)
+        {
+            m_skeleton = Skeleton::create(m_rootBone, m_animations);
+        }
+        m_skeleton->evaluate(m_animation_index, anim.current_time, m_key_cursors, m_bone_transforms,
+                             m_boneMatrices);
     }
 }
 
+void Mesh::update_bone_transforms()
+{
+    if(!m_skeleton || m_bone_transforms.size() != m_skeleton->num_bones()){ return; }
+    const auto &bones = m_skeleton->bones();
+    for(uint32_t i = 0; i < bones.size(); ++i){ bones[i]->worldtransform = m_bone_transforms[i]; }
+}
+
 uint32_t Mesh::num_bones()
 {
     return num_bones_in_hierarchy(root_bone());
 }
 
-void Mesh::build_bone_matrices(BonePtr bone, std::vector<glm::mat4> &matrices,
-                               glm::mat4 parentTransform)
+void update_animations(const std::vector<Mesh*> &the_meshes, float time_delta, crocore::ThreadPool *the_pool)
 {
-    if(m_animations.empty()) return;
+    //! the job owns its data, tasks starting late must not touch anything before claiming a mesh
+    struct animation_job_t
+    {
+        std::vector<Mesh*> meshes;
+        uint32_t num_meshes = 0;
+        float time_delta = 0.f;
+        std::atomic<uint32_t> next_mesh{0}, num_done{0};
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+
+    //! claim and evaluate meshes until none are left
+    auto process = [](const std::shared_ptr<animation_job_t> &the_job)
+    {
+        const uint32_t num_meshes = the_job->num_meshes;
+        uint32_t i;
 
-    auto &anim = m_animations[m_animation_index];
-    float time = anim.current_time;
-    glm::mat4 boneTransform = bone->transform;
+        while((i = the_job->next_mesh++) < num_meshes)
+        {
+            the_job->meshes[i]->evaluate_animation(the_job->time_delta);
 
-    const AnimationKeys &bonekeys = anim.bone_keys[bone];
-    bool boneHasKeys = false;
+            if(++the_job->num_done == num_meshes)
+            {
+                std::unique_lock<std::mutex> lock(the_job->mutex);
+                the_job->condition.notify_all();
+            }
+        }
+    };
+
+    const uint32_t num_meshes = the_meshes.size();
+    auto job = std::make_shared<animation_job_t>();
+    job->meshes = the_meshes;
+    job->num_meshes = num_meshes;
+    job->time_delta = time_delta;
 
-    // translation
-    glm::mat4 translation;
-    if(!bonekeys.positionkeys.empty())
+    if(the_pool && num_meshes > 1)
     {
-        boneHasKeys = true;
-        uint32_t i = 0;
-        for (; i < bonekeys.positionkeys.size() - 1; i++)
-        {
-            const Key<glm::vec3> &key = bonekeys.positionkeys[i + 1];
-            if(key.time >= time)
-                break;
-        }
-        // i now holds the correct time index
-        const Key<glm::vec3> &key1 = bonekeys.positionkeys[i],
-                key2 = bonekeys.positionkeys[(i + 1) % bonekeys.positionkeys.size()];
-
-        float startTime = key1.time;
-        float endTime = key2.time < key1.time ? key2.time + anim.duration : key2.time;
-        float frac = std::max( (time - startTime) / (endTime - startTime), 0.0f);
-        glm::vec3 pos = glm::mix(key1.value, key2.value, frac);
-        translation = glm::translate(translation, pos);
+        uint32_t num_tasks = std::min<uint32_t>(the_pool->num_threads(), num_meshes - 1);
+        for(uint32_t i = 0; i < num_tasks; ++i){ the_pool->post([job, process](){ process(job); }); }
     }
+    process(job);
 
-    // rotation
-    glm::mat4 rotation;
-    if(!bonekeys.rotationkeys.empty())
     {
-        boneHasKeys = true;
-        uint32_t i = 0;
-        for (; i < bonekeys.rotationkeys.size() - 1; i++)
-        {
-            const Key<glm::quat> &key = bonekeys.rotationkeys[i+1];
-            if(key.time >= time)
-                break;
-        }
-        // i now holds the correct time index
-        const Key<glm::quat> &key1 = bonekeys.rotationkeys[i],
-                key2 = bonekeys.rotationkeys[(i + 1) % bonekeys.rotationkeys.size()];
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->condition.wait(lock, [&job, num_meshes](){ return job->num_done == num_meshes; });
+    }
 
-        float startTime = key1.time;
-        float endTime = key2.time < key1.time ? key2.time + anim.duration : key2.time;
-        float frac = std::max( (time - startTime) / (endTime - startTime), 0.0f);
+    // bones can be shared between copies of a mesh -> serial write-back
+    for(auto m : the_meshes){ m->update_bone_transforms(); }
+}
 
-        // quaternion spherical linear interpolation
-        glm::quat interpolRot = glm::slerp(key1.value, key2.value, frac);
-        rotation = glm::mat4_cast(interpolRot);
+AABB Mesh::aabb() const
+{
+    // register with our geometry, so changes of its bounds reach our ancestors
+    if(m_geometry.get() != m_observed_geometry)
+    {
+        m_observed_geometry = m_geometry.get();
+        auto self = std::static_pointer_cast<const Mesh>(weak_from_this().lock());
+        if(m_geometry && self){ m_geometry->add_bounds_observer(self); }
+        invalidate_aabb();
     }
 
-    // scale
-    glm::mat4 scaleMatrix;
-    if(!bonekeys.scalekeys.empty())
+    // geometry-bounds can change without us noticing
+    if(m_geometry && !(m_geometry->aabb() == m_geometry_aabb))
     {
-        if(bonekeys.scalekeys.size() == 1)
-        {
-            scaleMatrix = glm::scale(scaleMatrix, bonekeys.scalekeys.front().value);
-        }
-        else
-        {
-            boneHasKeys = true;
-            uint32_t i = 0;
-            for (; i < bonekeys.scalekeys.size() - 1; i++)
-            {
-                const Key<glm::vec3> &key = bonekeys.scalekeys[i + 1];
-                if(key.time >= time)
-                    break;
-            }
-            // i now holds the correct time index
-            const Key<glm::vec3> &key1 = bonekeys.scalekeys[i],
-                    key2 = bonekeys.scalekeys[(i + 1) % bonekeys.scalekeys.size()];
-
-            float startTime = key1.time;
-            float endTime = key2.time < key1.time ? key2.time + anim.duration : key2.time;
-            float frac = std::max( (time - startTime) / (endTime - startTime), 0.0f);
-            glm::vec3 scale = glm::mix(key1.value, key2.value, frac);
-            scaleMatrix = glm::scale(scaleMatrix, scale);
-        }
+        m_geometry_aabb = m_geometry->aabb();
+        invalidate_aabb();
     }
-    if(boneHasKeys){ boneTransform = translation * rotation * scaleMatrix; }
-    bone->worldtransform = parentTransform * boneTransform;
-
-    // add final transform
-    matrices[bone->index] = bone->worldtransform * bone->offset;
-
-    // recursion through all children
-    for(auto &b : bone->children){ build_bone_matrices(b, matrices, bone->worldtransform); }
+    return Object3D::aabb();
 }
 
-AABB Mesh::aabb() const
+AABB Mesh::compute_aabb() const
 {
-    AABB ret = m_geometry->aabb();
+    AABB ret = m_geometry_aabb;
     mat4 global_trans = global_transform();
     ret.transform(global_trans);
     for(auto &c :children()){ ret += c->aabb(); }
@@ -352,6 +416,42 @@ gl::OBB Mesh::obb() const
     return ret;
 }
 
+TriangleBVHConstPtr Mesh::triangle_bvh() const
+{
+    std::vector<TriangleBVH::range_t> ranges(m_entries.size());
+    
+    for(uint32_t i = 0; i < m_entries.size(); ++i)
+    {
+        const Entry &e = m_entries[i];
+        uint32_t primitive_type = e.primitive_type ? e.primitive_type : m_geometry->primitive_type();
+        
+        // non-triangle entries are represented by empty ranges
+        if(primitive_type == GL_TRIANGLES)
+        {
+            ranges[i].base_index = e.base_index;
+            ranges[i].num_indices = e.num_indices;
+            ranges[i].base_vertex = e.base_vertex;
+            ranges[i].num_vertices = e.num_vertices;
+        }
+    }
+    return m_geometry->triangle_bvh(ranges);
+}
+
+const std::vector<Mesh::Entry>& Mesh::entries(uint32_t the_lod) const
+{
+    if(!the_lod || m_lods.empty()){ return m_entries; }
+    return m_lods[std::min<uint32_t>(the_lod, m_lods.size()) - 1].entries;
+}
+
+uint32_t Mesh::select_lod(float the_screen_size, uint32_t the_current_lod, float the_hysteresis) const
+{
+    // level i > 0 is used below m_lods[i - 1].screen_size
+    uint32_t ret = std::min<uint32_t>(the_current_lod, m_lods.size());
+    while(ret && the_screen_size > m_lods[ret - 1].screen_size * (1.f + the_hysteresis)){ ret--; }
+    while(ret < m_lods.size() && the_screen_size < m_lods[ret].screen_size * (1.f - the_hysteresis)){ ret++; }
+    return ret;
+}
+
 const MaterialPtr Mesh::material() const
 {
     if(!entries().empty()){ return m_materials[entries().front().material_index]; }
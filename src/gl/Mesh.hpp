@@ -58,6 +58,25 @@ namespace kinski { namespace gl {
 
     uint32_t num_bones_in_hierarchy(const BonePtr &the_root);
 
+    //! per-instance data, as sourced by instanced shaders
+    struct instance_record_t
+    {
+        //! "a_instance_transform"
+        mat4 transform;
+
+        //! "a_instance_normal_matrix", inverse-transpose of transform's upper 3x3, computed once per instance
+        mat3 normal_matrix;
+    };
+
+    instance_record_t create_instance_record(const mat4 &the_transform);
+
+    /*!
+     * advance and evaluate the skeletal animations of the_meshes.
+     * evaluation is distributed across the_pool, if provided
+     */
+    void update_animations(const std::vector<Mesh*> &the_meshes, float time_delta,
+                           crocore::ThreadPool *the_pool = nullptr);
+
     class Mesh : public Object3D
     {
     public:
@@ -72,6 +91,19 @@ namespace kinski { namespace gl {
             uint32_t primitive_type = 0;
             bool enabled = true;
         };
+
+        //! a level-of-detail, drawing a reduced set of indices into our geometry
+        struct lod_t
+        {
+            //! entries replacing our regular entries on this level
+            std::vector<Entry> entries;
+
+            //! this level is used while our projected size (fraction of viewport-height) stays below screen_size
+            float screen_size = 0.f;
+
+            //! simplification-error, relative to the extents of our geometry
+            float error = 0.f;
+        };
         
         struct VertexAttrib
         {
@@ -108,6 +140,10 @@ namespace kinski { namespace gl {
 
         void set_index_buffer(const gl::Buffer &the_buffer){ m_index_buffer = the_buffer; };
         gl::Buffer index_buffer() const { return m_index_buffer; };
+
+        //! type and size of the indices used for drawing, custom index-buffers are expected to contain index_t
+        GLenum index_type() const;
+        size_t index_size() const;
         
         void bind_vertex_pointers(int material_index = 0);
         void bind_vertex_pointers(const gl::ShaderPtr &the_shader);
@@ -117,24 +153,63 @@ namespace kinski { namespace gl {
         uint32_t vertex_array(const gl::ShaderPtr &the_shader) const;
         GLuint create_vertex_array(const gl::ShaderPtr &the_shader);
 
+        /*!
+         * returns true if the_shader provides per-instance transforms ("a_instance_transform").
+         * if the_shader is null, all material-shaders are checked
+         */
+        bool supports_instancing(const gl::ShaderPtr &the_shader = gl::ShaderPtr()) const;
+
+        /*!
+         * source per-instance transforms and normal-matrices for the_shader from the_buffer
+         * (an array of instance_record_t), starting at the_offset.
+         * the corresponding vertex-array needs to be bound.
+         * an empty the_buffer restores the default, a single identity-record.
+         */
+        void bind_instance_transforms(const gl::ShaderPtr &the_shader, const gl::Buffer &the_buffer = gl::Buffer(),
+                                      size_t the_offset = 0);
+
         void update(float time_delta) override;
         
         /*!
-         * returns an AABB with global transform applied to it
+         * returns an AABB with global transform applied to it.
+         * changes to the bounds of our geometry are picked up here and invalidate the cached bounds
          */
         AABB aabb() const override;
         
         gl::OBB obb() const override;
         
+        /*!
+         * returns a BVH over all triangles of this mesh (in object-space),
+         * range-indices of the BVH correspond to the indices of our entries
+         */
+        TriangleBVHConstPtr triangle_bvh() const;
+        
         const std::vector<Entry>& entries() const {return m_entries;};
         std::vector<Entry>& entries() {return m_entries;};
+
+        //! entries for level-of-detail the_lod, level 0 refers to entries()
+        const std::vector<Entry>& entries(uint32_t the_lod) const;
+
+        //! coarser levels-of-detail, ordered by decreasing screen_size (see gl::create_lods())
+        const std::vector<lod_t>& lods() const { return m_lods; };
+        std::vector<lod_t>& lods() { return m_lods; };
+
+        //! number of levels-of-detail, including the full-resolution level 0
+        uint32_t num_lods() const { return m_lods.size() + 1; };
+
+        /*!
+         * select a level-of-detail for the projected size the_screen_size (fraction of viewport-height).
+         * leaving the_current_lod requires the size to pass a threshold by the_hysteresis (relative),
+         * avoiding popping for objects close to a threshold
+         */
+        uint32_t select_lod(float the_screen_size, uint32_t the_current_lod = 0, float the_hysteresis = 0.f) const;
         
         const std::vector<MaterialPtr>& materials() const {return m_materials;};
         std::vector<MaterialPtr>& materials() {return m_materials;};
         
         const std::vector<MeshAnimation>& animations() const { return m_animations; };
         std::vector<MeshAnimation>& animations() { return m_animations; };
-        void add_animation(const MeshAnimation &theAnim) { m_animations.push_back(theAnim); };
+        void add_animation(const MeshAnimation &theAnim) { m_animations.push_back(theAnim); m_skeleton.reset(); };
         
         uint32_t animation_index() const { return m_animation_index; }
         void set_animation_index(uint32_t the_index);
@@ -145,7 +220,10 @@ namespace kinski { namespace gl {
         const std::vector<mat4>& bone_matrices() const { return m_boneMatrices; };
 
         const BonePtr& root_bone() const { return m_rootBone; };
-        void set_root_bone(BonePtr b){ m_rootBone = b; };
+        void set_root_bone(BonePtr b){ m_rootBone = b; m_skeleton.reset(); };
+
+        //! advance the current animation by time_delta and update bone-matrices and -transforms
+        void update_animation(float time_delta);
 
         uint32_t num_bones();
         
@@ -156,15 +234,36 @@ namespace kinski { namespace gl {
         
         virtual void accept(Visitor &theVisitor) override;
         
+    protected:
+
+        AABB compute_aabb() const override;
+
     private:
         
         Mesh(const GeometryPtr &theGeom, const MaterialPtr &theMaterial);
 
-        void build_bone_matrices(BonePtr bone, std::vector<glm::mat4> &matrices,
-                                 glm::mat4 parentTransform = glm::mat4(1));
+        //! advance and evaluate the current animation, leaves our (possibly shared) bones untouched
+        void evaluate_animation(float time_delta);
+
+        //! write evaluated world-transforms back to our bones
+        void update_bone_transforms();
+
+        friend void update_animations(const std::vector<Mesh*> &the_meshes, float time_delta,
+                                      crocore::ThreadPool *the_pool);
+
+        //! invalidates our cached bounds, when the bounds of m_geometry change
+        friend class Geometry;
 
         GeometryPtr m_geometry;
+
+        //! geometry-bounds used for the cached AABB
+        mutable AABB m_geometry_aabb;
+
+        //! geometry we are registered with as bounds-observer
+        mutable const Geometry *m_observed_geometry = nullptr;
+
         std::vector<Entry> m_entries;
+        std::vector<lod_t> m_lods;
         std::vector<MaterialPtr> m_materials;
 
         //! optional index buffer, can be used to override the index buffer from m_geometry
@@ -176,9 +275,20 @@ namespace kinski { namespace gl {
         std::vector<MeshAnimation> m_animations;
         float m_animation_speed;
         std::vector<mat4> m_boneMatrices;
+
+        //! compiled bones and animations, shared with copies of this mesh.
+        // recompiled when bones or the number of animations change
+        SkeletonConstPtr m_skeleton;
+
+        //! cached key-indices and world-transforms of m_skeleton's bones
+        std::vector<uint32_t> m_key_cursors;
+        std::vector<mat4> m_bone_transforms;
         
         //! holds our vertex attributes, using gl::Geometry::BufferBit as keys
         std::unordered_multimap<uint32_t, VertexAttrib> m_vertex_attribs;
+
+        //! buffer-version of m_geometry, m_vertex_attribs were created for
+        uint32_t m_vertex_attribs_version = 0;
         
         std::string m_vertexLocationName;
         std::string m_normalLocationName;
@@ -188,5 +298,7 @@ namespace kinski { namespace gl {
         std::string m_colorLocationName;
         std::string m_boneIDsLocationName;
         std::string m_boneWeightsLocationName;
+        std::string m_instanceTransformLocationName;
+        std::string m_instanceNormalMatrixLocationName;
     };
 }}
@@ -8,11 +8,108 @@
 // __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
 
 #include <algorithm>
+#include <mutex>
+#include <unordered_map>
 #include "gl/geometry_types.hpp"
 #include "Object3D.hpp"
 #include "Visitor.hpp"
 
 namespace kinski { namespace gl {
+
+    namespace
+    {
+        // tags exceeding the capacity are stored by name
+        const uint32_t num_tag_bits = 8 * sizeof(tag_mask_t);
+
+        struct tag_registry_t
+        {
+            std::mutex mutex;
+            std::unordered_map<std::string, tag_mask_t> bits;
+            std::vector<std::string> names;
+        };
+
+        tag_registry_t& tag_registry()
+        {
+            static tag_registry_t s_registry;
+            return s_registry;
+        }
+    }
+
+    tag_mask_t tag_bit(const std::string &the_tag)
+    {
+        auto &registry = tag_registry();
+        std::unique_lock<std::mutex> lock(registry.mutex);
+
+        auto it = registry.bits.find(the_tag);
+        if(it != registry.bits.end()){ return it->second; }
+
+        if(registry.names.size() == num_tag_bits)
+        {
+            LOG_TRACE << "tag-capacity exceeded, '" << the_tag << "' is stored by name";
+            return 0;
+        }
+        tag_mask_t bit = tag_mask_t(1) << registry.names.size();
+        registry.bits[the_tag] = bit;
+        registry.names.push_back(the_tag);
+        return bit;
+    }
+
+    tag_mask_t find_tag_bit(const std::string &the_tag)
+    {
+        auto &registry = tag_registry();
+        std::unique_lock<std::mutex> lock(registry.mutex);
+        auto it = registry.bits.find(the_tag);
+        return it != registry.bits.end() ? it->second : 0;
+    }
+
+    tag_mask_t tag_mask(const std::set<std::string> &the_tags)
+    {
+        tag_mask_t ret = 0;
+        for(const auto &t : the_tags){ ret |= find_tag_bit(t); }
+        return ret;
+    }
+
+    std::set<std::string> tag_names(tag_mask_t the_mask)
+    {
+        std::set<std::string> ret;
+        if(!the_mask){ return ret; }
+
+        auto &registry = tag_registry();
+        std::unique_lock<std::mutex> lock(registry.mutex);
+
+        for(uint32_t i = 0; i < registry.names.size(); ++i)
+        {
+            if(the_mask & (tag_mask_t(1) << i)){ ret.insert(registry.names[i]); }
+        }
+        return ret;
+    }
+
+    tag_filter_t::tag_filter_t(const std::set<std::string> &the_tags):
+    accept_all(the_tags.empty())
+    {
+        auto &registry = tag_registry();
+        std::unique_lock<std::mutex> lock(registry.mutex);
+
+        for(const auto &t : the_tags)
+        {
+            auto it = registry.bits.find(t);
+            if(it != registry.bits.end()){ mask |= it->second; }
+
+            // never interned tags can only be found by name, once all bits are taken
+            else if(registry.names.size() == num_tag_bits){ names.push_back(t); }
+        }
+    }
+
+    bool tag_filter_t::matches(tag_mask_t the_mask, const std::vector<std::string> &the_overflow_tags) const
+    {
+        if(accept_all || (mask & the_mask)){ return true; }
+
+        for(const auto &t : the_overflow_tags)
+        {
+            if(std::find(names.begin(), names.end(), t) != names.end()){ return true; }
+        }
+        return false;
+    }
     
     uint32_t Object3D::s_id_pool = 0;
     
@@ -32,11 +129,74 @@ namespace kinski { namespace gl {
     {
 
     }
+
+    Object3D::~Object3D()
+    {
+        // orphaned children fall back to their local transforms
+        for(auto &c : m_children){ c->invalidate_transform(); }
+    }
+
+    void Object3D::set_enabled(bool b)
+    {
+        if(b != m_enabled)
+        {
+            m_enabled = b;
+
+            // disabled objects do not contribute to their parent's bounds
+            if(auto p = parent()){ p->invalidate_aabb(); }
+        }
+    }
+
+    void Object3D::invalidate_transform()
+    {
+        // bounds of this object and all ancestors depend on this transform
+        invalidate_aabb();
+
+        // a dirty transform implies dirty transforms for all descendants, no need to descend again
+        if(m_dirty_bits & DIRTY_TRANSFORM){ return; }
+        m_dirty_bits |= DIRTY_ALL;
+        m_aabb_version++;
+
+        std::vector<Object3D*> stack;
+        for(auto &c : m_children){ stack.push_back(c.get()); }
+
+        while(!stack.empty())
+        {
+            Object3D *node = stack.back();
+            stack.pop_back();
+            if(node->m_dirty_bits & DIRTY_TRANSFORM){ continue; }
+            node->m_dirty_bits |= DIRTY_ALL;
+            node->m_aabb_version++;
+            for(auto &c : node->m_children){ stack.push_back(c.get()); }
+        }
+    }
+
+    void Object3D::invalidate_aabb(bool the_force) const
+    {
+        // ancestors of a dirty node are already flagged, unless it was attached after they were computed
+        const Object3D *node = this;
+        Object3DPtr p;
+
+        while(node && (the_force || !(node->m_dirty_bits & DIRTY_AABB)))
+        {
+            node->m_dirty_bits |= DIRTY_AABB;
+            node->m_aabb_version++;
+            p = node->parent();
+            node = p.get();
+        }
+    }
     
+    void Object3D::set_position(const glm::vec3 &thePos)
+    {
+        m_transform[3] = vec4(thePos, 1.f);
+        invalidate_transform();
+    }
+
     void Object3D::set_rotation(const glm::quat &theRot)
     {
         glm::vec3 pos_tmp(position()), scale_tmp(scale());
         m_transform = glm::mat4_cast(theRot);
+        invalidate_transform();
         set_position(pos_tmp);
         set_scale(scale_tmp);
     }
@@ -45,6 +205,7 @@ namespace kinski { namespace gl {
     {
         glm::vec3 pos_tmp(position()), scale_tmp(scale());
         m_transform = glm::mat4(theRot);
+        invalidate_transform();
         set_position(pos_tmp);
         set_scale(scale_tmp);
     }
@@ -53,6 +214,7 @@ namespace kinski { namespace gl {
     {
         glm::vec3 pos_tmp(position()), scale_tmp(scale());
         m_transform = glm::mat4_cast(glm::quat(glm::vec3(pitch, yaw, roll)));
+        invalidate_transform();
         set_position(pos_tmp);
         set_scale(scale_tmp);
     }
@@ -76,18 +238,18 @@ namespace kinski { namespace gl {
     {
         glm::vec3 scale_vec = s / scale();
         m_transform = glm::scale(m_transform, scale_vec);
+        invalidate_transform();
     }
     
     glm::mat4 Object3D::global_transform() const
     {
-        glm::mat4 ret = transform();
-        Object3DPtr ancestor = parent();
-        while (ancestor)
+        if(m_dirty_bits & DIRTY_TRANSFORM)
         {
-            ret = ancestor->transform() * ret;
-            ancestor = ancestor->parent();
+            Object3DPtr p = parent();
+            m_global_transform = p ? p->global_transform() * m_transform : m_transform;
+            m_dirty_bits &= ~DIRTY_TRANSFORM;
         }
-        return ret;
+        return m_global_transform;
     }
     
     glm::vec3 Object3D::global_position() const
@@ -114,6 +276,7 @@ namespace kinski { namespace gl {
     {
         glm::mat4 parent_trans_inv = parent() ? glm::inverse(parent()->global_transform()) : glm::mat4(1);
         m_transform = parent_trans_inv * transform;
+        invalidate_transform();
     }
     
     void Object3D::set_global_position(const glm::vec3 &position)
@@ -149,6 +312,7 @@ namespace kinski { namespace gl {
         else
         {
             m_parent.reset();
+            invalidate_transform();
         }
     }
     
@@ -166,12 +330,16 @@ namespace kinski { namespace gl {
 
             the_child->set_parent(Object3DPtr());
             the_child->m_parent = shared_from_this();
+            the_child->invalidate_transform();
 
             // prevent multiple insertions
             if(std::find(m_children.begin(), m_children.end(), the_child) == m_children.end())
             {
                 m_children.push_back(the_child);
             }
+
+            // the child's dirty-bits say nothing about our bounds
+            invalidate_aabb(true);
         }
     }
     
@@ -181,6 +349,7 @@ namespace kinski { namespace gl {
         if(it != m_children.end())
         {
             m_children.erase(it);
+            invalidate_aabb(true);
             if(the_child){the_child->set_parent(Object3DPtr());}
         }
         // not a direct descendant, go on recursive if requested
@@ -194,6 +363,16 @@ namespace kinski { namespace gl {
     }
     
     AABB Object3D::aabb() const
+    {
+        if(m_dirty_bits & DIRTY_AABB)
+        {
+            m_aabb = compute_aabb();
+            m_dirty_bits &= ~DIRTY_AABB;
+        }
+        return m_aabb;
+    }
+
+    AABB Object3D::compute_aabb() const
     {
         AABB ret;
         mat4 global_trans = global_transform();
@@ -212,9 +391,28 @@ namespace kinski { namespace gl {
         return ret;
     }
     
+    std::set<std::string> Object3D::tags() const
+    {
+        std::set<std::string> ret = tag_names(m_tag_mask);
+        ret.insert(m_overflow_tags.begin(), m_overflow_tags.end());
+        return ret;
+    }
+    
+    bool Object3D::has_tag(const std::string& the_tag) const
+    {
+        if(m_tag_mask & find_tag_bit(the_tag)){ return true; }
+        return std::find(m_overflow_tags.begin(), m_overflow_tags.end(), the_tag) != m_overflow_tags.end();
+    }
+    
     void Object3D::add_tag(const std::string& the_tag, bool recursive)
     {
-        m_tags.insert(the_tag);
+        tag_mask_t bit = tag_bit(the_tag);
+        
+        if(bit){ m_tag_mask |= bit; }
+        else if(std::find(m_overflow_tags.begin(), m_overflow_tags.end(), the_tag) == m_overflow_tags.end())
+        {
+            m_overflow_tags.push_back(the_tag);
+        }
         
         if(recursive)
         {
@@ -225,7 +423,14 @@ namespace kinski { namespace gl {
     
     void Object3D::remove_tag(const std::string& the_tag, bool recursive)
     {
-        m_tags.erase(the_tag);
+        tag_mask_t bit = find_tag_bit(the_tag);
+        
+        if(bit){ m_tag_mask &= ~bit; }
+        else
+        {
+            m_overflow_tags.erase(std::remove(m_overflow_tags.begin(), m_overflow_tags.end(), the_tag),
+                                  m_overflow_tags.end());
+        }
         
         if(recursive)
         {
@@ -14,6 +14,47 @@
 
 namespace kinski { namespace gl {
 
+    //! bitmask of interned tags, see gl::tag_bit()
+    using tag_mask_t = uint64_t;
+
+    /*!
+     * returns the bit assigned to the_tag, interning the tag on first use.
+     * only the first 64 distinct tags get a bit, 0 is returned once all bits are taken.
+     * thread-safe.
+     */
+    tag_mask_t tag_bit(const std::string &the_tag);
+
+    //! returns the bit assigned to the_tag or 0, if the tag was never interned
+    tag_mask_t find_tag_bit(const std::string &the_tag);
+
+    //! returns the combined bits for all tags in the_tags, tags without a bit do not contribute
+    tag_mask_t tag_mask(const std::set<std::string> &the_tags);
+
+    //! returns the names of all tags contained in the_mask
+    std::set<std::string> tag_names(tag_mask_t the_mask);
+
+    /*!
+     * a set of tags, prepared for filtering objects. creating a filter does not intern its tags,
+     * so tags unknown to all objects match nothing.
+     * an empty filter accepts everything, otherwise at least one tag needs to match
+     */
+    struct tag_filter_t
+    {
+        tag_filter_t() = default;
+        explicit tag_filter_t(const std::set<std::string> &the_tags);
+
+        //! true for objects with the_mask and the_overflow_tags (see Object3D::overflow_tags())
+        bool matches(tag_mask_t the_mask, const std::vector<std::string> &the_overflow_tags) const;
+
+        bool accept_all = true;
+
+        //! combined bits of all filter-tags with an assigned bit
+        tag_mask_t mask = 0;
+
+        //! filter-tags without a bit, compared by name
+        std::vector<std::string> names;
+    };
+
     class Object3D : public std::enable_shared_from_this<Object3D>
     {
     public:
@@ -22,26 +63,39 @@ namespace kinski { namespace gl {
         
         static Object3DPtr create(const std::string &the_name = "");
 
-        virtual ~Object3D(){};
+        virtual ~Object3D();
         
         inline uint32_t get_id() const {return m_id;};
         inline void set_id(uint32_t the_id) { m_id = the_id; };
         inline const std::string name() const { return m_name; }
         inline void set_name(const std::string &the_name){ m_name = the_name; }
-        inline const std::set<std::string>& tags() const { return m_tags; };
-        inline std::set<std::string>& tags() { return m_tags; };
-        inline bool has_tag(const std::string& the_tag) const { return m_tags.count(the_tag); };
+
+        //! tags as bitmask, used for filtering
+        inline tag_mask_t tag_mask() const { return m_tag_mask; }
+        inline void set_tag_mask(tag_mask_t the_mask) { m_tag_mask = the_mask; }
+
+        //! tags stored by name, since all bits were taken when they were added
+        inline const std::vector<std::string>& overflow_tags() const { return m_overflow_tags; }
+
+        //! names of all tags, assembled from our bitmask and overflow-tags
+        std::set<std::string> tags() const;
+        bool has_tag(const std::string& the_tag) const;
+
+        //! true if we pass the_filter
+        inline bool matches(const tag_filter_t &the_filter) const
+        {
+            return the_filter.matches(m_tag_mask, m_overflow_tags);
+        }
         
         void add_tag(const std::string& the_tag, bool recursive = false);
         void remove_tag(const std::string& the_tag, bool recursive = false);
         
         inline bool enabled() const {return m_enabled;}
-        void set_enabled(bool b = true){m_enabled = b;}
+        void set_enabled(bool b = true);
         bool billboard() const {return m_billboard;};
         void set_billboard(bool b) {m_billboard = b;}
-        inline void set_position(const vec3 &thePos) { position() = thePos; };
+        void set_position(const vec3 &thePos);
         inline vec3 position() const {return m_transform[3].xyz(); }
-        inline vec3& position() {return *reinterpret_cast<vec3*>(&m_transform[3].x);}
         inline vec3 lookAt() const {return normalize(-m_transform[2].xyz());}
         inline vec3 side() const {return normalize(m_transform[0].xyz());}
         inline vec3 up() const {return normalize(m_transform[1].xyz());}
@@ -50,7 +104,7 @@ namespace kinski { namespace gl {
         void set_rotation(float pitch, float yaw, float roll);
         quat rotation() const;
         
-        inline vec3 scale(){return vec3(length(m_transform[0]),
+        inline vec3 scale() const {return vec3(length(m_transform[0]),
                                         length(m_transform[1]),
                                         length(m_transform[2]));};
 
@@ -60,8 +114,8 @@ namespace kinski { namespace gl {
         void set_look_at(const vec3 &theLookAt, const vec3 &theUp = vec3(0, 1, 0));
         void set_look_at(const Object3DPtr &theLookAt);
         
-        inline void set_transform(const mat4 &theTrans) {m_transform = theTrans;}
-        inline mat4& transform() {return m_transform;}
+        //! the local transform can only be modified via setters, which invalidate all caches depending on it
+        inline void set_transform(const mat4 &theTrans) { m_transform = theTrans; invalidate_transform(); }
         inline const mat4& transform() const {return m_transform;};
         
         void set_parent(const Object3DPtr &the_parent);
@@ -72,6 +126,10 @@ namespace kinski { namespace gl {
         inline std::list<Object3DPtr>& children(){return m_children;}
         inline const std::list<Object3DPtr>& children() const {return m_children;}
         
+        /*!
+         * returns the world-transform of this object.
+         * the result is cached and only recomputed after this object or one of its ancestors changed
+         */
         mat4 global_transform() const;
         vec3 global_position() const;
         quat global_rotation() const;
@@ -82,9 +140,20 @@ namespace kinski { namespace gl {
         void set_global_rotation(const quat &rotation);
         void set_global_scale(const vec3 &scale);
         
+        /*!
+         * returns the world-space bounds of this object, including all of its enabled children.
+         * the result is cached and only recomputed after a change within the subtree
+         */
         virtual gl::AABB aabb() const;
         virtual gl::OBB obb() const;
-        
+
+        /*!
+         * incremented whenever the cached bounds of this object get invalidated.
+         * invalidation propagates upwards, so the counter of a root-node changes with
+         * any modification of transforms, bounds or enabled-state within its hierarchy
+         */
+        inline uint32_t aabb_version() const { return m_aabb_version; }
+
         /*!
          * Performs an update on this scenegraph node.
          * Triggered by gl::Scene instances during gl::Scene::update(float delta) calls
@@ -104,15 +173,35 @@ namespace kinski { namespace gl {
     protected:
         Object3D();
 
+        //! computes the world-space bounds, bypassing the cache
+        virtual gl::AABB compute_aabb() const;
+
+        /*!
+         * flag the cached bounds of this object and all of its ancestors as outdated.
+         * stops at the first flagged ancestor, unless the_force is set (required after re-parenting)
+         */
+        void invalidate_aabb(bool the_force = false) const;
+
     private:
 
+        enum DirtyBits : uint32_t
+        {
+            DIRTY_TRANSFORM = 1 << 0,
+            DIRTY_AABB = 1 << 1,
+            DIRTY_ALL = DIRTY_TRANSFORM | DIRTY_AABB
+        };
+
+        //! flag the cached world-transforms and bounds of this subtree (and bounds of all ancestors) as outdated
+        void invalidate_transform();
+
         static uint32_t s_id_pool;
         
         //! unique id
         uint32_t m_id;
         
-        //! set of tags
-        std::set<std::string> m_tags;
+        //! interned tags
+        tag_mask_t m_tag_mask = 0;
+        std::vector<std::string> m_overflow_tags;
         
         //! user definable name
         std::string m_name;
@@ -128,6 +217,12 @@ namespace kinski { namespace gl {
         std::list<Object3DPtr> m_children;
         
         update_fn_t m_update_function;
+
+        //! lazily updated world-transform and bounds
+        mutable mat4 m_global_transform = glm::mat4(1);
+        mutable gl::AABB m_aabb;
+        mutable uint32_t m_dirty_bits = DIRTY_ALL;
+        mutable uint32_t m_aabb_version = 0;
     };
 
 }}//namespace
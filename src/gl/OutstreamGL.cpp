@@ -109,7 +109,10 @@ namespace kinski{ namespace gl{
                 { col = gl::COLOR_RED; }
 
 //                col.a = (float) i / m_lines.size();
-                for(auto m : visitor.get_objects()){ m->material()->set_diffuse(col); }
+                for(auto m : visitor.get_objects())
+                {
+                    for(auto &mat : m->materials()){ mat->set_diffuse(col); }
+                }
                 ++obj_it;
             }
             
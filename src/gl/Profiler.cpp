@@ -0,0 +1,461 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+//  Profiler.cpp
+//
+//  Hierarchical per-frame timing of cpu-scopes and gpu-timestamps
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "Profiler.hpp"
+
+namespace kinski { namespace gl {
+
+namespace
+{
+//! number of frames in flight, before gpu-queries are read back
+const uint32_t g_num_query_frames = 3;
+
+using profile_clock_t = std::chrono::steady_clock;
+
+double seconds_since(const profile_clock_t::time_point &the_start)
+{
+    return std::chrono::duration<double>(profile_clock_t::now() - the_start).count();
+}
+
+//! minimal escaping for scope-names used as JSON-strings
+std::string escape(const char *the_str)
+{
+    std::string ret;
+
+    for(const char *c = the_str ? the_str : ""; *c; ++c)
+    {
+        if(*c == '"' || *c == '\\'){ ret.push_back('\\'); }
+        if(static_cast<unsigned char>(*c) >= 0x20){ ret.push_back(*c); }
+    }
+    return ret;
+}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct ProfilerImpl
+{
+    //! a recorded frame, waiting for its gpu-queries to become available
+    struct pending_frame_t
+    {
+        Profiler::frame_t frame;
+
+        //! pool of query-objects, two consecutive queries (begin, end) per gpu-scope
+        std::vector<GLuint> queries;
+        uint32_t num_queries = 0;
+
+        //! index of the begin-query per scope, -1 for cpu-only scopes
+        std::vector<int32_t> query_index;
+
+        bool active = false;
+    };
+
+    bool enabled = true;
+    bool gpu_timing = true;
+
+    //! gpu-timing is evaluated per frame
+    bool frame_gpu_timing = false;
+    bool in_frame = false;
+
+    uint64_t frame_index = 0;
+    profile_clock_t::time_point start_time = profile_clock_t::now(), frame_start;
+    std::thread::id thread_id;
+
+    std::array<pending_frame_t, g_num_query_frames> pending;
+
+    //! indices of the currently open scopes
+    std::vector<uint32_t> scope_stack;
+
+    crocore::CircularBuffer<Profiler::frame_t> history;
+
+    //! guards history against concurrent readers (stats_json, chrome_trace)
+    mutable std::mutex mutex;
+
+    explicit ProfilerImpl(uint32_t the_history_size) : history(the_history_size) {}
+
+    pending_frame_t &current() { return pending[frame_index % g_num_query_frames]; }
+
+    void release_queries()
+    {
+#if !defined(KINSKI_GLES)
+        for(auto &p : pending)
+        {
+            if(!p.queries.empty()){ glDeleteQueries(p.queries.size(), p.queries.data()); }
+            p.queries.clear();
+            p.num_queries = 0;
+            std::fill(p.query_index.begin(), p.query_index.end(), -1);
+        }
+#endif
+    }
+
+    //! read back gpu-timestamps, if already available, and move the frame to our history
+    void resolve(pending_frame_t &p)
+    {
+#if !defined(KINSKI_GLES)
+        if(p.num_queries)
+        {
+            // timestamps complete in order, checking the last one will do
+            GLuint available = 0;
+            glGetQueryObjectuiv(p.queries[p.num_queries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if(available)
+            {
+                std::vector<GLuint64> timestamps(p.num_queries);
+
+                for(uint32_t i = 0; i < p.num_queries; ++i)
+                {
+                    glGetQueryObjectui64v(p.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+                }
+                GLuint64 first = *std::min_element(timestamps.begin(), timestamps.end());
+
+                for(uint32_t i = 0; i < p.frame.scopes.size(); ++i)
+                {
+                    int32_t q = p.query_index[i];
+                    if(q < 0){ continue; }
+                    auto &s = p.frame.scopes[i];
+                    s.gpu_begin = (timestamps[q] - first) * 1.0e-9;
+                    s.gpu_duration = (timestamps[q + 1] - timestamps[q]) * 1.0e-9;
+                }
+            }else{ LOG_TRACE_2 << "profiler: gpu-queries not ready, dropping gpu-timings"; }
+        }
+#endif
+        std::unique_lock<std::mutex> lock(mutex);
+        history.push_back(std::move(p.frame));
+        p.frame = Profiler::frame_t();
+        p.active = false;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+Profiler::Profiler(uint32_t the_history_size) :
+        m_impl(new ProfilerImpl(std::max<uint32_t>(the_history_size, 1)))
+{
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// query-objects are not released here, the GL-context is usually gone at this point
+Profiler::~Profiler() = default;
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Profiler::enabled() const
+{
+    return m_impl->enabled;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Profiler::set_enabled(bool b)
+{
+    m_impl->enabled = b;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Profiler::gpu_timing() const
+{
+    return m_impl->gpu_timing;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Profiler::set_gpu_timing(bool b)
+{
+    // takes effect with the next frame
+    m_impl->gpu_timing = b;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Profiler::begin_frame()
+{
+    if(m_impl->in_frame){ end_frame(); }
+    if(!m_impl->enabled){ return; }
+
+    auto &p = m_impl->current();
+    if(p.active){ m_impl->resolve(p); }
+
+#if !defined(KINSKI_GLES)
+    m_impl->frame_gpu_timing = m_impl->gpu_timing && context();
+    if(!m_impl->gpu_timing && context()){ m_impl->release_queries(); }
+#endif
+
+    p.frame.index = m_impl->frame_index;
+    p.frame.timestamp = seconds_since(m_impl->start_time);
+    p.frame.scopes.clear();
+    p.query_index.clear();
+    p.num_queries = 0;
+
+    m_impl->frame_start = profile_clock_t::now();
+    m_impl->thread_id = std::this_thread::get_id();
+    m_impl->scope_stack.clear();
+    m_impl->in_frame = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Profiler::end_frame()
+{
+    if(!m_impl->in_frame || std::this_thread::get_id() != m_impl->thread_id){ return; }
+
+    LOG_WARNING_IF(!m_impl->scope_stack.empty()) << "profiler: unbalanced scopes at end of frame";
+    while(!m_impl->scope_stack.empty()){ end_scope(); }
+
+    auto &p = m_impl->current();
+    p.frame.duration = seconds_since(m_impl->frame_start);
+    if(context()){ p.frame.state_stats = context()->state_stats(); }
+    p.active = true;
+
+    m_impl->frame_index++;
+    m_impl->in_frame = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t Profiler::frame_index() const
+{
+    return m_impl->frame_index;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Profiler::begin_scope(const char *the_name, bool the_gpu)
+{
+    if(!m_impl->in_frame || std::this_thread::get_id() != m_impl->thread_id){ return; }
+
+    auto &p = m_impl->current();
+    scope_t s;
+    s.name = the_name;
+    s.depth = m_impl->scope_stack.size();
+    s.cpu_begin = seconds_since(m_impl->frame_start);
+
+    int32_t query_index = -1;
+
+#if !defined(KINSKI_GLES)
+    if(the_gpu && m_impl->frame_gpu_timing)
+    {
+        if(p.num_queries + 2 > p.queries.size())
+        {
+            size_t num_new = std::max<size_t>(p.queries.size(), 16);
+            p.queries.resize(p.queries.size() + num_new);
+            glGenQueries(num_new, p.queries.data() + p.queries.size() - num_new);
+        }
+        query_index = p.num_queries;
+        p.num_queries += 2;
+        glQueryCounter(p.queries[query_index], GL_TIMESTAMP);
+    }
+#endif
+    m_impl->scope_stack.push_back(p.frame.scopes.size());
+    p.frame.scopes.push_back(s);
+    p.query_index.push_back(query_index);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Profiler::end_scope()
+{
+    if(!m_impl->in_frame || m_impl->scope_stack.empty() ||
+       std::this_thread::get_id() != m_impl->thread_id){ return; }
+
+    auto &p = m_impl->current();
+    uint32_t index = m_impl->scope_stack.back();
+    m_impl->scope_stack.pop_back();
+
+    auto &s = p.frame.scopes[index];
+    s.cpu_duration = seconds_since(m_impl->frame_start) - s.cpu_begin;
+
+#if !defined(KINSKI_GLES)
+    if(p.query_index[index] >= 0){ glQueryCounter(p.queries[p.query_index[index] + 1], GL_TIMESTAMP); }
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const crocore::CircularBuffer<Profiler::frame_t> &Profiler::history() const
+{
+    return m_impl->history;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Profiler::clear()
+{
+    std::unique_lock<std::mutex> lock(m_impl->mutex);
+    m_impl->history.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string Profiler::stats_json(uint32_t the_num_frames) const
+{
+    struct entry_t
+    {
+        const char *name;
+        uint32_t depth;
+        double cpu = 0.0, cpu_max = 0.0, gpu = 0.0, gpu_max = 0.0;
+        uint32_t num_gpu = 0;
+    };
+    std::vector<entry_t> entries;
+    std::map<std::pair<uint32_t, std::string>, size_t> entry_map;
+
+    std::unique_lock<std::mutex> lock(m_impl->mutex);
+    const auto &history = m_impl->history;
+    uint32_t num_frames = std::min<uint32_t>(the_num_frames, history.size());
+    double frame_sum = 0.0;
+
+    // newest frames first, so the scopes of the latest frame determine the order
+    for(uint32_t i = 0; i < num_frames; ++i)
+    {
+        const auto &frame = history[history.size() - 1 - i];
+        frame_sum += frame.duration;
+
+        // accumulate scopes occurring more than once within a frame
+        struct frame_time_t { double cpu = 0.0, gpu = 0.0; bool has_gpu = false; };
+        std::map<size_t, frame_time_t> frame_times;
+
+        for(const auto &s : frame.scopes)
+        {
+            auto key = std::make_pair(s.depth, std::string(s.name ? s.name : ""));
+            auto it = entry_map.find(key);
+
+            if(it == entry_map.end())
+            {
+                it = entry_map.insert({key, entries.size()}).first;
+                entries.push_back({s.name, s.depth});
+            }
+            auto &t = frame_times[it->second];
+            t.cpu += s.cpu_duration;
+
+            if(s.gpu_duration >= 0.0)
+            {
+                t.gpu += s.gpu_duration;
+                t.has_gpu = true;
+            }
+        }
+
+        for(const auto &pair : frame_times)
+        {
+            auto &e = entries[pair.first];
+            e.cpu += pair.second.cpu;
+            e.cpu_max = std::max(e.cpu_max, pair.second.cpu);
+
+            if(pair.second.has_gpu)
+            {
+                e.gpu += pair.second.gpu;
+                e.gpu_max = std::max(e.gpu_max, pair.second.gpu);
+                e.num_gpu++;
+            }
+        }
+    }
+    std::stringstream ss;
+    ss.precision(3);
+    ss << std::fixed;
+
+    double frame_ms = num_frames ? 1000.0 * frame_sum / num_frames : 0.0;
+    Context::state_stats_t stats;
+    if(num_frames){ stats = history[history.size() - 1].state_stats; }
+
+    ss << "{\"frame\":" << (num_frames ? history[history.size() - 1].index : 0) << ",\"num_frames\":" << num_frames
+       << ",\"frame_ms\":" << frame_ms << ",\"fps\":" << (frame_ms > 0.0 ? 1000.0 / frame_ms : 0.0)
+       << ",\"state_changes\":" << stats.num_changes << ",\"state_redundant\":" << stats.num_redundant
+       << ",\"upload_bytes\":" << stats.num_upload_bytes << ",\"draw_calls\":" << stats.num_draw_calls
+       << ",\"scopes\":[";
+
+    for(uint32_t i = 0; i < entries.size(); ++i)
+    {
+        const auto &e = entries[i];
+        ss << (i ? "," : "") << "{\"name\":\"" << escape(e.name) << "\",\"depth\":" << e.depth
+           << ",\"cpu_ms\":" << 1000.0 * e.cpu / num_frames << ",\"cpu_max_ms\":" << 1000.0 * e.cpu_max;
+
+        if(e.num_gpu)
+        {
+            ss << ",\"gpu_ms\":" << 1000.0 * e.gpu / e.num_gpu << ",\"gpu_max_ms\":" << 1000.0 * e.gpu_max;
+        }
+        ss << "}";
+    }
+    ss << "]}";
+    return ss.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string Profiler::chrome_trace() const
+{
+    std::stringstream ss;
+    ss.precision(3);
+    ss << std::fixed;
+
+    // metadata, naming our cpu- and gpu-tracks
+    ss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":["
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"cpu\"}},"
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"gpu\"}}";
+
+    std::unique_lock<std::mutex> lock(m_impl->mutex);
+
+    for(const auto &frame : m_impl->history)
+    {
+        // timestamps in microseconds, gpu-scopes are aligned to the frame's start
+        const double frame_start = 1.0e6 * frame.timestamp;
+
+        for(const auto &s : frame.scopes)
+        {
+            ss << ",{\"name\":\"" << escape(s.name) << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+               << ",\"ts\":" << frame_start + 1.0e6 * s.cpu_begin << ",\"dur\":" << 1.0e6 * s.cpu_duration
+               << ",\"args\":{\"frame\":" << frame.index << "}}";
+
+            if(s.gpu_duration >= 0.0)
+            {
+                ss << ",{\"name\":\"" << escape(s.name) << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":0,\"tid\":1"
+                   << ",\"ts\":" << frame_start + 1.0e6 * s.gpu_begin << ",\"dur\":" << 1.0e6 * s.gpu_duration
+                   << ",\"args\":{\"frame\":" << frame.index << "}}";
+            }
+        }
+    }
+    ss << "]}";
+    return ss.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Profiler::save_chrome_trace(const std::string &the_path) const
+{
+    std::ofstream stream(the_path);
+
+    if(!stream.is_open())
+    {
+        LOG_WARNING << "could not open file for writing: " << the_path;
+        return false;
+    }
+    stream << chrome_trace();
+    return stream.good();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Profiler &profiler()
+{
+    static Profiler s_profiler;
+    return s_profiler;
+}
+
+}}// namespaces
@@ -0,0 +1,119 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+//  Profiler.hpp
+//
+//  Hierarchical per-frame timing of cpu-scopes and gpu-timestamps
+
+#pragma once
+
+#include <crocore/CircularBuffer.hpp>
+#include "gl/gl.hpp"
+
+namespace kinski { namespace gl {
+
+/*!
+ * records nested, named scopes per frame, on the cpu and (optionally) as pairs of gpu-timestamps.
+ * gpu-queries are read back with a delay of a few frames to avoid stalling the pipeline,
+ * completed frames are kept in a ring-buffer history.
+ * scopes are only recorded on the thread which called begin_frame()
+ */
+class Profiler
+{
+public:
+
+    struct scope_t
+    {
+        const char *name = nullptr;
+
+        //! nesting level, 0 for top-level scopes
+        uint32_t depth = 0;
+
+        //! seconds, relative to the start of the frame
+        double cpu_begin = 0.0;
+        double cpu_duration = 0.0;
+
+        //! seconds, relative to the frame's first gpu-timestamp. negative if not available
+        double gpu_begin = -1.0;
+        double gpu_duration = -1.0;
+    };
+
+    struct frame_t
+    {
+        uint64_t index = 0;
+
+        //! seconds since creation of the profiler
+        double timestamp = 0.0;
+        double duration = 0.0;
+
+        //! scopes in order of their beginning
+        std::vector<scope_t> scopes;
+
+        //! GL state-changes, uploads and draw-calls issued during this frame
+        Context::state_stats_t state_stats;
+    };
+
+    explicit Profiler(uint32_t the_history_size = 300);
+
+    ~Profiler();
+
+    bool enabled() const;
+
+    void set_enabled(bool b);
+
+    bool gpu_timing() const;
+
+    //! gpu-timing requires a current GL-context, disabling it releases all query-objects
+    void set_gpu_timing(bool b);
+
+    void begin_frame();
+
+    void end_frame();
+
+    //! index of the current frame or, outside of frames, the next one
+    uint64_t frame_index() const;
+
+    //! the_name needs to outlive the profiler's history, usually a string-literal
+    void begin_scope(const char *the_name, bool the_gpu = true);
+
+    void end_scope();
+
+    //! completed frames, oldest first. not synchronized, access from the profiling thread only
+    const crocore::CircularBuffer<frame_t> &history() const;
+
+    void clear();
+
+    /*!
+     * JSON-summary for the last the_num_frames:
+     * mean frame-time, state-stats of the latest frame and mean/max timings per scope-name
+     */
+    std::string stats_json(uint32_t the_num_frames = 60) const;
+
+    //! the complete history in chrome's trace-event format (chrome://tracing)
+    std::string chrome_trace() const;
+
+    bool save_chrome_trace(const std::string &the_path) const;
+
+private:
+    std::unique_ptr<struct ProfilerImpl> m_impl;
+};
+
+//! the profiler used by App and the renderers
+Profiler &profiler();
+
+//! Convenience class which opens a scope with gl::profiler() for its lifetime
+class ScopedProfile
+{
+public:
+    explicit ScopedProfile(const char *the_name, bool the_gpu = true) { profiler().begin_scope(the_name, the_gpu); }
+
+    ~ScopedProfile() { profiler().end_scope(); }
+};
+
+}}// namespaces
@@ -13,6 +13,7 @@
 #include "Camera.hpp"
 #include "SceneRenderer.hpp"
 #include "Fbo.hpp"
+#include "Profiler.hpp"
 #include "geometry_types.hpp"
 
 using namespace std;
@@ -28,6 +29,15 @@ namespace kinski { namespace gl {
         bool operator <(const range_item_t &other) const {return distance < other.distance;}
     };
     
+    //! axis-aligned box enclosing the_obb
+    inline gl::AABB obb_bounds(const gl::OBB &the_obb)
+    {
+        vec3 extents = glm::abs(the_obb.axis[0]) * the_obb.half_lengths.x +
+                       glm::abs(the_obb.axis[1]) * the_obb.half_lengths.y +
+                       glm::abs(the_obb.axis[2]) * the_obb.half_lengths.z;
+        return gl::AABB(the_obb.center - extents, the_obb.center + extents);
+    }
+    
     class UpdateVisitor : public Visitor
     {
     public:
@@ -38,8 +48,20 @@ namespace kinski { namespace gl {
             theNode.update(m_time_step);
             Visitor::visit(static_cast<gl::Object3D&>(theNode));
         };
+
+        //! animations are collected and evaluated in a batch
+        void visit(gl::Mesh &theNode) override
+        {
+            theNode.Object3D::update(m_time_step);
+            if(theNode.root_bone()){ m_meshes.push_back(&theNode); }
+            Visitor::visit(static_cast<gl::Object3D&>(theNode));
+        };
+
+        const std::vector<gl::Mesh*>& meshes() const { return m_meshes; }
+
     private:
         float m_time_step;
+        std::vector<gl::Mesh*> m_meshes;
     };
     
     ScenePtr Scene::create()
@@ -68,12 +90,19 @@ namespace kinski { namespace gl {
     {
         m_root = gl::Object3D::create("scene root");
         m_skybox.reset();
+        
+        // the new root might reside at the address of the old one
+        m_pick_root = nullptr;
+        m_pick_objects.clear();
     }
     
-    void Scene::update(float time_delta)
+    void Scene::update(float time_delta, crocore::ThreadPool *the_pool)
     {
         UpdateVisitor uv(time_delta);
         m_root->accept(uv);
+
+        gl::ScopedProfile sp("animation", false);
+        update_animations(uv.meshes(), time_delta, the_pool);
     }
     
     void Scene::render(const CameraPtr &theCamera, const std::set<std::string> &the_tags) const
@@ -81,64 +110,96 @@ namespace kinski { namespace gl {
         m_num_visible_objects = m_renderer->render_scene(shared_from_this(), theCamera, the_tags);
     }
     
+    void Scene::update_pick_bvh() const
+    {
+        // any change within the hierarchy bumps the root's version
+        if(m_root.get() == m_pick_root && m_root->aabb_version() == m_pick_version){ return; }
+        
+        SelectVisitor<Object3D> sv;
+        m_root->accept(sv);
+        
+        std::vector<Object3D*> objects;
+        objects.reserve(sv.get_objects().size());
+        
+        for(auto the_object : sv.get_objects())
+        {
+            if(the_object != m_root.get()){ objects.push_back(the_object); }
+        }
+        
+        std::vector<gl::AABB> bounds(objects.size());
+        for(uint32_t i = 0; i < objects.size(); ++i){ bounds[i] = obb_bounds(objects[i]->obb()); }
+        
+        // same objects as before -> refit is sufficient
+        if(objects == m_pick_objects){ m_pick_bvh.refit(bounds); }
+        else
+        {
+            m_pick_bvh.build(bounds, 1);
+            m_pick_objects = std::move(objects);
+        }
+        
+        // clear the dirty-flags of the entire hierarchy, so the next modification is registered
+        m_root->aabb();
+        m_pick_root = m_root.get();
+        m_pick_version = m_root->aabb_version();
+    }
+    
     Object3DPtr Scene::pick(const Ray &ray, bool high_precision,
                             const std::set<std::string> &the_tags) const
     {
         Object3DPtr ret;
-        SelectVisitor<Object3D> sv(the_tags);
-        m_root->accept(sv);
+        update_pick_bvh();
+        tag_filter_t filter(the_tags);
+        
+        range_item_t nearest(nullptr, std::numeric_limits<float>::max());
+        uint32_t num_hits = 0;
         
-        std::list<range_item_t> clicked_items;
-        for (const auto &the_object : sv.get_objects())
+        m_pick_bvh.traverse(ray, nearest.distance, [&](uint32_t i)
         {
-            if(the_object == m_root.get()){ continue; }
-
+            Object3D *the_object = m_pick_objects[i];
+            if(!the_object->matches(filter)){ return; }
+            
             gl::OBB boundingBox = the_object->obb();
-
-            if (ray_intersection ray_hit = boundingBox.intersect(ray))
+            ray_intersection ray_hit = boundingBox.intersect(ray);
+            
+            if(!ray_hit){ return; }
+            
+            if(high_precision)
             {
-                if(high_precision)
+                if(const gl::Mesh *m = dynamic_cast<const gl::Mesh*>(the_object))
                 {
-                    if(const gl::Mesh *m = dynamic_cast<const gl::Mesh*>(the_object))
+                    mat4 global_trans = the_object->global_transform();
+                    gl::Ray ray_in_object_space = ray.transform(glm::inverse(global_trans));
+                    const auto &entries = m->entries();
+                    
+                    ray_triangle_intersection ray_tri_hit =
+                    m->triangle_bvh()->intersect(ray_in_object_space, [&entries](uint32_t e)
+                    {
+                        return entries[e].enabled;
+                    });
+                    
+                    if(ray_tri_hit)
                     {
-                        gl::Ray ray_in_object_space = ray.transform(glm::inverse(the_object->global_transform()));
-                        const auto &vertices = m->geometry()->vertices();
-                        const auto &indices = m->geometry()->indices();
+                        // hit-distance in world-space
+                        vec3 hit_pos = (global_trans * vec4(ray_in_object_space * ray_tri_hit.distance, 1.f)).xyz();
+                        float distance = glm::length(hit_pos - ray.origin);
+                        LOG_TRACE_2 << "hit distance: " << distance;
+                        num_hits++;
                         
-                        for(const auto &e : m->entries())
-                        {
-                            if(e.primitive_type && e.primitive_type != GL_TRIANGLES){ continue; }
-                            
-                            for(uint32_t i = 0; i < e.num_indices; i += 3)
-                            {
-                                gl::Triangle t(vertices[indices[i + e.base_index] + e.base_vertex],
-                                               vertices[indices[i + e.base_index + 1] + e.base_vertex],
-                                               vertices[indices[i + e.base_index + 2] + e.base_vertex]);
-                                
-                                if(ray_triangle_intersection ray_tri_hit = t.intersect(ray_in_object_space))
-                                {
-                                    float distance_scale = glm::length(the_object->global_scale() *
-                                                                       ray_in_object_space.direction);
-                                    ray_tri_hit.distance *= distance_scale;
-                                    clicked_items.push_back(range_item_t(the_object, ray_tri_hit.distance));
-                                    LOG_TRACE_2 << "hit distance: " << ray_tri_hit.distance;
-                                    break;
-                                }
-                            }
-                        }
+                        if(distance < nearest.distance){ nearest = range_item_t(the_object, distance); }
                     }
                 }
-                else
-                {
-                    clicked_items.push_back(range_item_t(the_object, ray_hit.distance));
-                }
             }
-        }
-        if(!clicked_items.empty())
+            else
+            {
+                num_hits++;
+                if(ray_hit.distance < nearest.distance){ nearest = range_item_t(the_object, ray_hit.distance); }
+            }
+        });
+        
+        if(nearest.object)
         {
-            clicked_items.sort();
-            ret = clicked_items.front().object->shared_from_this();
-            LOG_TRACE << "ray hit id " << ret->get_id() << " (" << clicked_items.size() << " total)";
+            ret = nearest.object->shared_from_this();
+            LOG_TRACE << "ray hit id " << ret->get_id() << " (" << num_hits << " total)";
         }
         return ret;
     }
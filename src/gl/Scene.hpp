@@ -13,6 +13,7 @@
 #include "Light.hpp"
 #include "Camera.hpp"
 #include "Visitor.hpp"
+#include "BVH.hpp"
 #include "SceneRenderer.hpp"
 
 namespace kinski { namespace gl {
@@ -25,7 +26,11 @@ namespace kinski { namespace gl {
         
         static ScenePtr create();
         
-        void update(float time_delta);
+        /*!
+         * update all objects in the scene.
+         * skeletal animations of all meshes are evaluated in one batch, distributed across the_pool, if provided
+         */
+        void update(float time_delta, crocore::ThreadPool *the_pool = nullptr);
         void render(const CameraPtr &theCamera, const std::set<std::string> &the_tags = {}) const;
         Object3DPtr pick(const Ray &ray, bool high_precision = false,
                          const std::set<std::string> &the_tags = {}) const;
@@ -56,6 +61,17 @@ namespace kinski { namespace gl {
         mutable uint32_t m_num_visible_objects;
         mutable gl::SceneRendererPtr m_renderer;
         Object3DPtr m_root;
+        
+        //! refit or rebuild the pick-BVH, if anything changed below m_root since the last call
+        void update_pick_bvh() const;
+
+        //! BVH over all enabled objects used by pick(), refit as long as the set of objects stays the same
+        mutable gl::BVH m_pick_bvh;
+        mutable std::vector<Object3D*> m_pick_objects;
+
+        //! root and its aabb_version() at the time m_pick_bvh was last updated
+        mutable const Object3D *m_pick_root = nullptr;
+        mutable uint32_t m_pick_version = 0;
     };
     
 }}//namespace
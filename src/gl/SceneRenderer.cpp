@@ -11,11 +11,19 @@
 //
 //  Created by Fabian on 4/21/13.
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <crocore/ThreadPool.hpp>
 #include "Visitor.hpp"
 #include "Mesh.hpp"
 #include "Camera.hpp"
 #include "Light.hpp"
 #include "Fbo.hpp"
+#include "Profiler.hpp"
 #include "Scene.hpp"
 #include "SceneRenderer.hpp"
 
@@ -28,95 +36,413 @@ using namespace glm;
 
 const char* SceneRenderer::TAG_NO_CULL = "no_cull";
 
-class CullVisitor : public Visitor
+class SnapshotVisitor : public Visitor
 {
 public:
-    CullVisitor(const CameraPtr &theCamera, const std::set<std::string> &the_tags):
+    SnapshotVisitor(const CullSnapshotPtr &the_snapshot):
     Visitor(),
-    m_frustum(theCamera->frustum()),
-    m_tags(the_tags),
-    m_render_bin(new gl::RenderBin(theCamera))
+    m_snapshot(the_snapshot),
+    m_no_cull_bit(tag_bit(gl::SceneRenderer::TAG_NO_CULL))
     {
-        transform_stack().push(theCamera->view_matrix());
+        m_parents.push(-1);
     }
     
-    RenderBinPtr get_render_bin() const {return m_render_bin;}
-    
     void visit(Mesh &theNode) override
     {
-        if(!theNode.enabled() || !check_tags(m_tags, theNode.tags())) return;
-        
-        glm::mat4 model_view = transform_stack().top() * theNode.transform();
-        gl::AABB boundingBox = theNode.aabb();
+        if(!theNode.enabled()) return;
+
+        const gl::Mesh &node = theNode;
+        mat4 world_transform = transform_stack().top() * node.transform();
+        gl::AABB aabb = theNode.aabb();
+
+        auto &s = *m_snapshot;
+        int32_t index = s.meshes.size();
+        s.meshes.push_back(std::static_pointer_cast<gl::Mesh>(theNode.shared_from_this()));
+        s.transforms.push_back(world_transform);
+        s.min_x.push_back(aabb.min.x); s.min_y.push_back(aabb.min.y); s.min_z.push_back(aabb.min.z);
+        s.max_x.push_back(aabb.max.x); s.max_y.push_back(aabb.max.y); s.max_z.push_back(aabb.max.z);
+        s.tag_masks.push_back(node.tag_mask());
+        s.no_cull.push_back(m_no_cull_bit ? (node.tag_mask() & m_no_cull_bit) != 0 :
+                            node.has_tag(gl::SceneRenderer::TAG_NO_CULL));
+        s.parents.push_back(m_parents.top());
 
-        if(m_frustum.intersect(boundingBox) || crocore::contains(theNode.tags(), gl::SceneRenderer::TAG_NO_CULL))
-        {
-            RenderBin::item item;
-            item.mesh = std::dynamic_pointer_cast<gl::Mesh>(theNode.shared_from_this());
-            item.transform = model_view;
-            m_render_bin->items.push_back(item);
-        }
         // super class provides node traversing and transform accumulation
+        m_parents.push(index);
         Visitor::visit(static_cast<gl::Object3D&>(theNode));
+        m_parents.pop();
     }
     
     void visit(Light &theNode) override
     {
-        if(theNode.enabled() && check_tags(m_tags, theNode.tags()))
+        if(theNode.enabled())
         {
-            RenderBin::light light_item;
-            light_item.light = std::dynamic_pointer_cast<gl::Light>(theNode.shared_from_this());
-            light_item.transform = transform_stack().top() * theNode.transform();
-            
-            // collect only lights that actually affect the scene
-            gl::Sphere bounding_sphere(gl::vec3(theNode.transform()[3].xyz()), theNode.radius());
-
-            if(m_frustum.intersect(bounding_sphere))
-            {
-                m_render_bin->lights.push_back(light_item);
-            }
+            const gl::Light &node = theNode;
+            auto &s = *m_snapshot;
+            s.lights.push_back(std::dynamic_pointer_cast<gl::Light>(theNode.shared_from_this()));
+            s.light_transforms.push_back(transform_stack().top() * node.transform());
+            s.light_tag_masks.push_back(node.tag_mask());
+            s.light_parents.push_back(m_parents.top());
         }
         // super class provides node traversing and transform accumulation
         Visitor::visit(static_cast<gl::Object3D&>(theNode));
     }
     
-    void clear(){m_render_bin->items.clear();}
-    
 private:
-    gl::Frustum m_frustum;
-    std::set<std::string> m_tags;
-    RenderBinPtr m_render_bin;
+    CullSnapshotPtr m_snapshot;
+    tag_mask_t m_no_cull_bit;
+    std::stack<int32_t> m_parents;
 };
 
-void sort_render_bin(const RenderBinPtr &the_bin,
-                     std::list<RenderBin::item> &the_opaque_items,
-                     std::list<RenderBin::item> &the_transparent_items)
+void CullSnapshot::clear()
+{
+    scene.reset();
+    meshes.clear();
+    transforms.clear();
+    for(auto v : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z}){ v->clear(); }
+    tag_masks.clear();
+    no_cull.clear();
+    parents.clear();
+    lights.clear();
+    light_transforms.clear();
+    light_tag_masks.clear();
+    light_parents.clear();
+}
+
+void RenderBin::clear()
+{
+    meshes.clear();
+    transforms.clear();
+    lods.clear();
+    sort_keys.clear();
+    sorted_indices.clear();
+    batches.clear();
+    lights.clear();
+    num_opaque = num_opaque_batches = 0;
+}
+
+void RenderBin::add_item(const gl::MeshPtr &the_mesh, const mat4 &the_transform, uint32_t the_lod)
+{
+    meshes.push_back(the_mesh);
+    transforms.push_back(the_transform);
+    lods.push_back(the_lod);
+}
+
+RenderBin::range_t RenderBin::opaque_items() const
+{
+    range_t ret;
+    ret.first = sorted_indices.data();
+    ret.last = ret.first + num_opaque;
+    return ret;
+}
+
+RenderBin::range_t RenderBin::blended_items() const
+{
+    range_t ret;
+    ret.first = sorted_indices.data() + num_opaque;
+    ret.last = sorted_indices.data() + sorted_indices.size();
+    return ret;
+}
+
+namespace
 {
-    for (auto &item :the_bin->items)
+    // number of items tested per task
+    const uint32_t cull_chunk_size = 1024;
+
+    /*!
+     * test items [the_begin, the_end) of the_snapshot against the_frustum
+     * and append the indices of all visible items to the_out_indices.
+     * the_tag_mask is optional, containing a non-zero entry per item that passed tag-filtering
+     */
+    void cull_chunk(const CullSnapshot &the_snapshot, const gl::Frustum &the_frustum,
+                    const std::vector<uint8_t> &the_tag_mask, uint32_t the_begin, uint32_t the_end,
+                    std::vector<uint32_t> &the_out_indices)
     {
-        bool opaque = true;
-        for (const auto &material : item.mesh->materials())
+        const uint32_t num_items = the_end - the_begin;
+        uint8_t visible[cull_chunk_size];
+        std::fill(visible, visible + num_items, 1);
+
+        const auto &s = the_snapshot;
+
+        for(const gl::Plane &p : the_frustum.planes)
         {
-            if(material->blending() && material->diffuse().a < 1.f)
+            const vec4 &c = p.coefficients;
+
+            // select the positive vertex per component, identical for all boxes
+            const float *px = (c.x >= 0 ? s.max_x : s.min_x).data() + the_begin;
+            const float *py = (c.y >= 0 ? s.max_y : s.min_y).data() + the_begin;
+            const float *pz = (c.z >= 0 ? s.max_z : s.min_z).data() + the_begin;
+            uint32_t i = 0;
+
+#if defined(__SSE__)
+            const __m128 nx = _mm_set1_ps(c.x), ny = _mm_set1_ps(c.y), nz = _mm_set1_ps(c.z), w = _mm_set1_ps(c.w);
+            const __m128 zero = _mm_setzero_ps();
+
+            for(; i + 4 <= num_items; i += 4)
             {
-                opaque = false;
-                break;
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(px + i)),
+                                                 _mm_mul_ps(ny, _mm_loadu_ps(py + i))),
+                                      _mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(pz + i)), w));
+                int outside = _mm_movemask_ps(_mm_cmplt_ps(d, zero));
+
+                // positive vertex outside -> reject
+                if(outside)
+                {
+                    for(uint32_t k = 0; k < 4; ++k){ if(outside & (1 << k)){ visible[i + k] = 0; } }
+                }
+            }
+#endif
+            for(; i < num_items; ++i)
+            {
+                if(c.x * px[i] + c.y * py[i] + c.z * pz[i] + c.w < 0){ visible[i] = 0; }
+            }
+        }
+
+        for(uint32_t i = 0; i < num_items; ++i)
+        {
+            uint32_t index = the_begin + i;
+
+            if((visible[i] || s.no_cull[index]) && (the_tag_mask.empty() || the_tag_mask[index]))
+            {
+                the_out_indices.push_back(index);
             }
         }
-        if(opaque){the_opaque_items.push_back(item);}
-        else{the_transparent_items.push_back(item);}
     }
-    
-    //sort opaque items near to far
-    the_opaque_items.sort([](const RenderBin::item &lhs, const RenderBin::item &rhs) -> bool
+
+    // relative margin around lod-thresholds, avoids popping for objects close to a threshold
+    const float lod_hysteresis = .1f;
+
+    //! projected size of a bounding-sphere, as fraction of the viewport-height
+    inline float projected_size(const vec3 &the_center, float the_radius, const mat4 &the_view_matrix,
+                                const mat4 &the_projection)
     {
-        return lhs.transform[3].z > rhs.transform[3].z;
-    });
-    //sort transparent items far to near
-    the_transparent_items.sort([](const RenderBin::item &lhs, const RenderBin::item &rhs) -> bool
+        // orthographic projection
+        if(the_projection[2][3] == 0.f){ return the_radius * the_projection[1][1]; }
+
+        float depth = -(the_view_matrix * vec4(the_center, 1.f)).z;
+        return depth > the_radius ? the_radius * the_projection[1][1] / depth : std::numeric_limits<float>::max();
+    }
+
+    //! state shared between the calling thread and all worker-tasks of a parallel cull
+    struct cull_job_t
     {
-        return lhs.transform[3].z < rhs.transform[3].z;
-    });
+        cull_job_t(const CullSnapshotConstPtr &the_snapshot, const gl::Frustum &the_frustum):
+        snapshot(the_snapshot), frustum(the_frustum){}
+
+        CullSnapshotConstPtr snapshot;
+        gl::Frustum frustum;
+        std::vector<uint8_t> tag_mask;
+
+        //! visible indices, one vector per chunk
+        std::vector<std::vector<uint32_t>> results;
+
+        std::atomic<uint32_t> next_chunk{0}, num_done{0};
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+
+    //! claim and process chunks until none are left
+    void process_cull_job(const std::shared_ptr<cull_job_t> &the_job)
+    {
+        const uint32_t num_chunks = the_job->results.size();
+        const uint32_t num_items = the_job->snapshot->num_items();
+        uint32_t c;
+
+        while((c = the_job->next_chunk++) < num_chunks)
+        {
+            uint32_t begin = c * cull_chunk_size, end = std::min(begin + cull_chunk_size, num_items);
+            cull_chunk(*the_job->snapshot, the_job->frustum, the_job->tag_mask, begin, end, the_job->results[c]);
+
+            if(++the_job->num_done == num_chunks)
+            {
+                std::unique_lock<std::mutex> lock(the_job->mutex);
+                the_job->condition.notify_all();
+            }
+        }
+    }
+
+    inline matrix_struct_140_t create_matrix_struct(const CameraPtr &the_cam, const gl::MeshPtr &the_mesh,
+                                                    const mat4 &the_transform)
+    {
+        matrix_struct_140_t m;
+        m.model_view = the_transform;
+        m.model_view_projection = the_cam->projection_matrix() * the_transform;
+        m.normal_matrix = mat4(glm::inverseTranspose(glm::mat3(the_transform)));
+        m.texture_matrix = the_mesh->material()->texture_matrix();
+        return m;
+    }
+
+    // bits used for the different sort-key fields
+    const uint32_t num_shader_bits = 12, num_material_bits = 12, num_vao_bits = 15, num_depth_bits = 24;
+
+    inline uint64_t hash_ptr(const void *the_ptr, uint32_t the_num_bits)
+    {
+        uint64_t h = reinterpret_cast<uintptr_t>(the_ptr) * 0x9E3779B97F4A7C15ULL;
+        return h >> (64 - the_num_bits);
+    }
+
+    // maps a view-space distance to an unsigned int, preserving order
+    inline uint64_t quantize_depth(float the_distance)
+    {
+        the_distance = std::max(the_distance, 0.f);
+        uint32_t bits;
+        memcpy(&bits, &the_distance, sizeof(bits));
+        return bits >> (32 - num_depth_bits);
+    }
+
+    /*!
+     * layout (msb -> lsb)
+     * opaque:  0 | shader | material | vertex-array | depth (near to far)
+     * blended: 1 | inverted depth (far to near) | shader | material | vertex-array
+     */
+    uint64_t create_sort_key(const gl::Mesh *the_mesh, const mat4 &the_transform, bool &is_opaque)
+    {
+        const gl::MaterialPtr &mat = the_mesh->material();
+        is_opaque = true;
+
+        for(const auto &m : the_mesh->materials())
+        {
+            if(m->blending() && m->diffuse().a < 1.f){ is_opaque = false; break; }
+        }
+        uint64_t shader = mat && mat->shader() ? hash_ptr(mat->shader().get(), num_shader_bits) : 0;
+        uint64_t material = hash_ptr(mat.get(), num_material_bits);
+
+        // a vertex-array is determined by geometry and shader
+        uint64_t vao = hash_ptr(the_mesh->geometry().get(), num_vao_bits);
+        uint64_t depth = quantize_depth(-the_transform[3].z);
+        uint64_t state = (shader << (num_material_bits + num_vao_bits)) | (material << num_vao_bits) | vao;
+
+        if(is_opaque){ return (state << num_depth_bits) | depth; }
+
+        uint64_t inv_depth = ~depth & ((1ULL << num_depth_bits) - 1);
+        return (1ULL << 63) | (inv_depth << (num_shader_bits + num_material_bits + num_vao_bits)) | state;
+    }
+
+    /*!
+     * LSD radix-sort (8 bits per pass) of the_keys, reordering the_indices accordingly.
+     * passes on bytes that are identical for all keys are skipped.
+     */
+    void radix_sort(std::vector<uint64_t> &the_keys, std::vector<uint32_t> &the_indices,
+                    std::vector<uint64_t> &the_key_scratch, std::vector<uint32_t> &the_index_scratch)
+    {
+        const size_t num_items = the_keys.size();
+        the_key_scratch.resize(num_items);
+        the_index_scratch.resize(num_items);
+
+        uint64_t *keys_in = the_keys.data(), *keys_out = the_key_scratch.data();
+        uint32_t *indices_in = the_indices.data(), *indices_out = the_index_scratch.data();
+
+        for(uint32_t shift = 0; shift < 64; shift += 8)
+        {
+            uint32_t offsets[256] = {};
+            for(size_t i = 0; i < num_items; ++i){ offsets[(keys_in[i] >> shift) & 0xFF]++; }
+
+            // all keys share this byte
+            if(offsets[(keys_in[0] >> shift) & 0xFF] == num_items){ continue; }
+
+            uint32_t sum = 0;
+            for(uint32_t &o : offsets){ uint32_t c = o; o = sum; sum += c; }
+
+            for(size_t i = 0; i < num_items; ++i)
+            {
+                uint32_t pos = offsets[(keys_in[i] >> shift) & 0xFF]++;
+                keys_out[pos] = keys_in[i];
+                indices_out[pos] = indices_in[i];
+            }
+            std::swap(keys_in, keys_out);
+            std::swap(indices_in, indices_out);
+        }
+
+        // odd number of passes -> results reside in scratch buffers
+        if(keys_in != the_keys.data())
+        {
+            the_keys.swap(the_key_scratch);
+            the_indices.swap(the_index_scratch);
+        }
+    }
+}
+
+void sort_render_bin(const RenderBinPtr &the_bin)
+{
+    const size_t num_items = the_bin->num_items();
+    the_bin->sort_keys.resize(num_items);
+    the_bin->sorted_indices.resize(num_items);
+    the_bin->num_opaque = 0;
+    if(!num_items){ return; }
+
+    for(uint32_t i = 0; i < num_items; ++i)
+    {
+        bool opaque;
+        the_bin->sort_keys[i] = create_sort_key(the_bin->meshes[i].get(), the_bin->transforms[i], opaque);
+        the_bin->sorted_indices[i] = i;
+        if(opaque){ the_bin->num_opaque++; }
+    }
+    radix_sort(the_bin->sort_keys, the_bin->sorted_indices, the_bin->m_key_scratch, the_bin->m_index_scratch);
+}
+
+namespace
+{
+    inline bool is_batch_compatible(const RenderBinPtr &the_bin, uint32_t the_lhs, uint32_t the_rhs)
+    {
+        const gl::MeshPtr &lhs = the_bin->meshes[the_lhs], &rhs = the_bin->meshes[the_rhs];
+        if(lhs->geometry() != rhs->geometry() || lhs->materials() != rhs->materials()){ return false; }
+        if(lhs->geometry()->has_bones()){ return false; }
+
+        const auto &lhs_entries = lhs->entries(the_bin->lods[the_lhs]);
+        const auto &rhs_entries = rhs->entries(the_bin->lods[the_rhs]);
+        if(lhs_entries.size() != rhs_entries.size()){ return false; }
+
+        for(uint32_t i = 0; i < lhs_entries.size(); ++i)
+        {
+            const auto &l = lhs_entries[i], &r = rhs_entries[i];
+
+            if(l.enabled != r.enabled || l.base_index != r.base_index || l.base_vertex != r.base_vertex ||
+               l.num_indices != r.num_indices || l.material_index != r.material_index ||
+               l.primitive_type != r.primitive_type){ return false; }
+        }
+        return true;
+    }
+
+    void create_batches(const RenderBinPtr &the_bin, const RenderBin::range_t &the_items,
+                        const std::function<bool(const gl::MeshPtr&)> &the_instancing_fn)
+    {
+        const uint32_t *it = the_items.begin();
+
+        while(it != the_items.end())
+        {
+            RenderBin::range_t batch;
+            batch.first = it++;
+            const gl::MeshPtr &mesh = the_bin->meshes[*batch.first];
+
+            if(it != the_items.end() && is_batch_compatible(the_bin, *batch.first, *it) &&
+               (!the_instancing_fn || the_instancing_fn(mesh)))
+            {
+                while(it != the_items.end() && is_batch_compatible(the_bin, *batch.first, *it)){ ++it; }
+            }
+            batch.last = it;
+            the_bin->batches.push_back(batch);
+        }
+    }
+}
+
+void batch_render_bin(const RenderBinPtr &the_bin, const std::function<bool(const gl::MeshPtr&)> &the_instancing_fn)
+{
+    the_bin->batches.clear();
+
+    // batches never mix opaque and blended items
+    create_batches(the_bin, the_bin->opaque_items(), the_instancing_fn);
+    the_bin->num_opaque_batches = the_bin->batches.size();
+    create_batches(the_bin, the_bin->blended_items(), the_instancing_fn);
+}
+
+void create_instance_records(const RenderBinPtr &the_bin, std::vector<gl::instance_record_t> &the_records)
+{
+    the_records.clear();
+
+    for(const auto &batch : the_bin->batches)
+    {
+        if(batch.size() < 2){ continue; }
+        for(uint32_t i : batch){ the_records.push_back(gl::create_instance_record(the_bin->transforms[i])); }
+    }
 }
 
 SceneRendererPtr SceneRenderer::create()
@@ -134,35 +460,70 @@ uint32_t SceneRenderer::render_scene(const gl::SceneConstPtr &the_scene,
                                      const CameraPtr &the_cam,
                                      const std::set<std::string> &the_tags)
 {
+    // flatten the scene once, culled for all passes below
+    {
+        gl::ScopedProfile sp("cull", false);
+        m_cull_snapshot = create_cull_snapshot(the_scene, m_cull_snapshot);
+    }
+
     // shadow passes
-    SelectVisitor<Light> lv;
-    the_scene->root()->accept(lv);
-    
     float extents = 2.f * glm::length(the_scene->root()->aabb().halfExtents());
-    
-    uint32_t i = 0;
     set_shadowmap_size(glm::vec2(1024));
-    
-    for(gl::Light *l : lv.get_objects())
+
+    std::vector<gl::LightPtr> shadow_lights;
+
+    for(const gl::LightPtr &l : m_cull_snapshot->lights)
     {
-        if(l->enabled() && l->cast_shadow())
+        if(!l->cast_shadow()){ continue; }
+
+        if(shadow_lights.size() >= shadow_fbos().size())
         {
-            if(i >= shadow_fbos().size())
-            {
-                LOG_WARNING << "too many lights with active shadows";
-                break;
-            }
-            set_shadow_pass(true);
-            shadow_cams()[i] = gl::create_shadow_camera(l, min(extents, l->radius()));
-            
-            // offscreen render shadow map here
-            gl::render_to_texture(shadow_fbos()[i], [&]()
-                                  {
-                                      glClear(GL_DEPTH_BUFFER_BIT);
-                                      render(cull(the_scene, shadow_cams()[i]));
-                                  });
-            i++;
-            set_shadow_pass(false);
+            LOG_WARNING << "too many lights with active shadows";
+            break;
+        }
+        shadow_lights.push_back(l);
+    }
+
+#if !defined(KINSKI_GLES)
+    // at most one matrix-record per item and pass, so the ring-buffer is never resized mid-frame
+    reserve_matrix_records(m_cull_snapshot->num_items() * (shadow_lights.size() + 1));
+
+    // advance to the next segment of our matrix ring-buffer
+    m_matrix_buffer.begin_segment();
+#endif
+
+    auto create_fbo = [this](const gl::LightPtr &)
+    {
+        gl::FboPtr ret;
+#ifndef KINSKI_GLES
+        gl::Fbo::Format fmt;
+        fmt.num_color_buffers = 0;
+        ret = gl::Fbo::create(m_shadow_map_size.x, m_shadow_map_size.y, fmt);
+#endif
+        return ret;
+    };
+
+    auto render_shadow_map = [this](shadow_map_t &the_map)
+    {
+        set_shadow_pass(true);
+
+        // offscreen render shadow map here
+        gl::render_to_texture(the_map.fbo, [&]()
+                              {
+                                  glClear(GL_DEPTH_BUFFER_BIT);
+                                  render(the_map.casters);
+                              });
+        set_shadow_pass(false);
+    };
+
+    {
+        gl::ScopedProfile sp("shadow");
+        auto shadow_maps = update_shadow_maps(shadow_lights, extents, create_fbo, render_shadow_map);
+
+        for(uint32_t i = 0; i < shadow_maps.size(); ++i)
+        {
+            shadow_fbos()[i] = shadow_maps[i]->fbo;
+            shadow_cams()[i] = shadow_maps[i]->render_camera;
         }
     }
 
@@ -178,30 +539,155 @@ uint32_t SceneRenderer::render_scene(const gl::SceneConstPtr &the_scene,
     }
     
     // forward render pass
-    auto render_bin = cull(the_scene, the_cam, the_tags);
+    {
+        gl::ScopedProfile sp("cull", false);
+        m_render_bin = cull(m_cull_snapshot, the_cam, the_tags, m_render_bin, m_thread_pool);
+    }
 
     // issue draw commands
-    render(render_bin);
+    {
+        gl::ScopedProfile sp("forward");
+        render(m_render_bin);
+    }
+
+#if !defined(KINSKI_GLES)
+    m_matrix_buffer.end_segment();
+#endif
     
     // return number of rendered objects
-    return render_bin->items.size();
+    return m_render_bin->num_items();
 }
 
 RenderBinPtr cull(const gl::SceneConstPtr &the_scene,
                   const CameraPtr &theCamera,
-                  const std::set<std::string> &the_tags)
+                  const std::set<std::string> &the_tags,
+                  RenderBinPtr the_bin)
 {
-    CullVisitor cull_visitor(theCamera, the_tags);
-    the_scene->root()->accept(cull_visitor);
-    auto bin = cull_visitor.get_render_bin();
-    bin->scene = the_scene;
-    return bin;
+    return cull(create_cull_snapshot(the_scene), theCamera, the_tags, the_bin);
+}
+
+CullSnapshotPtr create_cull_snapshot(const gl::SceneConstPtr &the_scene, CullSnapshotPtr the_snapshot)
+{
+    if(the_snapshot){ the_snapshot->clear(); }
+    else{ the_snapshot = std::make_shared<gl::CullSnapshot>(); }
+
+    SnapshotVisitor snapshot_visitor(the_snapshot);
+    the_scene->root()->accept(snapshot_visitor);
+    the_snapshot->scene = the_scene;
+    return the_snapshot;
+}
+
+RenderBinPtr cull(const CullSnapshotConstPtr &the_snapshot,
+                  const CameraPtr &theCamera,
+                  const std::set<std::string> &the_tags,
+                  RenderBinPtr the_bin,
+                  crocore::ThreadPool *the_pool)
+{
+    if(the_bin)
+    {
+        the_bin->clear();
+        the_bin->camera = theCamera;
+    }
+    else{ the_bin = std::make_shared<gl::RenderBin>(theCamera); }
+
+    const auto &s = *the_snapshot;
+    const uint32_t num_items = s.num_items();
+    const uint32_t num_chunks = (num_items + cull_chunk_size - 1) / cull_chunk_size;
+    const mat4 view_matrix = theCamera->view_matrix();
+
+    auto job = std::make_shared<cull_job_t>(the_snapshot, theCamera->frustum());
+    job->results.resize(num_chunks);
+
+    // tag-filtering, rejected meshes also reject their entire subtree
+    const tag_filter_t filter(the_tags);
+
+    if(!filter.accept_all)
+    {
+        job->tag_mask.resize(num_items);
+
+        for(uint32_t i = 0; i < num_items; ++i)
+        {
+            job->tag_mask[i] = (s.parents[i] < 0 || job->tag_mask[s.parents[i]]) &&
+                               filter.matches(s.tag_masks[i], s.meshes[i]->overflow_tags());
+        }
+    }
+
+    // distribute chunks to worker-threads, if any. tasks starting late will find no chunks left
+    if(the_pool && num_chunks > 1)
+    {
+        uint32_t num_tasks = std::min<uint32_t>(the_pool->num_threads(), num_chunks - 1);
+        for(uint32_t i = 0; i < num_tasks; ++i){ the_pool->post([job](){ process_cull_job(job); }); }
+    }
+    process_cull_job(job);
+
+    if(num_chunks)
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->condition.wait(lock, [&job, num_chunks](){ return job->num_done == num_chunks; });
+    }
+
+    // merge in chunk-order, independent of scheduling
+    size_t num_visible = 0;
+    for(const auto &r : job->results){ num_visible += r.size(); }
+    the_bin->meshes.reserve(num_visible);
+    the_bin->transforms.reserve(num_visible);
+    the_bin->lods.reserve(num_visible);
+
+    // levels-of-detail by projected size, starting from the previous selection
+    const mat4 projection = theCamera->projection_matrix();
+    auto &lod_history = the_bin->lod_scratch;
+    lod_history.clear();
+
+    for(const auto &r : job->results)
+    {
+        for(uint32_t i : r)
+        {
+            const gl::MeshPtr &m = s.meshes[i];
+            uint32_t lod = 0;
+
+            if(!m->lods().empty())
+            {
+                vec3 min(s.min_x[i], s.min_y[i], s.min_z[i]), max(s.max_x[i], s.max_y[i], s.max_z[i]);
+                float size = projected_size(.5f * (min + max), .5f * glm::length(max - min), view_matrix, projection);
+                auto it = the_bin->lod_history.find(m->get_id());
+                lod = m->select_lod(size, it != the_bin->lod_history.end() ? it->second : 0, lod_hysteresis);
+                lod_history[m->get_id()] = lod;
+            }
+            the_bin->add_item(m, view_matrix * s.transforms[i], lod);
+        }
+    }
+    the_bin->lod_history.swap(lod_history);
+    lod_history.clear();
+
+    // collect only lights that actually affect the scene
+    for(uint32_t i = 0; i < s.lights.size(); ++i)
+    {
+        int32_t parent = s.light_parents[i];
+        if(!filter.accept_all && !((parent < 0 || job->tag_mask[parent]) &&
+                                   filter.matches(s.light_tag_masks[i], s.lights[i]->overflow_tags())))
+        {
+            continue;
+        }
+        gl::Sphere bounding_sphere(s.light_transforms[i][3].xyz(), s.lights[i]->radius());
+
+        if(job->frustum.intersect(bounding_sphere))
+        {
+            RenderBin::light light_item;
+            light_item.light = s.lights[i];
+            light_item.transform = view_matrix * s.light_transforms[i];
+            the_bin->lights.push_back(light_item);
+        }
+    }
+    the_bin->scene = s.scene;
+    return the_bin;
 }
 
 void SceneRenderer::render(const RenderBinPtr &theBin)
 {
-    std::list<RenderBin::item> opaque_items, blended_items;
-    sort_render_bin(theBin, opaque_items, blended_items);
+    {
+        gl::ScopedProfile sp("sort", false);
+        sort_render_bin(theBin);
+    }
     m_num_shadow_lights = 0;
     
     for(const RenderBin::light &l : theBin->lights)
@@ -215,38 +701,118 @@ void SceneRenderer::render(const RenderBinPtr &theBin)
     // make sure we start with a known state
     gl::reset_state();
 
-    // draw our stuff
-    draw_sorted_by_material(theBin->camera, opaque_items, theBin->lights);
-    draw_sorted_by_material(theBin->camera, blended_items, theBin->lights);
+    // group identical items for instanced drawing
+#if !defined(KINSKI_GLES)
+    bool use_instancing = true;
+#else
+    bool use_instancing = false;
+#endif
+
+    batch_render_bin(theBin, [use_instancing](const gl::MeshPtr &m)
+    {
+        return use_instancing && m->supports_instancing();
+    });
+
+    // draw our stuff, opaque batches first
+    size_t matrix_offset = update_matrix_buffer(theBin);
+    draw_sorted_by_material(theBin, matrix_offset);
 }
 
-void SceneRenderer::draw_sorted_by_material(const CameraPtr &cam, const list<RenderBin::item> &item_list,
-                                            const list<RenderBin::light> &light_list)
+void SceneRenderer::reserve_matrix_records(size_t the_num_records)
 {
-    KINSKI_CHECK_GL_ERRORS();
-    
-    for (const RenderBin::item &item : item_list)
+#if !defined(KINSKI_GLES)
+    if(!m_matrix_stride)
     {
-        auto mesh = item.mesh;
+        // records need to respect the minimum offset-alignment for uniform buffers
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = std::max(alignment, 1);
+        m_matrix_stride = (sizeof(matrix_struct_140_t) + alignment - 1) / alignment * alignment;
+    }
+    const size_t num_bytes = the_num_records * m_matrix_stride;
+    if(m_matrix_buffer && m_matrix_buffer.segment_size() >= num_bytes){ return; }
 
-        matrix_struct_140_t m;
-        m.model_view = item.transform;
-        m.model_view_projection = cam->projection_matrix() * item.transform;
-        m.normal_matrix = mat4(glm::inverseTranspose(glm::mat3(item.transform)));
-        m.texture_matrix = mesh->material()->texture_matrix();
+    const size_t min_segment_size = 1 << 18;
+    size_t segment_size = std::max(min_segment_size, m_matrix_buffer.segment_size());
+    while(segment_size < num_bytes){ segment_size *= 2; }
+
+    LOG_TRACE << "resizing matrix ring-buffer: " << segment_size / 1024 << " kB per segment";
+    m_matrix_buffer = gl::RingBuffer(GL_UNIFORM_BUFFER, segment_size, 3);
+#endif
+}
 
+size_t SceneRenderer::update_matrix_buffer(const RenderBinPtr &the_bin)
+{
 #if !defined(KINSKI_GLES)
-        if(!m_uniform_buffer[MATRIX_UNIFORM_BUFFER])
+    create_instance_records(the_bin, m_instance_records);
+    if(the_bin->batches.empty()){ return 0; }
+
+    // records are written straight into the current segment
+    size_t offset = 0;
+    uint8_t *ptr = m_matrix_buffer.map(the_bin->batches.size() * m_matrix_stride, m_matrix_stride, offset);
+
+    if(!ptr)
+    {
+        LOG_WARNING << "matrix ring-buffer exhausted, see reserve_matrix_records()";
+        return 0;
+    }
+
+    for(const auto &batch : the_bin->batches)
+    {
+        uint32_t first = *batch.begin();
+        auto &m = *reinterpret_cast<matrix_struct_140_t*>(ptr);
+
+        if(batch.size() > 1)
         {
-            m_uniform_buffer[MATRIX_UNIFORM_BUFFER] = gl::Buffer(GL_UNIFORM_BUFFER, GL_STREAM_DRAW);
+            // instanced batch -> eye-space transforms are provided per instance
+            m = create_matrix_struct(the_bin->camera, the_bin->meshes[first], mat4(1));
         }
-        m_uniform_buffer[MATRIX_UNIFORM_BUFFER].set_data(&m, sizeof(matrix_struct_140_t));
-        glBindBufferBase(GL_UNIFORM_BUFFER, gl::Context::MATRIX_BLOCK, m_uniform_buffer[MATRIX_UNIFORM_BUFFER].id());
+        else{ m = create_matrix_struct(the_bin->camera, the_bin->meshes[first], the_bin->transforms[first]); }
+        ptr += m_matrix_stride;
+    }
+    m_matrix_buffer.unmap();
+
+    if(!m_instance_records.empty())
+    {
+        if(!m_instance_buffer){ m_instance_buffer = gl::Buffer(GL_ARRAY_BUFFER, GL_STREAM_DRAW); }
+        m_instance_buffer.set_data(m_instance_records);
+    }
+    return offset;
+#else
+    return 0;
+#endif
+}
+
+void SceneRenderer::draw_sorted_by_material(const RenderBinPtr &the_bin, size_t the_matrix_offset)
+{
+    KINSKI_CHECK_GL_ERRORS();
+
+#if !defined(KINSKI_GLES)
+    size_t matrix_offset = the_matrix_offset;
+#endif
+    size_t instance_offset = 0;
+
+    for(const auto &batch : the_bin->batches)
+    {
+        const uint32_t item_index = *batch.begin();
+        const gl::MeshPtr &mesh = the_bin->meshes[item_index];
+        const uint32_t num_instances = batch.size();
+
+#if !defined(KINSKI_GLES)
+        // bind this batch's matrix-record
+        glBindBufferRange(GL_UNIFORM_BUFFER, gl::Context::MATRIX_BLOCK, m_matrix_buffer.id(), matrix_offset,
+                          sizeof(matrix_struct_140_t));
+        matrix_offset += m_matrix_stride;
+#else
+        matrix_struct_140_t m = create_matrix_struct(the_bin->camera, mesh, the_bin->transforms[item_index]);
 #endif
         for(auto &mat : mesh->materials())
         {
             if(!m_shadow_pass && m_num_shadow_lights)
             {
+                // instances provide eye-space transforms, so their shadow-matrices need to undo the view
+                const mat4 shadow_transform = num_instances > 1 ? glm::inverse(the_bin->camera->view_matrix()) :
+                                              mesh->global_transform();
                 std::vector<glm::mat4> shadow_matrices;
                 char buf[32];
                 for(int i = 0; i < m_num_shadow_lights; i++)
@@ -254,7 +820,7 @@ void SceneRenderer::draw_sorted_by_material(const CameraPtr &cam, const list<Ren
                     if(!m_shadow_cams[i]) break;
                     int tex_unit = mat->textures().size() + i;
                     shadow_matrices.push_back(m_shadow_cams[i]->projection_matrix() *
-                                              m_shadow_cams[i]->view_matrix() * mesh->global_transform());
+                                              m_shadow_cams[i]->view_matrix() * shadow_transform);
                     m_shadow_fbos[i]->depth_texture().bind(tex_unit);
                     sprintf(buf, "u_shadow_map[%d]", i);
                     mat->uniform(buf, tex_unit);
@@ -271,7 +837,7 @@ void SceneRenderer::draw_sorted_by_material(const CameraPtr &cam, const list<Ren
             mat->shader()->uniform_block_binding("MatrixBlock", gl::Context::MATRIX_BLOCK);
             mat->shader()->uniform_block_binding("LightBlock", gl::Context::LIGHT_BLOCK);
 #else
-            set_light_uniforms(mat, light_list);
+            set_light_uniforms(mat, the_bin->lights);
             mat->uniform("u_modelViewMatrix", m.model_view);
             mat->uniform("u_modelViewProjectionMatrix", m.model_view_projection);
             mat->uniform("u_normalMatrix", mat3(m.normal_matrix));
@@ -279,74 +845,112 @@ void SceneRenderer::draw_sorted_by_material(const CameraPtr &cam, const list<Ren
 #endif
         }
 
+        // bind the vertex-array for a material and source instance-transforms, if necessary
+        auto bind_vertex_array = [&](uint32_t the_material_index)
+        {
+            mesh->bind_vertex_array(the_material_index);
+
+            if(num_instances > 1)
+            {
+                mesh->bind_instance_transforms(mesh->materials()[the_material_index]->shader(), m_instance_buffer,
+                                               instance_offset);
+            }
+        };
+
 //        if(m->geometry()->has_dirty_buffers()){ m->geometry()->create_gl_buffers(); }
         gl::apply_material(mesh->material());
-        mesh->bind_vertex_array();
+        bind_vertex_array(0);
 
         KINSKI_CHECK_GL_ERRORS();
+
+        // read-only access, avoids flagging the geometry as dirty
+        const gl::Geometry &geom = *mesh->geometry();
         
-        if(mesh->geometry()->has_indices())
+        const std::vector<gl::Mesh::Entry> &entries = mesh->entries(the_bin->lods[item_index]);
+
+        if(geom.has_indices())
         {
-            if(!mesh->entries().empty())
+            if(!entries.empty())
             {
-                std::list<uint32_t> mat_entries[mesh->materials().size()];
-                
-                for (uint32_t i = 0; i < mesh->entries().size(); ++i)
+                // bucket enabled entries by material in a single pass (stable counting-sort)
+                const uint32_t num_materials = mesh->materials().size();
+                m_entry_offsets.assign(num_materials + 1, 0);
+
+                for(const gl::Mesh::Entry &e : entries)
                 {
-                    uint32_t mat_index = mesh->entries()[i].material_index;
-                    
-                    if(mat_index < mesh->materials().size())
-                        mat_entries[mat_index].push_back(i);
+                    if(e.enabled && e.material_index < num_materials){ m_entry_offsets[e.material_index + 1]++; }
                 }
-                
-                for (uint32_t i = 0; i < mesh->materials().size(); ++i)
+                for(uint32_t i = 0; i < num_materials; ++i){ m_entry_offsets[i + 1] += m_entry_offsets[i]; }
+                m_sorted_entries.resize(m_entry_offsets[num_materials]);
+
+                // afterwards m_entry_offsets[i] marks the end of bucket i
+                for(const gl::Mesh::Entry &e : entries)
                 {
-                    const auto& entry_list = mat_entries[i];
-                    
-                    if(!entry_list.empty())
+                    if(e.enabled && e.material_index < num_materials)
                     {
-                        mesh->bind_vertex_array(i);
-                        apply_material(mesh->materials()[i]);
+                        m_sorted_entries[m_entry_offsets[e.material_index]++] = &e;
                     }
-                    
-                    for (auto entry_index : entry_list)
+                }
+
+                for(uint32_t i = 0, begin = 0; i < num_materials; begin = m_entry_offsets[i++])
+                {
+                    const uint32_t end = m_entry_offsets[i];
+                    if(begin == end){ continue; }
+
+                    bind_vertex_array(i);
+                    apply_material(mesh->materials()[i]);
+
+                    for(uint32_t k = begin; k < end; ++k)
                     {
-                        const gl::Mesh::Entry &e = mesh->entries()[entry_index];
-                        
-                        // skip disabled entries
-                        if(!e.enabled) continue;
-                        
+                        const gl::Mesh::Entry &e = *m_sorted_entries[k];
                         uint32_t primitive_type = e.primitive_type;
-                        primitive_type = primitive_type ? : mesh->geometry()->primitive_type();
+                        primitive_type = primitive_type ? : geom.primitive_type();
 
 #ifndef KINSKI_GLES
-                        glDrawElementsBaseVertex(primitive_type,
-                                                 e.num_indices,
-                                                 mesh->geometry()->index_type(),
-                                                 BUFFER_OFFSET(e.base_index * mesh->geometry()->index_size()),
-                                                 e.base_vertex);
+                        glDrawElementsInstancedBaseVertex(primitive_type, e.num_indices, mesh->index_type(),
+                                                          BUFFER_OFFSET(e.base_index * mesh->index_size()),
+                                                          num_instances, e.base_vertex);
 #else
-                        glDrawElements(primitive_type,
-                                       e.num_indices, mesh->geometry()->index_type(),
-                                       BUFFER_OFFSET(e.base_index * mesh->geometry()->index_size()));
+                        glDrawElements(primitive_type, e.num_indices, mesh->index_type(),
+                                       BUFFER_OFFSET(e.base_index * mesh->index_size()));
 #endif
+                        gl::context()->add_draw_call();
                     }
                 }
-                
             }
             else
             {
-                glDrawElements(mesh->geometry()->primitive_type(),
-                               mesh->geometry()->indices().size(), mesh->geometry()->index_type(),
+#ifndef KINSKI_GLES
+                glDrawElementsInstanced(geom.primitive_type(), geom.indices().size(), mesh->index_type(),
+                                        BUFFER_OFFSET(0), num_instances);
+#else
+                glDrawElements(geom.primitive_type(), geom.indices().size(), mesh->index_type(),
                                BUFFER_OFFSET(0));
+#endif
+                gl::context()->add_draw_call();
             }
         }
         else
         {
-            glDrawArrays(mesh->geometry()->primitive_type(), 0,
-                         mesh->geometry()->vertices().size());
+#ifndef KINSKI_GLES
+            glDrawArraysInstanced(geom.primitive_type(), 0, geom.vertices().size(), num_instances);
+#else
+            glDrawArrays(geom.primitive_type(), 0, geom.vertices().size());
+#endif
+            gl::context()->add_draw_call();
         }
         KINSKI_CHECK_GL_ERRORS();
+
+        if(num_instances > 1)
+        {
+            // restore default instance-transforms for all involved vertex-arrays
+            for(uint32_t i = 0; i < mesh->materials().size(); ++i)
+            {
+                mesh->bind_vertex_array(i);
+                mesh->bind_instance_transforms(mesh->materials()[i]->shader());
+            }
+            instance_offset += num_instances * sizeof(gl::instance_record_t);
+        }
     }
 #ifndef KINSKI_NO_VAO
     GL_SUFFIX(glBindVertexArray)(0);
@@ -354,40 +958,78 @@ void SceneRenderer::draw_sorted_by_material(const CameraPtr &cam, const list<Ren
 }
 
 void SceneRenderer::set_light_uniforms(MaterialPtr &the_mat,
-                                       const list<RenderBin::light> &light_list)
+                                       const std::vector<RenderBin::light> &light_list)
 {
+    enum LightMember{TYPE, POSITION, DIRECTION, DIFFUSE, AMBIENT, INTENSITY, RADIUS, QUADRATIC_ATTENUATION,
+        SPOT_COS_CUTOFF, SPOT_EXPONENT, NUM_MEMBERS};
+
+    const gl::ShaderPtr &shader = the_mat->shader();
+    if(!shader){ return; }
+
+    // uniform-handles per shader, resolved once
+    auto it = m_light_uniforms.find(shader.get());
+
+    // unknown shader, address re-used by another shader or program reloaded
+    if(it == m_light_uniforms.end() || it->second.shader.lock() != shader ||
+       it->second.generation != shader->generation())
+    {
+        for(auto i = m_light_uniforms.begin(); i != m_light_uniforms.end();)
+        {
+            if(i->second.shader.expired()){ i = m_light_uniforms.erase(i); }
+            else{ ++i; }
+        }
+        light_uniforms_t resolved;
+        resolved.shader = shader;
+        resolved.generation = shader->generation();
+        resolved.num_lights = shader->uniform_handle("u_numLights");
+        it = m_light_uniforms.insert_or_assign(shader.get(), std::move(resolved)).first;
+    }
+    auto &lights = it->second;
+
+    while(lights.handles.size() < light_list.size() * NUM_MEMBERS)
+    {
+        std::string light_str = "u_lights[" + std::to_string(lights.handles.size() / NUM_MEMBERS) + "]";
+
+        for(const char *member : {".type", ".position", ".direction", ".diffuse", ".ambient", ".intensity",
+                                  ".radius", ".quadraticAttenuation", ".spotCosCutoff", ".spotExponent"})
+        {
+            lights.handles.push_back(shader->uniform_handle(light_str + member));
+        }
+    }
+
+    // uploaded directly, the shader skips values it already holds
+    shader->bind();
     int light_count = 0;
-    
+
     for (const auto &l : light_list)
     {
-        std::string light_str = std::string("u_lights") + "[" + std::to_string(light_count) + "]";
-        
-        the_mat->uniform(light_str + ".type", (int)l.light->type());
-        the_mat->uniform(light_str + ".position", l.transform[3].xyz());
-        the_mat->uniform(light_str + ".direction", glm::normalize(-vec3(l.transform[2].xyz())));
-        the_mat->uniform(light_str + ".diffuse", l.light->diffuse());
-        the_mat->uniform(light_str + ".ambient", l.light->ambient());
-        the_mat->uniform(light_str + ".intensity", l.light->intensity());
-        
+        const gl::uniform_handle_t *handles = &lights.handles[light_count * NUM_MEMBERS];
+
+        shader->uniform(handles[TYPE], (int)l.light->type());
+        shader->uniform(handles[POSITION], l.transform[3].xyz());
+        shader->uniform(handles[DIRECTION], glm::normalize(-vec3(l.transform[2].xyz())));
+        shader->uniform(handles[DIFFUSE], l.light->diffuse());
+        shader->uniform(handles[AMBIENT], l.light->ambient());
+        shader->uniform(handles[INTENSITY], l.light->intensity());
+
         // point + spot
         if(l.light->type() > 0)
         {
-            the_mat->uniform(light_str + ".radius", l.light->radius());
-            the_mat->uniform(light_str + ".quadraticAttenuation", l.light->attenuation().quadratic);
-            
+            shader->uniform(handles[RADIUS], l.light->radius());
+            shader->uniform(handles[QUADRATIC_ATTENUATION], l.light->attenuation().quadratic);
+
             if(l.light->type() == Light::SPOT)
             {
-                the_mat->uniform(light_str + ".spotCosCutoff", cosf(glm::radians(l.light->spot_cutoff())));
-                the_mat->uniform(light_str + ".spotExponent", l.light->spot_exponent());
+                shader->uniform(handles[SPOT_COS_CUTOFF], cosf(glm::radians(l.light->spot_cutoff())));
+                shader->uniform(handles[SPOT_EXPONENT], l.light->spot_exponent());
             }
         }
         light_count++;
     }
-
-    the_mat->uniform("u_numLights", light_count);
+    shader->uniform(lights.num_lights, light_count);
 }
 
-void SceneRenderer::update_uniform_buffers(const std::list<RenderBin::light> &light_list)
+void SceneRenderer::update_uniform_buffers(const std::vector<RenderBin::light> &light_list)
 {
 #ifndef KINSKI_GLES
     struct lightstruct_std140
@@ -468,17 +1110,114 @@ void SceneRenderer::update_uniform_buffer_matrices(const glm::mat4 &model_view,
 void SceneRenderer::set_shadowmap_size(const glm::ivec2 &the_size)
 {
 #ifndef KINSKI_GLES
-    gl::Fbo::Format fmt;
-    fmt.num_color_buffers = 0;
-    
-    for(size_t i = 0; i < m_shadow_fbos.size(); i++)
+    if(the_size == m_shadow_map_size){ return; }
+    m_shadow_map_size = the_size;
+
+    // cached maps are recreated on demand
+    m_shadow_maps.clear();
+#endif
+}
+
+namespace
+{
+    template<typename T>
+    inline void hash_combine(size_t &the_seed, const T &the_value)
+    {
+        the_seed ^= std::hash<T>()(the_value) + 0x9e3779b9 + (the_seed << 6) + (the_seed >> 2);
+    }
+
+    inline void hash_combine(size_t &the_seed, const mat4 &the_mat)
     {
-        if(!m_shadow_fbos[i] || m_shadow_fbos[i]->size() != the_size)
+        const float *ptr = glm::value_ptr(the_mat);
+        for(uint32_t i = 0; i < 16; ++i){ hash_combine(the_seed, ptr[i]); }
+    }
+
+    // evict shadow-maps not used for this many frames
+    constexpr uint64_t g_shadow_map_max_idle_frames = 120;
+}
+
+std::vector<SceneRenderer::shadow_map_t*>
+SceneRenderer::update_shadow_maps(const std::vector<gl::LightPtr> &the_lights, float the_far_clip,
+                                  const std::function<gl::FboPtr(const gl::LightPtr&)> &the_create_fbo_fn,
+                                  const std::function<void(shadow_map_t&)> &the_render_fn)
+{
+    m_frame_index++;
+    m_num_shadow_updates = 0;
+
+    std::vector<shadow_map_t*> ret, outdated;
+
+    for(const auto &l : the_lights)
+    {
+        auto &map = m_shadow_maps[l.get()];
+
+        // address re-used by another light
+        if(map.light.lock() != l){ map = shadow_map_t(); }
+
+        map.light = l;
+        map.last_use = m_frame_index;
+        if(!map.fbo){ map.fbo = the_create_fbo_fn(l); }
+
+        map.camera = gl::create_shadow_camera(l, std::min(the_far_clip, l->radius()));
+        map.casters = cull(m_cull_snapshot, map.camera, {}, map.casters, m_thread_pool);
+
+        // casters are stored in eye-coords of the light,
+        // so the signature covers movement of both light and casters, as well as modified geometry
+        size_t signature = std::hash<const gl::Fbo*>()(map.fbo.get());
+        hash_combine(signature, map.camera->projection_matrix());
+        bool animated = false;
+
+        for(uint32_t i = 0; i < map.casters->meshes.size(); ++i)
         {
-            m_shadow_fbos[i] = gl::Fbo::create(the_size.x, the_size.y, fmt);
+            const auto &mesh = map.casters->meshes[i];
+            hash_combine(signature, mesh.get());
+            hash_combine(signature, mesh->geometry().get());
+            hash_combine(signature, mesh->geometry()->modification_count());
+            hash_combine(signature, mesh->material()->shadow_properties());
+            hash_combine(signature, map.casters->transforms[i]);
+            hash_combine(signature, map.casters->lods[i]);
+
+            const gl::Mesh &m = *mesh;
+            animated = animated || (m.geometry()->has_bones() && !m.animations().empty());
         }
+        if(!map.has_content || animated || signature != map.signature)
+        {
+            map.signature = signature;
+            outdated.push_back(&map);
+        }
+        ret.push_back(&map);
     }
-#endif
+
+    // stalest maps first
+    std::stable_sort(outdated.begin(), outdated.end(), [](const shadow_map_t *lhs, const shadow_map_t *rhs)
+    {
+        return lhs->has_content == rhs->has_content ? lhs->last_update < rhs->last_update : !lhs->has_content;
+    });
+
+    for(auto *map : outdated)
+    {
+        if(map->has_content && m_shadow_update_budget && m_num_shadow_updates >= m_shadow_update_budget)
+        {
+            // stays outdated
+            map->signature = 0;
+            continue;
+        }
+        if(map->fbo){ the_render_fn(*map); }
+        map->render_camera = map->camera;
+        map->has_content = true;
+        map->last_update = m_frame_index;
+        m_num_shadow_updates++;
+    }
+
+    // evict unused maps
+    for(auto it = m_shadow_maps.begin(); it != m_shadow_maps.end();)
+    {
+        if(it->second.light.expired() || m_frame_index - it->second.last_use > g_shadow_map_max_idle_frames)
+        {
+            it = m_shadow_maps.erase(it);
+        }
+        else{ ++it; }
+    }
+    return ret;
 }
 
 }}
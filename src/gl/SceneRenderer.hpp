@@ -16,24 +16,19 @@
 #include "gl/gl.hpp"
 #include "gl/Fbo.hpp"
 #include "gl/Buffer.hpp"
+#include "gl/Mesh.hpp"
+
+namespace crocore{ class ThreadPool; }
 
 namespace kinski{ namespace gl{
     
 DEFINE_CLASS_PTR(RenderBin);
+DEFINE_CLASS_PTR(CullSnapshot);
 
 class RenderBin
 {
 public:
 
-    struct item
-    {
-        //! the item's mesh
-        gl::MeshPtr mesh;
-
-        //! the item's transform in eye-coords
-        mat4 transform;
-    };
-
     struct light
     {
         //! a lightsource
@@ -42,20 +37,145 @@ public:
         //! the light's transform in eye-coords
         mat4 transform;
     };
-    
+
+    //! a contiguous range of item-indices
+    struct range_t
+    {
+        const uint32_t *first = nullptr, *last = nullptr;
+        inline const uint32_t* begin() const { return first; }
+        inline const uint32_t* end() const { return last; }
+        inline size_t size() const { return last - first; }
+        inline bool empty() const { return first == last; }
+    };
+
     RenderBin(const CameraPtr &cam): camera(cam){};
+
+    //! remove all items and lights, keeping allocated storage for reuse
+    void clear();
+
+    //! add an item with its transform in eye-coords, drawn using level-of-detail the_lod
+    void add_item(const gl::MeshPtr &the_mesh, const mat4 &the_transform, uint32_t the_lod = 0);
+
+    inline size_t num_items() const { return meshes.size(); }
+
+    //! indices of opaque items, sorted by state (shader, material, vertex-array), then near to far
+    range_t opaque_items() const;
+
+    //! indices of blended items, sorted far to near
+    range_t blended_items() const;
+
     CameraPtr camera;
     SceneConstPtr scene;
-    std::list<item> items;
-    std::list<light> lights;
+
+    // item storage (struct-of-arrays)
+    std::vector<gl::MeshPtr> meshes;
+    std::vector<mat4> transforms;
+    std::vector<uint32_t> lods;
+
+    //! packed 64-bit sort-keys, one per item
+    std::vector<uint64_t> sort_keys;
+
+    //! item-indices, ordered by sort_keys after a call to sort_render_bin
+    std::vector<uint32_t> sorted_indices;
+
+    //! number of opaque items, leading sorted_indices
+    uint32_t num_opaque = 0;
+
+    //! runs of sorted items, sharing geometry and materials, after a call to batch_render_bin
+    std::vector<range_t> batches;
+
+    //! number of opaque batches, leading batches
+    uint32_t num_opaque_batches = 0;
+
+    std::vector<light> lights;
+
+    //! levels-of-detail selected during the previous cull, keyed by Object3D::get_id(), used for hysteresis.
+    //! only meshes seen in that cull are kept. kept by clear()
+    std::unordered_map<uint32_t, uint32_t> lod_history;
+
+    //! selections of the current cull, swapped with lod_history afterwards. empty, but keeps its buckets
+    std::unordered_map<uint32_t, uint32_t> lod_scratch;
+
+private:
+
+    std::vector<uint64_t> m_key_scratch;
+    std::vector<uint32_t> m_index_scratch;
+    friend void sort_render_bin(const RenderBinPtr &the_bin);
 };
 
+/*!
+ * flattened snapshot of all enabled meshes and lights within a scene, using world-coords.
+ * a snapshot is created once per frame and can then be culled against several cameras.
+ */
+class CullSnapshot
+{
+public:
+
+    //! remove all items and lights, keeping allocated storage for reuse
+    void clear();
+
+    inline size_t num_items() const { return meshes.size(); }
+
+    SceneConstPtr scene;
+
+    // mesh storage (struct-of-arrays), bounds are split by component for SIMD plane-tests
+    std::vector<gl::MeshPtr> meshes;
+    std::vector<mat4> transforms;
+    std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+    std::vector<tag_mask_t> tag_masks;
+    std::vector<uint8_t> no_cull;
+
+    //! index of the closest ancestor-mesh or -1, tag-filters apply to entire subtrees
+    std::vector<int32_t> parents;
+
+    // light storage
+    std::vector<gl::LightPtr> lights;
+    std::vector<mat4> light_transforms;
+    std::vector<tag_mask_t> light_tag_masks;
+    std::vector<int32_t> light_parents;
+};
+
+/*!
+ * flatten the_scene into a CullSnapshot.
+ * if the_snapshot is provided it will be cleared and reused, avoiding per-frame allocations.
+ */
+CullSnapshotPtr create_cull_snapshot(const gl::SceneConstPtr &the_scene, CullSnapshotPtr the_snapshot = nullptr);
+
+/*!
+ * collect all visible meshes and lights of the_scene.
+ * if the_bin is provided it will be cleared and reused, avoiding per-frame allocations.
+ */
 RenderBinPtr cull(const gl::SceneConstPtr &the_scene, const CameraPtr &theCamera,
-                  const std::set<std::string> &the_tags = {});
+                  const std::set<std::string> &the_tags = {}, RenderBinPtr the_bin = nullptr);
+
+/*!
+ * collect all visible meshes and lights of the_snapshot.
+ * if the_pool is provided, the frustum-tests are split into chunks and distributed across its threads,
+ * with the calling thread participating. the resulting RenderBin does not depend on the number of threads.
+ */
+RenderBinPtr cull(const CullSnapshotConstPtr &the_snapshot, const CameraPtr &theCamera,
+                  const std::set<std::string> &the_tags = {}, RenderBinPtr the_bin = nullptr,
+                  crocore::ThreadPool *the_pool = nullptr);
+
+/*!
+ * generate sort-keys for all items in the_bin and radix-sort them.
+ * afterwards RenderBin::opaque_items() and RenderBin::blended_items() provide the draw-order.
+ */
+void sort_render_bin(const RenderBinPtr &the_bin);
+
+/*!
+ * group consecutive items of a sorted RenderBin into batches, suitable for instanced drawing.
+ * items within a batch share geometry, materials and entries. skinned meshes are never batched.
+ * the_instancing_fn can be used to further restrict batching, it is evaluated for the first mesh of a batch.
+ */
+void batch_render_bin(const RenderBinPtr &the_bin,
+                      const std::function<bool(const gl::MeshPtr&)> &the_instancing_fn = {});
 
-void sort_render_bin(const RenderBinPtr &the_bin,
-                     std::list<RenderBin::item> &the_opaque_items,
-                     std::list<RenderBin::item> &the_transparent_items);
+/*!
+ * create per-instance records for all instanced batches of a batched RenderBin, in batch-order.
+ * the_records is cleared and reused, avoiding per-frame allocations.
+ */
+void create_instance_records(const RenderBinPtr &the_bin, std::vector<gl::instance_record_t> &the_records);
 
 DEFINE_CLASS_PTR(SceneRenderer);
 
@@ -72,8 +192,8 @@ public:
     virtual uint32_t render_scene(const gl::SceneConstPtr &the_scene, const CameraPtr &the_cam,
                                   const std::set<std::string> &the_tags = {});
 
-    void set_light_uniforms(MaterialPtr &the_mat, const std::list<RenderBin::light> &light_list);
-    void update_uniform_buffers(const std::list<RenderBin::light> &light_list);
+    void set_light_uniforms(MaterialPtr &the_mat, const std::vector<RenderBin::light> &light_list);
+    void update_uniform_buffers(const std::vector<RenderBin::light> &light_list);
     void update_uniform_buffer_matrices(const mat4 &model_view,
                                         const mat4 &projection);
 
@@ -82,25 +202,132 @@ public:
     std::vector<gl::CameraPtr>& shadow_cams() { return m_shadow_cams; }
     void set_shadow_pass(bool b){ m_shadow_pass = b; }
 
+    /*!
+     * provide a pool of worker-threads to be used for culling, can be nullptr.
+     * the pool needs to outlive this renderer
+     */
+    void set_thread_pool(crocore::ThreadPool *the_pool){ m_thread_pool = the_pool; }
+    crocore::ThreadPool* thread_pool() const { return m_thread_pool; }
+
+    /*!
+     * shadow-maps are cached per light and only re-rendered if the light or its shadow-casters changed.
+     * the_num_updates limits the number of re-rendered shadow-maps per frame (0 -> unlimited).
+     * maps without any content are always rendered
+     */
+    void set_shadow_update_budget(uint32_t the_num_updates){ m_shadow_update_budget = the_num_updates; }
+    uint32_t shadow_update_budget() const { return m_shadow_update_budget; }
+
+    //! number of shadow-maps re-rendered during the last frame
+    uint32_t num_shadow_updates() const { return m_num_shadow_updates; }
+
 protected:
     SceneRenderer();
 
+    //! cached shadow-map for a single light
+    struct shadow_map_t
+    {
+        std::weak_ptr<gl::Light> light;
+        gl::FboPtr fbo;
+
+        //! current camera of the light, used for culling and change-detection
+        gl::CameraPtr camera;
+
+        //! camera used for the last render, receivers need this one to match the depth-texture
+        gl::CameraPtr render_camera;
+
+        //! shadow-casters, culled for camera
+        RenderBinPtr casters;
+
+        //! hash over camera and casters, used to detect changes
+        size_t signature = 0;
+        bool has_content = false;
+        uint64_t last_update = 0, last_use = 0;
+    };
+
+    /*!
+     * return cached shadow-maps for the_lights, in the same order, after culling their shadow-casters.
+     * the_far_clip limits the range of the shadow-cameras, the_create_fbo_fn creates missing framebuffers.
+     * outdated maps are re-rendered via the_render_fn, stalest first and within shadow_update_budget().
+     * the returned pointers are valid until the next call
+     */
+    std::vector<shadow_map_t*>
+    update_shadow_maps(const std::vector<gl::LightPtr> &the_lights, float the_far_clip,
+                       const std::function<gl::FboPtr(const gl::LightPtr&)> &the_create_fbo_fn,
+                       const std::function<void(shadow_map_t&)> &the_render_fn);
+
+    //! render-bins, reused across frames
+    RenderBinPtr m_render_bin, m_shadow_render_bin;
+
+    //! flattened scene, created once per frame and culled for all passes
+    CullSnapshotPtr m_cull_snapshot;
+
+    //! optional worker-threads used for culling
+    crocore::ThreadPool *m_thread_pool = nullptr;
+
+    //! scratch-space for per-instance records
+    std::vector<gl::instance_record_t> m_instance_records;
+
 private:
 
     void render(const RenderBinPtr &theBin);
 
-    void draw_sorted_by_material(const CameraPtr &cam, const std::list<RenderBin::item> &item_list,
-                                 const std::list<RenderBin::light> &light_list);
+    /*!
+     * issue draw-calls for all batches of the_bin, instanced where possible.
+     * the_matrix_offset denotes the location of their matrix-records within m_matrix_buffer (GL only)
+     */
+    void draw_sorted_by_material(const RenderBinPtr &the_bin, size_t the_matrix_offset);
+
+    /*!
+     * write one matrix-record per batch of the_bin into the current segment of m_matrix_buffer
+     * and upload per-instance records for instanced batches.
+     * returns the offset of the first record
+     */
+    size_t update_matrix_buffer(const RenderBinPtr &the_bin);
+
+    /*!
+     * make sure a segment of m_matrix_buffer holds the_num_records matrix-records.
+     * call this between frames, before advancing to the next segment
+     */
+    void reserve_matrix_records(size_t the_num_records);
 
     enum UniformBufferIndex {LIGHT_UNIFORM_BUFFER = 0, MATRIX_UNIFORM_BUFFER = 1,
         SHADOW_UNIFORM_BUFFER = 2};
     gl::Buffer m_uniform_buffer[3];
 
+    //! per-draw matrix-records, one segment per frame
+    gl::RingBuffer m_matrix_buffer;
+    size_t m_matrix_stride = 0;
+
+    //! per-instance transforms for instanced batches
+    gl::Buffer m_instance_buffer;
+
+    //! light-uniforms of a shader, resolved once by set_light_uniforms()
+    struct light_uniforms_t
+    {
+        std::weak_ptr<gl::Shader> shader;
+        uint64_t generation = 0;
+
+        //! one handle per light-member and light
+        std::vector<gl::uniform_handle_t> handles;
+        gl::uniform_handle_t num_lights;
+    };
+    std::unordered_map<const gl::Shader*, light_uniforms_t> m_light_uniforms;
+
+    //! scratch-space for bucketing mesh-entries by material
+    std::vector<uint32_t> m_entry_offsets;
+    std::vector<const gl::Mesh::Entry*> m_sorted_entries;
+
     // shadow params
     int m_num_shadow_lights;
     std::vector<gl::FboPtr> m_shadow_fbos;
     std::vector<gl::CameraPtr> m_shadow_cams;
     bool m_shadow_pass;
+    ivec2 m_shadow_map_size = ivec2(0);
+
+    //! shadow-map cache
+    std::unordered_map<const gl::Light*, shadow_map_t> m_shadow_maps;
+    uint64_t m_frame_index = 0;
+    uint32_t m_shadow_update_budget = 0, m_num_shadow_updates = 0;
 };
     
 }}// namespace
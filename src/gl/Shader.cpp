@@ -7,6 +7,7 @@
 //  http://www.boost.org/LICENSE_1_0.txt
 // __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
 
+#include <unordered_map>
 #include "Shader.hpp"
 
 using namespace std;
@@ -15,21 +16,162 @@ namespace kinski{ namespace gl{
     
 //////////////////////////////////////////////////////////////////////////
 // Shader::Obj
+namespace
+{
+    // stamps for uniform-uploads, unique across all programs
+    uint64_t g_uniform_version = 0;
+
+    // stamps for successful links, unique across all programs
+    uint64_t g_program_generation = 0;
+}
+
 struct ShaderImpl
 {
-    ShaderImpl() : m_Handle(glCreateProgram()) {}
+    //! an active uniform (or array-element) and the last value uploaded to it
+    struct uniform_t
+    {
+        GLint location = -1;
+
+        //! index of the array's first element, size of the array
+        uint32_t base = 0, array_size = 1;
+
+        std::vector<uint8_t> value;
+    };
+
+    ShaderImpl() : m_Handle(glCreateProgram()), m_uniform_version(++g_uniform_version) {}
     
     ~ShaderImpl()
     {
-        if(m_Handle){ glDeleteProgram(m_Handle);}
+        if(m_Handle)
+        {
+            if(gl::context()){ gl::context()->program_deleted(m_Handle); }
+            glDeleteProgram(m_Handle);
+        }
     }
+
+    //! query all active uniforms, including array-elements, after a successful link
+    void resolve_uniforms();
+
+    //! returns the index for name, querying and adding unknown names
+    uint32_t uniform_index(const std::string &name);
+
+    /*!
+     * returns the location to upload the provided data to
+     * or -1, if the uniform is inactive, the handle is stale or the uniform already holds this value.
+     * the_count > 1 denotes uploads of entire arrays.
+     */
+    GLint location_for_upload(const uniform_handle_t &the_handle, const void *the_data, size_t the_num_bytes,
+                              int the_count = 1, bool the_transpose = false);
     
     GLuint						m_Handle;
-    std::map<std::string,int>	m_uniform_locations;
+    std::vector<uniform_t> m_uniforms;
+    std::unordered_map<std::string, uint32_t> m_uniform_indices;
     std::map<std::string, GLuint>	m_UniformBlockIndices;
 
+    //! changes whenever a uniform-value of this program was modified
+    uint64_t m_uniform_version;
+
+    //! set on every (re-)link, stored in uniform-handles. GL may hand out the name of a deleted program again
+    uint64_t m_generation = 0;
 };
 
+void ShaderImpl::resolve_uniforms()
+{
+    m_uniforms.clear();
+    m_uniform_indices.clear();
+
+    GLint num_uniforms = 0, max_length = 0;
+    glGetProgramiv(m_Handle, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    glGetProgramiv(m_Handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<char> buf(max_length + 1);
+
+    for(GLint i = 0; i < num_uniforms; ++i)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type;
+        glGetActiveUniform(m_Handle, i, buf.size(), &length, &size, &type, buf.data());
+        std::string name(buf.data(), length);
+        GLint loc = glGetUniformLocation(m_Handle, name.c_str());
+
+        // members of uniform-blocks
+        if(loc < 0){ continue; }
+
+        // arrays are reported as "name[0]", also register the plain name and all elements
+        std::string base_name = name;
+        if(name.size() > 3 && !name.compare(name.size() - 3, 3, "[0]")){ base_name = name.substr(0, name.size() - 3); }
+
+        uint32_t base = m_uniforms.size();
+        uniform_t u;
+        u.location = loc;
+        u.base = base;
+        u.array_size = size;
+        m_uniforms.push_back(u);
+        m_uniform_indices[name] = base;
+
+        if(base_name != name)
+        {
+            m_uniform_indices[base_name] = base;
+
+            for(GLint j = 1; j < size; ++j)
+            {
+                std::string element_name = base_name + "[" + std::to_string(j) + "]";
+                uniform_t element;
+                element.location = glGetUniformLocation(m_Handle, element_name.c_str());
+                element.base = base;
+                element.array_size = 1;
+                m_uniform_indices[element_name] = m_uniforms.size();
+                m_uniforms.push_back(element);
+            }
+        }
+    }
+    m_uniform_version = ++g_uniform_version;
+}
+
+uint32_t ShaderImpl::uniform_index(const std::string &name)
+{
+    auto it = m_uniform_indices.find(name);
+    if(it != m_uniform_indices.end()){ return it->second; }
+
+    // not reported as active uniform, cache the result of a direct query
+    uniform_t u;
+    u.location = glGetUniformLocation(m_Handle, name.c_str());
+    u.base = m_uniforms.size();
+    m_uniform_indices[name] = m_uniforms.size();
+    m_uniforms.push_back(u);
+    return u.base;
+}
+
+GLint ShaderImpl::location_for_upload(const uniform_handle_t &the_handle, const void *the_data, size_t the_num_bytes,
+                                      int the_count, bool the_transpose)
+{
+    // handles of a previously linked program
+    if(the_handle.generation != m_generation || the_handle.index >= m_uniforms.size()){ return -1; }
+
+    const uint32_t index = the_handle.index;
+    uniform_t &u = m_uniforms[index];
+    if(u.location < 0){ return -1; }
+
+    const uint8_t *data = static_cast<const uint8_t*>(the_data);
+
+    // transposed values are never cached
+    if(!the_transpose && u.value.size() == the_num_bytes && std::equal(data, data + the_num_bytes, u.value.begin()))
+    {
+        return -1;
+    }
+    if(the_transpose){ u.value.clear(); }
+    else{ u.value.assign(data, data + the_num_bytes); }
+
+    // keep caches of aliasing array-elements consistent
+    if(index != u.base){ m_uniforms[u.base].value.clear(); }
+    else
+    {
+        for(uint32_t j = 1; j < std::min<uint32_t>(the_count, u.array_size); ++j){ m_uniforms[u.base + j].value.clear(); }
+    }
+    m_uniform_version = ++g_uniform_version;
+    return u.location;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Shader
 ShaderPtr Shader::create(const std::string &vertexShader, const std::string &fragmentShader,
@@ -96,17 +238,19 @@ void Shader::link()
 		throw ShaderLinkException(log);
 	}
     std::string log = get_program_log();
+    m_impl->resolve_uniforms();
+    m_impl->m_generation = ++g_program_generation;
 }
 
 void Shader::bind() const
 {
     if(!m_impl) throw ShaderNullProgramExc();
-	glUseProgram(m_impl->m_Handle);
+    gl::context()->use_program(m_impl->m_Handle);
 }
 
 void Shader::unbind()
 {
-	glUseProgram(0);
+    gl::context()->use_program(0);
 }
 
 GLuint Shader::handle() const
@@ -149,115 +293,199 @@ std::string Shader::get_program_log() const
     return log;
 }
 
-void Shader::uniform(const std::string &name, GLint data)
+void Shader::uniform(const uniform_handle_t &the_handle, GLint data)
 {
-	GLint loc = uniform_location(name);
+	GLint loc = m_impl->location_for_upload(the_handle, &data, sizeof(data));
 	if(loc != -1) glUniform1i(loc, data);
 }
 
-void Shader::uniform(const std::string &name, const glm::vec2 &data)
+void Shader::uniform(const std::string &name, GLint data)
+{
+    uniform(uniform_handle(name), data);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::vec2 &data)
 {
-	GLint loc = uniform_location(name);
+	GLint loc = m_impl->location_for_upload(the_handle, &data, sizeof(data));
 	if(loc != -1) glUniform2f( loc, data.x, data.y );
 }
 
-void Shader::uniform(const std::string &name, const GLint *data, int count)
+void Shader::uniform(const std::string &name, const glm::vec2 &data)
+{
+    uniform(uniform_handle(name), data);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const GLint *data, int count)
 {
-	GLint loc = uniform_location(name);
+	GLint loc = m_impl->location_for_upload(the_handle, data, count * sizeof(GLint), count);
 	if(loc != -1) glUniform1iv( loc, count, data );
 }
 
-void Shader::uniform(const std::string &name, const glm::ivec2 *data, int count)
+void Shader::uniform(const std::string &name, const GLint *data, int count)
 {
-	GLint loc = uniform_location(name);
+    uniform(uniform_handle(name), data, count);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::ivec2 *data, int count)
+{
+	GLint loc = m_impl->location_for_upload(the_handle, data, count * sizeof(glm::ivec2), count);
 	if(loc != -1) glUniform2iv(loc, count, &data[0].x);
 }
 
-void Shader::uniform(const std::string &name, GLfloat data)
+void Shader::uniform(const std::string &name, const glm::ivec2 *data, int count)
 {
-	GLint loc = uniform_location(name);
+    uniform(uniform_handle(name), data, count);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, GLfloat data)
+{
+	GLint loc = m_impl->location_for_upload(the_handle, &data, sizeof(data));
 	if(loc != -1) glUniform1f(loc, data);
 }
 
-void Shader::uniform(const std::string &name, const glm::vec3 &data)
+void Shader::uniform(const std::string &name, GLfloat data)
 {
-	GLint loc = uniform_location(name);
+    uniform(uniform_handle(name), data);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::vec3 &data)
+{
+	GLint loc = m_impl->location_for_upload(the_handle, &data, sizeof(data));
 	if(loc != -1) glUniform3f( loc, data.x, data.y, data.z );
 }
 
-void Shader::uniform(const std::string &name, const glm::vec4 &data)
+void Shader::uniform(const std::string &name, const glm::vec3 &data)
 {
-	GLint loc = uniform_location(name);
+    uniform(uniform_handle(name), data);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::vec4 &data)
+{
+	GLint loc = m_impl->location_for_upload(the_handle, &data, sizeof(data));
 	if(loc != -1) glUniform4f( loc, data.x, data.y, data.z, data.w );
 }
 
-void Shader::uniform(const std::string &name, const GLfloat *data, int count)
+void Shader::uniform(const std::string &name, const glm::vec4 &data)
+{
+    uniform(uniform_handle(name), data);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const GLfloat *data, int count)
 {
-	GLint loc = uniform_location(name);
+	GLint loc = m_impl->location_for_upload(the_handle, data, count * sizeof(GLfloat), count);
 	if(loc != -1) glUniform1fv(loc, count, data);
 }
 
-    void Shader::uniform(const std::string &name, const glm::vec2 *theArray, int count)
+void Shader::uniform(const std::string &name, const GLfloat *data, int count)
 {
-	GLint loc = uniform_location(name);
+    uniform(uniform_handle(name), data, count);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::vec2 *theArray, int count)
+{
+	GLint loc = m_impl->location_for_upload(the_handle, theArray, count * sizeof(glm::vec2), count);
 	if(loc != -1) glUniform2fv(loc, count, &theArray[0].x);
 }
 
-void Shader::uniform(const std::string &name, const glm::vec3 *theArray, int count)
+void Shader::uniform(const std::string &name, const glm::vec2 *theArray, int count)
 {
-	GLint loc = uniform_location(name);
+    uniform(uniform_handle(name), theArray, count);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::vec3 *theArray, int count)
+{
+	GLint loc = m_impl->location_for_upload(the_handle, theArray, count * sizeof(glm::vec3), count);
 	if(loc != -1) glUniform3fv(loc, count, &theArray[0].x);
 }
 
-void Shader::uniform(const std::string &name, const glm::vec4 *theArray, int count)
+void Shader::uniform(const std::string &name, const glm::vec3 *theArray, int count)
 {
-	GLint loc = uniform_location(name);
+    uniform(uniform_handle(name), theArray, count);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::vec4 *theArray, int count)
+{
+	GLint loc = m_impl->location_for_upload(the_handle, theArray, count * sizeof(glm::vec4), count);
 	if(loc != -1) glUniform4fv(loc, count, &theArray[0].x);
 }
 
+void Shader::uniform(const std::string &name, const glm::vec4 *theArray, int count)
+{
+    uniform(uniform_handle(name), theArray, count);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::mat3 &theMat, bool transpose)
+{
+	uniform(the_handle, &theMat, 1, transpose);
+}
+
 void Shader::uniform(const std::string &name, const glm::mat3 &theMat, bool transpose)
 {
-	GLint loc = uniform_location(name);
-	if(loc != -1) glUniformMatrix3fv(loc, 1, ( transpose ) ? GL_TRUE : GL_FALSE,
-                                     glm::value_ptr(theMat));
+    uniform(uniform_handle(name), theMat, transpose);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::mat4 &theMat, bool transpose)
+{
+	uniform(the_handle, &theMat, 1, transpose);
 }
 
 void Shader::uniform(const std::string &name, const glm::mat4 &theMat, bool transpose)
 {
-	GLint loc = uniform_location(name);
-	if(loc != -1) glUniformMatrix4fv(loc, 1, ( transpose ) ? GL_TRUE : GL_FALSE,
-                                     glm::value_ptr(theMat));
+    uniform(uniform_handle(name), theMat, transpose);
 }
 
-void Shader::uniform(const std::string &name, const glm::mat3 *theArray, int count, bool transpose)
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::mat3 *theArray, int count, bool transpose)
 {
-    GLint loc = uniform_location(name);
+    GLint loc = m_impl->location_for_upload(the_handle, theArray, count * sizeof(glm::mat3), count, transpose);
     if(loc != -1) glUniformMatrix3fv(loc, count, ( transpose ) ? GL_TRUE : GL_FALSE,
                                      glm::value_ptr(theArray[0]));
 }
 
-void Shader::uniform(const std::string &name, const glm::mat4 *theArray, int count, bool transpose)
+void Shader::uniform(const std::string &name, const glm::mat3 *theArray, int count, bool transpose)
+{
+    uniform(uniform_handle(name), theArray, count, transpose);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const glm::mat4 *theArray, int count, bool transpose)
 {
-    GLint loc = uniform_location(name);
+    GLint loc = m_impl->location_for_upload(the_handle, theArray, count * sizeof(glm::mat4), count, transpose);
     if(loc != -1) glUniformMatrix4fv(loc, count, ( transpose ) ? GL_TRUE : GL_FALSE,
                                      glm::value_ptr(theArray[0]));
 }
 
+void Shader::uniform(const std::string &name, const glm::mat4 *theArray, int count, bool transpose)
+{
+    uniform(uniform_handle(name), theArray, count, transpose);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const std::vector<GLint> &theArray)
+{
+    if(!theArray.empty()){ uniform(the_handle, theArray.data(), theArray.size()); }
+}
+
 void Shader::uniform(const std::string &name, const std::vector<GLint> &theArray)
 {
-    GLint loc = uniform_location(name);
-    if(loc != -1) glUniform1iv(loc, theArray.size(), &theArray[0]);
+    uniform(uniform_handle(name), theArray);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const std::vector<GLuint> &theArray)
+{
+    uniform(the_handle, std::vector<GLint>(theArray.begin(), theArray.end()));
 }
 
 void Shader::uniform(const std::string &name, const std::vector<GLuint> &theArray)
 {
-    uniform(name, std::vector<GLint>(theArray.begin(), theArray.end()));
+    uniform(uniform_handle(name), theArray);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const std::vector<GLfloat> &theArray)
+{
+    if(!theArray.empty()){ uniform(the_handle, theArray.data(), theArray.size()); }
 }
 
 void Shader::uniform(const std::string &name, const std::vector<GLfloat> &theArray)
 {
-    GLint loc = uniform_location(name);
-	if(loc != -1) glUniform1fv(loc, theArray.size(), &theArray[0]);
+    uniform(uniform_handle(name), theArray);
 }
 
 //void Shader::uniform(const std::string &name, const std::vector<GLdouble> &theArray)
@@ -266,36 +494,54 @@ void Shader::uniform(const std::string &name, const std::vector<GLfloat> &theArr
 //	if(loc != -1) glUniform1dv(loc, theArray.size(), &theArray[0]);
 //}
 
+void Shader::uniform(const uniform_handle_t &the_handle, const std::vector<glm::vec2> &theArray)
+{
+    if(!theArray.empty()){ uniform(the_handle, theArray.data(), theArray.size()); }
+}
+
 void Shader::uniform(const std::string &name, const std::vector<glm::vec2> &theArray)
 {
-    GLint loc = uniform_location(name);
-	if(loc != -1) glUniform2fv(loc, theArray.size(), &theArray[0].x);
+    uniform(uniform_handle(name), theArray);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const std::vector<glm::vec3> &theArray)
+{
+    if(!theArray.empty()){ uniform(the_handle, theArray.data(), theArray.size()); }
 }
 
 void Shader::uniform(const std::string &name, const std::vector<glm::vec3> &theArray)
 {
-    GLint loc = uniform_location(name);
-	if(loc != -1) glUniform3fv(loc, theArray.size(), &theArray[0].x);
+    uniform(uniform_handle(name), theArray);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const std::vector<glm::vec4> &theArray)
+{
+    if(!theArray.empty()){ uniform(the_handle, theArray.data(), theArray.size()); }
 }
 
 void Shader::uniform(const std::string &name, const std::vector<glm::vec4> &theArray)
 {
-    GLint loc = uniform_location(name);
-	if(loc != -1) glUniform4fv(loc, theArray.size(), &theArray[0].x);
+    uniform(uniform_handle(name), theArray);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const std::vector<glm::mat3> &theArray, bool transpose)
+{
+    if(!theArray.empty()){ uniform(the_handle, theArray.data(), theArray.size(), transpose); }
 }
 
 void Shader::uniform(const std::string &name, const std::vector<glm::mat3> &theArray, bool transpose)
 {
-    GLint loc = uniform_location(name);
-    if(loc != -1) glUniformMatrix3fv(loc, theArray.size(), ( transpose ) ? GL_TRUE : GL_FALSE,
-                                     glm::value_ptr(theArray[0]));
+    uniform(uniform_handle(name), theArray, transpose);
+}
+
+void Shader::uniform(const uniform_handle_t &the_handle, const std::vector<glm::mat4> &theArray, bool transpose)
+{
+    if(!theArray.empty()){ uniform(the_handle, theArray.data(), theArray.size(), transpose); }
 }
 
 void Shader::uniform(const std::string &name, const std::vector<glm::mat4> &theArray, bool transpose)
 {
-    GLint loc = uniform_location(name);
-    if(loc != -1) glUniformMatrix4fv(loc, theArray.size(), ( transpose ) ? GL_TRUE : GL_FALSE,
-                                     glm::value_ptr(theArray[0]));
+    uniform(uniform_handle(name), theArray, transpose);
 }
 
 void Shader::bindFragDataLocation(const std::string &fragLoc)
@@ -307,15 +553,22 @@ void Shader::bindFragDataLocation(const std::string &fragLoc)
     
 GLint Shader::uniform_location(const std::string &name)
 {
-	map<string,int>::const_iterator uniformIt = m_impl->m_uniform_locations.find(name);
-	if( uniformIt == m_impl->m_uniform_locations.end() )
-    {
-		GLint loc = glGetUniformLocation(m_impl->m_Handle, name.c_str());
-        m_impl->m_uniform_locations[name] = loc;
-		return loc;
-	}
-	else
-		return uniformIt->second;
+    return m_impl->m_uniforms[m_impl->uniform_index(name)].location;
+}
+
+uniform_handle_t Shader::uniform_handle(const std::string &name)
+{
+    return {m_impl->m_generation, m_impl->uniform_index(name)};
+}
+
+uint64_t Shader::uniform_version() const
+{
+    return m_impl->m_uniform_version;
+}
+
+uint64_t Shader::generation() const
+{
+    return m_impl->m_generation;
 }
     
 GLint Shader::uniform_block_index(const std::string &name)
@@ -13,6 +13,14 @@
 
 namespace kinski { namespace gl {
 
+//! a uniform of a specific program, resolved once via Shader::uniform_handle()
+struct uniform_handle_t
+{
+    //! Shader::generation() of the program the handle was resolved for
+    uint64_t generation = 0;
+    uint32_t index = 0;
+};
+
 //! Represents an OpenGL GLSL program.
 class Shader
 {
@@ -65,6 +73,53 @@ class Shader
     void bindFragDataLocation(const std::string &fragLoc);
     
 	GLint uniform_location(const std::string &name);
+
+    /*!
+     * resolve name to a handle, avoiding the lookup by name on every upload.
+     * active uniforms are resolved at link-time. handles become stale once the program is re-linked,
+     * uploads via stale handles are ignored
+     */
+    uniform_handle_t uniform_handle(const std::string &name);
+
+    // uploads via handle
+    void uniform(const uniform_handle_t &the_handle, GLint data);
+    inline void uniform(const uniform_handle_t &the_handle, GLuint data){ uniform(the_handle, GLint(data)); };
+    void uniform(const uniform_handle_t &the_handle, GLfloat data);
+    inline void uniform(const uniform_handle_t &the_handle, double data){ uniform(the_handle, (float) data); };
+    void uniform(const uniform_handle_t &the_handle, const GLint *data, int count);
+    void uniform(const uniform_handle_t &the_handle, const ivec2 *theArray, int count);
+    void uniform(const uniform_handle_t &the_handle, const vec2 &theVec);
+    void uniform(const uniform_handle_t &the_handle, const vec3 &theVec);
+    void uniform(const uniform_handle_t &the_handle, const vec4 &theVec);
+    void uniform(const uniform_handle_t &the_handle, const mat3 &theMat, bool transpose = false);
+    void uniform(const uniform_handle_t &the_handle, const mat4 &theMat, bool transpose = false);
+    void uniform(const uniform_handle_t &the_handle, const GLfloat *theArray, int count);
+    void uniform(const uniform_handle_t &the_handle, const vec2 *theArray, int count);
+    void uniform(const uniform_handle_t &the_handle, const vec3 *theArray, int count);
+    void uniform(const uniform_handle_t &the_handle, const vec4 *theArray, int count);
+    void uniform(const uniform_handle_t &the_handle, const mat3 *theArray, int count, bool transpose = false);
+    void uniform(const uniform_handle_t &the_handle, const mat4 *theArray, int count, bool transpose = false);
+    void uniform(const uniform_handle_t &the_handle, const std::vector<GLint> &theArray);
+    void uniform(const uniform_handle_t &the_handle, const std::vector<GLuint> &theArray);
+    void uniform(const uniform_handle_t &the_handle, const std::vector<GLfloat> &theArray);
+    void uniform(const uniform_handle_t &the_handle, const std::vector<vec2> &theArray);
+    void uniform(const uniform_handle_t &the_handle, const std::vector<vec3> &theArray);
+    void uniform(const uniform_handle_t &the_handle, const std::vector<vec4> &theArray);
+    void uniform(const uniform_handle_t &the_handle, const std::vector<mat3> &theArray, bool transpose = false);
+    void uniform(const uniform_handle_t &the_handle, const std::vector<mat4> &theArray, bool transpose = false);
+
+    /*!
+     * changes whenever a uniform-value of this program is modified.
+     * uniform uploads are skipped, if the program already holds the provided value
+     */
+    uint64_t uniform_version() const;
+
+    /*!
+     * changes with every (re-)link, unique across all programs.
+     * unlike handle(), it is never re-used for a reloaded program
+     */
+    uint64_t generation() const;
+
     GLint uniform_block_index(const std::string &name);
 	bool uniform_block_binding(const std::string &name, int the_value);
 	GLint attrib_location(const std::string &name) const;
@@ -0,0 +1,175 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+#include <deque>
+#include "Skeleton.hpp"
+
+namespace kinski { namespace gl {
+
+namespace
+{
+    template<typename T>
+    void add_channel(const std::vector<Key<T>> &the_keys, std::vector<Skeleton::channel_t> &the_channels,
+                     std::vector<float> &the_times, std::vector<T> &the_values)
+    {
+        Skeleton::channel_t c;
+        c.offset = the_times.size();
+        c.count = the_keys.size();
+
+        for(const auto &k : the_keys)
+        {
+            the_times.push_back(k.time);
+            the_values.push_back(k.value);
+        }
+        the_channels.push_back(c);
+    }
+
+    /*!
+     * index of the key starting the segment containing the_time.
+     * starts at the_cursor and walks forward, falls back to a binary search if time went backwards
+     */
+    inline uint32_t find_key(const float *the_times, uint32_t the_count, float the_time, uint32_t the_cursor)
+    {
+        if(the_cursor < the_count && (!the_cursor || the_times[the_cursor] < the_time))
+        {
+            while(the_cursor + 1 < the_count && the_times[the_cursor + 1] < the_time){ the_cursor++; }
+            return the_cursor;
+        }
+        return std::lower_bound(the_times + 1, the_times + the_count, the_time) - the_times - 1;
+    }
+
+    //! interpolation-weight between the_key and its successor, wrapping around at the end of the animation
+    inline float key_fraction(const float *the_times, uint32_t the_count, uint32_t the_key, float the_time,
+                              float the_duration)
+    {
+        float start = the_times[the_key], end = the_times[(the_key + 1) % the_count];
+        if(end < start){ end += the_duration; }
+        return end > start ? std::max((the_time - start) / (end - start), 0.f) : 0.f;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+SkeletonPtr Skeleton::create(const BonePtr &the_root, const std::vector<MeshAnimation> &the_animations)
+{
+    auto ret = SkeletonPtr(new Skeleton());
+    if(!the_root){ return ret; }
+
+    // breadth-first -> parents precede their children
+    std::deque<std::pair<BonePtr, int32_t>> queue = {{the_root, -1}};
+
+    while(!queue.empty())
+    {
+        BonePtr bone = queue.front().first;
+        int32_t parent = queue.front().second;
+        queue.pop_front();
+
+        int32_t index = ret->m_bones.size();
+        ret->m_bones.push_back(bone);
+        ret->m_parents.push_back(parent);
+        ret->m_indices.push_back(bone->index);
+        ret->m_transforms.push_back(bone->transform);
+        ret->m_offsets.push_back(bone->offset);
+        ret->m_num_matrices = std::max(ret->m_num_matrices, bone->index + 1);
+
+        for(const auto &child : bone->children){ queue.push_back({child, index}); }
+    }
+
+    const AnimationKeys empty_keys;
+
+    for(const auto &anim : the_animations)
+    {
+        animation_t a;
+        a.duration = anim.duration;
+        a.ticks_per_sec = anim.ticks_per_sec;
+
+        for(const auto &bone : ret->m_bones)
+        {
+            auto it = anim.bone_keys.find(bone);
+            const AnimationKeys &keys = it != anim.bone_keys.end() ? it->second : empty_keys;
+            add_channel(keys.positionkeys, a.position_channels, a.position_times, a.positions);
+            add_channel(keys.rotationkeys, a.rotation_channels, a.rotation_times, a.rotations);
+            add_channel(keys.scalekeys, a.scale_channels, a.scale_times, a.scales);
+        }
+        ret->m_animations.push_back(std::move(a));
+    }
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Skeleton::evaluate(uint32_t the_index, float the_time, std::vector<uint32_t> &the_cursors,
+                        std::vector<mat4> &the_out_transforms, std::vector<mat4> &the_out_matrices) const
+{
+    const uint32_t n = m_bones.size();
+    the_cursors.resize(3 * n, 0);
+    the_out_transforms.resize(n);
+    the_out_matrices.resize(m_num_matrices);
+    if(the_index >= m_animations.size()){ return; }
+
+    const animation_t &anim = m_animations[the_index];
+
+    for(uint32_t i = 0; i < n; ++i)
+    {
+        const channel_t &pc = anim.position_channels[i], &rc = anim.rotation_channels[i],
+                &sc = anim.scale_channels[i];
+        uint32_t *cursors = &the_cursors[3 * i];
+
+        mat4 bone_transform;
+
+        // a single scale-key does not animate a bone on its own
+        if(pc.count || rc.count || sc.count > 1)
+        {
+            vec3 position(0), scale(1);
+            quat rotation(1.f, 0.f, 0.f, 0.f);
+
+            if(pc.count)
+            {
+                const float *times = &anim.position_times[pc.offset];
+                const vec3 *values = &anim.positions[pc.offset];
+                uint32_t k = cursors[0] = find_key(times, pc.count, the_time, cursors[0]);
+                float frac = key_fraction(times, pc.count, k, the_time, anim.duration);
+                position = glm::mix(values[k], values[(k + 1) % pc.count], frac);
+            }
+
+            if(rc.count)
+            {
+                const float *times = &anim.rotation_times[rc.offset];
+                const quat *values = &anim.rotations[rc.offset];
+                uint32_t k = cursors[1] = find_key(times, rc.count, the_time, cursors[1]);
+                float frac = key_fraction(times, rc.count, k, the_time, anim.duration);
+                rotation = glm::slerp(values[k], values[(k + 1) % rc.count], frac);
+            }
+
+            if(sc.count)
+            {
+                const float *times = &anim.scale_times[sc.offset];
+                const vec3 *values = &anim.scales[sc.offset];
+                uint32_t k = cursors[2] = find_key(times, sc.count, the_time, cursors[2]);
+                float frac = key_fraction(times, sc.count, k, the_time, anim.duration);
+                scale = glm::mix(values[k], values[(k + 1) % sc.count], frac);
+            }
+
+            // translation * rotation * scale
+            bone_transform = glm::mat4_cast(rotation);
+            bone_transform[0] *= scale.x;
+            bone_transform[1] *= scale.y;
+            bone_transform[2] *= scale.z;
+            bone_transform[3] = vec4(position, 1.f);
+        }
+        else{ bone_transform = m_transforms[i]; }
+
+        // parents are already evaluated
+        the_out_transforms[i] = m_parents[i] < 0 ? bone_transform :
+                                the_out_transforms[m_parents[i]] * bone_transform;
+        the_out_matrices[m_indices[i]] = the_out_transforms[i] * m_offsets[i];
+    }
+}
+
+}}//namespace
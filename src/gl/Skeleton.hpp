@@ -0,0 +1,86 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+//  Skeleton.hpp
+//
+//  Compiled bone-hierarchy and animations for fast evaluation
+
+#pragma once
+
+#include "Mesh.hpp"
+
+namespace kinski { namespace gl {
+
+/*!
+ * Immutable, flattened representation of a bone-hierarchy and its animations.
+ * Bones are stored in topological order (parents precede their children),
+ * animation-keys are stored as separate arrays of key-times and values.
+ */
+class Skeleton
+{
+public:
+
+    //! range of keys for one bone and key-type
+    struct channel_t
+    {
+        uint32_t offset = 0;
+        uint32_t count = 0;
+    };
+
+    struct animation_t
+    {
+        float duration = 0.f;
+        float ticks_per_sec = 1.f;
+
+        //! per bone: position-, rotation- and scale-channel
+        std::vector<channel_t> position_channels, rotation_channels, scale_channels;
+
+        std::vector<float> position_times, rotation_times, scale_times;
+        std::vector<vec3> positions, scales;
+        std::vector<quat> rotations;
+    };
+
+    static SkeletonPtr create(const BonePtr &the_root, const std::vector<MeshAnimation> &the_animations);
+
+    inline uint32_t num_bones() const { return m_bones.size(); }
+
+    //! number of bone-matrices, sufficient for all Bone::index values
+    inline uint32_t num_matrices() const { return m_num_matrices; }
+
+    //! the original bones, in topological order
+    inline const std::vector<BonePtr>& bones() const { return m_bones; }
+
+    //! parent-indices into bones(), -1 for the root
+    inline const std::vector<int32_t>& parents() const { return m_parents; }
+
+    inline const std::vector<animation_t>& animations() const { return m_animations; }
+
+    /*!
+     * evaluate animation the_index at the_time (in ticks).
+     * world-transforms are written to the_out_transforms (in topological order),
+     * skinning-matrices to the_out_matrices (indexed by Bone::index).
+     * the_cursors caches key-indices between calls, playing forward only advances them
+     */
+    void evaluate(uint32_t the_index, float the_time, std::vector<uint32_t> &the_cursors,
+                  std::vector<mat4> &the_out_transforms, std::vector<mat4> &the_out_matrices) const;
+
+private:
+
+    Skeleton() = default;
+
+    std::vector<BonePtr> m_bones;
+    std::vector<int32_t> m_parents;
+    std::vector<uint32_t> m_indices;
+    std::vector<mat4> m_transforms;
+    std::vector<mat4> m_offsets;
+    std::vector<animation_t> m_animations;
+    uint32_t m_num_matrices = 0;
+};
+
+}}//namespace
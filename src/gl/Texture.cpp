@@ -28,7 +28,11 @@ struct TextureImpl
     
     ~TextureImpl()
     {
-        if(m_texture_id && !m_do_not_dispose){ glDeleteTextures(1, &m_texture_id); }
+        if(m_texture_id && !m_do_not_dispose)
+        {
+            if(gl::context()){ gl::context()->texture_deleted(m_texture_id); }
+            glDeleteTextures(1, &m_texture_id);
+        }
     }
 
     
@@ -94,14 +98,14 @@ void Texture::init(const void *data, GLint dataFormat, const Format &format)
     if(!m_impl->m_texture_id)
     {
         glGenTextures(1, &m_impl->m_texture_id);
-        glBindTexture(m_impl->m_target, m_impl->m_texture_id);
+        gl::context()->bind_texture(m_impl->m_target, m_impl->m_texture_id);
         glTexParameteri(m_impl->m_target, GL_TEXTURE_WRAP_S, format.wrap_s);
         glTexParameteri(m_impl->m_target, GL_TEXTURE_WRAP_T, format.wrap_t);
         glTexParameteri(m_impl->m_target, GL_TEXTURE_MIN_FILTER, format.min_filter);
         glTexParameteri(m_impl->m_target, GL_TEXTURE_MAG_FILTER, format.mag_filter);
         KINSKI_CHECK_GL_ERRORS();
     }
-    else{ glBindTexture(m_impl->m_target, m_impl->m_texture_id); }
+    else{ gl::context()->bind_texture(m_impl->m_target, m_impl->m_texture_id); }
     
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     
@@ -174,7 +178,7 @@ void Texture::update(const void *data, GLenum data_type, GLenum data_format, int
        m_impl->m_height == theHeight &&
        m_impl->m_datatype == data_type)
     {
-        glBindTexture(m_impl->m_target, m_impl->m_texture_id);
+        gl::context()->bind_texture(m_impl->m_target, m_impl->m_texture_id);
         glTexSubImage2D(m_impl->m_target, 0, 0, 0, m_impl->m_width, m_impl->m_height, data_format, data_type, data);
     }
     else 
@@ -377,7 +381,7 @@ void Texture::set_mipmapping(bool b)
         {
             bind();
 #if !defined(KINSKI_GLES_2)
-            if(m_impl->m_target == GL_TEXTURE_CUBE_MAP){ glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS); }
+            if(m_impl->m_target == GL_TEXTURE_CUBE_MAP){ gl::context()->set_enabled(GL_TEXTURE_CUBE_MAP_SEAMLESS, true); }
 #endif
             glGenerateMipmap(m_impl->m_target);
             set_min_filter(GL_LINEAR_MIPMAP_LINEAR);
@@ -480,24 +484,20 @@ void Texture::bind(GLuint textureUnit) const
 {
     if(!m_impl) throw TextureDataExc("Texture not initialized ...");
     m_impl->m_bound_texture_unit = textureUnit;
-	glActiveTexture(GL_TEXTURE0 + textureUnit);
-	glBindTexture(m_impl->m_target, m_impl->m_texture_id);
-	glActiveTexture(GL_TEXTURE0);
+    gl::context()->bind_texture(m_impl->m_target, m_impl->m_texture_id, textureUnit);
 }
 
 void Texture::unbind(GLuint textureUnit) const
 {
     if(!m_impl) throw TextureDataExc("Texture not initialized ...");
     m_impl->m_bound_texture_unit = -1;
-	glActiveTexture(GL_TEXTURE0 + textureUnit);
-	glBindTexture(m_impl->m_target, 0);
-	glActiveTexture(GL_TEXTURE0);
+    gl::context()->bind_texture(m_impl->m_target, 0, textureUnit);
 }
 
 void Texture::enable_and_bind() const
 {
 	glEnable(m_impl->m_target);
-	glBindTexture(m_impl->m_target, m_impl->m_texture_id);
+	gl::context()->bind_texture(m_impl->m_target, m_impl->m_texture_id);
 }
 
 void Texture::disable() const
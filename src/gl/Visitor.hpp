@@ -38,7 +38,9 @@ namespace kinski { namespace gl {
         {
             if(theNode.enabled() || !visit_only_enabled())
             {
-                m_transform_stack.push(m_transform_stack.top() * theNode.transform());
+                // read-only access, keeps cached world-transforms intact
+                const Object3D &node = theNode;
+                m_transform_stack.push(m_transform_stack.top() * node.transform());
                 for (Object3DPtr &child : theNode.children()){child->accept(*this);}
                 m_transform_stack.pop();
             }
@@ -49,14 +51,18 @@ namespace kinski { namespace gl {
 
     protected:
         
+        //! an empty filter accepts everything, otherwise at least one tag needs to match
+        static inline bool check_tags(const tag_filter_t &the_filter, const gl::Object3D &the_object)
+        {
+            return the_object.matches(the_filter);
+        }
+
         inline bool check_tags(const std::set<std::string> &filter_tags,
                                const std::set<std::string> &obj_tags)
         {
-            for(const auto &t : obj_tags)
-            {
-                if(crocore::contains(filter_tags, t)){ return true; }
-            }
-            return filter_tags.empty();
+            if(filter_tags.empty()){ return true; }
+            for(const auto &t : filter_tags){ if(obj_tags.count(t)){ return true; } }
+            return false;
         }
         
     private:
@@ -70,21 +76,22 @@ namespace kinski { namespace gl {
     public:
         SelectVisitor(const std::set<std::string> &the_tags = {}, bool select_only_enabled = true):
         Visitor(select_only_enabled),
-        m_tags(the_tags){}
+        m_tags(the_tags),
+        m_tag_filter(the_tags){}
         
         void visit(T &theNode) override
         {
             if(theNode.enabled() || !visit_only_enabled())
             {
-                if(check_tags(m_tags, theNode.tags())){ m_objects.push_back(&theNode); }
+                if(check_tags(m_tag_filter, theNode)){ m_objects.push_back(&theNode); }
                 Visitor::visit(static_cast<gl::Object3D&>(theNode));
             }
         };
         
         const std::set<std::string>& tags() const { return m_tags; }
-        void set_tags(const std::set<std::string>& the_tags){ m_tags = the_tags; }
-        void add_tag(const std::string& the_tag){ m_tags.insert(the_tag); }
-        void remove_tag(const std::string& the_tag){ m_tags.erase(the_tag); }
+        void set_tags(const std::set<std::string>& the_tags){ m_tags = the_tags; m_tag_filter = tag_filter_t(m_tags); }
+        void add_tag(const std::string& the_tag){ m_tags.insert(the_tag); m_tag_filter = tag_filter_t(m_tags); }
+        void remove_tag(const std::string& the_tag){ m_tags.erase(the_tag); m_tag_filter = tag_filter_t(m_tags); }
         
         void clear(){ m_objects.clear(); }
         const std::list<T*>& get_objects() const {return m_objects;};
@@ -92,6 +99,7 @@ namespace kinski { namespace gl {
     private:
         std::list<T*> m_objects;
         std::set<std::string> m_tags;
+        tag_filter_t m_tag_filter;
     };
     
 }}//namespace
@@ -11,9 +11,12 @@
 //
 //  Created by Croc Dialer on 25/08/15.
 
+#include <sstream>
 #include "Warp.hpp"
 #include "gl/Mesh.hpp"
 #include "gl/Camera.hpp"
+#include "gl/Fbo.hpp"
+#include "gl/Shader.hpp"
 #include "gl/BSpline.hpp"
 
 namespace kinski {
@@ -40,6 +43,133 @@ const std::vector<gl::vec2> default_points = {gl::vec2(0, 1), gl::vec2(1, 1), gl
                                               gl::vec2(1, 0)};
 
 const crocore::Area_<float> default_roi = {0.f, 0.f, 1.f, 1.f};
+
+#if !defined(KINSKI_GLES)
+
+//! lookup-textures sampled by a single compositing pass, one texture-unit remains for the source
+constexpr uint32_t g_max_warps_per_pass = 15;
+
+const char *g_matrix_block = R"(#version 410 core
+
+struct matrix_struct_t
+{
+    mat4 model_view;
+    mat4 model_view_projection;
+    mat4 texture_matrix;
+    mat3 normal_matrix;
+};
+
+layout(std140) uniform MatrixBlock
+{
+    matrix_struct_t ubo;
+};
+)";
+
+//! rasterise the warp-grid, storing its texture-coordinates and soft-edge alpha
+const char *g_lut_vert = R"(
+layout(location = 0) in vec4 a_vertex;
+layout(location = 2) in vec4 a_texCoord;
+layout(location = 3) in vec4 a_color;
+
+out vec3 v_lut;
+
+void main()
+{
+    v_lut = vec3(a_texCoord.xy, a_color.a);
+    gl_Position = ubo.model_view_projection * a_vertex;
+}
+)";
+
+const char *g_lut_frag = R"(#version 410 core
+
+in vec3 v_lut;
+out vec4 fragData;
+
+void main()
+{
+    // (u, v, alpha, coverage)
+    fragData = vec4(v_lut, 1.0);
+}
+)";
+
+const char *g_composite_vert = R"(
+layout(location = 0) in vec4 a_vertex;
+
+void main()
+{
+    gl_Position = ubo.model_view_projection * a_vertex;
+}
+)";
+
+//! blend the source, as looked up by each warp, in order (premultiplied alpha)
+const char *g_composite_frag = R"(
+uniform mat4 u_texture_matrix[NUM_WARPS];
+uniform vec2 u_window_dimension;
+uniform vec2 u_texture_size = vec2(1.0);
+uniform float u_brightness = 1.0;
+
+out vec4 fragData;
+
+vec4 source(vec2 the_coord)
+{
+#ifdef RECT_SOURCE
+    return texture(u_sampler_2Drect[0], the_coord * u_texture_size);
+#else
+    return texture(u_sampler_2D[0], the_coord);
+#endif
+}
+
+vec4 composite(vec4 the_dst, vec4 the_lut, mat4 the_texture_matrix)
+{
+    if(the_lut.a == 0.0){ return the_dst; }
+    vec4 color = source((the_texture_matrix * vec4(the_lut.xy, 0.0, 1.0)).xy);
+    float alpha = color.a * the_lut.z;
+    return vec4(u_brightness * color.rgb * alpha, alpha) + (1.0 - alpha) * the_dst;
+}
+
+void main()
+{
+    vec2 coord = gl_FragCoord.xy / u_window_dimension;
+    vec4 color = vec4(0.0);
+COMPOSITE_WARPS
+    fragData = color;
+}
+)";
+
+//! compositing-shader for the_num_warps lookup-textures, sampler-indices are unrolled
+gl::ShaderPtr composite_shader(uint32_t the_num_warps, bool the_rect_source)
+{
+    static std::map<std::pair<uint32_t, bool>, gl::ShaderPtr> shader_map;
+    auto &ret = shader_map[std::make_pair(the_num_warps, the_rect_source)];
+
+    if(!ret)
+    {
+        uint32_t lut_offset = the_rect_source ? 0 : 1;
+        std::stringstream ss;
+        ss << "#define NUM_WARPS " << the_num_warps << "\n";
+
+        if(the_rect_source)
+        {
+            ss << "#define RECT_SOURCE\n";
+            ss << "uniform sampler2DRect u_sampler_2Drect[1];\n";
+        }
+        ss << "uniform sampler2D u_sampler_2D[" << the_num_warps + lut_offset << "];\n";
+
+        std::stringstream warps;
+        for(uint32_t i = 0; i < the_num_warps; ++i)
+        {
+            warps << "    color = composite(color, texture(u_sampler_2D[" << i + lut_offset << "], coord), "
+                  << "u_texture_matrix[" << i << "]);\n";
+        }
+        std::string frag = g_composite_frag;
+        frag.replace(frag.find("COMPOSITE_WARPS"), std::string("COMPOSITE_WARPS").size(), warps.str());
+        ret = gl::Shader::create(std::string(g_matrix_block) + g_composite_vert,
+                                 "#version 410 core\n" + ss.str() + frag);
+    }
+    return ret;
+}
+
+#endif
 };
 
 struct WarpImpl
@@ -65,6 +195,30 @@ struct WarpImpl
 
     gl::vec4 m_edges = gl::vec4(0, 1, 1, 0), m_edge_exponents = gl::vec4(1);
 
+    //! interpolation-weights for a grid-column or -row, applied to 4 consecutive control points
+    struct basis_t
+    {
+        int index = 0;
+        float weights[4] = {0.f, 1.f, 0.f, 0.f};
+        float alpha = 1.f;
+    };
+    std::vector<basis_t> m_basis_u, m_basis_v;
+
+    //! control points, extrapolated by one column/row before and two after the edges
+    std::vector<gl::vec2> m_padded_points;
+
+    //! warped grid-vertices (x, y, alpha), before they are written to the geometries
+    std::vector<gl::vec3> m_warped_points;
+
+#if !defined(KINSKI_GLES)
+    // displacement/alpha lookup-texture, rasterised from m_mesh
+    gl::MeshPtr m_lut_mesh;
+    gl::FboPtr m_lut_fbo;
+    gl::Texture m_lut_texture;
+    gl::mat4 m_lut_transform;
+    bool m_dirty_lut = true;
+#endif
+
     WarpImpl()
     {
         create_mesh(m_grid_num_w, m_grid_num_h);
@@ -94,92 +248,12 @@ struct WarpImpl
         mat->set_depth_write(false);
         mat->set_blending(true);
         m_mesh = gl::Mesh::create(geom, mat);
-        m_dirty_subs = true;
-    }
-
-    void update_mesh()
-    {
-        vec2 p;
-        float u, v;
-        int col, row;
-
-        uint32_t index = 0;
-        auto &verts = m_mesh->geometry()->vertices();
-        auto &colors = m_mesh->geometry()->colors();
-
-        std::vector<vec2> cols, rows;
-
-        for(uint32_t y = 0; y < m_grid_num_h + 1; ++y)
-        {
-            for(uint32_t x = 0; x < m_grid_num_w + 1; ++x, ++index)
-            {
-                // transform coordinates to [0..numControls]
-                u = x * (m_num_subdivisions.x) / (float)(m_grid_num_w);
-                v = y * (m_num_subdivisions.y) / (float)(m_grid_num_h);
-
-                // determine col and row
-                col = (int)(u);
-                row = (int)(v);
-
-                // normalize coordinates to [0..1]
-                u -= col;
-                v -= row;
-
-                if(!m_cubic_interpolation)
-                {
-                    // perform linear interpolation
-                    vec2 p1 = mix(control_point(col, row), control_point(col + 1, row), u);
-                    vec2 p2 = mix(control_point(col, row + 1), control_point(col + 1, row + 1), u);
-                    p = mix(p1, p2, v);
-                }else
-                {
-                    // perform bicubic interpolation
-                    rows.clear();
-                    for(int i = -1; i < 3; ++i)
-                    {
-                        cols.clear();
-                        for(int j = -1; j < 3; ++j)
-                        {
-                            cols.push_back(control_point(col + i, row + j));
-                        }
-                        rows.push_back(cubic_interpolate(cols, v));
-                    }
-                    p = cubic_interpolate(rows, u);
-                }
-                verts[index] = vec3(p, 0);
-
-                //softedges
-                float alpha = 1.f;
-                float edge_u = x / (float)(m_grid_num_w);
-                float edge_v = y / (float)(m_grid_num_h);
-
-                if(m_edges.x > 0)
-                {
-                    alpha *= std::pow(crocore::clamp(edge_v / m_edges.x, 0.f, 1.f), m_edge_exponents.x);
-                }
-                if(m_edges.z < 1.f)
-                {
-                    alpha *= std::pow(crocore::map_value(edge_v, 1.f, m_edges.z, 0.f, 1.f), m_edge_exponents.z);
-                }
-                if(m_edges.w > 0)
-                {
-                    alpha *= std::pow(crocore::clamp(edge_u / m_edges.w, 0.f, 1.f), m_edge_exponents.w);
-                }
-                if(m_edges.y < 1.f)
-                {
-                    alpha *= std::pow(crocore::map_value(edge_u, 1.f, m_edges.y, 0.f, 1.f), m_edge_exponents.y);
-                }
 
-                colors[index].a = alpha;
-            }
-        }
-        m_dirty_subs = false;
-
-        // recreate grid mesh
+        // grid-topology only depends on the resolution, positions are updated in update_mesh()
         auto grid_geom = gl::Geometry::create();
-        grid_geom->append_vertices(m_mesh->geometry()->vertices());
+        grid_geom->append_vertices(geom->vertices());
         grid_geom->set_primitive_type(GL_LINES);
-        grid_geom->colors().resize(m_mesh->geometry()->vertices().size(), gl::COLOR_WHITE);
+        grid_geom->colors().resize(geom->vertices().size(), gl::COLOR_WHITE);
         auto &indices = grid_geom->indices();
 
         uint32_t num_w = m_grid_num_w + 1, num_h = m_grid_num_h + 1;
@@ -208,6 +282,201 @@ struct WarpImpl
         grid_mat->set_depth_test(false);
         grid_mat->set_depth_write(false);
         m_grid_mesh = gl::Mesh::create(grid_geom, grid_mat);
+
+#if !defined(KINSKI_GLES)
+        auto lut_mat = gl::Material::create(gl::Shader::create(std::string(g_matrix_block) + g_lut_vert, g_lut_frag));
+        lut_mat->set_depth_test(false);
+        lut_mat->set_depth_write(false);
+        lut_mat->set_blending(false);
+        lut_mat->set_two_sided();
+        m_lut_mesh = gl::Mesh::create(geom, lut_mat);
+#endif
+        m_dirty_subs = true;
+    }
+
+    //! weights and soft-edge alpha for grid-column/row the_i of the_num_grid
+    basis_t create_basis(uint32_t the_i, uint32_t the_num_grid, int the_num_subs, float the_edge_begin,
+                         float the_edge_end, float the_exp_begin, float the_exp_end) const
+    {
+        basis_t ret;
+
+        // transform coordinates to [0..numControls]
+        float t = the_i * the_num_subs / (float)the_num_grid;
+
+        // determine col/row and normalize to [0..1]
+        ret.index = (int)t;
+        t -= ret.index;
+
+        if(!m_cubic_interpolation)
+        {
+            ret.weights[1] = 1.f - t;
+            ret.weights[2] = t;
+        }else
+        {
+            // catmull-rom, see cubic_interpolate()
+            float t2 = t * t, t3 = t2 * t;
+            ret.weights[0] = 0.5f * (-t + 2.f * t2 - t3);
+            ret.weights[1] = 0.5f * (2.f - 5.f * t2 + 3.f * t3);
+            ret.weights[2] = 0.5f * (t + 4.f * t2 - 3.f * t3);
+            ret.weights[3] = 0.5f * (-t2 + t3);
+        }
+
+        //softedges
+        float edge = the_i / (float)the_num_grid;
+
+        if(the_edge_begin > 0)
+        {
+            ret.alpha *= std::pow(crocore::clamp(edge / the_edge_begin, 0.f, 1.f), the_exp_begin);
+        }
+        if(the_edge_end < 1.f)
+        {
+            ret.alpha *= std::pow(crocore::map_value(edge, 1.f, the_edge_end, 0.f, 1.f), the_exp_end);
+        }
+        return ret;
+    }
+
+    void update_mesh()
+    {
+        const int num_x = m_num_subdivisions.x, num_y = m_num_subdivisions.y, stride = num_x + 4;
+        m_padded_points.resize(stride * (num_y + 4));
+
+        for(int y = -1; y <= num_y + 2; ++y)
+        {
+            for(int x = -1; x <= num_x + 2; ++x){ m_padded_points[x + 1 + (y + 1) * stride] = control_point(x, y); }
+        }
+
+        // soft-edges are separable, so alpha is evaluated per column and row
+        m_basis_u.resize(m_grid_num_w + 1);
+        m_basis_v.resize(m_grid_num_h + 1);
+
+        for(uint32_t x = 0; x < m_grid_num_w + 1; ++x)
+        {
+            m_basis_u[x] = create_basis(x, m_grid_num_w, num_x, m_edges.w, m_edges.y, m_edge_exponents.w,
+                                        m_edge_exponents.y);
+        }
+        for(uint32_t y = 0; y < m_grid_num_h + 1; ++y)
+        {
+            m_basis_v[y] = create_basis(y, m_grid_num_h, num_y, m_edges.x, m_edges.z, m_edge_exponents.x,
+                                        m_edge_exponents.z);
+        }
+
+        const uint32_t num_verts = (m_grid_num_w + 1) * (m_grid_num_h + 1);
+        m_warped_points.resize(num_verts);
+        uint32_t index = 0;
+
+        for(uint32_t y = 0; y < m_grid_num_h + 1; ++y)
+        {
+            const basis_t &bv = m_basis_v[y];
+
+            for(uint32_t x = 0; x < m_grid_num_w + 1; ++x, ++index)
+            {
+                const basis_t &bu = m_basis_u[x];
+                vec2 p;
+
+                // tensor-product of linear or bicubic interpolation
+                for(int j = 0; j < 4; ++j)
+                {
+                    if(bv.weights[j] == 0.f){ continue; }
+                    const vec2 *cp = &m_padded_points[bu.index + (bv.index + j) * stride];
+                    vec2 row = bu.weights[0] * cp[0] + bu.weights[1] * cp[1] + bu.weights[2] * cp[2] +
+                               bu.weights[3] * cp[3];
+                    p += bv.weights[j] * row;
+                }
+                m_warped_points[index] = vec3(p, bu.alpha * bv.alpha);
+            }
+        }
+        m_dirty_subs = false;
+
+        // moving a single control point only affects a band of grid-rows, find the modified range
+        const gl::Geometry &geom = *m_mesh->geometry();
+        uint32_t first = num_verts, end = 0;
+
+        for(uint32_t i = 0; i < num_verts; ++i)
+        {
+            const vec3 &wp = m_warped_points[i];
+
+            if(wp.xy() != geom.vertices()[i].xy() || wp.z != geom.colors()[i].a)
+            {
+                first = std::min(first, i);
+                end = i + 1;
+            }
+        }
+
+        if(first < end)
+        {
+            // only the modified range is uploaded, grid-topology is unchanged
+            auto &verts = m_mesh->geometry()->vertices(first, end - first);
+            auto &colors = m_mesh->geometry()->colors(first, end - first);
+            auto &grid_verts = m_grid_mesh->geometry()->vertices(first, end - first);
+
+            for(uint32_t i = first; i < end; ++i)
+            {
+                verts[i] = grid_verts[i] = vec3(m_warped_points[i].xy(), 0.f);
+                colors[i].a = m_warped_points[i].z;
+            }
+        }
+
+#if !defined(KINSKI_GLES)
+        m_dirty_lut = true;
+#endif
+    }
+
+#if !defined(KINSKI_GLES)
+    /*!
+     * lookup-texture of the_size, holding (u, v, alpha, coverage) per output-pixel.
+     * only rasterised again after the mesh, the_transform or the_size changed
+     */
+    const gl::Texture& lut(const gl::mat4 &the_transform, const gl::ivec2 &the_size)
+    {
+        if(m_dirty_subs){ update_mesh(); }
+
+        if(!m_lut_fbo || m_lut_fbo->size() != the_size)
+        {
+            gl::Fbo::Format fmt;
+            fmt.color_internal_format = GL_RGBA32F;
+            fmt.data_type = GL_FLOAT;
+            fmt.depth_buffer = false;
+            m_lut_fbo = gl::Fbo::create(the_size.x, the_size.y, fmt);
+
+            // sampled at pixel-centers, no filtering across the warp-boundary
+            m_lut_fbo->texture().set_min_filter(GL_NEAREST);
+            m_lut_fbo->texture().set_mag_filter(GL_NEAREST);
+            m_dirty_lut = true;
+        }
+
+        if(m_dirty_lut || the_transform != m_lut_transform)
+        {
+            m_lut_texture = gl::render_to_texture(m_lut_fbo, [this, &the_transform]()
+            {
+                gl::clear(gl::vec4(0));
+                gl::ScopedMatrixPush model(MODEL_VIEW_MATRIX), projection(PROJECTION_MATRIX);
+                gl::set_matrices(m_camera);
+                gl::mult_matrix(MODEL_VIEW_MATRIX, the_transform);
+                gl::draw_mesh(m_lut_mesh);
+            });
+            m_lut_transform = the_transform;
+            m_dirty_lut = false;
+        }
+        return m_lut_texture;
+    }
+#endif
+
+    //! the_texture, restricted to m_src_area
+    gl::Texture roi_texture(const gl::Texture &the_texture) const
+    {
+        gl::Texture roi_tex = the_texture;
+
+        if(m_src_area != default_roi)
+        {
+            uvec2 sz(the_texture.width() - 1, the_texture.height() - 1);
+
+            crocore::Area_<uint32_t> abs_roi = {static_cast<uint32_t>(m_src_area.x * sz.x),
+                                                static_cast<uint32_t>(m_src_area.y * sz.y),
+                                                static_cast<uint32_t>(m_src_area.width * sz.x),
+                                                static_cast<uint32_t>(m_src_area.height * sz.y)};
+            roi_tex.set_roi(abs_roi);
+        }
+        return roi_tex;
     }
 
     void set_num_subdivisions_x(uint32_t the_num_subs_x)
@@ -386,38 +655,65 @@ Warp::Warp() : m_impl(new WarpImpl) {}
 
 void Warp::render_output(const gl::Texture &the_texture, const float the_brightness)
 {
+#if !defined(KINSKI_GLES)
+    render_warps({this}, the_texture, the_brightness);
+#else
     if(m_impl->m_dirty_subs){ m_impl->update_mesh(); }
     if(!the_texture){ return; }
 
-#if !defined(KINSKI_GLES)
-    if(the_texture.target() == GL_TEXTURE_RECTANGLE)
-    {
-        m_impl->m_mesh->material()->set_shader(gl::create_shader(gl::ShaderType::RECT_2D));
-        m_impl->m_mesh->material()->uniform("u_texture_size", the_texture.size());
-    }else{ m_impl->m_mesh->material()->set_shader(gl::create_shader(gl::ShaderType::UNLIT)); }
-
+    m_impl->m_mesh->material()->add_texture(m_impl->roi_texture(the_texture), Texture::Usage::COLOR);
+    m_impl->m_mesh->material()->set_diffuse(gl::Color(the_brightness, the_brightness,
+                                                      the_brightness, 1.f));
+    gl::ScopedMatrixPush model(MODEL_VIEW_MATRIX), projection(PROJECTION_MATRIX);
+    gl::set_matrices(m_impl->m_camera);
+    gl::mult_matrix(MODEL_VIEW_MATRIX, transform());
+    gl::draw_mesh(m_impl->m_mesh);
 #endif
-    gl::Texture roi_tex = the_texture;
-    if(m_impl->m_src_area != default_roi)
+}
+
+void render_warps(const std::vector<Warp*> &the_warps, const gl::Texture &the_texture, float the_brightness)
+{
+#if defined(KINSKI_GLES)
+    for(auto w : the_warps){ w->render_output(the_texture, the_brightness); }
+#else
+    if(!the_texture){ return; }
+    bool rect_source = the_texture.target() == GL_TEXTURE_RECTANGLE;
+    gl::ivec2 size = gl::window_dimension();
+
+    static gl::MaterialPtr material;
+
+    if(!material)
     {
-        uvec2 sz(the_texture.width() - 1, the_texture.height() - 1);
+        material = gl::Material::create();
+        material->set_depth_test(false);
+        material->set_depth_write(false);
+        material->set_blending(true);
 
-        crocore::Area_<uint32_t> abs_roi = {static_cast<uint32_t>(m_impl->m_src_area.x * sz.x),
-                                            static_cast<uint32_t>(m_impl->m_src_area.y * sz.y),
-                                            static_cast<uint32_t>(m_impl->m_src_area.width * sz.x),
-                                            static_cast<uint32_t>(m_impl->m_src_area.height * sz.y)};
-        roi_tex.set_roi(abs_roi);
+        // warps are composited with premultiplied alpha
+        material->set_blend_factors(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     }
+    material->uniform("u_brightness", the_brightness);
+    material->uniform("u_texture_size", gl::vec2(the_texture.size()));
 
-    m_impl->m_mesh->material()->add_texture(roi_tex, Texture::Usage::COLOR);
+    for(size_t first = 0; first < the_warps.size(); first += g_max_warps_per_pass)
+    {
+        uint32_t num_warps = std::min<size_t>(the_warps.size() - first, g_max_warps_per_pass);
+        std::vector<gl::mat4> texture_matrices(num_warps);
 
-    m_impl->m_mesh->material()->set_diffuse(gl::Color(the_brightness, the_brightness,
-                                                      the_brightness, 1.f));
+        material->clear_textures();
+        material->add_texture(the_texture, 0);
 
-    gl::ScopedMatrixPush model(MODEL_VIEW_MATRIX), projection(PROJECTION_MATRIX);
-    gl::set_matrices(m_impl->m_camera);
-    gl::mult_matrix(MODEL_VIEW_MATRIX, transform());
-    gl::draw_mesh(m_impl->m_mesh);
+        for(uint32_t i = 0; i < num_warps; ++i)
+        {
+            Warp *w = the_warps[first + i];
+            material->add_texture(w->m_impl->lut(w->transform(), size), i + 1);
+            texture_matrices[i] = w->m_impl->roi_texture(the_texture).transform();
+        }
+        material->uniform("u_texture_matrix", texture_matrices);
+        material->set_shader(composite_shader(num_warps, rect_source));
+        gl::draw_quad(gl::window_dimension(), material);
+    }
+#endif
 }
 
 void Warp::render_control_points()
@@ -81,9 +81,19 @@ namespace kinski{ namespace gl{
         void reset();
         
     private:
-        
+
+        friend void render_warps(const std::vector<Warp*> &the_warps, const gl::Texture &the_texture,
+                                 float the_brightness);
         std::shared_ptr<struct WarpImpl> m_impl;
     };
+
+    /*!
+     * composite the_warps over the current framebuffer, sampling the_texture.
+     * each warp is baked into a displacement/alpha lookup-texture, which is only updated after the warp changed.
+     * all warps are then resolved within a single fullscreen pass, later warps are blended over earlier ones
+     */
+    void render_warps(const std::vector<Warp*> &the_warps, const gl::Texture &the_texture,
+                      float the_brightness = 1.f);
     
 
 }}// namespaces
@@ -0,0 +1,939 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+//  render_benchmark.cpp
+//
+//  Headless benchmark for SceneRenderer and DeferredRenderer.
+//  Renders procedural scenes into an offscreen Fbo, using an EGL pbuffer- or surfaceless context,
+//  and writes timings per stage, draw-calls and state-changes as JSON.
+//
+//  usage: render_benchmark [--meshes N] [--lights N] [--shadows N] [--skinned N] [--labels N]
+//                          [--frames N] [--warmup N] [--width N] [--height N] [--seed N]
+//                          [--renderer forward|deferred|both] [--font path] [--no-readback]
+//                          [--clustered] [--light-sweep] [--scenegraph] [--nodes N] [--pick] [--picks N]
+//                          [--tag string] [--output path]
+//
+//  --clustered additionally benchmarks the DeferredRenderer with clustered lighting.
+//  --light-sweep repeats all runs for 10 to 1000 lights, instead of using --lights.
+//  --scenegraph times cached global transforms and bounds of a tree with --nodes objects (default: 100k)
+//  against an uncached walk up the hierarchy.
+//  --pick times Scene::pick against a linear pick, testing every object and triangle, for --picks rays
+//  (default: 1000) into the benchmark-scene. these cpu-only timings are reported as "cpu_stages".
+//  light-binning and skeletal animation are reported as the stages ".../light-grid" and "update/animation"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <crocore/ThreadPool.hpp>
+#include "gl/Camera.hpp"
+#include "gl/Light.hpp"
+#include "gl/Mesh.hpp"
+#include "gl/Scene.hpp"
+#include "gl/Fbo.hpp"
+#include "gl/Font.hpp"
+#include "gl/DeferredRenderer.hpp"
+#include "gl/Profiler.hpp"
+
+using namespace kinski;
+
+namespace
+{
+
+struct settings_t
+{
+    uint32_t num_meshes = 2000;
+    uint32_t num_lights = 16;
+    uint32_t num_shadow_lights = 1;
+    uint32_t num_skinned = 20;
+    uint32_t num_labels = 100;
+    uint32_t num_frames = 300;
+    uint32_t num_warmup = 30;
+    uint32_t seed = 1;
+    gl::ivec2 size = gl::ivec2(1280, 720);
+    std::string renderer = "both";
+    std::string font_path;
+    bool readback = true;
+    bool clustered = false;
+    bool light_sweep = false;
+    bool scenegraph = false;
+    uint32_t num_nodes = 100000;
+    bool pick = false;
+    uint32_t num_picks = 1000;
+    std::string tag;
+    std::string output_path = "render_benchmark.json";
+};
+
+//! summary of a series of samples, in milliseconds
+struct sample_stats_t
+{
+    double mean = 0.0, median = 0.0, p95 = 0.0, min = 0.0, max = 0.0;
+};
+
+struct stage_t
+{
+    //! slash-separated path of nested scope-names, e.g. "render/shadow/sort"
+    std::string name;
+    std::vector<double> cpu_ms, gpu_ms;
+};
+
+struct result_t
+{
+    std::string renderer;
+    uint32_t num_lights = 0;
+    uint32_t num_objects = 0;
+    std::vector<double> frame_ms;
+    std::vector<double> draw_calls, state_changes, state_redundant, upload_bytes;
+    std::vector<stage_t> stages;
+};
+
+//! egl-objects of our headless context
+struct egl_context_t
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string escape(const std::string &the_str)
+{
+    std::string ret;
+
+    for(char c : the_str)
+    {
+        if(c == '"' || c == '\\'){ ret.push_back('\\'); }
+        if(static_cast<unsigned char>(c) >= 0x20){ ret.push_back(c); }
+    }
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+sample_stats_t compute_stats(std::vector<double> the_samples)
+{
+    sample_stats_t ret;
+    if(the_samples.empty()){ return ret; }
+
+    std::sort(the_samples.begin(), the_samples.end());
+    double sum = 0.0;
+    for(double s : the_samples){ sum += s; }
+
+    ret.mean = sum / the_samples.size();
+    ret.median = the_samples[the_samples.size() / 2];
+    ret.p95 = the_samples[std::min<size_t>(the_samples.size() - 1, the_samples.size() * 95 / 100)];
+    ret.min = the_samples.front();
+    ret.max = the_samples.back();
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool parse_args(int argc, char *argv[], settings_t &the_settings)
+{
+    auto &s = the_settings;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        auto next_uint = [&]() -> uint32_t { return std::strtoul(argv[++i], nullptr, 10); };
+
+        if(arg == "--no-readback"){ s.readback = false; }
+        else if(arg == "--clustered"){ s.clustered = true; }
+        else if(arg == "--light-sweep"){ s.light_sweep = true; }
+        else if(arg == "--scenegraph"){ s.scenegraph = true; }
+        else if(arg == "--pick"){ s.pick = true; }
+        else if(!has_value){ return false; }
+        else if(arg == "--meshes"){ s.num_meshes = next_uint(); }
+        else if(arg == "--lights"){ s.num_lights = next_uint(); }
+        else if(arg == "--shadows"){ s.num_shadow_lights = next_uint(); }
+        else if(arg == "--skinned"){ s.num_skinned = next_uint(); }
+        else if(arg == "--labels"){ s.num_labels = next_uint(); }
+        else if(arg == "--frames"){ s.num_frames = std::max<uint32_t>(next_uint(), 1); }
+        else if(arg == "--warmup"){ s.num_warmup = next_uint(); }
+        else if(arg == "--width"){ s.size.x = std::max<uint32_t>(next_uint(), 1); }
+        else if(arg == "--height"){ s.size.y = std::max<uint32_t>(next_uint(), 1); }
+        else if(arg == "--seed"){ s.seed = next_uint(); }
+        else if(arg == "--nodes"){ s.num_nodes = std::max<uint32_t>(next_uint(), 1); }
+        else if(arg == "--picks"){ s.num_picks = std::max<uint32_t>(next_uint(), 1); }
+        else if(arg == "--renderer"){ s.renderer = argv[++i]; }
+        else if(arg == "--font"){ s.font_path = argv[++i]; }
+        else if(arg == "--tag"){ s.tag = argv[++i]; }
+        else if(arg == "--output"){ s.output_path = argv[++i]; }
+        else{ return false; }
+    }
+    return s.renderer == "forward" || s.renderer == "deferred" || s.renderer == "both";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * create a desktop-GL 4.1 core context without any window-system.
+ * prefers mesa's surfaceless platform, falls back to the default display with a small pbuffer
+ */
+bool create_egl_context(egl_context_t &the_egl)
+{
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if(client_extensions && strstr(client_extensions, "EGL_MESA_platform_surfaceless"))
+    {
+        auto get_platform_display =
+                reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+        if(get_platform_display)
+        {
+            the_egl.display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+    }
+    if(the_egl.display == EGL_NO_DISPLAY){ the_egl.display = eglGetDisplay(EGL_DEFAULT_DISPLAY); }
+
+    EGLint major = 0, minor = 0;
+
+    if(the_egl.display == EGL_NO_DISPLAY || !eglInitialize(the_egl.display, &major, &minor))
+    {
+        LOG_ERROR << "could not initialize EGL-display";
+        return false;
+    }
+    LOG_INFO << "EGL: " << major << "." << minor << " (" << eglQueryString(the_egl.display, EGL_VENDOR) << ")";
+
+    if(!eglBindAPI(EGL_OPENGL_API))
+    {
+        LOG_ERROR << "EGL: desktop OpenGL not supported";
+        return false;
+    }
+    const char *extensions = eglQueryString(the_egl.display, EGL_EXTENSIONS);
+    bool surfaceless = extensions && strstr(extensions, "EGL_KHR_surfaceless_context");
+
+    // we render into an Fbo, the default framebuffer is never touched
+    const EGLint config_attribs[] =
+    {
+        EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+
+    if(!eglChooseConfig(the_egl.display, config_attribs, &config, 1, &num_configs) || !num_configs)
+    {
+        LOG_ERROR << "EGL: no matching config";
+        return false;
+    }
+
+    const EGLint context_attribs[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 1,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+    the_egl.context = eglCreateContext(the_egl.display, config, EGL_NO_CONTEXT, context_attribs);
+
+    if(the_egl.context == EGL_NO_CONTEXT)
+    {
+        LOG_ERROR << "EGL: could not create an OpenGL 4.1 core context";
+        return false;
+    }
+
+    if(!surfaceless)
+    {
+        const EGLint pbuffer_attribs[] = {EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE};
+        the_egl.surface = eglCreatePbufferSurface(the_egl.display, config, pbuffer_attribs);
+
+        if(the_egl.surface == EGL_NO_SURFACE)
+        {
+            LOG_ERROR << "EGL: could not create a pbuffer-surface";
+            return false;
+        }
+    }
+    return eglMakeCurrent(the_egl.display, the_egl.surface, the_egl.surface, the_egl.context);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void destroy_egl_context(egl_context_t &the_egl)
+{
+    if(the_egl.display == EGL_NO_DISPLAY){ return; }
+    eglMakeCurrent(the_egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(the_egl.surface != EGL_NO_SURFACE){ eglDestroySurface(the_egl.display, the_egl.surface); }
+    if(the_egl.context != EGL_NO_CONTEXT){ eglDestroyContext(the_egl.display, the_egl.context); }
+    eglTerminate(the_egl.display);
+    the_egl = egl_context_t();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! a vertical capsule, skinned to a chain of the_num_bones bones, swaying around the z-axis
+gl::MeshPtr create_skinned_mesh(uint32_t the_num_bones, const gl::MaterialPtr &the_material)
+{
+    const float height = 4.f;
+    const float bone_length = height / (the_num_bones - 1);
+
+    auto geom = gl::Geometry::create_sphere(1.f, 24);
+
+    for(auto &v : geom->vertices()){ v.y *= .5f * height; }
+    geom->compute_aabb();
+
+    auto &bone_data = geom->bone_vertex_data();
+    bone_data.resize(geom->vertices().size());
+
+    for(uint32_t i = 0; i < geom->vertices().size(); ++i)
+    {
+        float t = glm::clamp((geom->vertices()[i].y + .5f * height) / bone_length, 0.f, the_num_bones - 1.001f);
+        uint32_t b = static_cast<uint32_t>(t);
+        bone_data[i].indices = gl::ivec4(b, b + 1, 0, 0);
+        bone_data[i].weights = gl::vec4(1.f - (t - b), t - b, 0.f, 0.f);
+    }
+
+    // bone-chain along the y-axis
+    std::vector<gl::BonePtr> bones;
+    gl::mat4 world(1);
+
+    for(uint32_t i = 0; i < the_num_bones; ++i)
+    {
+        auto b = std::make_shared<gl::Bone>();
+        b->name = "bone_" + std::to_string(i);
+        b->index = i;
+        b->transform = glm::translate(gl::mat4(1), gl::vec3(0, i ? bone_length : -.5f * height, 0));
+        world = world * b->transform;
+        b->worldtransform = world;
+        b->offset = glm::inverse(world);
+
+        if(i)
+        {
+            b->parent = bones.back();
+            b->parent->children.push_back(b);
+        }
+        bones.push_back(b);
+    }
+
+    gl::MeshAnimation anim;
+    anim.duration = 2.f;
+
+    for(const auto &b : bones)
+    {
+        gl::AnimationKeys keys;
+        keys.positionkeys.push_back(gl::Key<gl::vec3>(0.f, gl::vec3(b->transform[3])));
+        keys.rotationkeys.push_back(gl::Key<gl::quat>(0.f, glm::angleAxis(-.3f, gl::Z_AXIS)));
+        keys.rotationkeys.push_back(gl::Key<gl::quat>(1.f, glm::angleAxis(.3f, gl::Z_AXIS)));
+        anim.bone_keys[b] = keys;
+    }
+
+    auto mesh = gl::Mesh::create(geom, the_material);
+    mesh->set_root_bone(bones.front());
+    mesh->add_animation(anim);
+    return mesh;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! a grid of meshes on a ground-plane, with point-lights, skinned meshes and text-labels above
+gl::ScenePtr create_scene(const settings_t &the_settings, const gl::Font &the_font)
+{
+    std::mt19937 rng(the_settings.seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    auto scene = gl::Scene::create();
+    const bool use_shadows = the_settings.num_shadow_lights > 0;
+    const float spacing = 3.f;
+    const uint32_t grid_size = std::ceil(std::sqrt(std::max<float>(the_settings.num_meshes, 1)));
+    const float extent = .5f * grid_size * spacing;
+
+    auto random_color = [&]() { return gl::Color(unit(rng), unit(rng), unit(rng), 1.f); };
+
+    auto create_material = [&](gl::ShaderType the_type)
+    {
+        auto mat = gl::Material::create(the_type);
+        mat->set_diffuse(random_color());
+        mat->set_shadow_properties(gl::Material::SHADOW_CAST | gl::Material::SHADOW_RECEIVE);
+        return mat;
+    };
+
+    // shared geometries and materials, as in typical scenes
+    std::vector<gl::GeometryPtr> geometries =
+    {
+        gl::Geometry::create_box(gl::vec3(.5f)),
+        gl::Geometry::create_sphere(.6f, 32),
+        gl::Geometry::create_sphere(.6f, 8)
+    };
+    std::vector<gl::MaterialPtr> materials;
+    auto shader_type = use_shadows ? gl::ShaderType::PHONG_SHADOWS : gl::ShaderType::PHONG;
+    for(uint32_t i = 0; i < 16; ++i){ materials.push_back(create_material(shader_type)); }
+
+    auto ground = gl::Mesh::create(gl::Geometry::create_plane(2.f * extent, 2.f * extent), create_material(shader_type));
+    ground->set_rotation(glm::angleAxis(-glm::half_pi<float>(), gl::X_AXIS));
+    scene->add_object(ground);
+
+    for(uint32_t i = 0; i < the_settings.num_meshes; ++i)
+    {
+        auto mesh = gl::Mesh::create(geometries[rng() % geometries.size()], materials[rng() % materials.size()]);
+        mesh->set_position(gl::vec3((i % grid_size) * spacing - extent, .6f, (i / grid_size) * spacing - extent));
+        mesh->set_rotation(glm::angleAxis(glm::two_pi<float>() * unit(rng), gl::Y_AXIS));
+        scene->add_object(mesh);
+    }
+
+    auto skin_type = use_shadows ? gl::ShaderType::PHONG_SKIN_SHADOWS : gl::ShaderType::PHONG_SKIN;
+
+    for(uint32_t i = 0; i < the_settings.num_skinned; ++i)
+    {
+        auto mesh = create_skinned_mesh(8, create_material(skin_type));
+        mesh->set_position(gl::vec3(extent * (2.f * unit(rng) - 1.f), 3.f, extent * (2.f * unit(rng) - 1.f)));
+        mesh->set_animation_speed(.5f + unit(rng));
+        scene->add_object(mesh);
+    }
+
+    // a directional light, followed by point-lights. the first lights cast shadows
+    for(uint32_t i = 0; i < the_settings.num_lights; ++i)
+    {
+        auto light = gl::Light::create(i ? gl::Light::POINT : gl::Light::DIRECTIONAL);
+
+        if(i)
+        {
+            light->set_position(gl::vec3(extent * (2.f * unit(rng) - 1.f), 4.f, extent * (2.f * unit(rng) - 1.f)));
+            light->set_radius(4.f * spacing);
+            light->set_diffuse(random_color());
+        }else{ light->set_position(gl::vec3(1.f, 2.f, 1.f)); }
+
+        light->set_cast_shadow(i < the_settings.num_shadow_lights);
+        scene->add_object(light);
+    }
+
+    if(the_font)
+    {
+        for(uint32_t i = 0; i < the_settings.num_labels; ++i)
+        {
+            auto label = the_font.create_mesh("label #" + std::to_string(i), gl::COLOR_WHITE);
+            label->set_position(gl::vec3(extent * (2.f * unit(rng) - 1.f), 5.f, extent * (2.f * unit(rng) - 1.f)));
+            label->set_scale(.02f);
+            scene->add_object(label);
+        }
+    }else if(the_settings.num_labels){ LOG_WARNING << "no font provided (--font), skipping text-labels"; }
+    return scene;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * render the_scene for the configured number of frames.
+ * timings are gathered from gl::profiler(), its gpu-timings arrive a few frames delayed
+ */
+result_t run_benchmark(const settings_t &the_settings, const std::string &the_name, const gl::ScenePtr &the_scene,
+                       const gl::SceneRendererPtr &the_renderer, crocore::ThreadPool &the_pool)
+{
+    result_t ret;
+    ret.renderer = the_name;
+    ret.num_lights = the_settings.num_lights;
+
+    auto &profiler = gl::profiler();
+    profiler.clear();
+
+    gl::Fbo::Format fmt;
+    fmt.num_samples = 0;
+    auto fbo = gl::Fbo::create(the_settings.size.x, the_settings.size.y, fmt);
+
+    auto cam = gl::PerspectiveCamera::create(fbo->aspect_ratio(), 45.f, .1f, 1000.f);
+    float extent = 1.5f * std::ceil(std::sqrt(std::max<float>(the_settings.num_meshes, 1)));
+    cam->set_position(gl::vec3(0, .8f * extent + 5.f, 1.2f * extent + 5.f));
+    cam->set_look_at(gl::vec3(0));
+
+    std::vector<uint8_t> pixels(4 * the_settings.size.x * the_settings.size.y);
+
+    const uint64_t first_frame = profiler.frame_index() + the_settings.num_warmup;
+    const uint64_t end_frame = first_frame + the_settings.num_frames;
+    uint64_t next_frame = first_frame;
+    std::map<std::string, size_t> stage_map;
+
+    // collect measured frames from the profiler's history, as soon as they are available
+    auto collect = [&]()
+    {
+        const auto &history = profiler.history();
+
+        for(uint32_t i = 0; i < history.size(); ++i)
+        {
+            const auto &frame = history[i];
+            if(frame.index < next_frame || frame.index >= end_frame){ continue; }
+            next_frame = frame.index + 1;
+
+            ret.frame_ms.push_back(1000.0 * frame.duration);
+            ret.draw_calls.push_back(frame.state_stats.num_draw_calls);
+            ret.state_changes.push_back(frame.state_stats.num_changes);
+            ret.state_redundant.push_back(frame.state_stats.num_redundant);
+            ret.upload_bytes.push_back(frame.state_stats.num_upload_bytes);
+
+            // accumulate scopes with identical paths within a frame
+            std::vector<std::string> path;
+            std::map<size_t, std::pair<double, double>> frame_stages;
+
+            for(const auto &s : frame.scopes)
+            {
+                path.resize(s.depth);
+                path.push_back(s.name ? s.name : "");
+
+                std::string name;
+                for(const auto &p : path){ name += (name.empty() ? "" : "/") + p; }
+
+                auto it = stage_map.find(name);
+
+                if(it == stage_map.end())
+                {
+                    it = stage_map.insert({name, ret.stages.size()}).first;
+                    ret.stages.push_back({name});
+                }
+                auto &t = frame_stages[it->second];
+                t.first += 1000.0 * s.cpu_duration;
+                t.second = s.gpu_duration >= 0.0 ? t.second + 1000.0 * s.gpu_duration : -1.0;
+            }
+
+            for(const auto &pair : frame_stages)
+            {
+                ret.stages[pair.first].cpu_ms.push_back(pair.second.first);
+                if(pair.second.second >= 0.0){ ret.stages[pair.first].gpu_ms.push_back(pair.second.second); }
+            }
+        }
+    };
+
+    const float time_delta = 1.f / 60.f;
+
+    for(uint32_t i = 0; i < the_settings.num_warmup + the_settings.num_frames; ++i)
+    {
+        profiler.begin_frame();
+
+        {
+            gl::ScopedProfile sp("update", false);
+            the_scene->update(time_delta, &the_pool);
+        }
+
+        {
+            gl::ScopedProfile sp("render");
+
+            gl::render_to_texture(fbo, [&]()
+            {
+                gl::clear();
+                ret.num_objects = the_renderer->render_scene(the_scene, cam);
+            });
+        }
+
+        if(the_settings.readback)
+        {
+            gl::ScopedProfile sp("readback", false);
+            gl::SaveFramebufferBinding sfb;
+            fbo->bind();
+            glReadPixels(0, 0, fbo->width(), fbo->height(), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+        else{ glFlush(); }
+
+        gl::context()->end_frame();
+        profiler.end_frame();
+        collect();
+    }
+
+    // drain the profiler's pending frames
+    glFinish();
+
+    while(next_frame < end_frame && profiler.frame_index() < end_frame + 8)
+    {
+        profiler.begin_frame();
+        profiler.end_frame();
+        collect();
+    }
+    LOG_WARNING_IF(ret.frame_ms.size() < the_settings.num_frames) << the_name << ": only "
+                                                                  << ret.frame_ms.size() << " frames recorded";
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! wall-clock duration of the_fn, in milliseconds
+template<typename Fn> double time_ms(Fn the_fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    the_fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! uncached reference, walking up the hierarchy and concatenating from the root
+gl::mat4 global_transform_linear(const gl::Object3DPtr &the_object)
+{
+    std::vector<gl::Object3DConstPtr> ancestors;
+    for(gl::Object3DConstPtr p = the_object; p; p = p->parent()){ ancestors.push_back(p); }
+
+    gl::mat4 ret = ancestors.back()->transform();
+    for(auto it = ancestors.rbegin() + 1; it != ancestors.rend(); ++it){ ret = ret * (*it)->transform(); }
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * global transforms and bounds of a binary tree with random local transforms, cached and uncached.
+ * every iteration starts cold, by touching the root's transform
+ */
+std::vector<stage_t> run_scenegraph_benchmark(const settings_t &the_settings)
+{
+    std::mt19937 rng(the_settings.seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    const uint32_t num_nodes = the_settings.num_nodes;
+    std::vector<gl::Object3DPtr> nodes(num_nodes);
+
+    for(uint32_t i = 0; i < num_nodes; ++i)
+    {
+        nodes[i] = gl::Object3D::create();
+        nodes[i]->set_position(gl::vec3(unit(rng), unit(rng), unit(rng)) * 2.f - 1.f);
+        nodes[i]->set_rotation(unit(rng), unit(rng), 0.f);
+        if(i){ nodes[(i - 1) / 2]->add_child(nodes[i]); }
+    }
+
+    std::vector<stage_t> ret =
+    {
+        {"scenegraph/global_transform/linear"}, {"scenegraph/global_transform/cold"},
+        {"scenegraph/global_transform/cached"}, {"scenegraph/aabb/cold"}, {"scenegraph/aabb/cached"}
+    };
+    std::vector<gl::mat4> results_linear(num_nodes), results_cached(num_nodes);
+    uint32_t num_mismatches = 0;
+
+    for(uint32_t i = 0; i < the_settings.num_frames; ++i)
+    {
+        nodes[0]->set_transform(nodes[0]->transform());
+
+        ret[0].cpu_ms.push_back(time_ms([&]()
+        {
+            for(uint32_t j = 0; j < num_nodes; ++j){ results_linear[j] = global_transform_linear(nodes[j]); }
+        }));
+
+        // first pass fills the caches, second one reads them
+        for(uint32_t pass = 1; pass < 3; ++pass)
+        {
+            ret[pass].cpu_ms.push_back(time_ms([&]()
+            {
+                for(uint32_t j = 0; j < num_nodes; ++j){ results_cached[j] = nodes[j]->global_transform(); }
+            }));
+        }
+        if(results_linear != results_cached){ num_mismatches++; }
+
+        // bounds of the entire tree, after invalidation and cached
+        nodes[0]->set_transform(nodes[0]->transform());
+        gl::AABB bounds;
+        ret[3].cpu_ms.push_back(time_ms([&](){ bounds = nodes[0]->aabb(); }));
+        ret[4].cpu_ms.push_back(time_ms([&](){ if(!(nodes[0]->aabb() == bounds)){ num_mismatches++; } }));
+    }
+    LOG_WARNING_IF(num_mismatches) << "scenegraph: cached results differ from the reference in "
+                                   << num_mismatches << " iterations";
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * brute-force reference for Scene::pick, without any BVH.
+ * tests the OBBs of all enabled objects and, with the_high_precision, every triangle of a hit mesh
+ */
+gl::Object3D* pick_linear(const gl::ScenePtr &the_scene, const gl::Ray &the_ray, bool the_high_precision)
+{
+    gl::SelectVisitor<gl::Object3D> sv;
+    the_scene->root()->accept(sv);
+
+    gl::Object3D *ret = nullptr;
+    float nearest = std::numeric_limits<float>::max();
+
+    for(gl::Object3D *the_object : sv.get_objects())
+    {
+        if(the_object == the_scene->root().get()){ continue; }
+
+        gl::ray_intersection ray_hit = the_object->obb().intersect(the_ray);
+        if(!ray_hit){ continue; }
+        float distance = ray_hit.distance;
+
+        if(the_high_precision)
+        {
+            auto m = dynamic_cast<const gl::Mesh*>(the_object);
+            if(!m){ continue; }
+
+            gl::mat4 global_trans = the_object->global_transform();
+            gl::Ray ray_in_object_space = the_ray.transform(glm::inverse(global_trans));
+            const auto &vertices = m->geometry()->vertices();
+            const auto &indices = m->geometry()->indices();
+            gl::ray_triangle_intersection tri_hit(gl::REJECT);
+
+            for(const auto &e : m->entries())
+            {
+                uint32_t primitive_type = e.primitive_type ? e.primitive_type : m->geometry()->primitive_type();
+                if(!e.enabled || primitive_type != GL_TRIANGLES){ continue; }
+
+                for(uint32_t i = 0; i + 2 < e.num_indices; i += 3)
+                {
+                    gl::Triangle t(vertices[indices[e.base_index + i] + e.base_vertex],
+                                   vertices[indices[e.base_index + i + 1] + e.base_vertex],
+                                   vertices[indices[e.base_index + i + 2] + e.base_vertex]);
+                    auto hit = t.intersect(ray_in_object_space);
+                    if(hit && hit.distance >= 0.f && (!tri_hit || hit.distance < tri_hit.distance)){ tri_hit = hit; }
+                }
+            }
+            if(!tri_hit){ continue; }
+
+            // hit-distance in world-space
+            gl::vec3 hit_pos = (global_trans * gl::vec4(ray_in_object_space * tri_hit.distance, 1.f)).xyz();
+            distance = glm::length(hit_pos - the_ray.origin);
+        }
+        if(distance < nearest)
+        {
+            nearest = distance;
+            ret = the_object;
+        }
+    }
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Scene::pick and pick_linear for the same random rays, from the benchmark's camera-position into the grid.
+ * each sample is a single pick, in bounding-box and triangle (high-precision) mode
+ */
+std::vector<stage_t> run_pick_benchmark(const settings_t &the_settings, const gl::ScenePtr &the_scene)
+{
+    std::mt19937 rng(the_settings.seed);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+    float extent = 1.5f * std::ceil(std::sqrt(std::max<float>(the_settings.num_meshes, 1)));
+    gl::vec3 origin(0, .8f * extent + 5.f, 1.2f * extent + 5.f);
+
+    std::vector<gl::Ray> rays;
+    for(uint32_t i = 0; i < the_settings.num_picks; ++i)
+    {
+        rays.push_back(gl::Ray(origin, gl::vec3(extent * unit(rng), .6f, extent * unit(rng)) - origin));
+    }
+
+    // first pick builds the scene's pick-BVH
+    the_scene->pick(rays.front());
+
+    std::vector<stage_t> ret = {{"pick/bvh"}, {"pick/linear"}, {"pick/bvh_precise"}, {"pick/linear_precise"}};
+    uint32_t num_mismatches = 0;
+
+    for(uint32_t p = 0; p < 2; ++p)
+    {
+        const bool high_precision = p;
+        auto &bvh_stage = ret[2 * p], &linear_stage = ret[2 * p + 1];
+
+        for(const auto &ray : rays)
+        {
+            gl::Object3DPtr bvh_result;
+            gl::Object3D *linear_result = nullptr;
+            auto pick_bvh = [&](){ bvh_result = the_scene->pick(ray, high_precision); };
+            auto pick_brute_force = [&](){ linear_result = pick_linear(the_scene, ray, high_precision); };
+            bvh_stage.cpu_ms.push_back(time_ms(pick_bvh));
+            linear_stage.cpu_ms.push_back(time_ms(pick_brute_force));
+            if(bvh_result.get() != linear_result){ num_mismatches++; }
+        }
+    }
+    LOG_WARNING_IF(num_mismatches) << "pick: BVH- and linear results differ for " << num_mismatches << " rays";
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void write_stats(std::ostream &the_stream, const std::vector<double> &the_samples)
+{
+    auto s = compute_stats(the_samples);
+    the_stream << "{\"mean\":" << s.mean << ",\"median\":" << s.median << ",\"p95\":" << s.p95
+               << ",\"min\":" << s.min << ",\"max\":" << s.max << "}";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string results_json(const settings_t &the_settings, const std::vector<result_t> &the_results,
+                         const std::vector<stage_t> &the_cpu_stages)
+{
+    std::stringstream ss;
+    ss.precision(4);
+    ss << std::fixed;
+
+    auto gl_string = [](GLenum the_name)
+    {
+        auto str = reinterpret_cast<const char*>(glGetString(the_name));
+        return escape(str ? str : "");
+    };
+
+    const auto &s = the_settings;
+    ss << "{\n\"tag\":\"" << escape(s.tag) << "\",\n"
+       << "\"gl_version\":\"" << gl_string(GL_VERSION) << "\",\n"
+       << "\"gl_renderer\":\"" << gl_string(GL_RENDERER) << "\",\n"
+       << "\"settings\":{\"meshes\":" << s.num_meshes << ",\"lights\":" << s.num_lights
+       << ",\"shadows\":" << s.num_shadow_lights << ",\"skinned\":" << s.num_skinned
+       << ",\"labels\":" << s.num_labels << ",\"frames\":" << s.num_frames << ",\"warmup\":" << s.num_warmup
+       << ",\"width\":" << s.size.x << ",\"height\":" << s.size.y << ",\"seed\":" << s.seed
+       << ",\"readback\":" << (s.readback ? "true" : "false")
+       << ",\"clustered\":" << (s.clustered ? "true" : "false")
+       << ",\"light_sweep\":" << (s.light_sweep ? "true" : "false")
+       << ",\"nodes\":" << (s.scenegraph ? s.num_nodes : 0)
+       << ",\"picks\":" << (s.pick ? s.num_picks : 0) << "},\n"
+       << "\"results\":[";
+
+    for(uint32_t i = 0; i < the_results.size(); ++i)
+    {
+        const auto &r = the_results[i];
+        ss << (i ? ",\n" : "\n") << "{\"renderer\":\"" << r.renderer << "\",\"lights\":" << r.num_lights
+           << ",\"frames\":" << r.frame_ms.size()
+           << ",\"objects\":" << r.num_objects << ",\n\"frame_ms\":";
+        write_stats(ss, r.frame_ms);
+        ss << ",\n\"draw_calls\":";
+        write_stats(ss, r.draw_calls);
+        ss << ",\n\"state_changes\":";
+        write_stats(ss, r.state_changes);
+        ss << ",\n\"state_redundant\":";
+        write_stats(ss, r.state_redundant);
+        ss << ",\n\"upload_bytes\":";
+        write_stats(ss, r.upload_bytes);
+        ss << ",\n\"stages\":[";
+
+        for(uint32_t j = 0; j < r.stages.size(); ++j)
+        {
+            const auto &stage = r.stages[j];
+            ss << (j ? ",\n" : "\n") << "{\"name\":\"" << escape(stage.name) << "\",\"cpu_ms\":";
+            write_stats(ss, stage.cpu_ms);
+
+            if(!stage.gpu_ms.empty())
+            {
+                ss << ",\"gpu_ms\":";
+                write_stats(ss, stage.gpu_ms);
+            }
+            ss << "}";
+        }
+        ss << "]}";
+    }
+    ss << "],\n\"cpu_stages\":[";
+
+    for(uint32_t i = 0; i < the_cpu_stages.size(); ++i)
+    {
+        ss << (i ? ",\n" : "\n") << "{\"name\":\"" << escape(the_cpu_stages[i].name) << "\",\"cpu_ms\":";
+        write_stats(ss, the_cpu_stages[i].cpu_ms);
+        ss << "}";
+    }
+    ss << "]\n}\n";
+    return ss.str();
+}
+
+}// namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+    settings_t settings;
+
+    if(!parse_args(argc, argv, settings))
+    {
+        LOG_ERROR << "usage: " << argv[0] << " [--meshes N] [--lights N] [--shadows N] [--skinned N] [--labels N]"
+                  << " [--frames N] [--warmup N] [--width N] [--height N] [--seed N]"
+                  << " [--renderer forward|deferred|both] [--font path] [--no-readback]"
+                  << " [--clustered] [--light-sweep] [--scenegraph] [--nodes N] [--pick] [--picks N]"
+                  << " [--tag string] [--output path]";
+        return EXIT_FAILURE;
+    }
+
+    egl_context_t egl;
+
+    if(!create_egl_context(egl))
+    {
+        destroy_egl_context(egl);
+        return EXIT_FAILURE;
+    }
+    gl::create_context(nullptr);
+    gl::context()->set_current_context_id(egl.context);
+    gl::set_window_dimension(settings.size);
+
+    LOG_INFO << "OpenGL: " << glGetString(GL_VERSION) << " (" << glGetString(GL_RENDERER) << ")";
+
+    std::vector<result_t> results;
+    std::vector<stage_t> cpu_stages;
+
+    {
+        gl::Font font;
+
+        if(!settings.font_path.empty())
+        {
+            try{ font.load(settings.font_path, 64); }
+            catch(std::exception &e){ LOG_WARNING << e.what(); }
+        }
+
+        crocore::ThreadPool pool(std::max<uint32_t>(std::thread::hardware_concurrency(), 2) - 1);
+
+        std::vector<std::pair<std::string, gl::SceneRendererPtr>> renderers;
+        if(settings.renderer != "deferred"){ renderers.push_back({"forward", gl::SceneRenderer::create()}); }
+        if(settings.renderer != "forward"){ renderers.push_back({"deferred", gl::DeferredRenderer::create()}); }
+
+        if(settings.renderer != "forward" && settings.clustered)
+        {
+            auto clustered_renderer = gl::DeferredRenderer::create();
+            clustered_renderer->set_use_clustered_lighting(true);
+            renderers.push_back({"deferred_clustered", clustered_renderer});
+        }
+
+        // identical scenes (same seed) for each light-count
+        std::vector<uint32_t> light_counts = {settings.num_lights};
+        if(settings.light_sweep){ light_counts = {10, 30, 100, 300, 1000}; }
+
+        for(uint32_t num_lights : light_counts)
+        {
+            settings_t run_settings = settings;
+            run_settings.num_lights = num_lights;
+            auto scene = create_scene(run_settings, font);
+
+            for(auto &pair : renderers)
+            {
+                pair.second->set_thread_pool(&pool);
+                LOG_INFO << "benchmarking " << pair.first << " renderer (" << num_lights << " lights) ...";
+                results.push_back(run_benchmark(run_settings, pair.first, scene, pair.second, pool));
+
+                auto stats = compute_stats(results.back().frame_ms);
+                LOG_INFO << pair.first << ": " << stats.mean << " ms/frame (median: " << stats.median
+                         << " ms, p95: " << stats.p95 << " ms)";
+            }
+        }
+
+        // picking in the scene used for rendering, with the configured light-count
+        if(settings.pick)
+        {
+            LOG_INFO << "benchmarking pick (" << settings.num_picks << " rays) ...";
+            auto stages = run_pick_benchmark(settings, create_scene(settings, font));
+            cpu_stages.insert(cpu_stages.end(), stages.begin(), stages.end());
+        }
+    }
+
+    if(settings.scenegraph)
+    {
+        LOG_INFO << "benchmarking scenegraph (" << settings.num_nodes << " nodes) ...";
+        auto stages = run_scenegraph_benchmark(settings);
+        cpu_stages.insert(cpu_stages.end(), stages.begin(), stages.end());
+    }
+
+    for(const auto &stage : cpu_stages)
+    {
+        LOG_INFO << stage.name << ": " << compute_stats(stage.cpu_ms).median << " ms (median)";
+    }
+
+    std::ofstream stream(settings.output_path);
+    stream << results_json(settings, results, cpu_stages);
+    bool success = stream.good();
+    if(success){ LOG_INFO << "results written to: " << settings.output_path; }
+    else{ LOG_ERROR << "could not write results to: " << settings.output_path; }
+
+    gl::context()->clear_assets_for_context(egl.context);
+    destroy_egl_context(egl);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -7,7 +7,10 @@
 //  http://www.boost.org/LICENSE_1_0.txt
 // __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
 
+#include <chrono>
+#include <mutex>
 #include <crocore/filesystem.hpp>
+#include <crocore/ThreadPool.hpp>
 #include "gl.hpp"
 #include "Material.hpp"
 #include "Shader.hpp"
@@ -56,11 +59,65 @@ std::map<gl::ShaderType, std::string> g_shader_names =
                 {ShaderType::SDF_FONT,           "SDF_FONT"}
         };
 
+//! a vertex-array and the buffer-version of the geometry it was created for
+struct vao_t
+{
+    uint32_t id = 0;
+    uint32_t buffer_version = 0;
+};
+
 using vao_map_key_t = std::pair<const gl::Geometry *, const gl::Shader *>;
-using vao_map_t = std::unordered_map<vao_map_key_t, uint32_t, crocore::pair_hash<const gl::Geometry *, const gl::Shader *>>;
+using vao_map_t = std::unordered_map<vao_map_key_t, vao_t, crocore::pair_hash<const gl::Geometry *, const gl::Shader *>>;
 
 using fbo_map_key_t = std::pair<const gl::Fbo *, uint32_t>;
 using fbo_map_t = std::unordered_map<fbo_map_key_t, uint32_t, crocore::pair_hash<const gl::Fbo *, uint32_t>>;
+
+// marks unknown state-values
+constexpr GLenum STATE_UNKNOWN = std::numeric_limits<GLenum>::max();
+
+struct render_state_t
+{
+    // capability -> enabled
+    std::unordered_map<GLenum, bool> capabilities;
+
+    GLenum cull_face = STATE_UNKNOWN;
+    GLenum polygon_mode = STATE_UNKNOWN;
+    int depth_mask = -1;
+    GLenum blend_src = STATE_UNKNOWN, blend_dst = STATE_UNKNOWN;
+    GLenum blend_equation = STATE_UNKNOWN;
+    GLint scissor[4] = {-1, -1, -1, -1};
+
+    // NaN never compares equal
+    float point_size = std::numeric_limits<float>::quiet_NaN();
+    float line_width = std::numeric_limits<float>::quiet_NaN();
+
+    GLuint program = STATE_UNKNOWN;
+    GLenum active_texture_unit = STATE_UNKNOWN;
+
+    // (unit, target) -> texture
+    std::unordered_map<uint64_t, GLuint> textures;
+};
+
+// decoded images, waiting to be handed back to their materials
+struct decoded_image_t
+{
+    std::weak_ptr<gl::Material> material;
+    std::string path;
+    crocore::ImagePtr image;
+};
+
+struct texture_queue_t
+{
+    crocore::ThreadPool *pool = nullptr;
+    std::mutex mutex;
+    std::vector<decoded_image_t> decoded_images;
+
+    // upload budget and time spent during the current frame (secs)
+    double upload_budget = 0.004;
+    double upload_time = 0.0;
+    uint32_t num_uploads = 0;
+};
+texture_queue_t g_texture_queue;
 };
 
 struct ContextImpl
@@ -69,6 +126,20 @@ struct ContextImpl
     void *m_current_context_id = nullptr;
     std::unordered_map<void *, vao_map_t> m_vao_maps;
     std::unordered_map<void *, fbo_map_t> m_fbo_maps;
+    std::unordered_map<void *, render_state_t> m_render_states;
+    Context::state_stats_t m_state_stats, m_last_state_stats;
+
+    render_state_t& state(){ return m_render_states[m_current_context_id]; }
+
+    //! returns true, if the_value differs from the_state, which is then updated
+    template<typename T>
+    inline bool change(T &the_state, const T &the_value)
+    {
+        if(the_state == the_value){ m_state_stats.num_redundant++; return false; }
+        the_state = the_value;
+        m_state_stats.num_changes++;
+        return true;
+    }
 };
 
 Context::Context(std::shared_ptr<PlatformData> platform_data) : m_impl(new ContextImpl)
@@ -95,7 +166,9 @@ uint32_t Context::get_vao(const gl::GeometryPtr &the_geom, const gl::ShaderPtr &
 {
     vao_map_t &vao_map = m_impl->m_vao_maps[m_impl->m_current_context_id];
     auto it = vao_map.find(vao_map_key_t(the_geom.get(), the_shader.get()));
-    if(it != vao_map.end()){ return it->second; }
+
+    // vertex-arrays referencing outdated buffers or attribute-formats need to be recreated
+    if(it != vao_map.end() && it->second.buffer_version == the_geom->buffer_version()){ return it->second.id; }
     return 0;
 }
 
@@ -107,13 +180,14 @@ uint32_t Context::create_vao(const gl::GeometryPtr &the_geom, const gl::ShaderPt
     auto it = vao_map.find(key);
 
     // delete old vao
-    if(it != vao_map.end()){ GL_SUFFIX(glDeleteVertexArrays)(1, &it->second); }
+    if(it != vao_map.end()){ GL_SUFFIX(glDeleteVertexArrays)(1, &it->second.id); }
 
     // create new vao
-    uint32_t vao_id = 0;
-    GL_SUFFIX(glGenVertexArrays)(1, &vao_id);
-    vao_map[key] = vao_id;
-    return vao_id;
+    vao_t vao;
+    vao.buffer_version = the_geom->buffer_version();
+    GL_SUFFIX(glGenVertexArrays)(1, &vao.id);
+    vao_map[key] = vao;
+    return vao.id;
 #endif
     return 0;
 }
@@ -166,6 +240,154 @@ void Context::clear_assets_for_context(void *the_context_id)
 {
     m_impl->m_vao_maps.erase(the_context_id);
     m_impl->m_fbo_maps.erase(the_context_id);
+    m_impl->m_render_states.erase(the_context_id);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Context::set_enabled(GLenum the_capability, bool b)
+{
+    auto &caps = m_impl->state().capabilities;
+    auto it = caps.find(the_capability);
+
+    if(it != caps.end() && it->second == b){ m_impl->m_state_stats.num_redundant++; return; }
+    caps[the_capability] = b;
+    m_impl->m_state_stats.num_changes++;
+
+    if(b){ glEnable(the_capability); }
+    else{ glDisable(the_capability); }
+}
+
+void Context::set_cull_face(GLenum the_mode)
+{
+    if(m_impl->change(m_impl->state().cull_face, the_mode)){ glCullFace(the_mode); }
+}
+
+void Context::set_polygon_mode(GLenum the_mode)
+{
+#ifndef KINSKI_GLES
+    if(m_impl->change(m_impl->state().polygon_mode, the_mode)){ glPolygonMode(GL_FRONT_AND_BACK, the_mode); }
+#endif
+}
+
+void Context::set_depth_mask(bool b)
+{
+    if(m_impl->change(m_impl->state().depth_mask, (int)b)){ glDepthMask(b ? GL_TRUE : GL_FALSE); }
+}
+
+void Context::set_blend_func(GLenum the_src, GLenum the_dst)
+{
+    auto &state = m_impl->state();
+
+    if(m_impl->change(state.blend_src, the_src) | m_impl->change(state.blend_dst, the_dst))
+    {
+        glBlendFunc(the_src, the_dst);
+    }
+}
+
+void Context::set_blend_equation(GLenum the_equation)
+{
+#if !defined(KINSKI_GLES_2)
+    if(m_impl->change(m_impl->state().blend_equation, the_equation)){ glBlendEquation(the_equation); }
+#endif
+}
+
+void Context::set_scissor(GLint the_x, GLint the_y, GLsizei the_width, GLsizei the_height)
+{
+    auto &scissor = m_impl->state().scissor;
+
+    if(scissor[0] == the_x && scissor[1] == the_y && scissor[2] == the_width && scissor[3] == the_height)
+    {
+        m_impl->m_state_stats.num_redundant++;
+        return;
+    }
+    scissor[0] = the_x;
+    scissor[1] = the_y;
+    scissor[2] = the_width;
+    scissor[3] = the_height;
+    m_impl->m_state_stats.num_changes++;
+    glScissor(the_x, the_y, the_width, the_height);
+}
+
+void Context::set_point_size(float the_size)
+{
+#ifndef KINSKI_GLES
+    if(m_impl->change(m_impl->state().point_size, the_size)){ glPointSize(the_size); }
+#endif
+}
+
+void Context::set_line_width(float the_width)
+{
+    if(m_impl->change(m_impl->state().line_width, the_width)){ glLineWidth(the_width); }
+}
+
+void Context::use_program(GLuint the_program)
+{
+    if(m_impl->change(m_impl->state().program, the_program)){ glUseProgram(the_program); }
+}
+
+void Context::bind_texture(GLenum the_target, GLuint the_texture, GLuint the_unit)
+{
+    auto &state = m_impl->state();
+    uint64_t key = (uint64_t(the_unit) << 32) | the_target;
+    auto it = state.textures.find(key);
+
+    if(it != state.textures.end() && it->second == the_texture)
+    {
+        // subsequent texture-operations expect the unit to be active
+        if(m_impl->change(state.active_texture_unit, the_unit)){ glActiveTexture(GL_TEXTURE0 + the_unit); }
+        m_impl->m_state_stats.num_redundant++;
+        return;
+    }
+    state.textures[key] = the_texture;
+    if(m_impl->change(state.active_texture_unit, the_unit)){ glActiveTexture(GL_TEXTURE0 + the_unit); }
+    m_impl->m_state_stats.num_changes++;
+    glBindTexture(the_target, the_texture);
+}
+
+void Context::texture_deleted(GLuint the_texture)
+{
+    // deleted textures are unbound from the current context, but not necessarily from others
+    for(auto &p : m_impl->m_render_states)
+    {
+        for(auto &t : p.second.textures){ if(t.second == the_texture){ t.second = STATE_UNKNOWN; }}
+    }
+}
+
+void Context::program_deleted(GLuint the_program)
+{
+    for(auto &p : m_impl->m_render_states)
+    {
+        if(p.second.program == the_program){ p.second.program = STATE_UNKNOWN; }
+    }
+}
+
+void Context::invalidate_state()
+{
+    m_impl->state() = render_state_t();
+}
+
+void Context::end_frame()
+{
+    g_texture_queue.upload_time = 0.0;
+    g_texture_queue.num_uploads = 0;
+    m_impl->m_last_state_stats = m_impl->m_state_stats;
+    m_impl->m_state_stats = state_stats_t();
+}
+
+void Context::add_upload_bytes(size_t the_num_bytes)
+{
+    m_impl->m_state_stats.num_upload_bytes += the_num_bytes;
+}
+
+void Context::add_draw_call()
+{
+    m_impl->m_state_stats.num_draw_calls++;
+}
+
+const Context::state_stats_t& Context::state_stats() const
+{
+    return m_impl->m_last_state_stats;
 }
 
 void create_context(const std::shared_ptr<PlatformData> &the_platform_data)
@@ -850,21 +1072,15 @@ void draw_quad(const gl::MaterialPtr &theMaterial,
 void draw_text_2D(const std::string &theText, const gl::Font &theFont, const Color &the_color,
                   const glm::vec2 &theTopLeft)
 {
-    gl::ScopedMatrixPush model(MODEL_VIEW_MATRIX), projection(PROJECTION_MATRIX);
-
     if(!theFont.glyph_texture()) return;
-    mat4 projectionMatrix = ortho(0.0f, g_viewport_dim[0], 0.0f, g_viewport_dim[1], 0.0f, 1.0f);
-
-    // create the font mesh
-    gl::MeshPtr m = theFont.create_mesh(theText, the_color);
 
-    m->material()->set_diffuse(the_color);
-    m->material()->set_depth_test(false);
-    m->set_position(glm::vec3(theTopLeft.x, g_viewport_dim[1] - theTopLeft.y -
-                                            m->geometry()->aabb().height(), 0.f));
-    gl::load_matrix(gl::PROJECTION_MATRIX, projectionMatrix);
-    gl::load_matrix(gl::MODEL_VIEW_MATRIX, m->transform());
-    draw_mesh(m);
+    // a batch of one string, glyph-quads are streamed instead of cached per string
+    static gl::TextBatchPtr batch;
+    if(!batch){ batch = gl::TextBatch::create(theFont); }
+    batch->set_font(theFont);
+    batch->clear();
+    batch->add(theText, theTopLeft, the_color);
+    batch->draw();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -920,7 +1136,15 @@ void draw_transform(const glm::mat4 &the_transform, float the_scale)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void draw_mesh(const MeshPtr &the_mesh, const ShaderPtr &overide_shader)
+namespace
+{
+
+/*!
+ * draw the_mesh the_num_instances times, using the entries of level-of-detail the_lod.
+ * for more than one instance, per-instance transforms are sourced from the_instance_buffer
+ */
+void draw_mesh_internal(const MeshPtr &the_mesh, const ShaderPtr &overide_shader,
+                        const gl::Buffer &the_instance_buffer, uint32_t the_num_instances, uint32_t the_lod)
 {
     KINSKI_CHECK_GL_ERRORS();
     if(!the_mesh) return;
@@ -958,69 +1182,93 @@ void draw_mesh(const MeshPtr &the_mesh, const ShaderPtr &overide_shader)
     gl::apply_material(the_mesh->material(), false, overide_shader, &img_tex_map);
     KINSKI_CHECK_GL_ERRORS();
 
-    the_mesh->bind_vertex_array(overide_shader ? overide_shader : the_mesh->materials()[0]->shader());
+    const bool instanced = the_num_instances > 1;
+
+    auto shader_for_material = [&](uint32_t i) -> const gl::ShaderPtr&
+    {
+        return overide_shader ? overide_shader : the_mesh->materials()[i]->shader();
+    };
+
+    // bind the vertex-array for a material and source instance-transforms, if necessary
+    auto bind_vertex_array = [&](uint32_t i)
+    {
+        the_mesh->bind_vertex_array(shader_for_material(i));
+        if(instanced){ the_mesh->bind_instance_transforms(shader_for_material(i), the_instance_buffer); }
+    };
+    bind_vertex_array(0);
     KINSKI_CHECK_GL_ERRORS();
 
+    // read-only access, avoids flagging the geometry as dirty
+    const gl::Geometry &geom = *the_mesh->geometry();
+
+    const std::vector<gl::Mesh::Entry> &entries = the_mesh->entries(the_lod);
+
     if(the_mesh->geometry()->has_indices() || the_mesh->index_buffer())
     {
-        if(!the_mesh->entries().empty())
+        if(!entries.empty())
         {
-            std::list<uint32_t> mat_entries[the_mesh->materials().size()];
-
-            for(uint32_t i = 0; i < the_mesh->entries().size(); ++i)
-            {
-                uint32_t mat_index = the_mesh->entries()[i].material_index;
-                if(mat_index < the_mesh->materials().size()){ mat_entries[mat_index].push_back(i); }
-            }
-
             for(uint32_t i = 0; i < the_mesh->materials().size(); ++i)
             {
-                const auto &entry_list = mat_entries[i];
-
-                if(!entry_list.empty())
-                {
-                    if(!overide_shader){ the_mesh->bind_vertex_array(i); }
-                    apply_material(the_mesh->materials()[i], false, overide_shader, &img_tex_map);
-                }
+                bool material_applied = false;
 
-                for(auto entry_index : entry_list)
+                for(const gl::Mesh::Entry &e : entries)
                 {
-                    const gl::Mesh::Entry &e = the_mesh->entries()[entry_index];
+                    // skip disabled entries and those using other materials
+                    if(!e.enabled || e.material_index != i) continue;
 
-                    // skip disabled entries
-                    if(!e.enabled) continue;
+                    if(!material_applied)
+                    {
+                        if(!overide_shader || instanced){ bind_vertex_array(i); }
+                        apply_material(the_mesh->materials()[i], false, overide_shader, &img_tex_map);
+                        material_applied = true;
+                    }
 
                     uint32_t primitive_type = e.primitive_type;
-                    primitive_type = primitive_type ?: the_mesh->geometry()->primitive_type();
+                    primitive_type = primitive_type ?: geom.primitive_type();
 #ifndef KINSKI_GLES
-                    glDrawElementsBaseVertex(primitive_type,
-                                             e.num_indices,
-                                             the_mesh->geometry()->index_type(),
-                                             BUFFER_OFFSET(e.base_index * the_mesh->geometry()->index_size()),
-                                             e.base_vertex);
+                    glDrawElementsInstancedBaseVertex(primitive_type, e.num_indices, the_mesh->index_type(),
+                                                      BUFFER_OFFSET(e.base_index * the_mesh->index_size()),
+                                                      the_num_instances, e.base_vertex);
 #else
-                    glDrawElements(primitive_type,
-                                   e.num_indices,
-                                   the_mesh->geometry()->index_type(),
-                                   BUFFER_OFFSET(e.base_index * the_mesh->geometry()->index_size()));
+                    glDrawElements(primitive_type, e.num_indices, the_mesh->index_type(),
+                                   BUFFER_OFFSET(e.base_index * the_mesh->index_size()));
 #endif
+                    context()->add_draw_call();
                     KINSKI_CHECK_GL_ERRORS();
                 }
             }
         }else
         {
-            glDrawElements(the_mesh->geometry()->primitive_type(),
-                           the_mesh->geometry()->indices().size(), the_mesh->geometry()->index_type(),
-                           BUFFER_OFFSET(0));
+#ifndef KINSKI_GLES
+            glDrawElementsInstanced(geom.primitive_type(), geom.indices().size(), the_mesh->index_type(),
+                                    BUFFER_OFFSET(0), the_num_instances);
+#else
+            glDrawElements(geom.primitive_type(), geom.indices().size(), the_mesh->index_type(), BUFFER_OFFSET(0));
+#endif
+            context()->add_draw_call();
             KINSKI_CHECK_GL_ERRORS();
         }
     }else
     {
-        glDrawArrays(the_mesh->geometry()->primitive_type(), 0,
-                     the_mesh->geometry()->vertices().size());
+#ifndef KINSKI_GLES
+        glDrawArraysInstanced(geom.primitive_type(), 0, geom.vertices().size(), the_num_instances);
+#else
+        glDrawArrays(geom.primitive_type(), 0, geom.vertices().size());
+#endif
+        context()->add_draw_call();
         KINSKI_CHECK_GL_ERRORS();
     }
 
+    if(instanced)
+    {
+        // restore default instance-transforms for all involved vertex-arrays
+        for(uint32_t i = 0; i < the_mesh->materials().size(); ++i)
+        {
+            the_mesh->bind_vertex_array(shader_for_material(i));
+            the_mesh->bind_instance_transforms(shader_for_material(i));
+        }
+    }
+
 #ifndef KINSKI_NO_VAO
     GL_SUFFIX(glBindVertexArray)(0);
 #endif
@@ -1028,12 +1276,43 @@ void draw_mesh(const MeshPtr &the_mesh, const ShaderPtr &overide_shader)
     KINSKI_CHECK_GL_ERRORS();
 }
 
+}// namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+void draw_mesh(const MeshPtr &the_mesh, const ShaderPtr &overide_shader, uint32_t the_lod)
+{
+    draw_mesh_internal(the_mesh, overide_shader, gl::Buffer(), 1, the_lod);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 void draw_mesh_instanced(const MeshPtr &the_mesh, const std::vector<glm::mat4> &the_transforms,
-                         const ShaderPtr &overide_shader)
+                         const ShaderPtr &overide_shader, uint32_t the_lod)
 {
+    if(!the_mesh || the_transforms.empty()){ return; }
+
+#if !defined(KINSKI_GLES)
+    if(the_transforms.size() > 1 && !the_mesh->geometry()->has_bones() &&
+       the_mesh->supports_instancing(overide_shader))
+    {
+        static gl::Buffer instance_buffer(GL_ARRAY_BUFFER, GL_STREAM_DRAW);
+        static std::vector<gl::instance_record_t> records;
+        records.clear();
+        for(const auto &t : the_transforms){ records.push_back(gl::create_instance_record(t)); }
+        instance_buffer.set_data(records);
+        draw_mesh_internal(the_mesh, overide_shader, instance_buffer, the_transforms.size(), the_lod);
+        return;
+    }
+#endif
 
+    // fallback: one draw-call per instance
+    for(const auto &t : the_transforms)
+    {
+        gl::ScopedMatrixPush sp(gl::MODEL_VIEW_MATRIX);
+        gl::mult_matrix(gl::MODEL_VIEW_MATRIX, t);
+        draw_mesh_internal(the_mesh, overide_shader, gl::Buffer(), 1, the_lod);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1228,14 +1507,34 @@ gl::Texture render_to_texture(const FboPtr &the_fbo, std::function<void()> the_f
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void apply_material(const MaterialPtr &the_mat, bool force_apply, const ShaderPtr &override_shader,
-                    std::map<crocore::ImagePtr, gl::Texture> *the_img_tex_cache)
+namespace
 {
-    KINSKI_CHECK_GL_ERRORS();
-    static MaterialPtr last_mat = gl::Material::create();
-    if(!the_mat) return;
 
-    // process texture queue
+void process_texture_queue(const MaterialPtr &the_mat, std::map<crocore::ImagePtr, gl::Texture> *the_img_tex_cache)
+{
+    using AssetLoadStatus = gl::Material::AssetLoadStatus;
+    auto &queue = g_texture_queue;
+
+    // hand decoded images back to their materials
+    std::vector<decoded_image_t> decoded_images;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        std::swap(decoded_images, queue.decoded_images);
+    }
+
+    for(auto &d : decoded_images)
+    {
+        auto mat = d.material.lock();
+        if(!mat){ continue; }
+        auto it = mat->queued_textures().find(d.path);
+
+        if(it != mat->queued_textures().end() && it->second.status == AssetLoadStatus::LOADING)
+        {
+            it->second.image = d.image;
+            it->second.status = d.image ? AssetLoadStatus::IMAGE_LOADED : AssetLoadStatus::NOT_FOUND;
+        }
+    }
+
     auto it = the_mat->queued_textures().begin(), end = the_mat->queued_textures().end();
 
     for(; it != end;)
@@ -1247,27 +1546,46 @@ void apply_material(const MaterialPtr &the_mat, bool force_apply, const ShaderPt
         // no DXT compression for normal maps
         bool use_compression = pair.second.key != (uint32_t)Texture::Usage::NORMAL;
 
-        if(pair.second.status == gl::Material::AssetLoadStatus::NOT_LOADED)
+        if(pair.second.status == AssetLoadStatus::NOT_LOADED)
         {
-            try
+            if(queue.pool)
             {
-                auto t = gl::create_texture_from_file(pair.first, true, use_compression, anisotropic_lvl);
-                the_mat->add_texture(t, pair.second.key);
+                // decode on the pool, the result is picked up during one of the next calls
+                pair.second.status = AssetLoadStatus::LOADING;
+                std::weak_ptr<gl::Material> weak_mat = the_mat;
+                std::string path = pair.first;
 
-                // copy iterator before incrementing
-                auto delete_it = it++;
+                queue.pool->post([weak_mat, path]()
+                {
+                    decoded_image_t d = {weak_mat, path, nullptr};
+                    try{ d.image = crocore::create_image_from_file(path); }
+                    catch(std::exception &e){ LOG_WARNING << e.what(); }
 
-                // remove last iterator from map
-                the_mat->queued_textures().erase(delete_it);
+                    std::lock_guard<std::mutex> lock(g_texture_queue.mutex);
+                    g_texture_queue.decoded_images.push_back(std::move(d));
+                });
             }
-            catch(std::exception &e)
+            else
             {
-                LOG_WARNING << e.what();
-                pair.second.status = gl::Material::AssetLoadStatus::NOT_FOUND;
-                it++;
+                try
+                {
+                    pair.second.image = crocore::create_image_from_file(pair.first);
+                    pair.second.status = pair.second.image ? AssetLoadStatus::IMAGE_LOADED : AssetLoadStatus::NOT_FOUND;
+                }
+                catch(std::exception &e)
+                {
+                    LOG_WARNING << e.what();
+                    pair.second.status = AssetLoadStatus::NOT_FOUND;
+                }
             }
-        }else if(pair.second.status == gl::Material::AssetLoadStatus::IMAGE_LOADED)
+        }
+
+        // uploads are limited per frame, when decoding asynchronously
+        bool within_budget = !queue.pool || !queue.num_uploads || queue.upload_time < queue.upload_budget;
+
+        if(pair.second.status == AssetLoadStatus::IMAGE_LOADED && within_budget)
         {
+            auto start_time = std::chrono::steady_clock::now();
             gl::Texture t;
 
             if(the_img_tex_cache)
@@ -1285,8 +1603,10 @@ void apply_material(const MaterialPtr &the_mat, bool force_apply, const ShaderPt
                 LOG_TRACE << "creating texture: " << pair.first;
                 t = gl::create_texture_from_image(pair.second.image, true, use_compression, anisotropic_lvl);
                 if(the_img_tex_cache){ (*the_img_tex_cache)[pair.second.image] = t; }
+                queue.num_uploads++;
             }
             the_mat->add_texture(t, pair.second.key);
+            queue.upload_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
 
             // copy iterator before incrementing
             auto delete_it = it++;
@@ -1294,7 +1614,40 @@ void apply_material(const MaterialPtr &the_mat, bool force_apply, const ShaderPt
             // remove last iterator from map
             the_mat->queued_textures().erase(delete_it);
         }
+        else{ it++; }
     }
+}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void set_texture_decode_pool(crocore::ThreadPool *the_pool)
+{
+    g_texture_queue.pool = the_pool;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void set_texture_upload_budget(double the_secs)
+{
+    g_texture_queue.upload_budget = the_secs;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void apply_material(const MaterialPtr &the_mat, bool force_apply, const ShaderPtr &override_shader,
+                    std::map<crocore::ImagePtr, gl::Texture> *the_img_tex_cache)
+{
+    KINSKI_CHECK_GL_ERRORS();
+    if(!the_mat) return;
+
+    // all state-changes are routed through the context, skipping redundant ones
+    auto &ctx = gl::context();
+    if(force_apply){ ctx->invalidate_state(); }
+
+    // process texture queue
+    if(!the_mat->queued_textures().empty()){ process_texture_queue(the_mat, the_img_tex_cache); }
 
     // shader queue
     if(the_mat->queued_shader() != gl::ShaderType::NONE)
@@ -1311,110 +1664,57 @@ void apply_material(const MaterialPtr &the_mat, bool force_apply, const ShaderPt
     KINSKI_CHECK_GL_ERRORS();
 
     // twoSided
-    if(force_apply || last_mat->culling() != the_mat->culling() || last_mat->wireframe() != the_mat->wireframe())
+    if(the_mat->culling() == Material::CULL_NONE || the_mat->wireframe()){ ctx->set_enabled(GL_CULL_FACE, false); }
+    else
     {
-        if(the_mat->culling() == Material::CULL_NONE || the_mat->wireframe()){ glDisable(GL_CULL_FACE); }
-        else
-        {
-            glEnable(GL_CULL_FACE);
-            int val = GL_BACK;
+        ctx->set_enabled(GL_CULL_FACE, true);
+        GLenum val = GL_BACK;
 
-            if(the_mat->culling() & Material::CULL_BACK)
-            {
-                val = GL_BACK;
+        if(the_mat->culling() & Material::CULL_BACK)
+        {
+            val = GL_BACK;
 
-                if(the_mat->culling() & Material::CULL_FRONT){ val = GL_FRONT_AND_BACK; }
-            }else if(the_mat->culling() & Material::CULL_FRONT){ val = GL_FRONT; }
-            glCullFace(val);
-        }
+            if(the_mat->culling() & Material::CULL_FRONT){ val = GL_FRONT_AND_BACK; }
+        }else if(the_mat->culling() & Material::CULL_FRONT){ val = GL_FRONT; }
+        ctx->set_cull_face(val);
     }
-    KINSKI_CHECK_GL_ERRORS();
 
     // wireframe ?
 #ifndef KINSKI_GLES
-    if(force_apply || last_mat->wireframe() != the_mat->wireframe())
-        glPolygonMode(GL_FRONT_AND_BACK, the_mat->wireframe() ? GL_LINE : GL_FILL);
+    ctx->set_polygon_mode(the_mat->wireframe() ? GL_LINE : GL_FILL);
 #endif
 
-    KINSKI_CHECK_GL_ERRORS();
-
     // read write depth buffer ?
-    if(force_apply || last_mat->depth_test() != the_mat->depth_test())
-    {
-        if(the_mat->depth_test()){ glEnable(GL_DEPTH_TEST); }
-        else{ glDisable(GL_DEPTH_TEST); }
-    }
-    KINSKI_CHECK_GL_ERRORS();
-
-    if(force_apply || last_mat->depth_write() != the_mat->depth_write())
-    {
-        if(the_mat->depth_write()){ glDepthMask(GL_TRUE); }
-        else{ glDepthMask(GL_FALSE); }
-    }
-    KINSKI_CHECK_GL_ERRORS();
-
-    if(force_apply || last_mat->stencil_test() != the_mat->stencil_test())
-    {
-        if(the_mat->stencil_test()){ glEnable(GL_STENCIL_TEST); }
-        else{ glDisable(GL_STENCIL_TEST); }
-
-    }
-    KINSKI_CHECK_GL_ERRORS();
+    ctx->set_enabled(GL_DEPTH_TEST, the_mat->depth_test());
+    ctx->set_depth_mask(the_mat->depth_write());
+    ctx->set_enabled(GL_STENCIL_TEST, the_mat->stencil_test());
 
     // scissor test
-    if(force_apply || last_mat->scissor_rect() != the_mat->scissor_rect())
-    {
-        auto rect = the_mat->scissor_rect();
-
-        if(the_mat->scissor_rect() == crocore::Area_<uint32_t>()){ glDisable(GL_SCISSOR_TEST); }
-        else
-        {
-            glEnable(GL_SCISSOR_TEST);
-            glScissor(rect.x, gl::window_dimension().y - (rect.y + rect.height), rect.width, rect.height);
-        }
-    }
-    KINSKI_CHECK_GL_ERRORS();
+    auto rect = the_mat->scissor_rect();
 
-    if(force_apply || last_mat->blending() != the_mat->blending())
+    if(rect == crocore::Area_<uint32_t>()){ ctx->set_enabled(GL_SCISSOR_TEST, false); }
+    else
     {
-        if(!the_mat->blending()){ glDisable(GL_BLEND); }
-        else{ glEnable(GL_BLEND); }
+        ctx->set_enabled(GL_SCISSOR_TEST, true);
+        ctx->set_scissor(rect.x, gl::window_dimension().y - (rect.y + rect.height), rect.width, rect.height);
     }
-    KINSKI_CHECK_GL_ERRORS();
 
-    if(force_apply || last_mat->blend_factors() != the_mat->blend_factors())
-    {
-        glBlendFunc(the_mat->blend_src(), the_mat->blend_dst());
-    }
-    KINSKI_CHECK_GL_ERRORS();
-
-#if !defined(KINSKI_GLES_2)
-    if(force_apply || last_mat->blend_equation() != the_mat->blend_equation())
-    {
-        glBlendEquation(the_mat->blend_equation());
-    }
-    KINSKI_CHECK_GL_ERRORS();
-#endif
+    ctx->set_enabled(GL_BLEND, the_mat->blending());
+    ctx->set_blend_func(the_mat->blend_src(), the_mat->blend_dst());
+    ctx->set_blend_equation(the_mat->blend_equation());
 
-    if(force_apply || last_mat->point_size() != the_mat->point_size())
+    if(the_mat->point_size() > 0.f)
     {
-        if(the_mat->point_size() > 0.f)
-        {
 #ifndef KINSKI_GLES
-            glEnable(GL_PROGRAM_POINT_SIZE);
-            glPointSize(the_mat->point_size());
+        ctx->set_enabled(GL_PROGRAM_POINT_SIZE, true);
 #endif
-            KINSKI_CHECK_GL_ERRORS();
-        }
+        ctx->set_point_size(the_mat->point_size());
     }
 
 #if defined(KINSKI_GLES)
-    if(force_apply || last_mat->line_width() != the_mat->line_width())
-    {
-        glLineWidth(the_mat->line_width());
-        KINSKI_CHECK_GL_ERRORS();
-    }
+    ctx->set_line_width(the_mat->line_width());
 #endif
+    KINSKI_CHECK_GL_ERRORS();
 
     // add texturemaps
     int32_t tex_unit = 0, tex_2d = 0, num_textures = 0;
@@ -1423,7 +1723,7 @@ void apply_material(const MaterialPtr &the_mat, bool force_apply, const ShaderPt
 #endif
 
 #if !defined(KINSKI_GLES)
-    int32_t tex_rect = 0;
+    int32_t tex_rect = 0, tex_buffer = 0;
 #endif
     char buf[512];
 
@@ -1461,6 +1761,10 @@ void apply_material(const MaterialPtr &the_mat, bool force_apply, const ShaderPt
             case GL_TEXTURE_RECTANGLE:
                 sprintf(buf, "u_sampler_2Drect[%d]", tex_rect++);
                 break;
+
+            case GL_TEXTURE_BUFFER:
+                sprintf(buf, "u_sampler_buffer[%d]", tex_buffer++);
+                break;
 #endif
             default:
                 break;
@@ -1473,18 +1777,17 @@ void apply_material(const MaterialPtr &the_mat, bool force_apply, const ShaderPt
 
     // update uniform buffers and uniform values for current shader
     the_mat->update_uniforms(shader);
-
-    *last_mat = *the_mat;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 void reset_state()
 {
+    // applying defaults through the context only issues what differs
     static auto mat = gl::Material::create();
-    gl::apply_material(mat, true);
+    gl::apply_material(mat);
 #if !defined(KINSKI_GLES_2)
-    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    gl::context()->set_enabled(GL_TEXTURE_CUBE_MAP_SEAMLESS, true);
 #endif
 }
 
@@ -1535,7 +1838,7 @@ bool is_point_inside_mesh(const glm::vec3 &p, gl::MeshPtr m)
     // checks only make sense with triangle geometry
     if(!m ||
        m->geometry()->primitive_type() != GL_TRIANGLES ||
-       m->geometry()->faces().empty())
+       !m->geometry()->has_vertices())
     {
         return false;
     }
@@ -1545,17 +1848,10 @@ bool is_point_inside_mesh(const glm::vec3 &p, gl::MeshPtr m)
     // checks if p is inside the aabb of our mesh)
     if(!aabb.intersect(p)) return false;
 
-    const auto &vertices = m->geometry()->vertices();
-
-    // check the point's distance to all triangle planes
-    for(const auto &face : m->geometry()->faces())
-    {
-        gl::Plane plane(vertices[face.a], vertices[face.b], vertices[face.c]);
-        plane.transform(m->transform());
-        if(plane.distance(p) < 0)
-            return false;
-    }
-    return true;
+    // cast a ray in object-space and count the crossed triangles, an odd number means inside
+    glm::vec3 p_object_space = (glm::inverse(m->global_transform()) * glm::vec4(p, 1.f)).xyz();
+    gl::Ray ray(p_object_space, glm::vec3(0.4315f, 0.7712f, 0.4679f));
+    return m->triangle_bvh()->num_intersections(ray) % 2;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -29,6 +29,8 @@
 
 #include "SerializerGL.hpp"
 
+namespace crocore{ class ThreadPool; }
+
 namespace kinski {
 namespace gl {
 
@@ -161,6 +163,8 @@ DEFINE_CLASS_PTR(Camera);
 
 DEFINE_CLASS_PTR(Bone);
 
+DEFINE_CLASS_PTR(Skeleton);
+
 DEFINE_CLASS_PTR(Scene);
 
 class Context
@@ -189,6 +193,66 @@ public:
 
     void clear_assets_for_context(void *the_context_id);
 
+    /*!
+     * shadowed GL render-state for the current context.
+     * changes are only issued if they differ from the tracked state,
+     * state modified by foreign code needs to be discarded via invalidate_state()
+     */
+    struct state_stats_t
+    {
+        //! state-changes issued to / skipped by the GL
+        uint32_t num_changes = 0;
+        uint32_t num_redundant = 0;
+
+        //! bytes uploaded into buffer-objects
+        size_t num_upload_bytes = 0;
+
+        //! issued glDraw*-calls
+        uint32_t num_draw_calls = 0;
+    };
+
+    void set_enabled(GLenum the_capability, bool b);
+
+    void set_cull_face(GLenum the_mode);
+
+    void set_polygon_mode(GLenum the_mode);
+
+    void set_depth_mask(bool b);
+
+    void set_blend_func(GLenum the_src, GLenum the_dst);
+
+    void set_blend_equation(GLenum the_equation);
+
+    void set_scissor(GLint the_x, GLint the_y, GLsizei the_width, GLsizei the_height);
+
+    void set_point_size(float the_size);
+
+    void set_line_width(float the_width);
+
+    void use_program(GLuint the_program);
+
+    void bind_texture(GLenum the_target, GLuint the_texture, GLuint the_unit = 0);
+
+    //! drop references to deleted GL-objects, ids might get recycled
+    void texture_deleted(GLuint the_texture);
+
+    void program_deleted(GLuint the_program);
+
+    //! forget the tracked state, the next changes will be issued unconditionally
+    void invalidate_state();
+
+    //! finish counting state-changes and uploads for the current frame
+    void end_frame();
+
+    //! account for the_num_bytes uploaded into a buffer-object
+    void add_upload_bytes(size_t the_num_bytes);
+
+    //! account for an issued draw-call
+    void add_draw_call();
+
+    //! state-changes and uploads during the last completed frame
+    const state_stats_t& state_stats() const;
+
     enum UniformBlockBinding
     {
         MATERIAL_BLOCK = 0,
@@ -307,10 +371,16 @@ void clear_color(const Color &theColor);
 void clear(const gl::Color &the_color);
 
 
-void draw_mesh(const MeshPtr &the_mesh, const ShaderPtr &overide_shader = ShaderPtr());
+//! draw the_mesh, using the entries of level-of-detail the_lod
+void draw_mesh(const MeshPtr &the_mesh, const ShaderPtr &overide_shader = ShaderPtr(), uint32_t the_lod = 0);
 
+/*!
+ * draw the_mesh once for each transform in the_transforms (relative to the current modelview-matrix).
+ * uses a single instanced draw-call if the shader supports per-instance transforms,
+ * one draw-call per transform otherwise.
+ */
 void draw_mesh_instanced(const MeshPtr &the_mesh, const std::vector<glm::mat4> &the_transforms,
-                         const ShaderPtr &overide_shader = ShaderPtr());
+                         const ShaderPtr &overide_shader = ShaderPtr(), uint32_t the_lod = 0);
 
 void draw_light(const LightPtr &theLight);
 
@@ -384,7 +454,20 @@ void apply_material(const MaterialPtr &the_mat, bool force_apply = false,
                     std::map<crocore::ImagePtr, gl::Texture> *the_img_tex_cache = nullptr);
 
 /*!
- * resets the OpenGL state to default values
+ * queued material-textures are decoded asynchronously using the_pool.
+ * nullptr (default) -> textures are decoded synchronously during apply_material()
+ */
+void set_texture_decode_pool(crocore::ThreadPool *the_pool);
+
+/*!
+ * limit the time (secs) spent on uploading queued material-textures per frame.
+ * at least one texture is uploaded per frame
+ */
+void set_texture_upload_budget(double the_secs);
+
+/*!
+ * resets the OpenGL state to default values.
+ * only differing state is issued, use gl::context()->invalidate_state() after foreign GL-calls
  */
 void reset_state();
 
@@ -491,9 +574,12 @@ private:
 };
 
 /*!
- * unfinished geometry check
- * return true if point p is contained within the mesh's geometry
- * TODO: only convex or concave?
+ * return true if point p is contained within the mesh's geometry.
+ * p is given in world-space and transformed by the inverse of the mesh's global transform.
+ * the test counts the triangles crossed by a ray (even-odd rule), so the mesh is expected
+ * to be closed (watertight) but may be concave.
+ * NOTE: previous versions tested p against all triangle-planes transformed by the mesh's
+ * local transform, which only worked for convex meshes without transformed ancestors.
  */
 bool is_point_inside_mesh(const vec3 &p, gl::MeshPtr m);
 
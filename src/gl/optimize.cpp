@@ -0,0 +1,410 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+#include <numeric>
+#include <set>
+#include <map>
+#include "optimize.hpp"
+
+namespace kinski { namespace gl {
+
+namespace
+{
+    // sub-clusters are split off while their miss-ratio stays within this factor of their cluster
+    const float overdraw_threshold = 1.05f;
+
+    const uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+
+    //! FIFO cache simulation, using insertion-timestamps per vertex
+    struct vertex_cache_t
+    {
+        vertex_cache_t(size_t the_num_vertices, uint32_t the_cache_size):
+        timestamps(the_num_vertices, 0), cache_size(the_cache_size), time(the_cache_size + 1){}
+
+        //! access vertex the_index, returns true on a cache-miss
+        inline bool access(uint32_t the_index)
+        {
+            if(time - timestamps[the_index] > cache_size){ timestamps[the_index] = time++; return true; }
+            return false;
+        }
+
+        //! evict all entries
+        inline void flush(){ time += cache_size + 1; }
+
+        std::vector<uint32_t> timestamps;
+        uint32_t cache_size, time;
+    };
+
+    /*!
+     * tipsify (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+     * writes the reordered triangles to the_out_indices and the start-triangles of all clusters,
+     * separated by non-local jumps (hard boundaries), to the_out_clusters
+     */
+    void tipsify(const index_t *the_indices, size_t the_num_indices, size_t the_num_vertices, uint32_t the_cache_size,
+                 std::vector<index_t> &the_out_indices, std::vector<uint32_t> &the_out_clusters)
+    {
+        const size_t num_triangles = the_num_indices / 3;
+
+        // triangles per vertex, the initial offsets double as live-triangle counts
+        std::vector<uint32_t> offsets(the_num_vertices + 1, 0), adjacency(the_num_indices), live(the_num_vertices, 0);
+        for(size_t i = 0; i < the_num_indices; ++i){ live[the_indices[i]]++; }
+        std::partial_sum(live.begin(), live.end(), offsets.begin() + 1);
+        {
+            std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+            for(size_t i = 0; i < the_num_indices; ++i){ adjacency[cursor[the_indices[i]]++] = i / 3; }
+        }
+
+        std::vector<uint32_t> timestamps(the_num_vertices, 0), dead_ends, candidates;
+        std::vector<uint8_t> emitted(num_triangles, 0);
+        uint32_t time = the_cache_size + 1, cursor = 0;
+        dead_ends.reserve(the_num_indices);
+        the_out_indices.clear();
+        the_out_indices.reserve(the_num_indices);
+        the_out_clusters.clear();
+
+        // recently used vertices with live triangles first, then the next vertex in input-order
+        auto skip_dead_end = [&]() -> int64_t
+        {
+            while(!dead_ends.empty())
+            {
+                uint32_t d = dead_ends.back();
+                dead_ends.pop_back();
+                if(live[d]){ return d; }
+            }
+            for(; cursor < the_num_vertices; ++cursor){ if(live[cursor]){ return cursor; } }
+            return -1;
+        };
+
+        int64_t fan = skip_dead_end();
+        if(fan >= 0){ the_out_clusters.push_back(0); }
+
+        while(fan >= 0)
+        {
+            candidates.clear();
+
+            // emit all remaining triangles around the fanning vertex
+            for(uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a)
+            {
+                uint32_t t = adjacency[a];
+                if(emitted[t]){ continue; }
+                emitted[t] = 1;
+
+                for(uint32_t k = 0; k < 3; ++k)
+                {
+                    index_t v = the_indices[3 * t + k];
+                    the_out_indices.push_back(v);
+                    dead_ends.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if(time - timestamps[v] > the_cache_size){ timestamps[v] = time++; }
+                }
+            }
+
+            // prefer the oldest candidate, that would still be cached after emitting its triangles
+            int64_t next = -1, best_priority = -1;
+
+            for(uint32_t v : candidates)
+            {
+                if(!live[v]){ continue; }
+                int64_t priority = 0;
+                if(time - timestamps[v] + 2 * live[v] <= the_cache_size){ priority = time - timestamps[v]; }
+                if(priority > best_priority){ best_priority = priority; next = v; }
+            }
+
+            if(next < 0)
+            {
+                next = skip_dead_end();
+                if(next >= 0){ the_out_clusters.push_back(the_out_indices.size() / 3); }
+            }
+            fan = next;
+        }
+    }
+
+    /*!
+     * split the_clusters further at positions where the miss-ratio so far stays close to the cluster's,
+     * so that sub-clusters can be reordered without degrading cache-efficiency
+     */
+    std::vector<uint32_t> soft_boundaries(const std::vector<index_t> &the_indices, size_t the_num_vertices,
+                                          const std::vector<uint32_t> &the_clusters, uint32_t the_cache_size)
+    {
+        std::vector<uint32_t> ret;
+        vertex_cache_t cache(the_num_vertices, the_cache_size);
+        const uint32_t num_triangles = the_indices.size() / 3;
+
+        for(uint32_t c = 0; c < the_clusters.size(); ++c)
+        {
+            uint32_t begin = the_clusters[c], end = c + 1 < the_clusters.size() ? the_clusters[c + 1] : num_triangles;
+            if(begin == end){ continue; }
+
+            cache.flush();
+            uint32_t cluster_misses = 0;
+            for(uint32_t i = 3 * begin; i < 3 * end; ++i){ cluster_misses += cache.access(the_indices[i]); }
+            float cluster_acmr = cluster_misses / float(end - begin);
+
+            cache.flush();
+            uint32_t start = begin, misses = 0;
+            ret.push_back(begin);
+
+            for(uint32_t t = begin; t + 1 < end; ++t)
+            {
+                for(uint32_t k = 0; k < 3; ++k){ misses += cache.access(the_indices[3 * t + k]); }
+
+                if(misses / float(t + 1 - start) <= overdraw_threshold * cluster_acmr)
+                {
+                    ret.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    cache.flush();
+                }
+            }
+        }
+        return ret;
+    }
+
+    inline bool is_triangles(const gl::Geometry &the_geom, const Mesh::Entry &the_entry)
+    {
+        uint32_t primitive_type = the_entry.primitive_type ? the_entry.primitive_type : the_geom.primitive_type();
+        return primitive_type == GL_TRIANGLES;
+    }
+
+    template<typename T> void permute(std::vector<T> &the_array, const std::vector<uint32_t> &the_remap)
+    {
+        if(the_array.size() != the_remap.size()){ return; }
+        std::vector<T> tmp(the_array.size());
+        for(size_t i = 0; i < the_array.size(); ++i){ tmp[the_remap[i]] = the_array[i]; }
+        the_array.swap(tmp);
+    }
+
+    /*!
+     * optimize triangle-order for all entries in the_entry_lists, then reorder vertices by first use.
+     * entries might share index-ranges (levels-of-detail share vertex-ranges with their base-entries)
+     */
+    optimize_stats_t optimize_entries(gl::Geometry &the_geom, const std::vector<const std::vector<Mesh::Entry>*> &the_entry_lists,
+                                      uint32_t the_cache_size)
+    {
+        optimize_stats_t ret;
+        if(!the_geom.has_indices()){ return ret; }
+
+        const gl::Geometry &const_geom = the_geom;
+        const auto &vertices = const_geom.vertices();
+        std::vector<index_t> &indices = the_geom.indices();
+
+        // faces usually mirror the leading indices
+        auto &faces = the_geom.faces();
+        bool faces_mirror_indices = 3 * faces.size() <= indices.size() &&
+                                    (faces.empty() || !memcmp(faces.data(), indices.data(),
+                                                              3 * faces.size() * sizeof(index_t)));
+
+        // distinct index- and vertex-ranges
+        std::vector<const Mesh::Entry*> entries;
+        std::set<std::pair<uint32_t, uint32_t>> index_ranges;
+        std::map<uint32_t, uint32_t> vertex_ranges;
+        bool overlapping = false;
+
+        for(const auto *list : the_entry_lists)
+        {
+            for(const auto &e : *list)
+            {
+                if(!e.num_indices || e.base_index + e.num_indices > indices.size()){ continue; }
+                if(!index_ranges.insert(std::make_pair(e.base_index, e.num_indices)).second){ continue; }
+                entries.push_back(&e);
+
+                uint32_t num_vertices = e.num_vertices ? e.num_vertices : vertices.size() - e.base_vertex;
+                auto it = vertex_ranges.insert(std::make_pair(e.base_vertex, num_vertices)).first;
+                overlapping = overlapping || it->second != num_vertices;
+            }
+        }
+
+        // vertex-cache and overdraw, per entry
+        uint32_t num_triangles = 0;
+
+        for(const Mesh::Entry *e : entries)
+        {
+            if(!is_triangles(const_geom, *e)){ continue; }
+            index_t *entry_indices = indices.data() + e->base_index;
+            uint32_t num_vertices = vertex_ranges[e->base_vertex];
+
+            ret.acmr_before += compute_acmr(entry_indices, e->num_indices, the_cache_size) * e->num_indices / 3;
+            optimize_triangle_order(entry_indices, e->num_indices, vertices.data() + e->base_vertex, num_vertices,
+                                    the_cache_size);
+            ret.acmr_after += compute_acmr(entry_indices, e->num_indices, the_cache_size) * e->num_indices / 3;
+            num_triangles += e->num_indices / 3;
+        }
+        if(num_triangles)
+        {
+            ret.acmr_before /= num_triangles;
+            ret.acmr_after /= num_triangles;
+        }
+
+        // vertex-ranges need to be identical or disjoint
+        uint32_t range_end = 0;
+
+        for(const auto &r : vertex_ranges)
+        {
+            overlapping = overlapping || r.first < range_end || r.first + r.second > vertices.size();
+            range_end = r.first + r.second;
+        }
+        if(overlapping)
+        {
+            LOG_DEBUG << "overlapping vertex-ranges, skipping vertex-fetch optimization";
+            if(faces_mirror_indices && !faces.empty())
+            {
+                memcpy(reinterpret_cast<index_t*>(faces.data()), indices.data(),
+                       3 * faces.size() * sizeof(index_t));
+            }
+            return ret;
+        }
+
+        // vertex-fetch: order by first use within each range, unused vertices last
+        std::vector<uint32_t> remap(vertices.size(), unassigned);
+        std::map<uint32_t, uint32_t> range_cursors;
+        for(const auto &r : vertex_ranges){ range_cursors[r.first] = r.first; }
+
+        for(const Mesh::Entry *e : entries)
+        {
+            uint32_t &cursor = range_cursors[e->base_vertex];
+
+            for(uint32_t i = e->base_index; i < e->base_index + e->num_indices; ++i)
+            {
+                uint32_t v = e->base_vertex + indices[i];
+                if(remap[v] == unassigned){ remap[v] = cursor++; }
+            }
+        }
+        for(const auto &r : vertex_ranges)
+        {
+            uint32_t &cursor = range_cursors[r.first];
+            for(uint32_t v = r.first; v < r.first + r.second; ++v){ if(remap[v] == unassigned){ remap[v] = cursor++; } }
+        }
+        for(uint32_t v = 0; v < remap.size(); ++v){ if(remap[v] == unassigned){ remap[v] = v; } }
+
+        for(const Mesh::Entry *e : entries)
+        {
+            for(uint32_t i = e->base_index; i < e->base_index + e->num_indices; ++i)
+            {
+                indices[i] = remap[e->base_vertex + indices[i]] - e->base_vertex;
+            }
+        }
+
+        if(faces_mirror_indices)
+        {
+            if(!faces.empty())
+            {
+                memcpy(reinterpret_cast<index_t*>(faces.data()), indices.data(), 3 * faces.size() * sizeof(index_t));
+            }
+        }
+        else
+        {
+            for(auto &f : faces){ for(auto &i : f.indices){ i = remap[i]; }}
+        }
+
+        permute(the_geom.vertices(), remap);
+        permute(the_geom.normals(), remap);
+        permute(the_geom.tangents(), remap);
+        permute(the_geom.tex_coords(), remap);
+        permute(the_geom.colors(), remap);
+        permute(the_geom.point_sizes(), remap);
+        permute(the_geom.bone_vertex_data(), remap);
+        return ret;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+float compute_acmr(const index_t *the_indices, size_t the_num_indices, uint32_t the_cache_size)
+{
+    if(the_num_indices < 3){ return 0.f; }
+    vertex_cache_t cache(*std::max_element(the_indices, the_indices + the_num_indices) + 1, the_cache_size);
+    uint32_t misses = 0;
+    for(size_t i = 0; i < the_num_indices; ++i){ misses += cache.access(the_indices[i]); }
+    return misses / float(the_num_indices / 3);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void optimize_triangle_order(index_t *the_indices, size_t the_num_indices, const vec3 *the_vertices,
+                             size_t the_num_vertices, uint32_t the_cache_size)
+{
+    if(the_num_indices < 6 || the_num_indices % 3){ return; }
+    std::vector<index_t> indices;
+    std::vector<uint32_t> hard_clusters;
+    tipsify(the_indices, the_num_indices, the_num_vertices, the_cache_size, indices, hard_clusters);
+
+    // overdraw: order clusters by their tendency to occlude others
+    auto clusters = soft_boundaries(indices, the_num_vertices, hard_clusters, the_cache_size);
+    const uint32_t num_triangles = indices.size() / 3, num_clusters = clusters.size();
+    std::vector<vec3> centroids(num_clusters, vec3(0)), normals(num_clusters, vec3(0));
+    vec3 mesh_centroid(0);
+    float mesh_area = 0.f;
+
+    for(uint32_t c = 0; c < num_clusters; ++c)
+    {
+        uint32_t end = c + 1 < num_clusters ? clusters[c + 1] : num_triangles;
+        float area = 0.f;
+
+        for(uint32_t t = clusters[c]; t < end; ++t)
+        {
+            const vec3 &p0 = the_vertices[indices[3 * t]], &p1 = the_vertices[indices[3 * t + 1]],
+                    &p2 = the_vertices[indices[3 * t + 2]];
+            vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            centroids[c] += (p0 + p1 + p2) * (a / 3.f);
+            normals[c] += n;
+            area += a;
+        }
+        mesh_centroid += centroids[c];
+        mesh_area += area;
+        centroids[c] = area > 0.f ? centroids[c] / area : the_vertices[indices[3 * clusters[c]]];
+    }
+    if(mesh_area > 0.f){ mesh_centroid /= mesh_area; }
+
+    std::vector<float> sort_keys(num_clusters);
+    std::vector<uint32_t> order(num_clusters);
+    std::iota(order.begin(), order.end(), 0);
+
+    for(uint32_t c = 0; c < num_clusters; ++c)
+    {
+        float len = glm::length(normals[c]);
+        sort_keys[c] = len > 0.f ? glm::dot(centroids[c] - mesh_centroid, normals[c] / len) : 0.f;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sort_keys](uint32_t lhs, uint32_t rhs)
+    {
+        return sort_keys[lhs] > sort_keys[rhs];
+    });
+
+    index_t *out = the_indices;
+
+    for(uint32_t c : order)
+    {
+        uint32_t end = c + 1 < num_clusters ? clusters[c + 1] : num_triangles;
+        out = std::copy(indices.begin() + 3 * clusters[c], indices.begin() + 3 * end, out);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+optimize_stats_t optimize_mesh(const gl::MeshPtr &the_mesh, uint32_t the_cache_size)
+{
+    if(!the_mesh || !the_mesh->geometry()){ return {}; }
+    std::vector<const std::vector<Mesh::Entry>*> entry_lists = {&the_mesh->entries()};
+    for(const auto &lod : the_mesh->lods()){ entry_lists.push_back(&lod.entries); }
+    return optimize_entries(*the_mesh->geometry(), entry_lists, the_cache_size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+optimize_stats_t optimize_geometry(const gl::GeometryPtr &the_geom, uint32_t the_cache_size)
+{
+    if(!the_geom){ return {}; }
+    std::vector<Mesh::Entry> entries(1);
+    entries[0].num_indices = the_geom->indices().size();
+    entries[0].num_vertices = the_geom->vertices().size();
+    return optimize_entries(*the_geom, {&entries}, the_cache_size);
+}
+
+}}//namespace
@@ -0,0 +1,48 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+//  optimize.hpp
+//
+//  Index- and vertex-reordering for vertex-cache efficiency, overdraw and fetch locality
+
+#pragma once
+
+#include "Mesh.hpp"
+
+namespace kinski { namespace gl {
+
+//! average cache miss-ratio (vertex-transforms per triangle) of the_indices for a FIFO cache of the_cache_size
+float compute_acmr(const index_t *the_indices, size_t the_num_indices, uint32_t the_cache_size = 16);
+
+/*!
+ * reorder the triangles in the_indices for post-transform vertex-cache efficiency (tipsify),
+ * then reorder clusters of triangles to reduce overdraw, outward facing clusters are drawn first.
+ * the_vertices holds the positions referenced by the_indices
+ */
+void optimize_triangle_order(index_t *the_indices, size_t the_num_indices, const vec3 *the_vertices,
+                             size_t the_num_vertices, uint32_t the_cache_size = 16);
+
+struct optimize_stats_t
+{
+    //! triangle-weighted average cache miss-ratio, before and after optimization
+    float acmr_before = 0.f;
+    float acmr_after = 0.f;
+};
+
+/*!
+ * optimize the triangle-order of all entries (including levels-of-detail) of the_mesh.
+ * afterwards vertices are reordered by first use within each entry's vertex-range, improving fetch locality.
+ * base_vertex and base_index of all entries remain valid
+ */
+optimize_stats_t optimize_mesh(const gl::MeshPtr &the_mesh, uint32_t the_cache_size = 16);
+
+//! optimize all triangles of the_geom as a single range, see optimize_mesh()
+optimize_stats_t optimize_geometry(const gl::GeometryPtr &the_geom, uint32_t the_cache_size = 16);
+
+}}//namespace
@@ -0,0 +1,77 @@
+// #version 410
+// #include brdf.glsl
+
+// regular textures
+uniform int u_numTextures;
+uniform sampler2D u_sampler_2D[5];
+
+#define ALBEDO 0
+#define NORMAL 1
+#define POSITION 2
+#define EMISSION 3
+#define AO_ROUGH_METAL 4
+
+// cluster-grid (offset, count), light-indices and light-parameters (float-bits, 5 texels per light)
+uniform usamplerBuffer u_sampler_buffer[3];
+
+#define CLUSTERS 0
+#define LIGHT_INDICES 1
+#define LIGHTS 2
+
+// number of clusters (x, y: screen-tiles, z: depth-slices)
+uniform vec3 u_grid_dims;
+
+// near- and far-plane of the camera
+uniform vec2 u_clip_planes;
+
+in VertexData
+{
+  vec4 color;
+  vec2 texCoord;
+} vertex_in;
+
+out vec4 fragData;
+
+Lightsource fetch_light(int index)
+{
+    vec4 v[5];
+    for(int i = 0; i < 5; ++i){ v[i] = uintBitsToFloat(texelFetch(u_sampler_buffer[LIGHTS], 5 * index + i)); }
+
+    Lightsource l;
+    l.position = v[0].xyz;
+    l.type = int(v[0].w);
+    l.diffuse = v[1];
+    l.ambient = v[2];
+    l.direction = v[3].xyz;
+    l.intensity = v[3].w;
+    l.radius = v[4].x;
+    l.spotCosCutoff = v[4].y;
+    l.spotExponent = v[4].z;
+    l.quadraticAttenuation = v[4].w;
+    return l;
+}
+
+void main()
+{
+    vec2 tex_coord = gl_FragCoord.xy / textureSize(u_sampler_2D[ALBEDO], 0);
+    vec4 color = texture(u_sampler_2D[ALBEDO], tex_coord);
+    vec3 normal = normalize(texture(u_sampler_2D[NORMAL], tex_coord).xyz);
+    vec3 position = texture(u_sampler_2D[POSITION], tex_coord).xyz;
+    vec3 ao_rough_metal = texture(u_sampler_2D[AO_ROUGH_METAL], tex_coord).rgb;
+
+    // exponential depth-slices
+    float depth = max(-position.z, u_clip_planes.x);
+    float slice = log(depth / u_clip_planes.x) / log(u_clip_planes.y / u_clip_planes.x) * u_grid_dims.z;
+    ivec3 dims = ivec3(u_grid_dims);
+    ivec3 coord = clamp(ivec3(tex_coord * u_grid_dims.xy, slice), ivec3(0), dims - 1);
+    int cluster_index = (coord.z * dims.y + coord.y) * dims.x + coord.x;
+    uvec2 cluster = texelFetch(u_sampler_buffer[CLUSTERS], cluster_index).xy;
+
+    fragData = vec4(0);
+
+    for(uint i = 0; i < cluster.y; ++i)
+    {
+        int light_index = int(texelFetch(u_sampler_buffer[LIGHT_INDICES], int(cluster.x + i)).x);
+        fragData += shade(fetch_light(light_index), normal, position, color, ao_rough_metal.g, ao_rough_metal.b, 1.0);
+    }
+}
@@ -16,7 +16,10 @@ layout(std140) uniform MatrixBlock
 
 layout(location = 0) in vec4 a_vertex;
 
+// per-instance transform, defaults to identity for non-instanced draws
+layout(location = 8) in mat4 a_instance_transform;
+
 void main()
 {
-    gl_Position = ubo.model_view_projection * a_vertex;
+    gl_Position = ubo.model_view_projection * a_instance_transform * a_vertex;
 }
@@ -135,6 +135,11 @@ layout(location = 1) in vec3 a_normal;
 layout(location = 2) in vec4 a_texCoord;
 layout(location = 3) in vec4 a_color;
 
+// per-instance transform, defaults to identity for non-instanced draws
+layout(location = 8) in mat4 a_instance_transform;
+// per-instance normal-matrix, the inverse-transpose of a_instance_transform's upper 3x3
+layout(location = 12) in mat3 a_instance_normal_matrix;
+
 out VertexData
 {
   vec4 color;
@@ -144,8 +149,12 @@ out VertexData
 void main()
 {
   vertex_out.texCoord = ubo.texture_matrix * a_texCoord;
-  vec3 normal = normalize(ubo.normal_matrix * a_normal);
-  vec3 eyeVec = (ubo.model_view * a_vertex).xyz;
+  vec4 vertex = a_instance_transform * a_vertex;
+
+  // inverse-transpose keeps normals perpendicular for non-uniformly scaled instances, computed once per instance
+  mat3 normal_matrix = ubo.normal_matrix * a_instance_normal_matrix;
+  vec3 normal = normalize(normal_matrix * a_normal);
+  vec3 eyeVec = (ubo.model_view * vertex).xyz;
   vec4 shade_color = vec4(0);
 
   int num_lights = min(MAX_NUM_LIGHTS, u_numLights);
@@ -156,5 +165,5 @@ void main()
                            vec4(u_material.metalness, u_material.roughness, 0, 1), 1.0);
   }
   vertex_out.color = a_color * shade_color;
-  gl_Position = ubo.model_view_projection * a_vertex;
+  gl_Position = ubo.model_view_projection * vertex;
 }
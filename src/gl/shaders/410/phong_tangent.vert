@@ -20,6 +20,11 @@ layout(location = 2) in vec4 a_texCoord;
 // layout(location = 3) in vec4 a_color;
 layout(location = 5) in vec3 a_tangent;
 
+// per-instance transform, defaults to identity for non-instanced draws
+layout(location = 8) in mat4 a_instance_transform;
+// per-instance normal-matrix, the inverse-transpose of a_instance_transform's upper 3x3
+layout(location = 12) in mat3 a_instance_normal_matrix;
+
 out VertexData
 {
   // vec4 color;
@@ -31,9 +36,13 @@ out VertexData
 
 void main()
 {
-  vertex_out.normal = normalize(ubo.normal_matrix * a_normal);
-  vertex_out.tangent = normalize(ubo.normal_matrix * a_tangent);
+  vec4 vertex = a_instance_transform * a_vertex;
+
+  // inverse-transpose keeps normals perpendicular for non-uniformly scaled instances, computed once per instance
+  mat3 normal_matrix = ubo.normal_matrix * a_instance_normal_matrix;
+  vertex_out.normal = normalize(normal_matrix * a_normal);
+  vertex_out.tangent = normalize(normal_matrix * a_tangent);
   vertex_out.texCoord = ubo.texture_matrix * a_texCoord;
-  vertex_out.eyeVec = (ubo.model_view * a_vertex).xyz;
-  gl_Position = ubo.model_view_projection * a_vertex;
+  vertex_out.eyeVec = (ubo.model_view * vertex).xyz;
+  gl_Position = ubo.model_view_projection * vertex;
 }
@@ -18,6 +18,9 @@ layout(location = 0) in vec4 a_vertex;
 layout(location = 2) in vec4 a_texCoord;
 layout(location = 3) in vec4 a_color;
 
+// per-instance transform, defaults to identity for non-instanced draws
+layout(location = 8) in mat4 a_instance_transform;
+
 out VertexData
 {
   vec4 color;
@@ -28,5 +31,5 @@ void main()
 {
   vertex_out.color = a_color;
   vertex_out.texCoord = (ubo.texture_matrix * a_texCoord).xy;
-  gl_Position = ubo.model_view_projection * a_vertex;
+  gl_Position = ubo.model_view_projection * a_instance_transform * a_vertex;
 }
@@ -0,0 +1,502 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+#include <unordered_map>
+#include <numeric>
+#include "simplify.hpp"
+
+namespace kinski { namespace gl {
+
+namespace
+{
+    enum vertex_kind : uint8_t
+    {
+        //! interior vertex, can collapse onto any neighbour
+        MANIFOLD = 0,
+
+        //! vertex on an open border, can only collapse along the border
+        BORDER = 1,
+
+        //! non-manifold or complex vertex, never collapses
+        LOCKED = 2
+    };
+
+    // border-edges are weighted stronger, to keep outlines intact
+    const float border_weight = 10.f;
+
+    // collapses must not rotate adjacent triangles more than ~75 degrees
+    const float min_normal_cos = .25f;
+
+    inline uint64_t pack(uint64_t a, uint64_t b){ return (a << 32) | b; }
+
+    //! symmetric 4x4 matrix describing a sum of squared plane-distances, plus the accumulated weight
+    struct quadric_t
+    {
+        float a00 = 0.f, a11 = 0.f, a22 = 0.f, a10 = 0.f, a20 = 0.f, a21 = 0.f;
+        float b0 = 0.f, b1 = 0.f, b2 = 0.f, c = 0.f, w = 0.f;
+
+        quadric_t& operator+=(const quadric_t &q)
+        {
+            a00 += q.a00; a11 += q.a11; a22 += q.a22; a10 += q.a10; a20 += q.a20; a21 += q.a21;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c; w += q.w;
+            return *this;
+        }
+    };
+
+    //! squared distance to the plane dot(n, p) + d = 0, weighted by the_weight
+    quadric_t plane_quadric(const vec3 &n, float d, float the_weight)
+    {
+        quadric_t q;
+        q.a00 = the_weight * n.x * n.x; q.a11 = the_weight * n.y * n.y; q.a22 = the_weight * n.z * n.z;
+        q.a10 = the_weight * n.y * n.x; q.a20 = the_weight * n.z * n.x; q.a21 = the_weight * n.z * n.y;
+        q.b0 = the_weight * n.x * d; q.b1 = the_weight * n.y * d; q.b2 = the_weight * n.z * d;
+        q.c = the_weight * d * d;
+        q.w = the_weight;
+        return q;
+    }
+
+    //! weighted mean of squared distances from p to all planes in q
+    inline float quadric_error(const quadric_t &q, const vec3 &p)
+    {
+        float ax = q.a00 * p.x + q.a10 * p.y + q.a20 * p.z;
+        float ay = q.a10 * p.x + q.a11 * p.y + q.a21 * p.z;
+        float az = q.a20 * p.x + q.a21 * p.y + q.a22 * p.z;
+        float r = p.x * ax + p.y * ay + p.z * az + 2.f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+        return std::abs(r) / std::max(q.w, 1e-12f);
+    }
+
+    struct position_hash
+    {
+        size_t operator()(const vec3 &v) const
+        {
+            uint32_t h[3];
+            memcpy(h, &v[0], sizeof(h));
+            return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+        }
+    };
+
+    struct collapse_t
+    {
+        uint32_t from, to;
+        float cost;
+    };
+
+    //! size of the axis-aligned bounds of the_vertices
+    inline vec3 extents(const vec3 *the_vertices, size_t the_num_vertices)
+    {
+        if(!the_num_vertices){ return vec3(0.f); }
+        vec3 min = the_vertices[0], max = the_vertices[0];
+
+        for(size_t i = 1; i < the_num_vertices; ++i)
+        {
+            min = glm::min(min, the_vertices[i]);
+            max = glm::max(max, the_vertices[i]);
+        }
+        return max - min;
+    }
+
+    inline float max_extent(const vec3 *the_vertices, size_t the_num_vertices)
+    {
+        vec3 e = extents(the_vertices, the_num_vertices);
+        return std::max(e.x, std::max(e.y, e.z));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::vector<index_t> simplify_indices(const vec3 *the_vertices, size_t the_num_vertices,
+                                      const index_t *the_indices, size_t the_num_indices,
+                                      size_t the_target_num_indices, float the_max_error, float *the_out_error)
+{
+    std::vector<index_t> indices(the_indices, the_indices + the_num_indices);
+    if(the_out_error){ *the_out_error = 0.f; }
+
+    if(!the_num_vertices || the_num_indices % 3 || the_target_num_indices >= the_num_indices){ return indices; }
+
+    // work in normalized coordinates, errors are relative to the extents
+    vec3 min = the_vertices[0];
+    for(size_t i = 1; i < the_num_vertices; ++i){ min = glm::min(min, the_vertices[i]); }
+    float extent = max_extent(the_vertices, the_num_vertices);
+    float scale = extent > 0.f ? 1.f / extent : 1.f;
+
+    // vertices sharing a position (wedges) are grouped, collapses operate on those groups
+    std::unordered_map<vec3, uint32_t, position_hash> group_map;
+    std::vector<uint32_t> groups(the_num_vertices);
+    std::vector<vec3> positions;
+
+    for(size_t i = 0; i < the_num_vertices; ++i)
+    {
+        // adding zero maps -0.f to 0.f
+        vec3 p = the_vertices[i] + vec3(0.f);
+        auto it = group_map.insert(std::make_pair(p, (uint32_t)positions.size()));
+        if(it.second){ positions.push_back((p - min) * scale); }
+        groups[i] = it.first->second;
+    }
+    const uint32_t num_groups = positions.size();
+    group_map.clear();
+
+    // wedges per group
+    std::vector<uint32_t> wedge_offsets(num_groups + 1, 0), wedges(the_num_vertices);
+    for(uint32_t g : groups){ wedge_offsets[g + 1]++; }
+    std::partial_sum(wedge_offsets.begin(), wedge_offsets.end(), wedge_offsets.begin());
+    {
+        std::vector<uint32_t> cursor(wedge_offsets.begin(), wedge_offsets.end() - 1);
+        for(uint32_t i = 0; i < the_num_vertices; ++i){ wedges[cursor[groups[i]]++] = i; }
+    }
+
+    auto triangle_normal = [](const vec3 &p0, const vec3 &p1, const vec3 &p2)
+    {
+        return glm::cross(p1 - p0, p2 - p0);
+    };
+
+    // accumulate face-quadrics, weighted by area
+    std::vector<quadric_t> quadrics(num_groups);
+
+    for(size_t i = 0; i < indices.size(); i += 3)
+    {
+        const vec3 &p0 = positions[groups[indices[i]]], &p1 = positions[groups[indices[i + 1]]],
+                &p2 = positions[groups[indices[i + 2]]];
+        vec3 n = triangle_normal(p0, p1, p2);
+        float len = glm::length(n);
+        if(len <= 0.f){ continue; }
+        n /= len;
+
+        quadric_t q = plane_quadric(n, -glm::dot(n, p0), .5f * len);
+        for(uint32_t k = 0; k < 3; ++k){ quadrics[groups[indices[i + k]]] += q; }
+    }
+
+    std::vector<uint8_t> kinds(num_groups), locked(num_groups), num_border_edges(num_groups);
+    std::vector<uint32_t> remap(the_num_vertices);
+    std::vector<uint32_t> adjacency_offsets(num_groups + 1), adjacency, cursor;
+    std::vector<collapse_t> collapses;
+    std::vector<std::pair<uint32_t, uint32_t>> wedge_remap;
+
+    // number of triangles containing the directed edge a -> b
+    auto edge_count = [&](uint32_t a, uint32_t b)
+    {
+        uint32_t ret = 0;
+
+        for(uint32_t i = adjacency_offsets[a]; i < adjacency_offsets[a + 1]; ++i)
+        {
+            const index_t *tri = &indices[3 * adjacency[i]];
+
+            for(uint32_t k = 0; k < 3; ++k)
+            {
+                if(groups[tri[k]] == a && groups[tri[(k + 1) % 3]] == b){ ret++; }
+            }
+        }
+        return ret;
+    };
+
+    // edges without an oppositely oriented twin are border-edges
+    auto is_border_edge = [&](uint32_t a, uint32_t b){ return (edge_count(a, b) + edge_count(b, a)) == 1; };
+
+    const float max_error_sq = the_max_error * the_max_error;
+    float error = 0.f;
+    bool first_pass = true;
+
+    while(indices.size() > the_target_num_indices)
+    {
+        const size_t num_triangles = indices.size() / 3;
+
+        // triangles per group
+        std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+        for(index_t i : indices){ adjacency_offsets[groups[i] + 1]++; }
+        std::partial_sum(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+        cursor.assign(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        adjacency.resize(indices.size());
+        for(size_t i = 0; i < indices.size(); ++i){ adjacency[cursor[groups[indices[i]]]++] = i / 3; }
+
+        // classify groups by their outgoing edges
+        std::fill(kinds.begin(), kinds.end(), MANIFOLD);
+        std::fill(num_border_edges.begin(), num_border_edges.end(), 0);
+
+        for(uint32_t a = 0; a < num_groups; ++a)
+        {
+            for(uint32_t i = adjacency_offsets[a]; i < adjacency_offsets[a + 1]; ++i)
+            {
+                const index_t *tri = &indices[3 * adjacency[i]];
+
+                for(uint32_t k = 0; k < 3; ++k)
+                {
+                    if(groups[tri[k]] != a){ continue; }
+                    uint32_t b = groups[tri[(k + 1) % 3]];
+
+                    if(edge_count(a, b) > 1){ kinds[a] = kinds[b] = LOCKED; }
+
+                    if(!edge_count(b, a))
+                    {
+                        num_border_edges[a] = std::min(num_border_edges[a] + 1, 3);
+                        num_border_edges[b] = std::min(num_border_edges[b] + 1, 3);
+                    }
+                }
+            }
+        }
+
+        for(uint32_t g = 0; g < num_groups; ++g)
+        {
+            if(kinds[g] != LOCKED && num_border_edges[g]){ kinds[g] = num_border_edges[g] == 2 ? BORDER : LOCKED; }
+        }
+
+        // borders of the original mesh are kept in place by additional planes, perpendicular to the faces
+        if(first_pass)
+        {
+            for(size_t i = 0; i < indices.size(); i += 3)
+            {
+                const vec3 &p0 = positions[groups[indices[i]]], &p1 = positions[groups[indices[i + 1]]],
+                        &p2 = positions[groups[indices[i + 2]]];
+                vec3 n = triangle_normal(p0, p1, p2);
+                if(glm::length(n) <= 0.f){ continue; }
+                n = glm::normalize(n);
+
+                for(uint32_t k = 0; k < 3; ++k)
+                {
+                    uint32_t a = groups[indices[i + k]], b = groups[indices[i + (k + 1) % 3]];
+                    if(edge_count(b, a)){ continue; }
+
+                    vec3 e = positions[b] - positions[a];
+                    vec3 edge_normal = glm::cross(e, n);
+                    if(glm::length(edge_normal) <= 0.f){ continue; }
+                    edge_normal = glm::normalize(edge_normal);
+
+                    quadric_t q = plane_quadric(edge_normal, -glm::dot(edge_normal, positions[a]),
+                                                glm::dot(e, e) * border_weight);
+                    quadrics[a] += q;
+                    quadrics[b] += q;
+                }
+            }
+            first_pass = false;
+        }
+
+        auto can_collapse = [&](uint32_t from, uint32_t to)
+        {
+            return kinds[from] == MANIFOLD || (kinds[from] == BORDER && is_border_edge(from, to));
+        };
+
+        auto collapse_cost = [&](uint32_t from, uint32_t to)
+        {
+            quadric_t q = quadrics[from];
+            q += quadrics[to];
+            return quadric_error(q, positions[to]);
+        };
+
+        // candidate collapses, cheapest direction per edge
+        collapses.clear();
+
+        for(size_t i = 0; i < indices.size(); i += 3)
+        {
+            for(uint32_t k = 0; k < 3; ++k)
+            {
+                uint32_t a = groups[indices[i + k]], b = groups[indices[i + (k + 1) % 3]];
+
+                // interior edges are visited in both directions
+                if(a == b || (a > b && edge_count(b, a))){ continue; }
+
+                bool ab = can_collapse(a, b), ba = can_collapse(b, a);
+                if(!ab && !ba){ continue; }
+
+                float cost_ab = ab ? collapse_cost(a, b) : std::numeric_limits<float>::max();
+                float cost_ba = ba ? collapse_cost(b, a) : std::numeric_limits<float>::max();
+                collapses.push_back(cost_ab <= cost_ba ? collapse_t{a, b, cost_ab} : collapse_t{b, a, cost_ba});
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const collapse_t &lhs, const collapse_t &rhs){ return lhs.cost < rhs.cost; });
+
+        // apply non-overlapping collapses, cheapest first
+        std::fill(locked.begin(), locked.end(), 0);
+        std::iota(remap.begin(), remap.end(), 0);
+        const size_t num_to_remove = num_triangles - the_target_num_indices / 3;
+        size_t num_removed = 0, num_collapses = 0;
+
+        for(const collapse_t &c : collapses)
+        {
+            if(num_removed >= num_to_remove || c.cost > max_error_sq){ break; }
+            if(locked[c.from] || locked[c.to]){ continue; }
+
+            const uint32_t *tris_begin = &adjacency[adjacency_offsets[c.from]];
+            const uint32_t *tris_end = &adjacency[0] + adjacency_offsets[c.from + 1];
+            uint32_t num_degenerate = 0;
+            wedge_remap.clear();
+
+            // the wedge of 'from' within the_tri
+            auto wedge = [&](const index_t *the_tri) -> uint32_t
+            {
+                for(uint32_t k = 0; k < 3; ++k){ if(groups[the_tri[k]] == c.from){ return the_tri[k]; } }
+                return 0;
+            };
+
+            // triangles sharing the edge are removed and determine the target for each wedge of 'from'
+            for(const uint32_t *t = tris_begin; t != tris_end; ++t)
+            {
+                const index_t *tri = &indices[3 * *t];
+
+                for(uint32_t k = 0; k < 3; ++k)
+                {
+                    if(groups[tri[k]] != c.to){ continue; }
+                    uint32_t v = wedge(tri);
+                    num_degenerate++;
+
+                    bool found = false;
+                    for(const auto &p : wedge_remap){ found = found || p.first == v; }
+                    if(!found){ wedge_remap.push_back(std::make_pair(v, tri[k])); }
+                }
+            }
+            bool valid = !wedge_remap.empty();
+
+            // remaining triangles need a target for their wedge, keeping seams intact,
+            // and must not flip or rotate heavily
+            for(const uint32_t *t = tris_begin; valid && t != tris_end; ++t)
+            {
+                const index_t *tri = &indices[3 * *t];
+                uint32_t v = wedge(tri);
+                vec3 p[3], q[3];
+                bool degenerate = false, has_target = false;
+
+                for(uint32_t k = 0; k < 3; ++k)
+                {
+                    degenerate = degenerate || groups[tri[k]] == c.to;
+                    p[k] = positions[groups[tri[k]]];
+                    q[k] = tri[k] == v ? positions[c.to] : p[k];
+                }
+                if(degenerate){ continue; }
+
+                for(const auto &w : wedge_remap){ has_target = has_target || w.first == v; }
+                vec3 n0 = triangle_normal(p[0], p[1], p[2]), n1 = triangle_normal(q[0], q[1], q[2]);
+                valid = has_target && glm::dot(n0, n1) > min_normal_cos * glm::length(n0) * glm::length(n1);
+            }
+            if(!valid){ continue; }
+
+            // lock the neighbourhood, following collapses in this pass are evaluated on the old triangles
+            for(const uint32_t *t = tris_begin; t != tris_end; ++t)
+            {
+                const index_t *tri = &indices[3 * *t];
+                for(uint32_t k = 0; k < 3; ++k){ locked[groups[tri[k]]] = 1; }
+            }
+            for(const auto &w : wedge_remap){ remap[w.first] = w.second; }
+            quadrics[c.to] += quadrics[c.from];
+            error = std::max(error, c.cost);
+            num_removed += num_degenerate;
+            num_collapses++;
+        }
+        if(!num_collapses){ break; }
+
+        // redirect indices and remove collapsed triangles
+        size_t num_indices = 0;
+
+        for(size_t i = 0; i < indices.size(); i += 3)
+        {
+            index_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if(groups[a] == groups[b] || groups[b] == groups[c] || groups[c] == groups[a]){ continue; }
+            indices[num_indices++] = a;
+            indices[num_indices++] = b;
+            indices[num_indices++] = c;
+        }
+        indices.resize(num_indices);
+    }
+    if(the_out_error){ *the_out_error = sqrtf(error); }
+    return indices;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::vector<index_t> simplify(const gl::GeometryConstPtr &the_geom, float the_ratio, float the_max_error,
+                              float *the_out_error)
+{
+    if(the_out_error){ *the_out_error = 0.f; }
+    if(!the_geom){ return {}; }
+    const auto &indices = the_geom->indices();
+
+    if(the_geom->primitive_type() != GL_TRIANGLES){ return indices; }
+    size_t target = 3 * size_t(std::max(the_ratio, 0.f) * indices.size() / 3);
+
+    return simplify_indices(the_geom->vertices().data(), the_geom->vertices().size(), indices.data(),
+                            indices.size(), target, the_max_error, the_out_error);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void create_lods(const gl::MeshPtr &the_mesh, const std::vector<float> &the_ratios, float the_max_error,
+                 float the_screen_error)
+{
+    if(!the_mesh){ return; }
+    the_mesh->lods().clear();
+
+    const gl::GeometryPtr &geom = the_mesh->geometry();
+
+    // read-only access, avoids flagging the geometry as dirty
+    const gl::Geometry &const_geom = *geom;
+    const auto &vertices = const_geom.vertices();
+    const auto &geom_indices = const_geom.indices();
+
+    float extent = max_extent(vertices.data(), vertices.size());
+    if(extent <= 0.f || geom_indices.empty()){ return; }
+
+    // diameter of the bounding-sphere, relative to the extents
+    float diameter = glm::length(extents(vertices.data(), vertices.size())) / extent;
+
+    const std::vector<Mesh::Entry> &base_entries = the_mesh->entries();
+    std::vector<Mesh::Entry> entries = base_entries;
+    float screen_size = std::numeric_limits<float>::max();
+
+    for(float ratio : the_ratios)
+    {
+        Mesh::lod_t lod;
+        lod.entries = entries;
+        size_t num_indices = 0, num_indices_prev = 0;
+        std::vector<index_t> lod_indices;
+
+        // each level is simplified from its predecessor
+        for(uint32_t i = 0; i < entries.size(); ++i)
+        {
+            const Mesh::Entry &e = entries[i];
+            uint32_t primitive_type = e.primitive_type ? e.primitive_type : geom->primitive_type();
+            num_indices_prev += e.num_indices;
+
+            if(primitive_type != GL_TRIANGLES || !e.num_indices)
+            {
+                num_indices += e.num_indices;
+                continue;
+            }
+            size_t num_vertices = e.num_vertices ? e.num_vertices : vertices.size() - e.base_vertex;
+            float entry_extent = max_extent(vertices.data() + e.base_vertex, num_vertices);
+            float entry_scale = entry_extent > 0.f ? entry_extent / extent : 1.f;
+            size_t target = 3 * size_t(ratio * base_entries[i].num_indices / 3);
+
+            float error = 0.f;
+            auto indices = simplify_indices(vertices.data() + e.base_vertex, num_vertices,
+                                            geom_indices.data() + e.base_index, e.num_indices, target,
+                                            the_max_error / entry_scale, &error);
+            lod.error = std::max(lod.error, error * entry_scale);
+
+            auto &lod_entry = lod.entries[i];
+            lod_entry.base_index = geom_indices.size() + lod_indices.size();
+            lod_entry.num_indices = indices.size();
+            lod_indices.insert(lod_indices.end(), indices.begin(), indices.end());
+            num_indices += indices.size();
+        }
+
+        // no further reduction possible within the_max_error
+        if(num_indices >= num_indices_prev){ break; }
+
+        geom->append_indices(lod_indices);
+
+        // the projected error, relative to the projected size, equals error / diameter
+        lod.screen_size = lod.error > 0.f ? the_screen_error * diameter / lod.error :
+                          std::numeric_limits<float>::max();
+        screen_size = lod.screen_size = std::min(lod.screen_size, screen_size);
+
+        entries = lod.entries;
+        LOG_TRACE << "lod " << the_mesh->lods().size() + 1 << ": " << num_indices / 3 << " triangles -- error: "
+                  << lod.error << " -- screen-size: " << lod.screen_size;
+        the_mesh->lods().push_back(std::move(lod));
+    }
+}
+
+}}//namespace
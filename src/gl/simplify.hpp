@@ -0,0 +1,47 @@
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+//
+// Copyright (C) 2012-2016, Fabian Schmidt <crocdialer@googlemail.com>
+//
+// It is distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+// __ ___ ____ _____ ______ _______ ________ _______ ______ _____ ____ ___ __
+
+//  simplify.hpp
+//
+//  Mesh simplification and level-of-detail generation
+
+#pragma once
+
+#include "Mesh.hpp"
+
+namespace kinski { namespace gl {
+
+/*!
+ * reduce the triangle-list the_indices to about the_target_num_indices, using edge-collapses
+ * ordered by a quadric error metric. vertices are never moved or created, collapses only redirect indices
+ * onto existing vertices, so all other attributes (normals, tex-coords, bone-weights, ...) stay valid.
+ * attribute-seams (distinct vertices sharing a position) and open borders are preserved.
+ * simplification stops early if the error, relative to the extents of the_vertices, would exceed the_max_error.
+ * the reached error is written to the_out_error, if provided
+ */
+std::vector<index_t> simplify_indices(const vec3 *the_vertices, size_t the_num_vertices,
+                                      const index_t *the_indices, size_t the_num_indices,
+                                      size_t the_target_num_indices, float the_max_error = 1.f,
+                                      float *the_out_error = nullptr);
+
+//! simplify all triangles of the_geom to about the_ratio of their number, see simplify_indices()
+std::vector<index_t> simplify(const gl::GeometryConstPtr &the_geom, float the_ratio, float the_max_error = 1.f,
+                              float *the_out_error = nullptr);
+
+/*!
+ * create a chain of levels-of-detail for the_mesh, one per entry in the_ratios (fraction of triangles).
+ * the indices of all levels are appended to the mesh's geometry and share its vertices.
+ * levels are selected by projected size, a level's screen_size is chosen so that its error
+ * projects to about the_screen_error (fraction of viewport-height).
+ * levels that could not be reduced any further are omitted
+ */
+void create_lods(const gl::MeshPtr &the_mesh, const std::vector<float> &the_ratios = {.5f, .25f, .125f},
+                 float the_max_error = .05f, float the_screen_error = 1.f / 720.f);
+
+}}//namespace
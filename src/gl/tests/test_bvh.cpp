@@ -0,0 +1,128 @@
+//  See http://www.boost.org/libs/test for the library home page.
+
+// Boost.Test
+
+// each test module could contain no more then one 'main' file with init function defined
+// alternatively you could define init function yourself
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+#include "gl/Geometry.hpp"
+
+using namespace kinski;
+//____________________________________________________________________________//
+
+namespace
+{
+    // brute-force reference, testing every single triangle
+    gl::ray_triangle_intersection intersect_linear(const gl::GeometryConstPtr &the_geom, const gl::Ray &the_ray)
+    {
+        gl::ray_triangle_intersection ret(gl::REJECT);
+        const auto &vertices = the_geom->vertices();
+        const auto &indices = the_geom->indices();
+
+        for(uint32_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            gl::Triangle t(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]]);
+            auto hit = t.intersect(the_ray);
+            if(hit && hit.distance >= 0.f && (!ret || hit.distance < ret.distance)){ ret = hit; }
+        }
+        return ret;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_BVH )
+{
+    // a row of unit-boxes along the x-axis
+    std::vector<gl::AABB> boxes;
+    for(int i = 0; i < 100; ++i){ boxes.push_back(gl::AABB(glm::vec3(i, 0, 0), glm::vec3(i + 1, 1, 1))); }
+
+    gl::BVH bvh;
+    bvh.build(boxes, 1);
+    BOOST_CHECK(!bvh.empty());
+    BOOST_CHECK(bvh.num_primitives() == boxes.size());
+    BOOST_CHECK(bvh.nodes().size() == 2 * boxes.size() - 1);
+    BOOST_CHECK_CLOSE(bvh.nodes()[0].bounds.max.x, 100.f, 0.0001f);
+
+    // ray along the row, only the first box should be reported when shrinking the distance
+    gl::Ray ray(glm::vec3(-10, .5f, .5f), glm::vec3(1, 0, 0));
+    float max_distance = std::numeric_limits<float>::max();
+    std::vector<uint32_t> visited;
+
+    bvh.traverse(ray, max_distance, [&](uint32_t i)
+    {
+        visited.push_back(i);
+        max_distance = std::min(max_distance, boxes[i].min.x - ray.origin.x);
+    });
+    BOOST_CHECK(!visited.empty());
+    BOOST_CHECK(visited.front() == 0);
+    BOOST_CHECK_CLOSE(max_distance, 10.f, 0.0001f);
+
+    // missing ray
+    max_distance = std::numeric_limits<float>::max();
+    visited.clear();
+    bvh.traverse(gl::Ray(glm::vec3(-10, 5, .5f), glm::vec3(1, 0, 0)), max_distance,
+                 [&](uint32_t i){ visited.push_back(i); });
+    BOOST_CHECK(visited.empty());
+
+    // refit after moving all boxes up
+    for(auto &bb : boxes){ bb.transform(glm::translate(glm::mat4(1), glm::vec3(0, 10, 0))); }
+    bvh.refit(boxes);
+    BOOST_CHECK_CLOSE(bvh.nodes()[0].bounds.min.y, 10.f, 0.0001f);
+
+    max_distance = std::numeric_limits<float>::max();
+    visited.clear();
+    bvh.traverse(ray, max_distance, [&](uint32_t i){ visited.push_back(i); });
+    BOOST_CHECK(visited.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_TriangleBVH )
+{
+    gl::GeometryConstPtr geom = gl::Geometry::create_sphere(1.f, 64);
+    auto bvh = geom->triangle_bvh();
+    BOOST_CHECK(bvh);
+    BOOST_CHECK(bvh->num_triangles() == geom->indices().size() / 3);
+
+    // cached
+    BOOST_CHECK(bvh == geom->triangle_bvh());
+
+    // different range-sets are cached side by side and do not evict each other
+    gl::TriangleBVH::range_t half;
+    half.num_indices = (geom->indices().size() / 6) * 3;
+    half.num_vertices = geom->vertices().size();
+    auto half_bvh = geom->triangle_bvh({half});
+    BOOST_CHECK(half_bvh->num_triangles() == half.num_indices / 3);
+    BOOST_CHECK(bvh == geom->triangle_bvh());
+    BOOST_CHECK(half_bvh == geom->triangle_bvh({half}));
+
+    const size_t num_rays = 2000;
+    std::vector<gl::Ray> rays;
+
+    for(uint32_t i = 0; i < num_rays; ++i)
+    {
+        glm::vec3 origin = glm::sphericalRand(5.f);
+        rays.push_back(gl::Ray(origin, glm::normalize(glm::sphericalRand(.5f) - origin)));
+    }
+
+    // compare against brute-force
+    std::vector<gl::ray_triangle_intersection> results_linear, results_bvh;
+    for(const auto &r : rays){ results_linear.push_back(intersect_linear(geom, r)); }
+    for(const auto &r : rays){ results_bvh.push_back(bvh->intersect(r)); }
+
+    for(uint32_t i = 0; i < num_rays; ++i)
+    {
+        BOOST_CHECK(results_linear[i].type == results_bvh[i].type);
+        if(results_linear[i]){ BOOST_CHECK_CLOSE(results_linear[i].distance, results_bvh[i].distance, 0.001f); }
+    }
+
+    // inside/outside checks via crossing-count
+    gl::Ray inside_ray(glm::vec3(0), glm::normalize(glm::vec3(.4315f, .7712f, .4679f)));
+    BOOST_CHECK(bvh->num_intersections(inside_ray) % 2 == 1);
+
+    gl::Ray outside_ray(glm::vec3(0, 0, 3), inside_ray.direction);
+    BOOST_CHECK(bvh->num_intersections(outside_ray) % 2 == 0);
+}
+
+//____________________________________________________________________________//
+
+// EOF
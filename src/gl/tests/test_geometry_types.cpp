@@ -8,7 +8,10 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/test/floating_point_comparison.hpp>
 #include "gl/geometry_types.hpp"
+#include "gl/Geometry.hpp"
 #include "gl/Camera.hpp"
+#include "gl/Mesh.hpp"
+#include "gl/SceneRenderer.hpp"
 
 using namespace kinski;
 //____________________________________________________________________________//
@@ -50,9 +53,9 @@ BOOST_AUTO_TEST_CASE( test_Plane )
 BOOST_AUTO_TEST_CASE( test_scale )
 {
     auto test_object = gl::Object3D::create();
-    test_object->transform() = glm::rotate(test_object->transform(), 47.f, glm::vec3(1, 1, 1));
-    test_object->transform() = glm::translate(test_object->transform(), glm::vec3(100, -1221, 1));
-    test_object->transform() = glm::scale(test_object->transform(), glm::vec3(2, 3, 4));
+    test_object->set_transform(glm::rotate(test_object->transform(), 47.f, glm::vec3(1, 1, 1)));
+    test_object->set_transform(glm::translate(test_object->transform(), glm::vec3(100, -1221, 1)));
+    test_object->set_transform(glm::scale(test_object->transform(), glm::vec3(2, 3, 4)));
 
     glm::vec3 scale = test_object->scale();
     BOOST_CHECK_CLOSE(scale.x, 2.f, 0.0001f);
@@ -66,6 +69,157 @@ BOOST_AUTO_TEST_CASE( test_scale )
     BOOST_CHECK_CLOSE(scale.z, 5.f, 0.0001f);
 }
 
+BOOST_AUTO_TEST_CASE( test_instance_records )
+{
+    // three meshes sharing geometry and material, plus an unrelated one
+    auto geom = gl::Geometry::create_box(glm::vec3(.5f));
+    auto mat = gl::Material::create();
+    auto bin = std::make_shared<gl::RenderBin>(gl::PerspectiveCamera::create());
+    glm::mat4 view = glm::lookAt(glm::vec3(3, 4, 10), glm::vec3(0), glm::vec3(0, 1, 0));
+
+    for(uint32_t i = 0; i < 3; ++i)
+    {
+        glm::mat4 world = glm::scale(glm::rotate(glm::translate(glm::mat4(1), glm::vec3(i, 2, -3.f * i)),
+                                                 0.7f * (i + 1), glm::vec3(0, 1, 1)), glm::vec3(1, 5, 0.25f));
+        bin->add_item(gl::Mesh::create(geom, mat), view * world);
+    }
+    bin->add_item(gl::Mesh::create(gl::Geometry::create_sphere(1.f, 16), gl::Material::create()), view);
+
+    gl::sort_render_bin(bin);
+    gl::batch_render_bin(bin);
+    BOOST_REQUIRE(bin->batches.size() == 2);
+
+    std::vector<gl::instance_record_t> records(5);
+    gl::create_instance_records(bin, records);
+    BOOST_REQUIRE(records.size() == 3);
+
+    // surface with normal (1, 1, 0) and tangent (1, -1, 0)
+    glm::vec3 normal = glm::normalize(glm::vec3(1, 1, 0)), tangent = glm::normalize(glm::vec3(1, -1, 0));
+    uint32_t r = 0;
+
+    // records follow the instanced batch, single draws get none
+    for(const auto &batch : bin->batches)
+    {
+        if(batch.size() < 2){ continue; }
+        BOOST_CHECK(batch.size() == 3);
+
+        for(uint32_t i : batch)
+        {
+            const auto &record = records[r++];
+            BOOST_CHECK(record.transform == bin->transforms[i]);
+
+            // normals stay perpendicular to tangents under non-uniform scale
+            glm::vec3 tangent_eye = glm::normalize(glm::mat3(record.transform) * tangent);
+            glm::vec3 normal_eye = glm::normalize(record.normal_matrix * normal);
+            BOOST_CHECK_SMALL(glm::dot(normal_eye, tangent_eye), 1.e-5f);
+
+            // whereas the plain upper 3x3 skews them
+            glm::vec3 normal_skewed = glm::normalize(glm::mat3(record.transform) * normal);
+            BOOST_CHECK(std::abs(glm::dot(normal_skewed, tangent_eye)) > 0.1f);
+        }
+    }
+    BOOST_CHECK(r == records.size());
+
+    // identity for non-instanced draws
+    auto identity = gl::create_instance_record(glm::mat4(1));
+    BOOST_CHECK(identity.normal_matrix == glm::mat3(1));
+}
+
+BOOST_AUTO_TEST_CASE( test_vertex_attrib_encoding )
+{
+    auto round_trip = [](gl::VertexLayout::Format the_format, const glm::vec4 &the_value, uint32_t the_num_components)
+    {
+        uint8_t buf[16] = {};
+        glm::vec4 ret(0);
+        gl::encode_vertex_attrib(the_format, &the_value[0], the_num_components, buf);
+        gl::decode_vertex_attrib(the_format, buf, the_num_components, &ret[0]);
+        return ret;
+    };
+
+    // half-floats: 11 significant bits
+    BOOST_CHECK(gl::vertex_attrib_size(gl::VertexLayout::HALF, 3) == 8);
+    BOOST_CHECK(gl::vertex_attrib_size(gl::VertexLayout::HALF, 2) == 4);
+    glm::vec4 pos(1.f, -0.333f, 1234.5f, 0.f);
+    glm::vec4 pos_half = round_trip(gl::VertexLayout::HALF, pos, 3);
+    for(uint32_t i = 0; i < 3; ++i){ BOOST_CHECK_SMALL(pos_half[i] - pos[i], std::abs(pos[i]) / 1024.f); }
+    BOOST_CHECK(round_trip(gl::VertexLayout::HALF, glm::vec4(0.5f, 2.f, -8.f, 0.f), 3).xyz() ==
+                glm::vec3(0.5f, 2.f, -8.f));
+
+    // signed normalized 10:10:10:2, e.g. unit-length normals
+    BOOST_CHECK(gl::vertex_attrib_size(gl::VertexLayout::SNORM_10_10_10_2, 3) == 4);
+    glm::vec4 normal(glm::normalize(glm::vec3(0.3f, -0.8f, 0.52f)), 0.f);
+    glm::vec4 normal_packed = round_trip(gl::VertexLayout::SNORM_10_10_10_2, normal, 3);
+    for(uint32_t i = 0; i < 3; ++i){ BOOST_CHECK_SMALL(normal_packed[i] - normal[i], 1.f / 511.f); }
+    BOOST_CHECK(round_trip(gl::VertexLayout::SNORM_10_10_10_2, glm::vec4(1, -1, 0, 0), 3).xyz() ==
+                glm::vec3(1, -1, 0));
+
+    // unsigned normalized 8bit colors, values are clamped to [0, 1]
+    BOOST_CHECK(gl::vertex_attrib_size(gl::VertexLayout::UNORM_8, 4) == 4);
+    glm::vec4 color(0.2f, 0.5f, 1.f, 0.75f);
+    glm::vec4 color_packed = round_trip(gl::VertexLayout::UNORM_8, color, 4);
+    for(uint32_t i = 0; i < 4; ++i){ BOOST_CHECK_SMALL(color_packed[i] - color[i], 1.f / 255.f); }
+    BOOST_CHECK(round_trip(gl::VertexLayout::UNORM_8, glm::vec4(-1.f, 2.f, 0.f, 1.f), 4) == glm::vec4(0, 1, 0, 1));
+
+    // floats are copied verbatim
+    BOOST_CHECK(round_trip(gl::VertexLayout::FLOAT, pos, 3).xyz() == pos.xyz());
+}
+
+BOOST_AUTO_TEST_CASE( test_pending_ranges )
+{
+    const uint32_t all_bits = gl::Geometry::VERTEX_BIT | gl::Geometry::NORMAL_BIT | gl::Geometry::TEXCOORD_BIT |
+                              gl::Geometry::TANGENT_BIT | gl::Geometry::POINTSIZE_BIT | gl::Geometry::COLOR_BIT |
+                              gl::Geometry::INDEX_BIT;
+    using range_t = std::pair<size_t, size_t>;
+
+    for(bool interleaved : {false, true})
+    {
+        auto geom = gl::Geometry::create_plane(1.f, 1.f, 4, 4);
+        const size_t num_vertices = geom->vertices().size();
+
+        gl::VertexLayout layout;
+        layout.interleaved = interleaved;
+        geom->set_vertex_layout(layout);
+
+        // flagged attributes are uploaded entirely
+        BOOST_CHECK(geom->pending_range(gl::Geometry::COLOR_BIT) == range_t(0, num_vertices));
+
+        // as if uploaded
+        geom->remove_flag(all_bits);
+        BOOST_CHECK(!geom->has_dirty_buffers());
+        BOOST_CHECK(geom->pending_range(gl::Geometry::VERTEX_BIT) == range_t(0, 0));
+
+        // ranges for the same attribute are merged, ranges beyond the vertex-count are clamped
+        geom->vertices(2, 3)[2].x += 1.f;
+        geom->vertices(7, 1)[7].x += 1.f;
+        geom->colors(10, 2)[10].a = 0.5f;
+        geom->tex_coords(num_vertices - 1, 10);
+        BOOST_CHECK(geom->has_dirty_buffers());
+
+        if(interleaved)
+        {
+            // a single vertex-buffer, covering all modified attributes
+            for(uint32_t bit : {gl::Geometry::VERTEX_BIT, gl::Geometry::NORMAL_BIT, gl::Geometry::COLOR_BIT})
+            {
+                BOOST_CHECK(geom->pending_range(bit) == range_t(2, num_vertices));
+            }
+        }
+        else
+        {
+            BOOST_CHECK(geom->pending_range(gl::Geometry::VERTEX_BIT) == range_t(2, 8));
+            BOOST_CHECK(geom->pending_range(gl::Geometry::COLOR_BIT) == range_t(10, 12));
+            BOOST_CHECK(geom->pending_range(gl::Geometry::TEXCOORD_BIT) == range_t(num_vertices - 1, num_vertices));
+            BOOST_CHECK(geom->pending_range(gl::Geometry::NORMAL_BIT) == range_t(0, 0));
+        }
+
+        // flagging an attribute supersedes its ranges
+        geom->set_flag(gl::Geometry::VERTEX_BIT);
+        BOOST_CHECK(geom->pending_range(gl::Geometry::VERTEX_BIT) == range_t(0, num_vertices));
+
+        // absent attributes have nothing to upload
+        BOOST_CHECK(geom->pending_range(gl::Geometry::POINTSIZE_BIT) == range_t(0, 0));
+    }
+}
+
 //____________________________________________________________________________//
 
 // EOF
@@ -0,0 +1,76 @@
+//  See http://www.boost.org/libs/test for the library home page.
+
+// Boost.Test
+
+// each test module could contain no more then one 'main' file with init function defined
+// alternatively you could define init function yourself
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+#include "gl/LightGrid.hpp"
+
+using namespace kinski;
+//____________________________________________________________________________//
+
+namespace
+{
+    const float z_near = .1f, z_far = 200.f;
+    const glm::mat4 projection = glm::perspective(glm::radians(45.f), 16.f / 9.f, z_near, z_far);
+
+    // random point-light volumes inside the view-frustum
+    std::vector<glm::vec4> create_lights(uint32_t the_num_lights)
+    {
+        std::vector<glm::vec4> ret;
+
+        for(uint32_t i = 0; i < the_num_lights; ++i)
+        {
+            float d = glm::linearRand(1.f, 100.f);
+            ret.push_back(glm::vec4(glm::linearRand(-d, d), glm::linearRand(-d, d) * .5f, -d,
+                                    glm::linearRand(1.f, 10.f)));
+        }
+        return ret;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_LightGrid )
+{
+    gl::LightGrid grid(glm::uvec3(16, 9, 24));
+    BOOST_CHECK(grid.num_clusters() == 16 * 9 * 24);
+
+    auto lights = create_lights(200);
+
+    // directional light
+    lights.push_back(glm::vec4(0, 0, 0, -1));
+    grid.update(projection, z_near, z_far, lights);
+
+    BOOST_CHECK(grid.clusters().size() == grid.num_clusters());
+    BOOST_CHECK(grid.slice(z_near) == 0);
+    BOOST_CHECK(grid.slice(z_far) == grid.dimensions().z - 1);
+
+    // every point lit by a light needs to find that light in its cluster
+    for(uint32_t i = 0; i < 5000; ++i)
+    {
+        glm::vec2 ndc = glm::linearRand(glm::vec2(-1), glm::vec2(1));
+        float depth = glm::linearRand(z_near, 120.f);
+
+        // point on the view-ray through ndc at depth
+        glm::vec4 p = glm::inverse(projection) * glm::vec4(ndc, 1.f, 1.f);
+        glm::vec3 dir = glm::vec3(p) / p.w;
+        glm::vec3 point = dir * (depth / -dir.z);
+
+        glm::uvec3 coord(glm::min<uint32_t>((ndc.x * .5f + .5f) * 16, 15),
+                         glm::min<uint32_t>((ndc.y * .5f + .5f) * 9, 8),
+                         grid.slice(depth));
+        const auto &cluster = grid.clusters()[grid.cluster_index(coord)];
+        auto begin = grid.light_indices().begin() + cluster.offset, end = begin + cluster.count;
+
+        for(uint32_t l = 0; l < lights.size(); ++l)
+        {
+            bool lit = lights[l].w < 0.f || glm::distance(point, glm::vec3(lights[l])) <= lights[l].w;
+            if(lit){ BOOST_CHECK(std::find(begin, end, l) != end); }
+        }
+    }
+}
+
+//____________________________________________________________________________//
+
+// EOF
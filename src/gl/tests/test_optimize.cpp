@@ -0,0 +1,111 @@
+//  See http://www.boost.org/libs/test for the library home page.
+
+// Boost.Test
+
+// each test module could contain no more then one 'main' file with init function defined
+// alternatively you could define init function yourself
+#define BOOST_TEST_MAIN
+#include <random>
+#include <boost/test/unit_test.hpp>
+#include "gl/optimize.hpp"
+
+using namespace kinski;
+//____________________________________________________________________________//
+
+namespace
+{
+    //! shuffle the triangles of the_geom
+    void shuffle_triangles(const gl::GeometryPtr &the_geom)
+    {
+        auto &indices = the_geom->indices();
+        std::vector<gl::Face3> faces(indices.size() / 3);
+        memcpy((void*)faces.data(), indices.data(), indices.size() * sizeof(gl::index_t));
+        std::shuffle(faces.begin(), faces.end(), std::mt19937(1));
+        memcpy(indices.data(), (void*)faces.data(), indices.size() * sizeof(gl::index_t));
+        the_geom->faces() = faces;
+    }
+
+    //! sorted triangles, as position-triples starting with their smallest corner
+    std::vector<std::vector<float>> triangle_set(const gl::Geometry &the_geom)
+    {
+        std::vector<std::vector<float>> ret;
+        const auto &indices = the_geom.indices();
+
+        for(size_t i = 0; i < indices.size(); i += 3)
+        {
+            std::vector<glm::vec3> corners = {the_geom.vertices()[indices[i]], the_geom.vertices()[indices[i + 1]],
+                                              the_geom.vertices()[indices[i + 2]]};
+            auto less = [](const glm::vec3 &lhs, const glm::vec3 &rhs)
+            {
+                return std::tie(lhs.x, lhs.y, lhs.z) < std::tie(rhs.x, rhs.y, rhs.z);
+            };
+            std::rotate(corners.begin(), std::min_element(corners.begin(), corners.end(), less), corners.end());
+            std::vector<float> t;
+            for(const auto &c : corners){ t.insert(t.end(), {c.x, c.y, c.z}); }
+            ret.push_back(t);
+        }
+        std::sort(ret.begin(), ret.end());
+        return ret;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_optimize_geometry )
+{
+    auto geom = gl::Geometry::create_sphere(1.f, 48);
+    shuffle_triangles(geom);
+    const gl::Geometry &g = *geom;
+    auto triangles = triangle_set(g);
+    auto num_vertices = g.vertices().size();
+
+    auto stats = gl::optimize_geometry(geom);
+    BOOST_CHECK(stats.acmr_before > 2.f);
+    BOOST_CHECK(stats.acmr_after < .8f * stats.acmr_before);
+    BOOST_CHECK_CLOSE(stats.acmr_after, gl::compute_acmr(g.indices().data(), g.indices().size()), 1e-3f);
+
+    // same triangles (incl. winding), only reordered
+    BOOST_CHECK(g.vertices().size() == num_vertices);
+    BOOST_CHECK(g.normals().size() == num_vertices);
+    BOOST_CHECK(triangle_set(g) == triangles);
+
+    // vertices are ordered by first use
+    uint32_t next_vertex = 0;
+
+    for(auto i : g.indices())
+    {
+        BOOST_CHECK(i <= next_vertex);
+        if(i == next_vertex){ next_vertex++; }
+    }
+
+    // faces follow the indices
+    BOOST_CHECK(!memcmp(g.faces().data(), g.indices().data(), g.indices().size() * sizeof(gl::index_t)));
+}
+
+BOOST_AUTO_TEST_CASE( test_half_edges )
+{
+    auto geom = gl::Geometry::create_box(glm::vec3(1.f));
+    auto half_edges = gl::compute_half_edges(geom);
+    BOOST_CHECK(half_edges.size() == 3 * geom->faces().size());
+
+    for(const auto &e : half_edges)
+    {
+        BOOST_CHECK(e.next->next->next == &e);
+
+        // box-vertices are split per side, so only edges within a side have twins
+        if(e.twin)
+        {
+            BOOST_CHECK(e.twin->twin == &e);
+            BOOST_CHECK(e.twin->index == e.next->next->index);
+        }
+    }
+
+    // a 4x4 grid has 16 boundary-edges
+    auto plane = gl::Geometry::create_plane(1.f, 1.f, 4, 4);
+    auto plane_edges = gl::compute_half_edges(plane);
+    uint32_t num_boundary = 0;
+    for(const auto &e : plane_edges){ num_boundary += e.twin ? 0 : 1; }
+    BOOST_CHECK(num_boundary == 16);
+}
+
+//____________________________________________________________________________//
+
+// EOF
@@ -0,0 +1,75 @@
+//  See http://www.boost.org/libs/test for the library home page.
+
+// Boost.Test
+
+// each test module could contain no more then one 'main' file with init function defined
+// alternatively you could define init function yourself
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+#include "gl/Profiler.hpp"
+
+using namespace kinski;
+//____________________________________________________________________________//
+
+BOOST_AUTO_TEST_CASE( test_profiler )
+{
+    // without a GL-context only cpu-scopes are recorded
+    gl::Profiler profiler(8);
+    const uint32_t num_frames = 12;
+
+    for(uint32_t i = 0; i < num_frames; ++i)
+    {
+        profiler.begin_frame();
+        profiler.begin_scope("update");
+        profiler.end_scope();
+        profiler.begin_scope("draw");
+        profiler.begin_scope("cull");
+        profiler.end_scope();
+        profiler.begin_scope("\"quoted\"");
+        profiler.end_frame();
+    }
+
+    // frames enter the history after their gpu-queries were read back, a few frames later
+    const auto &history = profiler.history();
+    BOOST_CHECK(history.size() > 0);
+    BOOST_CHECK(history.size() <= 8);
+    BOOST_CHECK(history[history.size() - 1].index < num_frames - 1);
+
+    for(const auto &frame : history)
+    {
+        // unbalanced scopes are closed by end_frame()
+        BOOST_CHECK(frame.scopes.size() == 4);
+        BOOST_CHECK(frame.scopes[0].depth == 0);
+        BOOST_CHECK(frame.scopes[1].depth == 0);
+        BOOST_CHECK(frame.scopes[2].depth == 1);
+        BOOST_CHECK(frame.scopes[3].depth == 1);
+
+        const auto &draw = frame.scopes[1], &cull = frame.scopes[2];
+        BOOST_CHECK(cull.cpu_begin >= draw.cpu_begin);
+        BOOST_CHECK(cull.cpu_begin + cull.cpu_duration <= draw.cpu_begin + draw.cpu_duration);
+        BOOST_CHECK(draw.cpu_begin + draw.cpu_duration <= frame.duration);
+        BOOST_CHECK(cull.gpu_duration < 0.0);
+    }
+
+    // scopes outside of frames are ignored
+    profiler.begin_scope("orphan");
+    profiler.end_scope();
+
+    auto stats = profiler.stats_json(4);
+    BOOST_CHECK(stats.find("\"num_frames\":4") != std::string::npos);
+    BOOST_CHECK(stats.find("\"name\":\"cull\",\"depth\":1") != std::string::npos);
+    BOOST_CHECK(stats.find("\\\"quoted\\\"") != std::string::npos);
+    BOOST_CHECK(stats.find("orphan") == std::string::npos);
+    BOOST_CHECK(stats.find("gpu_ms") == std::string::npos);
+
+    auto trace = profiler.chrome_trace();
+    BOOST_CHECK(trace.find("\"traceEvents\":[") != std::string::npos);
+    BOOST_CHECK(trace.find("\"ph\":\"X\"") != std::string::npos);
+
+    profiler.clear();
+    BOOST_CHECK(profiler.history().empty());
+}
+
+//____________________________________________________________________________//
+
+// EOF
@@ -12,6 +12,20 @@
 using namespace kinski;
 //____________________________________________________________________________//
 
+namespace
+{
+    // uncached reference, walking up the hierarchy and concatenating from the root
+    glm::mat4 global_transform_linear(const gl::Object3DPtr &the_object)
+    {
+        std::vector<gl::Object3DConstPtr> ancestors;
+        for(gl::Object3DConstPtr p = the_object; p; p = p->parent()){ ancestors.push_back(p); }
+
+        glm::mat4 ret = ancestors.back()->transform();
+        for(auto it = ancestors.rbegin() + 1; it != ancestors.rend(); ++it){ ret = ret * (*it)->transform(); }
+        return ret;
+    }
+}
+
 BOOST_AUTO_TEST_CASE( test_Object3D )
 {
     gl::Object3DPtr a(gl::Object3D::create()), b(gl::Object3D::create()), c(gl::Object3D::create());
@@ -64,6 +78,167 @@ BOOST_AUTO_TEST_CASE( test_Object3D )
     BOOST_CHECK(b->global_scale() == glm::vec3(17.f));
 }
 
+BOOST_AUTO_TEST_CASE( test_Object3D_cached_transforms )
+{
+    gl::Object3DPtr a(gl::Object3D::create()), b(gl::Object3D::create()), c(gl::Object3D::create());
+
+    // a -> b -> c
+    a->add_child(b);
+    b->add_child(c);
+    c->set_position(glm::vec3(1, 0, 0));
+    BOOST_CHECK(c->global_position() == glm::vec3(1, 0, 0));
+
+    // changes to ancestors propagate
+    a->set_position(glm::vec3(0, 10, 0));
+    BOOST_CHECK(c->global_position() == glm::vec3(1, 10, 0));
+    b->set_position(glm::vec3(0, 0, 5));
+    BOOST_CHECK(c->global_position() == glm::vec3(1, 10, 5));
+    BOOST_CHECK(c->global_transform() == global_transform_linear(c));
+
+    // bounds include all enabled children
+    BOOST_CHECK(a->aabb().max == glm::vec3(1, 10, 5));
+    c->set_position(glm::vec3(2, 0, 0));
+    BOOST_CHECK(a->aabb().max == glm::vec3(2, 10, 5));
+    c->set_enabled(false);
+    BOOST_CHECK(a->aabb().max == glm::vec3(0, 10, 5));
+    c->set_position(glm::vec3(3, 0, 0));
+    BOOST_CHECK(a->aabb().max == glm::vec3(0, 10, 5));
+    c->set_enabled(true);
+    BOOST_CHECK(a->aabb().max == glm::vec3(3, 10, 5));
+
+    // re-parenting
+    c->set_parent(a);
+    BOOST_CHECK(c->global_position() == glm::vec3(3, 10, 0));
+    BOOST_CHECK(b->aabb().max == glm::vec3(0, 10, 5));
+    c->set_parent(gl::Object3DPtr());
+    BOOST_CHECK(c->global_position() == glm::vec3(3, 0, 0));
+    BOOST_CHECK(a->aabb().max == glm::vec3(0, 10, 5));
+
+    // orphaned by destruction of the parent
+    b->add_child(c);
+    BOOST_CHECK(c->global_position() == glm::vec3(3, 10, 5));
+    a.reset();
+    b.reset();
+    BOOST_CHECK(c->global_position() == glm::vec3(3, 0, 0));
+
+    // attaching fresh (uncached) nodes to parents with cached bounds
+    auto p = gl::Object3D::create(), q = gl::Object3D::create(), r = gl::Object3D::create();
+    auto d = gl::Object3D::create(), e = gl::Object3D::create();
+    p->add_child(q);
+    BOOST_CHECK(p->aabb().max.x == 0.f);
+    d->set_position(glm::vec3(10, 0, 0));
+    p->add_child(d);
+    BOOST_CHECK(p->aabb().max.x == 10.f);
+    e->set_position(glm::vec3(0, 7, 0));
+    e->set_parent(q);
+    BOOST_CHECK(p->aabb().max == glm::vec3(10, 7, 0));
+
+    // moving an entire subtree
+    BOOST_CHECK(r->aabb().max == glm::vec3(0));
+    q->set_parent(r);
+    BOOST_CHECK(r->aabb().max == glm::vec3(0, 7, 0));
+    BOOST_CHECK(p->aabb().max == glm::vec3(10, 0, 0));
+    p->remove_child(d);
+    BOOST_CHECK(p->aabb().max == glm::vec3(0));
+
+    // the root's version reflects changes anywhere within the hierarchy, since its bounds were queried
+    r->aabb();
+    uint32_t version = r->aabb_version();
+    BOOST_CHECK(r->aabb_version() == version);
+    e->set_position(glm::vec3(0, 8, 0));
+    BOOST_CHECK(r->aabb_version() != version);
+    BOOST_CHECK(r->aabb().max == glm::vec3(0, 8, 0));
+    version = r->aabb_version();
+    e->set_enabled(false);
+    BOOST_CHECK(r->aabb_version() != version);
+}
+
+BOOST_AUTO_TEST_CASE( test_Object3D_tags )
+{
+    auto a = gl::Object3D::create(), b = gl::Object3D::create();
+    a->add_child(b);
+    BOOST_CHECK(!a->tag_mask());
+
+    a->add_tag("foo", true);
+    a->add_tag("bar");
+    BOOST_CHECK(a->has_tag("foo") && a->has_tag("bar"));
+    BOOST_CHECK(b->has_tag("foo") && !b->has_tag("bar"));
+    BOOST_CHECK(!a->has_tag("unknown"));
+    BOOST_CHECK(a->tags() == std::set<std::string>({"foo", "bar"}));
+
+    // interned tags are stable
+    BOOST_CHECK(gl::tag_bit("foo") == gl::find_tag_bit("foo"));
+    BOOST_CHECK(gl::tag_bit("foo") != gl::tag_bit("bar"));
+    BOOST_CHECK(gl::tag_mask({"foo", "bar"}) == a->tag_mask());
+    BOOST_CHECK(gl::tag_names(b->tag_mask()) == std::set<std::string>({"foo"}));
+
+    a->remove_tag("foo", true);
+    BOOST_CHECK(a->tags() == std::set<std::string>({"bar"}));
+    BOOST_CHECK(b->tags().empty());
+
+    // filters don't intern their tags, unknown tags match nothing
+    BOOST_CHECK(a->matches(gl::tag_filter_t()));
+    BOOST_CHECK(a->matches(gl::tag_filter_t({"bar", "unknown"})));
+    BOOST_CHECK(!a->matches(gl::tag_filter_t({"unknown"})));
+    BOOST_CHECK(!gl::find_tag_bit("unknown"));
+
+    // exhaust all bits, further tags are stored by name
+    for(uint32_t i = 0; gl::tag_bit("tag_" + std::to_string(i)); ++i){}
+    BOOST_CHECK(!gl::tag_bit("overflow_1"));
+
+    b->add_tag("overflow_1");
+    b->add_tag("overflow_2");
+    BOOST_CHECK(b->tag_mask() == 0);
+    BOOST_CHECK(b->has_tag("overflow_1") && b->has_tag("overflow_2") && !a->has_tag("overflow_1"));
+    BOOST_CHECK(b->tags() == std::set<std::string>({"overflow_1", "overflow_2"}));
+    BOOST_CHECK(b->matches(gl::tag_filter_t({"overflow_2"})));
+    BOOST_CHECK(!a->matches(gl::tag_filter_t({"overflow_2"})));
+
+    // overflow-tags don't alias each other
+    b->remove_tag("overflow_1");
+    BOOST_CHECK(!b->has_tag("overflow_1") && b->has_tag("overflow_2"));
+    BOOST_CHECK(!b->matches(gl::tag_filter_t({"overflow_1"})));
+}
+
+BOOST_AUTO_TEST_CASE( test_Object3D_cached_transforms_tree )
+{
+    // binary tree with random local transforms
+    const uint32_t num_nodes = 10000;
+    std::vector<gl::Object3DPtr> nodes(num_nodes);
+
+    for(uint32_t i = 0; i < num_nodes; ++i)
+    {
+        nodes[i] = gl::Object3D::create();
+        nodes[i]->set_position(glm::linearRand(glm::vec3(-1), glm::vec3(1)));
+        nodes[i]->set_rotation(glm::linearRand(0.f, 1.f), glm::linearRand(0.f, 1.f), 0.f);
+        if(i){ nodes[(i - 1) / 2]->add_child(nodes[i]); }
+    }
+
+    // first pass fills the caches, second one reads them
+    for(uint32_t pass = 0; pass < 2; ++pass)
+    {
+        for(uint32_t i = 0; i < num_nodes; ++i)
+        {
+            BOOST_CHECK(nodes[i]->global_transform() == global_transform_linear(nodes[i]));
+        }
+    }
+
+    // bounds of the entire tree, followed by a cached query
+    gl::AABB bounds = nodes[0]->aabb();
+    BOOST_CHECK(nodes[0]->aabb() == bounds);
+
+    // moving a leaf only affects its ancestors' bounds
+    nodes.back()->set_global_transform(glm::translate(glm::mat4(1), glm::vec3(1000)));
+    BOOST_CHECK(nodes[0]->aabb().max == nodes.back()->global_position());
+
+    // moving the root invalidates everything
+    nodes[0]->set_position(glm::vec3(1, 2, 3));
+    for(uint32_t i = 0; i < num_nodes; i += 97)
+    {
+        BOOST_CHECK(nodes[i]->global_transform() == global_transform_linear(nodes[i]));
+    }
+}
+
 //____________________________________________________________________________//
 
 // EOF
@@ -0,0 +1,93 @@
+//  See http://www.boost.org/libs/test for the library home page.
+
+// Boost.Test
+
+// each test module could contain no more then one 'main' file with init function defined
+// alternatively you could define init function yourself
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+#include "gl/simplify.hpp"
+
+using namespace kinski;
+//____________________________________________________________________________//
+
+namespace
+{
+    //! bounds of all vertices referenced by the_indices
+    gl::AABB referenced_bounds(const std::vector<glm::vec3> &the_vertices, const std::vector<gl::index_t> &the_indices)
+    {
+        gl::AABB ret(the_vertices[the_indices[0]], the_vertices[the_indices[0]]);
+
+        for(auto i : the_indices)
+        {
+            ret.min = glm::min(ret.min, the_vertices[i]);
+            ret.max = glm::max(ret.max, the_vertices[i]);
+        }
+        return ret;
+    }
+
+    //! maximum distance of all referenced vertices from the origin
+    float max_radius(const std::vector<glm::vec3> &the_vertices, const std::vector<gl::index_t> &the_indices)
+    {
+        float ret = 0.f;
+        for(auto i : the_indices){ ret = std::max(ret, glm::length(the_vertices[i])); }
+        return ret;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_simplify_plane )
+{
+    // flat grid -> lossless reduction, borders stay in place
+    auto geom = gl::Geometry::create_plane(2.f, 1.f, 40, 20);
+    const gl::Geometry &g = *geom;
+
+    float error = 1.f;
+    auto indices = gl::simplify(geom, .1f, 1.f, &error);
+
+    BOOST_CHECK(indices.size() % 3 == 0);
+    BOOST_CHECK(!indices.empty());
+    BOOST_CHECK(indices.size() <= g.indices().size() / 10);
+    BOOST_CHECK_SMALL(error, 1e-3f);
+
+    gl::AABB bounds = referenced_bounds(g.vertices(), g.indices());
+    gl::AABB simplified_bounds = referenced_bounds(g.vertices(), indices);
+    BOOST_CHECK_SMALL(glm::length(bounds.min - simplified_bounds.min), 1e-5f);
+    BOOST_CHECK_SMALL(glm::length(bounds.max - simplified_bounds.max), 1e-5f);
+
+    // all indices refer to existing vertices
+    for(auto i : indices){ BOOST_CHECK(i < g.vertices().size()); }
+}
+
+BOOST_AUTO_TEST_CASE( test_simplify_sphere )
+{
+    auto geom = gl::Geometry::create_sphere(1.f, 64);
+    const gl::Geometry &g = *geom;
+    const size_t num_indices = g.indices().size();
+
+    float error_half = 0.f, error_quarter = 0.f;
+    auto half = gl::simplify(geom, .5f, 1.f, &error_half);
+    auto quarter = gl::simplify(geom, .25f, 1.f, &error_quarter);
+
+    BOOST_CHECK(half.size() <= num_indices / 2);
+    BOOST_CHECK(quarter.size() <= num_indices / 4);
+    BOOST_CHECK(error_half <= error_quarter);
+
+    // vertices are never moved, the silhouette shrinks by at most the error (relative to the diameter)
+    BOOST_CHECK_CLOSE(max_radius(g.vertices(), quarter), 1.f, 1e-3f);
+    BOOST_CHECK(error_quarter < .05f);
+
+    // the error-limit stops simplification early
+    float error_limited = 0.f;
+    auto limited = gl::simplify(geom, .01f, error_half, &error_limited);
+    BOOST_CHECK(limited.size() > num_indices / 100);
+    BOOST_CHECK(error_limited <= error_half);
+
+    // nothing to do
+    auto full = gl::simplify(geom, 1.f);
+    BOOST_CHECK(full == g.indices());
+}
+
+//____________________________________________________________________________//
+
+// EOF
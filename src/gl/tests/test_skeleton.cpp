@@ -0,0 +1,157 @@
+//  See http://www.boost.org/libs/test for the library home page.
+
+// Boost.Test
+
+// each test module could contain no more then one 'main' file with init function defined
+// alternatively you could define init function yourself
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+#include "gl/Skeleton.hpp"
+
+using namespace kinski;
+//____________________________________________________________________________//
+
+namespace
+{
+    template<typename T> uint32_t find_key_linear(const std::vector<gl::Key<T>> &the_keys, float the_time)
+    {
+        uint32_t i = 0;
+        for(; i < the_keys.size() - 1; i++){ if(the_keys[i + 1].time >= the_time){ break; }}
+        return i;
+    }
+
+    template<typename T> float fraction(const std::vector<gl::Key<T>> &the_keys, uint32_t i, float the_time,
+                                        float the_duration)
+    {
+        const auto &key1 = the_keys[i], &key2 = the_keys[(i + 1) % the_keys.size()];
+        float end_time = key2.time < key1.time ? key2.time + the_duration : key2.time;
+        return end_time > key1.time ? std::max((the_time - key1.time) / (end_time - key1.time), 0.f) : 0.f;
+    }
+
+    // reference, scanning all keys and recursing through the hierarchy
+    void build_bone_matrices_linear(const gl::BonePtr &the_bone, const gl::MeshAnimation &the_anim, float the_time,
+                                    std::vector<glm::mat4> &the_matrices, const glm::mat4 &the_parent = glm::mat4(1))
+    {
+        glm::mat4 bone_transform = the_bone->transform;
+        auto it = the_anim.bone_keys.find(the_bone);
+
+        if(it != the_anim.bone_keys.end())
+        {
+            const gl::AnimationKeys &keys = it->second;
+            glm::mat4 translation(1), rotation(1), scale(1);
+
+            if(!keys.positionkeys.empty())
+            {
+                uint32_t i = find_key_linear(keys.positionkeys, the_time);
+                float frac = fraction(keys.positionkeys, i, the_time, the_anim.duration);
+                translation = glm::translate(translation, glm::mix(keys.positionkeys[i].value,
+                              keys.positionkeys[(i + 1) % keys.positionkeys.size()].value, frac));
+            }
+            if(!keys.rotationkeys.empty())
+            {
+                uint32_t i = find_key_linear(keys.rotationkeys, the_time);
+                float frac = fraction(keys.rotationkeys, i, the_time, the_anim.duration);
+                rotation = glm::mat4_cast(glm::slerp(keys.rotationkeys[i].value,
+                                          keys.rotationkeys[(i + 1) % keys.rotationkeys.size()].value, frac));
+            }
+            if(!keys.scalekeys.empty())
+            {
+                uint32_t i = find_key_linear(keys.scalekeys, the_time);
+                float frac = fraction(keys.scalekeys, i, the_time, the_anim.duration);
+                scale = glm::scale(scale, glm::mix(keys.scalekeys[i].value,
+                                   keys.scalekeys[(i + 1) % keys.scalekeys.size()].value, frac));
+            }
+            bool has_keys = !keys.positionkeys.empty() || !keys.rotationkeys.empty() || keys.scalekeys.size() > 1;
+            if(has_keys){ bone_transform = translation * rotation * scale; }
+        }
+        glm::mat4 world = the_parent * bone_transform;
+        the_matrices[the_bone->index] = world * the_bone->offset;
+        for(const auto &c : the_bone->children){ build_bone_matrices_linear(c, the_anim, the_time, the_matrices, world); }
+    }
+
+    gl::BonePtr create_bones(uint32_t the_num_bones, std::vector<gl::BonePtr> &the_out_bones)
+    {
+        for(uint32_t i = 0; i < the_num_bones; ++i)
+        {
+            auto b = std::make_shared<gl::Bone>();
+            b->name = "bone_" + std::to_string(i);
+            b->index = the_num_bones - 1 - i;
+            b->transform = glm::translate(glm::mat4(1), glm::linearRand(glm::vec3(-1), glm::vec3(1)));
+            b->offset = glm::inverse(b->transform);
+
+            // random parent among existing bones
+            if(i)
+            {
+                b->parent = the_out_bones[glm::linearRand<uint32_t>(0, i - 1)];
+                b->parent->children.push_back(b);
+            }
+            the_out_bones.push_back(b);
+        }
+        return the_out_bones.front();
+    }
+
+    gl::MeshAnimation create_animation(const std::vector<gl::BonePtr> &the_bones, uint32_t the_num_keys)
+    {
+        gl::MeshAnimation anim;
+        anim.duration = 10.f;
+
+        // leave some bones without keys
+        for(uint32_t i = 0; i < the_bones.size(); i += (i % 5 == 4) ? 2 : 1)
+        {
+            gl::AnimationKeys keys;
+            float t = 0.f;
+
+            for(uint32_t k = 0; k < the_num_keys; ++k)
+            {
+                keys.positionkeys.push_back(gl::Key<glm::vec3>(t, glm::linearRand(glm::vec3(-1), glm::vec3(1))));
+                keys.rotationkeys.push_back(gl::Key<glm::quat>(t, glm::angleAxis(glm::linearRand(-3.f, 3.f),
+                                                                                 glm::sphericalRand(1.f))));
+                keys.scalekeys.push_back(gl::Key<glm::vec3>(t, glm::linearRand(glm::vec3(.5f), glm::vec3(2.f))));
+                t += anim.duration / the_num_keys;
+            }
+            anim.bone_keys[the_bones[i]] = keys;
+        }
+        return anim;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_Skeleton )
+{
+    std::vector<gl::BonePtr> bones;
+    auto root = create_bones(40, bones);
+    std::vector<gl::MeshAnimation> animations = {create_animation(bones, 30)};
+
+    auto skeleton = gl::Skeleton::create(root, animations);
+    BOOST_CHECK(skeleton->num_bones() == bones.size());
+    BOOST_CHECK(skeleton->num_matrices() == bones.size());
+
+    // parents precede their children
+    for(uint32_t i = 0; i < skeleton->num_bones(); ++i){ BOOST_CHECK(skeleton->parents()[i] < (int32_t)i); }
+
+    std::vector<uint32_t> cursors;
+    std::vector<glm::mat4> transforms, matrices, matrices_linear(bones.size());
+
+    // play forward and wrap around twice, then jump backwards
+    std::vector<float> times;
+    for(float t = 0.f; t < 20.f; t += .137f){ times.push_back(fmodf(t, animations[0].duration)); }
+    times.insert(times.end(), {7.f, 2.f, 9.9f, 0.f, 5.f});
+
+    for(float t : times)
+    {
+        skeleton->evaluate(0, t, cursors, transforms, matrices);
+        build_bone_matrices_linear(root, animations[0], t, matrices_linear);
+
+        for(uint32_t i = 0; i < bones.size(); ++i)
+        {
+            for(uint32_t c = 0; c < 4; ++c)
+            {
+                BOOST_CHECK_SMALL(glm::length(matrices[i][c] - matrices_linear[i][c]), 1e-3f);
+            }
+        }
+    }
+}
+
+//____________________________________________________________________________//
+
+// EOF
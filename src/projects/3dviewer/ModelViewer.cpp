@@ -36,6 +36,7 @@ void ModelViewer::setup()
     register_property(m_use_ground_plane);
     register_property(m_use_bones);
     register_property(m_display_bones);
+    register_property(m_create_lods);
     register_property(m_normalmap_path);
     register_property(m_skybox_path);
     register_property(m_ground_textures);
@@ -75,7 +76,7 @@ void ModelViewer::setup()
     ground_mesh->set_name(tag_ground_plane);
     ground_mesh->material()->set_shadow_properties(gl::Material::SHADOW_RECEIVE);
     ground_mesh->material()->set_roughness(0.4);
-    ground_mesh->transform() = glm::rotate(mat4(1), -glm::half_pi<float>(), gl::X_AXIS);
+    ground_mesh->set_transform(glm::rotate(mat4(1), -glm::half_pi<float>(), gl::X_AXIS));
     ground_mesh->add_tag(tag_ground_plane);
     scene()->add_object(ground_mesh);
     load_settings();
@@ -119,6 +120,7 @@ void ModelViewer::update(float timeDelta)
         auto obj = selected_objects().empty() ? nullptr : *selected_objects().begin();
         gui::draw_object3D_ui(obj, camera());
         gui::draw_scenegraph_ui(scene(), &m_selected_objects);
+        gui::draw_profiler_ui();
 
 //        // draw tasks
 //        auto tasks = Task::current_tasks();
@@ -197,13 +199,7 @@ void ModelViewer::draw()
             });
         }
         
-        for(uint32_t i = 0; i < m_warp_component->num_warps(); i++)
-        {
-            if(m_warp_component->enabled(i))
-            {
-                m_warp_component->render_output(i, textures()[TEXTURE_OUTPUT]);
-            }
-        }
+        m_warp_component->render_output(textures()[TEXTURE_OUTPUT]);
     }
     else
     {
@@ -484,9 +480,12 @@ void ModelViewer::update_property(const PropertyConstPtr &theProperty)
         if(*m_use_deferred_render && !m_deferred_renderer)
         {
             m_deferred_renderer = gl::DeferredRenderer::create();
+            m_deferred_renderer->set_thread_pool(&background_queue());
             m_dirty_g_buffer = true;
         }
-        scene()->set_renderer(*m_use_deferred_render ? m_deferred_renderer : gl::SceneRenderer::create());
+        auto renderer = *m_use_deferred_render ? m_deferred_renderer : gl::SceneRenderer::create();
+        renderer->set_thread_pool(&background_queue());
+        scene()->set_renderer(renderer);
     }
     else if(theProperty == m_normalmap_path)
     {
@@ -624,7 +623,7 @@ gl::MeshPtr ModelViewer::load_asset(const std::string &the_path)
             break;
 
         case fs::FileType::MODEL:
-            m = assimp::load_model(the_path);
+            m = assimp::load_model(the_path, true, nullptr, gl::VertexLayout::packed(), *m_create_lods);
             break;
 
         case fs::FileType::IMAGE:
@@ -633,7 +632,7 @@ gl::MeshPtr ModelViewer::load_asset(const std::string &the_path)
             auto geom = gl::Geometry::create_plane(1.f, 1.f, 100, 100);
             auto mat = gl::Material::create();
             m = gl::Mesh::create(geom, mat);
-            m->transform() = rotate(mat4(1), 90.f, gl::Y_AXIS);
+            m->set_transform(rotate(mat4(1), 90.f, gl::Y_AXIS));
             
             async_load_texture(the_path, [m](const gl::Texture &t)
             {
@@ -641,7 +640,7 @@ gl::MeshPtr ModelViewer::load_asset(const std::string &the_path)
                 m->material()->set_two_sided();
                 gl::vec3 s = m->scale();
                 m->set_scale(gl::vec3(s.x * t.aspect_ratio(), s.y, 1.f));
-                m->position().y += m->aabb().height() / 2.f;
+                m->set_position(m->position() + gl::vec3(0, m->aabb().height() / 2.f, 0));
             });
         }
             break;
@@ -657,7 +656,9 @@ gl::MeshPtr ModelViewer::load_asset(const std::string &the_path)
         m->set_scale(scale_factor);
         
         // set position
-        m->position().y = m->aabb().height() / 2.f - m->aabb().center().y;
+        gl::vec3 pos = m->position();
+        pos.y = m->aabb().height() / 2.f - m->aabb().center().y;
+        m->set_position(pos);
         
         // look for animations for this mesh
         auto animation_folder = fs::join_paths(asset_dir, "animations");
@@ -77,6 +77,9 @@ namespace kinski
         Property_<bool>::Ptr
         m_display_bones = Property_<bool>::create("display bones", false);
 
+        Property_<bool>::Ptr
+        m_create_lods = Property_<bool>::create("create levels-of-detail", true);
+
         Property_<gl::vec2>::Ptr
         m_blur_amount = Property_<gl::vec2>::create("blur amount", gl::vec2(1.f));
 
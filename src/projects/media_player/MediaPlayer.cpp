@@ -134,13 +134,7 @@ void MediaPlayer::draw()
 
     if(*m_use_warping)
     {
-        for(uint32_t i = 0; i < m_warp_component->num_warps(); i++)
-        {
-            if(m_warp_component->enabled(i))
-            {
-                m_warp_component->render_output(i, textures()[TEXTURE_INPUT], *m_brightness);
-            }
-        }
+        m_warp_component->render_output(textures()[TEXTURE_INPUT], *m_brightness);
     }
     else
     {